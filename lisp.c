@@ -10,6 +10,15 @@
 
 // Project headers
 #include "lisp.h"
+#include "lisp_jit.h"
+
+// Applications and native calls in progress, counted by apply(), apply_lambda(), jit_apply()
+// and every call into a native
+int lisp_depth = 0;
+
+// Special forms that are waiting on the value of one of their parts, and still need the rest of
+// their form once it arrives, counted by eval(), evcond() and eval_catch()
+int lisp_pending_forms = 0;
 
 /**
  * The core of the lisp evaluator, this function takes in an s-expression and evalautes it.
@@ -23,20 +32,23 @@ struct s_exp *eval(struct s_exp *exp, struct lisp_env *env) {
 	struct s_exp *car;
 	struct s_exp *cdr;
 	struct s_exp *caar;
-	struct s_exp *cadar;
-	struct s_exp *cur_arg;
-	struct s_exp *ret;
-	struct lisp_env *lambda_env;
+
+	LISP_STEP();
 
 	// Check if this is an atom or a pair
 	if (IS_ATOM(exp)) {
 		if (IS_SYMBOL(exp)) {
-			rtn = lookup_label(exp->lisp_car.label, env);
+			rtn = lookup_symbol(exp, env);
 			if (IS_UNDEFINED(rtn)) {
-				lisp_error("undefined symbol %s\n", exp->lisp_car.label);
+				lisp_source_site = exp;
+				lisp_throw(ERROR_UNDEFINED, exp, "undefined symbol %s", exp->lisp_car.label);
 			}
 			return rtn;
 		}
+		else if (IS_CONSTANT(exp)) {
+			// Quoted data pooled by the parser, which needs no dispatch on quote at all
+			return exp->lisp_car.car;
+		}
 		else {
 			// It is self-evaluating and should be returned as is.
 			return exp;
@@ -48,112 +60,214 @@ struct s_exp *eval(struct s_exp *exp, struct lisp_env *env) {
 	cdr = _cdr(exp);
 	
 	if (IS_ATOM(car)) {
-		// Handle a few specific special forms first, and then fall back to a symbol lookup
+		TRACE_HOOK(trace_form(car, exp));
+
+		// Handle the special forms first, and then fall back to a symbol lookup. Primitives like car
+		// and cons are ordinary function bindings, called directly by call_native()
 		if (c_lisp_eq(car, lisp_quote) == 1) {
 			return _car(cdr);
 		}
-		else if (c_lisp_eq(car, lisp_atom) == 1) {
-			return _atom(eval(_car(cdr), env));
-		}
-		else if (c_lisp_eq(car, lisp_eq) == 1) {
-			return _eq(eval(_car(cdr), env), eval(_car(_cdr(cdr)), env));
-		}
 		else if (c_lisp_eq(car, lisp_cond) == 1) {
 			return evcond(cdr, env);
 		}
-		else if (c_lisp_eq(car, lisp_car) == 1) {
-			return _car(eval(_car(cdr), env));
-		}
-		else if (c_lisp_eq(car, lisp_cdr) == 1) {
-			return _cdr(eval(_car(cdr), env));
+		else if (c_lisp_eq(car, lisp_define_memo) == 1) {
+			define_memo(cdr, env);
+			return lisp_undefined;
 		}
-		else if (c_lisp_eq(car, lisp_cons) == 1) {
-			return _cons(eval(_car(cdr), env), eval(_car(_cdr(cdr)), env));
+		else if (c_lisp_eq(car, lisp_defmacro) == 1) {
+			define_macro(cdr, env);
+			return lisp_undefined;
 		}
 		else if (c_lisp_eq(car, lisp_define) == 1) {
-			// Note: cannot use define with lambdas yet, because they only evaluate in place
-			define_label(_car(cdr)->lisp_car.label, eval(_car(_cdr(cdr)), env), env);
+			if (!IS_SYMBOL(_car(cdr))) {
+				lisp_source_site = cdr;
+				lisp_throw(ERROR_SYNTAX, _car(cdr), "expected a symbol as the name in define");
+			}
+			lisp_pending_forms += 1;
+			rtn = eval(_car(_cdr(cdr)), env);
+			lisp_pending_forms -= 1;
+			define_label(_car(cdr)->lisp_car.label, rtn, env);
 			return lisp_undefined;
 		}
+		else if (c_lisp_eq(car, lisp_set) == 1) {
+			lisp_pending_forms += 1;
+			rtn = eval_set(cdr, env);
+			lisp_pending_forms -= 1;
+			return rtn;
+		}
+		else if (c_lisp_eq(car, lisp_lambda) == 1 || c_lisp_eq(car, lisp_label) == 1 || c_lisp_eq(car, lisp_memo) == 1) {
+			// Function forms evaluate to themselves, so that they can be bound with define
+			return exp;
+		}
+		else if (c_lisp_eq(car, lisp_delay) == 1) {
+			return make_promise(_car(cdr), env);
+		}
+		else if (c_lisp_eq(car, lisp_stream_cons) == 1) {
+			// The head is evaluated now and the rest of the stream only when it is forced
+			lisp_pending_forms += 1;
+			rtn = eval(_car(cdr), env);
+			lisp_pending_forms -= 1;
+			return _cons(rtn, make_promise(_car(_cdr(cdr)), env));
+		}
+		else if (c_lisp_eq(car, lisp_catch) == 1) {
+			return eval_catch(cdr, env);
+		}
 		else {
-			// Simply get the corresponding value from the env and then eval with args unmodified
-			car = lookup_label(car->lisp_car.label, env);
-			return eval(_cons(car, cdr), env);
+			// Get the corresponding value from the env, through the call site's cache for globals,
+			// and apply it to the arguments directly. Any other atom is applied as it is, which
+			// fails unless it is already a function.
+			if (IS_SYMBOL(car))
+				car = lookup_symbol(car, env);
+
+			// Macro calls are replaced by their expansion the first time through
+			if (IS_MACRO(car)) {
+				return eval(macro_expand(car, exp, env), env);
+			}
+
+			return apply(car, cdr, env);
 		}
 	}
 	else {
 		caar = _car(car);
-		cadar = _car(_cdr(car));
 
-		if (c_lisp_eq(caar, lisp_lambda) == 1) {
-			// Evaluate the rest of this application to the lambda
-			cdr = eval_each(cdr, env);
+		if (c_lisp_eq(caar, lisp_lambda) == 1 || c_lisp_eq(caar, lisp_memo) == 1 || c_lisp_eq(caar, lisp_label) == 1) {
+			// A function form written in place is already a function value
+			return apply(car, cdr, env);
+		}
+		else {
+			// Anything else has to evaluate to a function before it can be applied
+			return apply(eval(car, env), cdr, env);
+		}
+	}
+}
+
+/**
+ * Applies a function value to a list of unevaluated arguments, counting the application as in
+ * progress until it returns, and tracing it as a span when tracing is on
+ */
+struct s_exp *apply(struct s_exp *function, struct s_exp *args, struct lisp_env *env) {
+	struct s_exp *ret;
 
-			// Create a new environment, and push each formal argument to it with a value from the cdr
-			lambda_env = (struct lisp_env *) calloc(1, sizeof(struct lisp_env));
-			lambda_env->parent = env;
+	if (++lisp_depth > lisp_depth_limit)
+		limit_exceeded(LIMIT_DEPTH);
+	TRACE_HOOK(trace_enter(function));
+	ret = apply_function(function, args, env);
+	TRACE_HOOK(trace_exit());
+	lisp_depth -= 1;
+	return ret;
+}
 
-			while (!IS_NIL(cadar)) {
-				cur_arg = _car(cadar);
+/**
+ * Does the work of apply(). The function may be a lambda, label, or memo form, or a native
+ * function. Any other symbol is assumed to be an alias for a special form, and is handed back
+ * to eval() to dispatch on.
+ */
+struct s_exp *apply_function(struct s_exp *function, struct s_exp *args, struct lisp_env *env) {
+	struct s_exp *head;
+	struct s_exp *ret;
+	struct lisp_env *label_env;
 
-				if (!IS_ATOM(cur_arg)) {
-					lisp_error("Expected only atoms as formal arguments to lambda\n");
-					cleanup_environment(lambda_env);
-					return lisp_undefined;
-				}
+	if (IS_ATOM(function)) {
+		if (IS_FUNCTION(function)) {
+			return call_native(function, args, env);
+		}
+		else if (IS_SYMBOL(function) && !IS_NIL(function)) {
+			return eval(_cons(function, args), env);
+		}
 
-				define_label(cur_arg->lisp_car.label, _car(cdr), lambda_env);
+		lisp_source_site = args;
+		lisp_throw(ERROR_TYPE, function, "expected a function to apply");
+	}
 
-				cadar = _cdr(cadar);
-				cdr = _cdr(cdr);
-			}
+	head = _car(function);
+
+	if (c_lisp_eq(head, lisp_lambda) == 1) {
+		// Evaluate the rest of this application to the lambda, then bind and run it, or hand it to
+		// the JIT, which runs compiled code once the lambda is hot
+		if (jit_enabled)
+			return jit_apply(function, args, env);
+		return apply_lambda(function, eval_each(args, env), env);
+	}
+	else if (c_lisp_eq(head, lisp_memo) == 1) {
+		// Memoized functions consult their result cache before doing any real work
+		return eval_memo(function, args, env);
+	}
+	else if (c_lisp_eq(head, lisp_label) == 1) {
+		// Create a new environment that will store the label for recursion
+		label_env = frame_acquire(env);
+		define_label(_car(_cdr(function))->lisp_car.label, function, label_env);
+
+		// Apply the labelled function once the label has been added
+		ret = apply(_car(_cdr(_cdr(function))), args, label_env);
+		frame_release(label_env);
+		return ret;
+	}
+
+	lisp_source_site = args;
+	lisp_throw(ERROR_TYPE, function, "expected a function to apply");
+}
+
+/**
+ * Applies a lambda form to a list of already evaluated arguments. A new environment is pushed
+ * on top of env, each formal argument is bound to the matching value, and then the body is
+ * evaluated inside of it.
+ */
+struct s_exp *apply_lambda(struct s_exp *lambda, struct s_exp *args, struct lisp_env *env) {
+	struct s_exp *formals;
+	struct s_exp *cur_arg;
+	struct s_exp *ret;
+	struct lisp_env *lambda_env;
+
+	// Create a new environment, and push each formal argument to it with a value from args
+	lambda_env = frame_acquire(env);
+	formals = _car(_cdr(lambda));
 
-			// Evaluate the body expression in the new environment
-			ret = eval(_car(_cdr(_cdr(car))), lambda_env);
-			free(lambda_env);
-			return ret;
+	while (!IS_NIL(formals)) {
+		cur_arg = _car(formals);
+
+		if (!IS_SYMBOL(cur_arg)) {
+			lisp_source_site = formals;
+			lisp_throw(ERROR_SYNTAX, cur_arg, "expected only symbols as formal arguments to lambda");
 		}
-		else if (c_lisp_eq(caar, lisp_label) == 1) {
-			// Create a new environment that will store the label for recursion
-			lambda_env = (struct lisp_env *) calloc(1, sizeof(struct lisp_env));
-			lambda_env->parent = env;
-			define_label(cadar->lisp_car.label, car, lambda_env);
 
-			// Evaluate the expression once the label has been added
-			ret = eval(_cons(_car(_cdr(_cdr(car))), cdr), lambda_env);
-			cleanup_environment(lambda_env);
-			return ret;
+		if (IS_ATOM(args)) {
+			lisp_source_site = formals;
+			lisp_throw(ERROR_ARITY, lambda, "too few arguments supplied to lambda");
 		}
-		else {
-			// It has to be a native function, so evaluate it and see what we get
-			car = eval(car, env);
 
-			// Check that we've actually produced a function
-			if (!IS_FUNCTION(car)) {
-				lisp_error("Expected a function, received something else, in eval()\n");
-				return lisp_undefined;
-			}
+		define_label(cur_arg->lisp_car.label, _car(args), lambda_env);
 
-			// Evaluate the arguments, and then pass it to the function call handler
-			cdr = eval_each(cdr, env);
-			return call_function(car, cdr);
-		}
+		formals = _cdr(formals);
+		args = _cdr(args);
 	}
+
+	// Evaluate the body expression in the new environment
+	lisp_depth += 1;
+	ret = eval(_car(_cdr(_cdr(lambda))), lambda_env);
+	lisp_depth -= 1;
+	frame_release(lambda_env);
+	return ret;
 }
 
 /**
- * Evaluates a conditional expression represented by c
+ * Evaluates a conditional expression represented by c. The rest of the clauses are still needed
+ * while a test is evaluated, but nothing is once the chosen expression is.
  */
 struct s_exp *evcond(struct s_exp *c, struct lisp_env *env) {
 	struct s_exp *car = _car(c);
 	struct s_exp *cdr = _cdr(c);
+	struct s_exp *test;
 
 	if (IS_ATOM(car)) {
-		lisp_error("atom passed to cond as conditional expression, expected pair\n");
-		return lisp_undefined;
+		lisp_source_site = c;
+		lisp_throw(ERROR_SYNTAX, car, "atom passed to cond as a clause, expected a pair");
 	}
 
-	if (c_lisp_eq(eval(_car(car), env), lisp_true) == 1) {
+	lisp_pending_forms += 1;
+	test = eval(_car(car), env);
+	lisp_pending_forms -= 1;
+
+	if (c_lisp_eq(test, lisp_true) == 1) {
 		return eval(_car(_cdr(car)), env);
 	}
 	else if (c_lisp_eq(cdr, lisp_nil) == 1) {
@@ -171,19 +285,185 @@ struct s_exp *evcond(struct s_exp *c, struct lisp_env *env) {
  * realizing it was needed for core stuff too
  */
 struct s_exp *eval_each(struct s_exp *exp, struct lisp_env *env) {
+	struct s_exp *first;
+
 	if (IS_NIL(exp))
 		return lisp_nil;
 	
 	if (IS_ATOM(exp))
 		return eval(exp, env);
 	
-	return _cons(eval(_car(exp), env), eval_each(_cdr(exp), env));
+	// Arguments are evaluated from left to right, which C doesn't promise for the two operands
+	first = eval(_car(exp), env);
+	return _cons(first, eval_each(_cdr(exp), env));
 }
 
 /**
  * Calls a function whose pointer is stored in the given s-expression, with the
- * given, pre-evaluated arguments
+ * given, pre-evaluated arguments in list form
  */
 struct s_exp *call_function(struct s_exp *function, struct s_exp *args) {
-	return function->lisp_car.fn(args);
+	struct s_exp *local[NATIVE_LOCAL_ARGS];
+	struct s_exp **argv;
+	struct s_exp *cur;
+	struct s_exp *ret;
+	int argc;
+
+	argc = 0;
+	for (cur = args; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		argc++;
+	}
+
+	argv = (argc <= NATIVE_LOCAL_ARGS) ? local : argv_acquire(argc);
+	for (argc = 0; !IS_ATOM(args); args = args->lisp_cdr.cdr) {
+		argv[argc++] = args->lisp_car.car;
+	}
+
+	ret = native_dispatch(function->lisp_car.native, argv, argc);
+	if (argv != local)
+		argv_release(argv);
+	return ret;
+}
+
+/**
+ * Applies a function value (a native, or a lambda, label or memo form) to an array of values
+ * that are already evaluated. Natives are called directly. For anything else, each value is
+ * wrapped in a constant cell, which evaluates to the value itself, so the usual application
+ * path can be reused without the values being evaluated a second time.
+ */
+struct s_exp *call_value(struct s_exp *function, struct s_exp **argv, int argc, struct lisp_env *env) {
+	struct s_exp *args;
+	struct s_exp *wrapper;
+	int i;
+
+	if (IS_FUNCTION(function))
+		return native_dispatch(function->lisp_car.native, argv, argc);
+
+	args = lisp_nil;
+	for (i = argc-1; i >= 0; --i) {
+		wrapper = find_free_s_exp();
+		wrapper->flags = FLAG_ATOM | FLAG_CONSTANT;
+		wrapper->lisp_car.car = argv[i];
+		wrapper->lisp_cdr.cdr = 0;
+		args = _cons(wrapper, args);
+	}
+
+	return apply(function, args, env);
+}
+
+/**
+ * Calls a native function on a list of unevaluated arguments. Natives with a fixed entry point
+ * matching the number of arguments are called with the evaluated arguments directly. Anything
+ * else has its arguments evaluated straight into an array on the C stack, so in neither case is
+ * an argument list consed for the call. Once the arguments are evaluated, they become the source
+ * site, which locates any error the native raises at the call.
+ */
+struct s_exp *call_native(struct s_exp *function, struct s_exp *args, struct lisp_env *env) {
+	struct lisp_native *native;
+	struct s_exp *local[NATIVE_LOCAL_ARGS];
+	struct s_exp **argv;
+	struct s_exp *cur;
+	struct s_exp *a0;
+	struct s_exp *a1;
+	struct s_exp *a2;
+	struct s_exp *ret;
+	int argc;
+
+	native = function->lisp_car.native;
+
+	// Arguments are evaluated into locals first, so that they are evaluated left to right
+	switch (native->arity) {
+		case 0:
+			if (native->fn0 != 0 && IS_ATOM(args)) {
+				lisp_source_site = args;
+				lisp_depth += 1;
+				ret = native->fn0();
+				lisp_depth -= 1;
+				return ret;
+			}
+			break;
+		case 1:
+			if (native->fn1 != 0 && !IS_ATOM(args) && IS_ATOM(args->lisp_cdr.cdr)) {
+				a0 = eval(args->lisp_car.car, env);
+				lisp_source_site = args;
+				lisp_depth += 1;
+				ret = native->fn1(a0);
+				lisp_depth -= 1;
+				return ret;
+			}
+			break;
+		case 2:
+			if (native->fn2 != 0 && !IS_ATOM(args)) {
+				cur = args->lisp_cdr.cdr;
+				if (!IS_ATOM(cur) && IS_ATOM(cur->lisp_cdr.cdr)) {
+					a0 = eval(args->lisp_car.car, env);
+					a1 = eval(cur->lisp_car.car, env);
+					lisp_source_site = args;
+					lisp_depth += 1;
+					ret = native->fn2(a0, a1);
+					lisp_depth -= 1;
+					return ret;
+				}
+			}
+			break;
+		case 3:
+			if (native->fn3 != 0 && !IS_ATOM(args) && !IS_ATOM(args->lisp_cdr.cdr)) {
+				cur = args->lisp_cdr.cdr->lisp_cdr.cdr;
+				if (!IS_ATOM(cur) && IS_ATOM(cur->lisp_cdr.cdr)) {
+					a0 = eval(args->lisp_car.car, env);
+					a1 = eval(args->lisp_cdr.cdr->lisp_car.car, env);
+					a2 = eval(cur->lisp_car.car, env);
+					lisp_source_site = args;
+					lisp_depth += 1;
+					ret = native->fn3(a0, a1, a2);
+					lisp_depth -= 1;
+					return ret;
+				}
+			}
+			break;
+	}
+
+	argc = 0;
+	for (cur = args; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		argc++;
+	}
+
+	argv = (argc <= NATIVE_LOCAL_ARGS) ? local : argv_acquire(argc);
+	for (argc = 0, cur = args; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		argv[argc++] = eval(cur->lisp_car.car, env);
+	}
+
+	lisp_source_site = args;
+	ret = native_dispatch(native, argv, argc);
+	if (argv != local)
+		argv_release(argv);
+	return ret;
+}
+
+/**
+ * Checks the argument count against the native function's declared arity and then calls it,
+ * through the array entry point if there is one and otherwise through the fixed one
+ */
+struct s_exp *native_dispatch(struct lisp_native *native, struct s_exp **argv, int argc) {
+	struct s_exp *ret;
+
+	if (native->arity != LISP_VARIADIC && native->arity != argc)
+		lisp_throw(ERROR_ARITY, lisp_nil, "%s expects %d arguments, but was given %d", native->name, native->arity, argc);
+
+	lisp_depth += 1;
+	if (native->fn != 0) {
+		ret = native->fn(argv, argc, native->data);
+	}
+	else {
+		switch (argc) {
+			case 0: ret = native->fn0(); break;
+			case 1: ret = native->fn1(argv[0]); break;
+			case 2: ret = native->fn2(argv[0], argv[1]); break;
+			case 3: ret = native->fn3(argv[0], argv[1], argv[2]); break;
+			default:
+				lisp_throw(ERROR_ARITY, lisp_nil, "%s has no entry point for %d arguments", native->name, argc);
+		}
+	}
+	lisp_depth -= 1;
+	return ret;
 }
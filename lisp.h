@@ -21,6 +21,24 @@
 #define FLAG_UNDEFINED		64
 #define FLAG_NIL			128
 #define FLAG_FUNCTION		256
+#define FLAG_ROPE			512
+#define FLAG_CONSTANT		1024
+#define FLAG_IMMUTABLE		2048
+#define FLAG_MACRO			4096
+#define FLAG_HASHCONS		32768
+#define FLAG_PROMISE		65536
+#define FLAG_ERROR			131072
+#define FLAG_BOX			262144
+#define FLAG_BIGNUM			1048576
+#define FLAG_RATIO			2097152
+#define FLAG_ARRAY			4194304
+
+// Used only while the garbage collector is running
+#define FLAG_GC_MARK		8192
+#define FLAG_FORWARDED		16384
+
+// Set on cells outside of the heap once the write barrier has remembered them
+#define FLAG_REMEMBERED		524288
 
 // Helper macros to check for types
 #define IS_ATOM(x) ((x->flags & FLAG_ATOM) == FLAG_ATOM)
@@ -32,6 +50,60 @@
 #define IS_UNDEFINED(x) ((x->flags & FLAG_UNDEFINED) == FLAG_UNDEFINED)
 #define IS_NIL(x) ((x->flags & FLAG_NIL) == FLAG_NIL)
 #define IS_FUNCTION(x) ((x->flags & FLAG_FUNCTION) == FLAG_FUNCTION)
+#define IS_ROPE(x) ((x->flags & FLAG_ROPE) == FLAG_ROPE)
+#define IS_CONSTANT(x) ((x->flags & FLAG_CONSTANT) == FLAG_CONSTANT)
+#define IS_IMMUTABLE(x) ((x->flags & FLAG_IMMUTABLE) == FLAG_IMMUTABLE)
+#define IS_MACRO(x) ((x->flags & FLAG_MACRO) == FLAG_MACRO)
+#define IS_HASHCONS(x) ((x->flags & FLAG_HASHCONS) == FLAG_HASHCONS)
+#define IS_PROMISE(x) ((x->flags & FLAG_PROMISE) == FLAG_PROMISE)
+#define IS_ERROR(x) ((x->flags & FLAG_ERROR) == FLAG_ERROR)
+#define IS_BOX(x) ((x->flags & FLAG_BOX) == FLAG_BOX)
+#define IS_BIGNUM(x) ((x->flags & FLAG_BIGNUM) == FLAG_BIGNUM)
+#define IS_RATIO(x) ((x->flags & FLAG_RATIO) == FLAG_RATIO)
+#define IS_ARRAY(x) ((x->flags & FLAG_ARRAY) == FLAG_ARRAY)
+
+// Native functions declare how many arguments they take, or that they take any number
+#define LISP_VARIADIC		-1
+
+// Native calls with up to this many arguments evaluate them into an array on the C stack
+#define NATIVE_LOCAL_ARGS	16
+
+// Local frames hold this many bindings inline, which covers the arguments of nearly every lambda
+#define FRAME_SLOTS			8
+
+struct s_exp;
+struct lisp_promise;
+struct lisp_condition;
+struct lisp_frame;
+struct lisp_argv;
+struct lisp_bignum;
+struct lisp_ratio;
+struct lisp_array;
+
+/**
+ * The signature for native functions. Arguments arrive already evaluated, as an array of argc
+ * expressions, along with the data pointer that was given when the function was registered.
+ */
+typedef struct s_exp *(*lisp_native_fn)(struct s_exp **argv, int argc, void *data);
+
+/**
+ * Description of a native function, pointed to by a FLAG_FUNCTION atom. A native with a fixed
+ * arity of three or less may provide the matching fixed entry point, which eval() calls with the
+ * evaluated arguments directly. Variadic natives, and any without a fixed entry point, are called
+ * through fn with an array of arguments. A pure native has no side effects and always returns
+ * the same result for the same arguments, so calls to it on constants can be folded.
+ */
+struct lisp_native {
+	char *name;
+	int arity;
+	int pure;
+	struct s_exp *(*fn0)(void);
+	struct s_exp *(*fn1)(struct s_exp *);
+	struct s_exp *(*fn2)(struct s_exp *, struct s_exp *);
+	struct s_exp *(*fn3)(struct s_exp *, struct s_exp *, struct s_exp *);
+	lisp_native_fn fn;
+	void *data;
+};
 
 /**
  * This structure defines the storage for any s-expression, which is effectively
@@ -50,11 +122,23 @@ struct s_exp {
 		int64_t siVal;
 		char *strVal;
 		char *label;
-		struct s_exp *(*fn)(struct s_exp *);
+		struct lisp_native *native;
+		struct lisp_rope *rope;
+		struct lisp_promise *promise;
+		struct lisp_condition *condition;
+		struct lisp_bignum *bignum;
+		struct lisp_ratio *ratio;
+		struct lisp_array *array;
 	} lisp_car;
 	union {
 		// If this is not an atom, cdr points to the rest of the list
 		struct s_exp *cdr;
+
+		// Symbols that have been looked up in a global environment cache the binding here
+		struct lisp_icache *icache;
+
+		// Strings (flat or rope) store their length in bytes here
+		uint64_t length;
 	} lisp_cdr;
 };
 
@@ -71,11 +155,73 @@ struct lisp_mapping {
 /**
  * Environments (each of which contain definitions for bound variables) are stored in
  * a linked list format that approximates a stack, where each environment points to the
- * more general environment below it (or, outside its scope, if you will).
+ * more general environment below it (or, outside its scope, if you will). Local frames taken
+ * from the frame pool point at the block they live in, and every other environment has a null
+ * frame.
  */
 struct lisp_env {
 	struct lisp_mapping *mapping;
 	struct lisp_env *parent;
+	uint64_t version;
+	struct lisp_frame *frame;
+};
+
+/**
+ * A pooled block holding a local frame along with room for its first FRAME_SLOTS bindings, so
+ * that binding arguments allocates nothing and releasing the frame is a push onto the free
+ * list. Bindings past the inline slots are allocated on their own, and overflow records that
+ * there are some to free. Frames in use are stacked through below, so that an evaluation that
+ * is abandoned part way through can release the frames it left behind.
+ */
+struct lisp_frame {
+	struct lisp_env env;
+	struct lisp_mapping slots[FRAME_SLOTS];
+	int used;
+	int overflow;
+	struct lisp_frame *next;
+	struct lisp_frame *below;
+};
+
+/**
+ * An array of more than NATIVE_LOCAL_ARGS evaluated arguments, which is too long for the C
+ * stack. Arrays in use are stacked through below, just like frames, so that an evaluation that
+ * is abandoned part way through can free the ones it left behind.
+ */
+struct lisp_argv {
+	struct lisp_argv *below;
+	struct s_exp *argv[];
+};
+
+/**
+ * An inline cache for a symbol's binding in a global environment (one with no parent). Each
+ * symbol cell read by the parser is a distinct call site, and it remembers which value the
+ * global lookup produced. The entry is only valid while the environment's version is unchanged,
+ * and define_label() bumps the version on every definition.
+ */
+struct lisp_icache {
+	struct lisp_env *env;
+	uint64_t version;
+	struct s_exp *value;
+};
+
+/**
+ * Quoted data found by the parser is kept in a pool of constants, so that every occurrence of an
+ * equal datum shares one constant cell. The constant cell is an atom whose car is the datum.
+ */
+struct lisp_constant {
+	uint64_t hash;
+	struct s_exp *cell;
+	struct lisp_constant *next;
+};
+
+/**
+ * Labels that outlive the code they were read from, such as those of symbols read as data, are
+ * interned, so that a label is stored once and never has to be freed
+ */
+struct lisp_label {
+	uint64_t hash;
+	char *label;
+	struct lisp_label *next;
 };
 
 ///////////////////////////////////
@@ -85,8 +231,18 @@ struct lisp_env {
 // Environment management/execution
 struct lisp_env *lisp_init(void);
 struct s_exp *lookup_label(char *label, struct lisp_env *env);
+struct s_exp *lookup_symbol(struct s_exp *symbol, struct lisp_env *env);
 void define_label(char *label, struct s_exp *val, struct lisp_env *env);
+int set_label(char *label, struct s_exp *val, struct lisp_env *env);
 void cleanup_environment(struct lisp_env *env);
+extern struct lisp_frame *frame_active;
+struct lisp_env *frame_acquire(struct lisp_env *parent);
+void frame_release(struct lisp_env *env);
+void frame_unwind(struct lisp_frame *mark);
+extern struct lisp_argv *argv_active;
+struct s_exp **argv_acquire(int argc);
+void argv_release(struct s_exp **argv);
+void argv_unwind(struct lisp_argv *mark);
 
 // S-Expression memory management
 // Raw memory management, directly allocates and deallocates memory, used during parsing and compilation
@@ -96,21 +252,37 @@ void free_sexp_list(struct s_exp *s);
 // Reference counting functions, these will track and tag expressions for garbage collection
 void addref(struct s_exp *s);
 void rmref(struct s_exp *s);
-// Manages the free store of elements, where unusued s-expressions are kept
-struct s_exp *alloc_s_exp_to_free(int count);
+// Allocates from the garbage collected heap, defined in lisp_gc.c
 struct s_exp *find_free_s_exp(void);
+struct s_exp *make_int(int64_t val);
+// Pooled constants for quoted data, used by the parser
+struct s_exp *intern_constant(struct s_exp *datum);
+void mark_immutable(struct s_exp *datum);
+void constant_pool_collect(void);
+// Interned labels
+char *intern_label(const char *label);
 
-// Error reporting
+// Reporting problems found outside of evaluation, which raises errors instead
 void lisp_error(char *fmt, ...);
 
 // External function interface
 struct s_exp *call_function(struct s_exp *function, struct s_exp *args);
+struct s_exp *call_value(struct s_exp *function, struct s_exp **argv, int argc, struct lisp_env *env);
+struct s_exp *call_native(struct s_exp *function, struct s_exp *args, struct lisp_env *env);
+struct s_exp *native_dispatch(struct lisp_native *native, struct s_exp **argv, int argc);
+struct s_exp *make_native(const char *name, int arity, lisp_native_fn fn, void *data);
 
 // Printing expressions to the screen
 void simple_print_exp(struct s_exp *exp);
 void pretty_print_exp(struct s_exp *exp);
 void pp_atomic(struct s_exp *exp);
 void pp_helper(struct s_exp *exp, int symbolCount, int tabLevel);
+void display_exp(struct s_exp *exp, int raw);
+
+// Lisp-space printing primitives
+struct s_exp *_display(struct s_exp **argv, int argc, void *data);
+struct s_exp *_write(struct s_exp **argv, int argc, void *data);
+struct s_exp *_newline(struct s_exp **argv, int argc, void *data);
 
 // Primitives for use inside the language
 #include "lisp_primitives.h"
@@ -118,11 +290,89 @@ void pp_helper(struct s_exp *exp, int symbolCount, int tabLevel);
 ///////////////////////////////////
 // The main evaluator functions, defined in lisp.c
 ///////////////////////////////////
-struct s_exp *apply(struct s_exp *function, struct s_exp *args);
+// How many applications and native calls are in progress, which tells the collector whether
+// anything besides its roots could be holding on to heap cells
+extern int lisp_depth;
+
+// How many special forms are waiting on one of their parts, holding on to the rest of the form,
+// which the collector has to wait out as well
+extern int lisp_pending_forms;
+struct s_exp *apply(struct s_exp *function, struct s_exp *args, struct lisp_env *env);
+struct s_exp *apply_function(struct s_exp *function, struct s_exp *args, struct lisp_env *env);
 struct s_exp *eval(struct s_exp *exp, struct lisp_env *env);
+struct s_exp *apply_lambda(struct s_exp *lambda, struct s_exp *args, struct lisp_env *env);
 struct s_exp *evcond(struct s_exp *c, struct lisp_env *env);
 struct s_exp *eval_each(struct s_exp *exp, struct lisp_env *env);
 
+///////////////////////////////////
+// Macros, defined in lisp_macro.c
+///////////////////////////////////
+void define_macro(struct s_exp *exp, struct lisp_env *env);
+struct s_exp *macro_expand(struct s_exp *macro, struct s_exp *exp, struct lisp_env *env);
+struct s_exp *unpool_constants(struct s_exp *form);
+struct s_exp *pool_constants(struct s_exp *code);
+
+///////////////////////////////////
+// Optimization pass run before evaluation, defined in lisp_optimize.c
+///////////////////////////////////
+struct s_exp *optimize(struct s_exp *exp, struct lisp_env *env);
+struct s_exp *optimize_exp(struct s_exp *exp, struct lisp_env *env, struct s_exp *bound);
+// Helper functions, used internally
+int opt_is_bound(struct s_exp *symbol, struct s_exp *bound);
+void opt_set_car(struct s_exp *cell, struct s_exp *value);
+void opt_set_cdr(struct s_exp *cell, struct s_exp *value);
+int opt_is_constant(struct s_exp *exp);
+struct s_exp *opt_quote(struct s_exp *value);
+struct s_exp *opt_lookup(struct s_exp *symbol, struct lisp_env *env);
+struct lisp_native *opt_pure_native(struct s_exp *head, struct lisp_env *env, struct s_exp *bound);
+struct s_exp *opt_fold(struct lisp_native *native, struct s_exp *args);
+int opt_is_trivial(struct s_exp *exp, struct lisp_env *env, struct s_exp *bound);
+struct s_exp *opt_substitute(struct s_exp *exp, struct s_exp *formals, struct s_exp *actuals);
+struct s_exp *opt_inline(struct s_exp *lambda, struct s_exp *actuals, struct lisp_env *env, struct s_exp *bound);
+struct s_exp *opt_cond(struct s_exp *exp, struct lisp_env *env, struct s_exp *bound);
+
+// Memoized functions, defined in lisp_memo.c
+#include "lisp_memo.h"
+
+// Native strings, defined in lisp_string.c
+#include "lisp_string.h"
+
+// Numbers, defined in lisp_number.c
+#include "lisp_number.h"
+
+// Arbitrary precision integers, defined in lisp_bignum.c
+#include "lisp_bignum.h"
+
+// The heap and garbage collector, defined in lisp_gc.c
+#include "lisp_gc.h"
+
+// Shared pairs, defined in lisp_hashcons.c
+#include "lisp_hashcons.h"
+
+// Promises and streams, defined in lisp_stream.c
+#include "lisp_stream.h"
+
+// Resource limits on evaluation, defined in lisp_limit.c
+#include "lisp_limit.h"
+
+// Raising and catching errors, defined in lisp_error.c
+#include "lisp_error.h"
+
+// Source locations of parsed code, defined in lisp_source.c
+#include "lisp_source.h"
+
+// Tracing hooks and the trace buffer, defined in lisp_trace.c
+#include "lisp_trace.h"
+
+// Loading files and the compile cache, defined in lisp_module.c
+#include "lisp_module.h"
+
+// Mutable cells and in-place changes, defined in lisp_mutate.c
+#include "lisp_mutate.h"
+
+// Numeric arrays and their kernels, defined in lisp_array.c
+#include "lisp_array.h"
+
 // Symbol definitions to expose primitives and handle builtins
 #include "lisp_values.h"
 
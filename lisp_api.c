@@ -0,0 +1,162 @@
+/**
+ * Implementation of the embedding interface
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_parser.h"
+#include "lisp_api.h"
+
+/**
+ * Creates a new, empty environment on top of parent. Definitions made in it are invisible to
+ * parent, so a host can give each script its own scope over a shared global environment. With
+ * a null parent, the new environment is a global environment of its own.
+ */
+struct lisp_env *lisp_env_create(struct lisp_env *parent) {
+	struct lisp_env *env;
+
+	env = (struct lisp_env *) calloc(1, sizeof(struct lisp_env));
+	env->parent = parent;
+	gc_register_env(env);
+	return env;
+}
+
+/**
+ * Releases an environment created with lisp_env_create(), along with its bindings. The parent
+ * is not affected.
+ */
+void lisp_env_destroy(struct lisp_env *env) {
+	gc_unregister_env(env);
+	cleanup_environment(env);
+	free(env);
+}
+
+/**
+ * Collects garbage. Bindings in environments are kept, but any other heap cell the host still
+ * holds may be released or moved, so the host must not keep results across a collection
+ * without binding them somewhere, and must not collect while an evaluation is in progress.
+ */
+void lisp_collect(void) {
+	gc_collect();
+}
+
+/**
+ * Binds name in env to a native function. Arity is the exact number of arguments the function
+ * expects, or LISP_VARIADIC if it accepts any number. The function receives its evaluated
+ * arguments as an array, along with data, and no argument list is built for the call.
+ */
+struct s_exp *lisp_register_native(struct lisp_env *env, const char *name, int arity, lisp_native_fn fn, void *data) {
+	struct s_exp *native;
+
+	native = make_native(name, arity, fn, data);
+	define_label((char *) name, native, env);
+	return native;
+}
+
+/**
+ * Binds name in env to a native function with a fixed arity entry point, which eval() calls
+ * with the evaluated arguments directly instead of through an array
+ */
+struct s_exp *lisp_register_native0(struct lisp_env *env, const char *name, struct s_exp *(*fn0)(void)) {
+	struct s_exp *native;
+
+	native = make_native(name, 0, 0, 0);
+	native->lisp_car.native->fn0 = fn0;
+	define_label((char *) name, native, env);
+	return native;
+}
+
+struct s_exp *lisp_register_native1(struct lisp_env *env, const char *name, struct s_exp *(*fn1)(struct s_exp *)) {
+	struct s_exp *native;
+
+	native = make_native(name, 1, 0, 0);
+	native->lisp_car.native->fn1 = fn1;
+	define_label((char *) name, native, env);
+	return native;
+}
+
+struct s_exp *lisp_register_native2(struct lisp_env *env, const char *name,
+		struct s_exp *(*fn2)(struct s_exp *, struct s_exp *)) {
+	struct s_exp *native;
+
+	native = make_native(name, 2, 0, 0);
+	native->lisp_car.native->fn2 = fn2;
+	define_label((char *) name, native, env);
+	return native;
+}
+
+struct s_exp *lisp_register_native3(struct lisp_env *env, const char *name,
+		struct s_exp *(*fn3)(struct s_exp *, struct s_exp *, struct s_exp *)) {
+	struct s_exp *native;
+
+	native = make_native(name, 3, 0, 0);
+	native->lisp_car.native->fn3 = fn3;
+	define_label((char *) name, native, env);
+	return native;
+}
+
+/**
+ * Parses and evaluates every top-level form in source, in order, returning the value of the
+ * last one. Returns lisp_undefined if the source does not parse or contains no forms. If a
+ * form raises an error, the rest are skipped and the error object is returned, which the host
+ * can recognize with IS_ERROR().
+ */
+struct s_exp *lisp_eval_string(struct lisp_env *env, const char *source) {
+	struct s_list *expList;
+	struct s_exp *result;
+
+	source_set_file(0);
+	expList = lisp_parse_string(source);
+	result = lisp_undefined;
+
+	while (expList != 0) {
+		expList->exp = optimize(expList->exp, env);
+		lisp_source_line = expList->line;
+		lisp_source_site = expList->exp;
+		result = lisp_eval_form(env, expList->exp);
+		if (IS_ERROR(result))
+			break;
+		expList = expList->next;
+	}
+
+	return result;
+}
+
+/**
+ * Evaluates a single form against env, returning the error object if it raises an error
+ */
+struct s_exp *lisp_eval_form(struct lisp_env *env, struct s_exp *form) {
+	struct lisp_handler handler;
+	struct s_exp *result;
+
+	handler_push(&handler);
+	if (setjmp(handler.jump) != 0)
+		return handler.error;
+
+	result = eval(form, env);
+	handler_pop(&handler);
+	return result;
+}
+
+/**
+ * Applies a function value (a native, or a lambda, label or memo form) to an array of values
+ * that are already evaluated, returning the error object if it raises an error. Natives that
+ * call back into lisp should use call_value() instead, so that errors pass through them.
+ */
+struct s_exp *lisp_call(struct lisp_env *env, struct s_exp *function, struct s_exp **argv, int argc) {
+	struct lisp_handler handler;
+	struct s_exp *result;
+
+	handler_push(&handler);
+	if (setjmp(handler.jump) != 0)
+		return handler.error;
+
+	result = call_value(function, argv, argc, env);
+	handler_pop(&handler);
+	return result;
+}
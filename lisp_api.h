@@ -0,0 +1,43 @@
+#ifndef _LISP_API_H_
+#define _LISP_API_H_
+/**
+ * The embedding interface, for host programs that want to run lisp code and expose their own
+ * functions to it. The host calls lisp_init() once to get a global environment, registers any
+ * native functions it needs, and then evaluates source or forms against whichever environment
+ * it chooses. This header may be included from C++.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Project headers
+#include "lisp.h"
+#include "lisp_parser.h"
+
+// Environments
+struct lisp_env *lisp_env_create(struct lisp_env *parent);
+void lisp_env_destroy(struct lisp_env *env);
+
+// Memory
+void lisp_collect(void);
+
+// Native functions
+struct s_exp *lisp_register_native(struct lisp_env *env, const char *name, int arity, lisp_native_fn fn, void *data);
+struct s_exp *lisp_register_native0(struct lisp_env *env, const char *name, struct s_exp *(*fn0)(void));
+struct s_exp *lisp_register_native1(struct lisp_env *env, const char *name, struct s_exp *(*fn1)(struct s_exp *));
+struct s_exp *lisp_register_native2(struct lisp_env *env, const char *name,
+		struct s_exp *(*fn2)(struct s_exp *, struct s_exp *));
+struct s_exp *lisp_register_native3(struct lisp_env *env, const char *name,
+		struct s_exp *(*fn3)(struct s_exp *, struct s_exp *, struct s_exp *));
+
+// Evaluation
+struct s_exp *lisp_eval_string(struct lisp_env *env, const char *source);
+struct s_exp *lisp_eval_form(struct lisp_env *env, struct s_exp *form);
+struct s_exp *lisp_call(struct lisp_env *env, struct s_exp *function, struct s_exp **argv, int argc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
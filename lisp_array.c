@@ -0,0 +1,944 @@
+/**
+ * Numeric arrays and the kernels that do arithmetic on them
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Project headers
+#include "lisp.h"
+#include "lisp_array.h"
+
+struct array_kernels array_kernels_scalar = {
+	.name = "scalar",
+	.sum_f64 = array_sum_f64_scalar,
+	.dot_f64 = array_dot_f64_scalar,
+	.map_f64 = array_map_f64_scalar,
+	.sum_i64 = array_sum_i64_scalar,
+	.map_i64 = array_map_i64_scalar
+};
+
+#if defined(__x86_64__)
+struct array_kernels array_kernels_sse2 = {
+	.name = "sse2",
+	.sum_f64 = array_sum_f64_sse2,
+	.dot_f64 = array_dot_f64_sse2,
+	.map_f64 = array_map_f64_sse2,
+	.sum_i64 = array_sum_i64_sse2,
+	.map_i64 = array_map_i64_sse2
+};
+
+struct array_kernels array_kernels_avx2 = {
+	.name = "avx2",
+	.sum_f64 = array_sum_f64_avx2,
+	.dot_f64 = array_dot_f64_avx2,
+	.map_f64 = array_map_f64_avx2,
+	.sum_i64 = array_sum_i64_avx2,
+	.map_i64 = array_map_i64_avx2
+};
+#endif
+
+// Chosen by array_init()
+struct array_kernels *array_kernels = &array_kernels_scalar;
+
+/**
+ * Creates an array atom of length elements of the given kind, all zero. The elements are charged
+ * against the cell budget, and a range error is raised if there isn't enough memory for them.
+ */
+struct s_exp *make_array(int kind, uint64_t length) {
+	struct lisp_array *array;
+	struct s_exp *rtn;
+	int64_t *data;
+	size_t size;
+
+	// aligned_alloc() wants a whole number of alignments, and never less than one
+	data = 0;
+	if (length <= (SIZE_MAX - ARRAY_ALIGN) / sizeof(int64_t)) {
+		size = (length * sizeof(int64_t) + ARRAY_ALIGN - 1) & ~((size_t) ARRAY_ALIGN - 1);
+		if (size == 0)
+			size = ARRAY_ALIGN;
+		limit_charge(size);
+		data = (int64_t *) aligned_alloc(ARRAY_ALIGN, size);
+	}
+	if (data == 0)
+		lisp_throw(ERROR_RANGE, lisp_nil, "unable to allocate an array of %" PRIu64 " elements", length);
+	memset(data, 0, size);
+
+	array = (struct lisp_array *) malloc(sizeof(struct lisp_array));
+	array->kind = kind;
+	array->length = length;
+	array->data.i64 = data;
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_ARRAY;
+	rtn->lisp_car.array = array;
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Prints an array as #f64(...) or #i64(...), with its elements printed the way numbers are
+ */
+void array_print(struct s_exp *a) {
+	struct lisp_array *array;
+	uint64_t i;
+
+	array = a->lisp_car.array;
+	printf((array->kind == ARRAY_F64) ? "#f64(" : "#i64(");
+	for (i = 0; i < array->length; ++i) {
+		if (i > 0)
+			printf(" ");
+		if (array->kind == ARRAY_F64)
+			printf("%f", array->data.f64[i]);
+		else
+			printf("%" PRId64, array->data.i64[i]);
+	}
+	printf(")");
+}
+
+/**
+ * Frees the storage owned by an array atom, when the collector finds it dead
+ */
+void array_free(struct s_exp *a) {
+	free(a->lisp_car.array->data.i64);
+	free(a->lisp_car.array);
+}
+
+/**
+ * Picks the fastest kernels that the processor supports, and adds the array primitives to the
+ * global environment
+ */
+void array_init(struct lisp_env *env) {
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		array_kernels = &array_kernels_avx2;
+	else
+		array_kernels = &array_kernels_sse2;
+#endif
+
+	define_label("make-array", make_native("make-array", LISP_VARIADIC, _make_array, 0), env);
+	define_label("list->array", make_native("list->array", 2, _list_to_array, 0), env);
+	define_label("array->list", make_native("array->list", 1, _array_to_list, 0), env);
+	define_label("array?", make_native("array?", 1, _array_p, 0), env);
+	define_label("array-length", make_native("array-length", 1, _array_length, 0), env);
+	define_label("array-ref", make_native("array-ref", 2, _array_ref, 0), env);
+	define_label("array-set!", make_native("array-set!", 3, _array_set, 0), env);
+	define_label("array-map", make_native("array-map", 2, _array_map, env), env);
+	define_label("array-sum", make_native("array-sum", 1, _array_sum, 0), env);
+	define_label("dot", make_native("dot", 2, _dot, 0), env);
+	define_label("array-add", make_native("array-add", 2, _array_add, 0), env);
+	define_label("array-sub", make_native("array-sub", 2, _array_sub, 0), env);
+	define_label("array-mul", make_native("array-mul", 2, _array_mul, 0), env);
+	define_label("array-div", make_native("array-div", 2, _array_div, 0), env);
+}
+
+/**
+ * (make-array kind n [fill]) makes an array of n elements of kind f64 or i64, each of which is
+ * fill, or zero
+ */
+struct s_exp *_make_array(struct s_exp **argv, int argc, void *data) {
+	struct lisp_array *array;
+	struct s_exp *rtn;
+	uint64_t i;
+	int kind;
+
+	if (argc != 2 && argc != 3)
+		lisp_throw(ERROR_ARITY, lisp_nil, "make-array expects 2 or 3 arguments, but was given %d", argc);
+
+	kind = array_kind(argv[0], "make-array");
+	if (!IS_INT(argv[1]) || argv[1]->lisp_car.siVal < 0)
+		lisp_throw(ERROR_TYPE, argv[1], "make-array expects a length that is not negative");
+
+	rtn = make_array(kind, (uint64_t) argv[1]->lisp_car.siVal);
+	array = rtn->lisp_car.array;
+	if (argc == 3) {
+		for (i = 0; i < array->length; ++i)
+			array_store(array, i, argv[2], "make-array");
+	}
+
+	return rtn;
+}
+
+/**
+ * (list->array kind list) makes an array of the given kind holding the numbers in list
+ */
+struct s_exp *_list_to_array(struct s_exp **argv, int argc, void *data) {
+	struct lisp_array *array;
+	struct s_exp *rtn;
+	struct s_exp *cur;
+	uint64_t length;
+	int kind;
+
+	kind = array_kind(argv[0], "list->array");
+
+	length = 0;
+	for (cur = argv[1]; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr)
+		length++;
+	if (!IS_NIL(cur))
+		lisp_throw(ERROR_TYPE, argv[1], "list->array expects a list");
+
+	rtn = make_array(kind, length);
+	array = rtn->lisp_car.array;
+	for (length = 0, cur = argv[1]; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr)
+		array_store(array, length++, cur->lisp_car.car, "list->array");
+
+	return rtn;
+}
+
+/**
+ * (array->list a) makes a list of the elements of a
+ */
+struct s_exp *_array_to_list(struct s_exp **argv, int argc, void *data) {
+	struct lisp_array *array;
+	struct s_exp *rtn;
+	uint64_t i;
+
+	array = array_check(argv[0], "array->list");
+
+	rtn = lisp_nil;
+	for (i = array->length; i > 0; --i)
+		rtn = _cons(array_element(array, i - 1), rtn);
+
+	return rtn;
+}
+
+/**
+ * (array? x) is true if x is an array
+ */
+struct s_exp *_array_p(struct s_exp **argv, int argc, void *data) {
+	return IS_ARRAY(argv[0]) ? lisp_true : lisp_false;
+}
+
+/**
+ * (array-length a) is the number of elements in a
+ */
+struct s_exp *_array_length(struct s_exp **argv, int argc, void *data) {
+	return make_int((int64_t) array_check(argv[0], "array-length")->length);
+}
+
+/**
+ * (array-ref a i) is element i of a, counting from zero
+ */
+struct s_exp *_array_ref(struct s_exp **argv, int argc, void *data) {
+	struct lisp_array *array;
+
+	array = array_check(argv[0], "array-ref");
+	return array_element(array, array_index(array, argv[1], "array-ref"));
+}
+
+/**
+ * (array-set! a i x) replaces element i of a with the number x
+ */
+struct s_exp *_array_set(struct s_exp **argv, int argc, void *data) {
+	struct lisp_array *array;
+
+	array = array_check(argv[0], "array-set!");
+	array_store(array, array_index(array, argv[1], "array-set!"), argv[2], "array-set!");
+	return lisp_undefined;
+}
+
+/**
+ * (array-map f a) makes an array of the results of calling f on each element of a. The result
+ * is an integer array if a is one and f always returns a fixnum, and a float array otherwise.
+ */
+struct s_exp *_array_map(struct s_exp **argv, int argc, void *data) {
+	struct lisp_array *in;
+	struct lisp_array *out;
+	struct s_exp *roots[3];
+	struct s_exp *args[1];
+	struct s_exp *value;
+	uint64_t i;
+
+	in = array_check(argv[1], "array-map");
+	roots[0] = argv[0];
+	roots[1] = argv[1];
+	roots[2] = make_array(in->kind, in->length);
+	out = roots[2]->lisp_car.array;
+
+	for (i = 0; i < in->length; ++i) {
+		args[0] = array_element(in, i);
+		value = call_value(roots[0], args, 1, (struct lisp_env *) data);
+		if (out->kind == ARRAY_I64 && !IS_INT(value))
+			array_make_f64(out);
+		array_store(out, i, value, "array-map");
+
+		// The arrays' storage doesn't move, only the atoms that own it
+		gc_safe_point(roots, 3);
+	}
+
+	return roots[2];
+}
+
+/**
+ * (array-sum a) adds up the elements of a
+ */
+struct s_exp *_array_sum(struct s_exp **argv, int argc, void *data) {
+	struct lisp_array *array;
+	struct s_exp *total;
+	int64_t sum;
+	uint64_t i;
+
+	array = array_check(argv[0], "array-sum");
+	if (array->kind == ARRAY_F64)
+		return make_float(array_kernels->sum_f64(array->data.f64, array->length));
+
+	if (array_kernels->sum_i64(array->data.i64, array->length, &sum))
+		return make_int(sum);
+
+	// Start over with exact arithmetic, which promotes to a bignum where it has to
+	total = make_int(0);
+	for (i = 0; i < array->length; ++i)
+		total = _add(total, make_int(array->data.i64[i]));
+	return total;
+}
+
+/**
+ * (dot a b) is the sum of the products of the elements of a and b, which must be the same length
+ */
+struct s_exp *_dot(struct s_exp **argv, int argc, void *data) {
+	struct lisp_array *x;
+	struct lisp_array *y;
+	struct s_exp *total;
+	double *xf;
+	double *yf;
+	double result;
+	int64_t product;
+	int64_t sum;
+	uint64_t i;
+
+	x = array_check(argv[0], "dot");
+	y = array_check(argv[1], "dot");
+	if (x->length != y->length)
+		lisp_throw(ERROR_RANGE, argv[1], "dot expects arrays of the same length");
+
+	// There is no vector multiply of 64-bit integers before AVX-512, so integers stay scalar
+	if (x->kind == ARRAY_I64 && y->kind == ARRAY_I64) {
+		sum = 0;
+		for (i = 0; i < x->length; ++i) {
+			if (__builtin_mul_overflow(x->data.i64[i], y->data.i64[i], &product) || __builtin_add_overflow(sum, product, &sum))
+				break;
+		}
+		if (i == x->length)
+			return make_int(sum);
+
+		total = make_int(0);
+		for (i = 0; i < x->length; ++i)
+			total = _add(total, _mul(make_int(x->data.i64[i]), make_int(y->data.i64[i])));
+		return total;
+	}
+
+	limit_charge(array_copy_size(x) + array_copy_size(y));
+	xf = array_as_f64(x);
+	yf = array_as_f64(y);
+	result = array_kernels->dot_f64(xf, yf, x->length);
+	if (x->kind == ARRAY_I64)
+		free(xf);
+	if (y->kind == ARRAY_I64)
+		free(yf);
+	return make_float(result);
+}
+
+/**
+ * (array-add a b) adds b to each element of a, where b is an array of the same length or a number
+ */
+struct s_exp *_array_add(struct s_exp **argv, int argc, void *data) {
+	return array_arith(ARRAY_ADD, argv[0], argv[1], "array-add");
+}
+
+/**
+ * (array-sub a b) subtracts b from each element of a
+ */
+struct s_exp *_array_sub(struct s_exp **argv, int argc, void *data) {
+	return array_arith(ARRAY_SUB, argv[0], argv[1], "array-sub");
+}
+
+/**
+ * (array-mul a b) multiplies each element of a by b
+ */
+struct s_exp *_array_mul(struct s_exp **argv, int argc, void *data) {
+	return array_arith(ARRAY_MUL, argv[0], argv[1], "array-mul");
+}
+
+/**
+ * (array-div a b) divides each element of a by b, always giving a float array
+ */
+struct s_exp *_array_div(struct s_exp **argv, int argc, void *data) {
+	return array_arith(ARRAY_DIV, argv[0], argv[1], "array-div");
+}
+
+/**
+ * Raises an error unless a is an array, and returns its storage
+ */
+struct lisp_array *array_check(struct s_exp *a, const char *name) {
+	if (!IS_ARRAY(a))
+		lisp_throw(ERROR_TYPE, a, "%s expects an array", name);
+
+	return a->lisp_car.array;
+}
+
+/**
+ * Reads the kind of an array from the symbol f64 or i64
+ */
+int array_kind(struct s_exp *kind, const char *name) {
+	if (IS_SYMBOL(kind) && strcmp(kind->lisp_car.label, "f64") == 0)
+		return ARRAY_F64;
+	if (IS_SYMBOL(kind) && strcmp(kind->lisp_car.label, "i64") == 0)
+		return ARRAY_I64;
+
+	lisp_throw(ERROR_TYPE, kind, "%s expects the kind f64 or i64", name);
+}
+
+/**
+ * Checks that index is a valid index into array, and returns it
+ */
+uint64_t array_index(struct lisp_array *array, struct s_exp *index, const char *name) {
+	if (!IS_INT(index))
+		lisp_throw(ERROR_TYPE, index, "%s expects an integer index", name);
+	if (index->lisp_car.siVal < 0 || (uint64_t) index->lisp_car.siVal >= array->length)
+		lisp_throw(ERROR_RANGE, index, "index %" PRId64 " out of range in %s", index->lisp_car.siVal, name);
+
+	return (uint64_t) index->lisp_car.siVal;
+}
+
+/**
+ * Makes a number atom holding element i of array
+ */
+struct s_exp *array_element(struct lisp_array *array, uint64_t i) {
+	if (array->kind == ARRAY_F64)
+		return make_float(array->data.f64[i]);
+
+	return make_int(array->data.i64[i]);
+}
+
+/**
+ * Stores the number value as element i of array. Integer arrays only take fixnums.
+ */
+void array_store(struct lisp_array *array, uint64_t i, struct s_exp *value, const char *name) {
+	if (array->kind == ARRAY_I64) {
+		if (!IS_INT(value))
+			lisp_throw(ERROR_TYPE, value, "%s expects a fixnum for an i64 array", name);
+		array->data.i64[i] = value->lisp_car.siVal;
+		return;
+	}
+
+	number_check(value, value, name);
+	array->data.f64[i] = number_to_double(value);
+}
+
+/**
+ * The number of bytes that array_as_f64() allocates for a copy of array, which callers charge
+ * against the cell budget before making any of their copies
+ */
+size_t array_copy_size(struct lisp_array *array) {
+	return (array->kind == ARRAY_F64) ? 0 : (array->length + 1) * sizeof(double);
+}
+
+/**
+ * The elements of array as doubles. For an integer array this is a converted copy, which the
+ * caller must free.
+ */
+double *array_as_f64(struct lisp_array *array) {
+	double *rtn;
+	uint64_t i;
+
+	if (array->kind == ARRAY_F64)
+		return array->data.f64;
+
+	rtn = (double *) malloc((array->length + 1) * sizeof(double));
+	for (i = 0; i < array->length; ++i)
+		rtn[i] = (double) array->data.i64[i];
+	return rtn;
+}
+
+/**
+ * Converts an integer array into a float array in place. The buffer is the same size, so each
+ * element is simply rewritten.
+ */
+void array_make_f64(struct lisp_array *array) {
+	uint64_t i;
+
+	for (i = 0; i < array->length; ++i)
+		array->data.f64[i] = (double) array->data.i64[i];
+	array->kind = ARRAY_F64;
+}
+
+/**
+ * Carries out op between each element of the array a and b, which is either an array of the
+ * same length or a number used for every element. The result is an integer array when both
+ * sides are integers and op isn't a division, and a float array otherwise.
+ */
+struct s_exp *array_arith(int op, struct s_exp *a, struct s_exp *b, const char *name) {
+	struct lisp_array *x;
+	struct lisp_array *y;
+	struct lisp_array *r;
+	struct s_exp *rtn;
+	double *xf;
+	double *yf;
+	double scalarF;
+	int64_t scalarI;
+	int kind;
+
+	x = array_check(a, name);
+	y = 0;
+	if (IS_ARRAY(b)) {
+		y = b->lisp_car.array;
+		if (y->length != x->length)
+			lisp_throw(ERROR_RANGE, b, "%s expects arrays of the same length", name);
+	}
+	else {
+		number_check(b, b, name);
+	}
+
+	kind = ARRAY_F64;
+	if (op != ARRAY_DIV && x->kind == ARRAY_I64 && ((y != 0) ? y->kind == ARRAY_I64 : IS_INT(b)))
+		kind = ARRAY_I64;
+
+	rtn = make_array(kind, x->length);
+	r = rtn->lisp_car.array;
+
+	if (kind == ARRAY_I64) {
+		scalarI = (y == 0) ? b->lisp_car.siVal : 0;
+		if (!array_kernels->map_i64(op, r->data.i64, x->data.i64, (y != 0) ? y->data.i64 : &scalarI, (y != 0) ? 1 : 0, x->length))
+			lisp_throw(ERROR_OVERFLOW, a, "integer overflow in %s", name);
+		return rtn;
+	}
+
+	limit_charge(array_copy_size(x) + ((y != 0) ? array_copy_size(y) : 0));
+	xf = array_as_f64(x);
+	if (y != 0) {
+		yf = array_as_f64(y);
+	}
+	else {
+		scalarF = number_to_double(b);
+		yf = &scalarF;
+	}
+
+	array_kernels->map_f64(op, r->data.f64, xf, yf, (y != 0) ? 1 : 0, x->length);
+
+	if (x->kind == ARRAY_I64)
+		free(xf);
+	if (y != 0 && y->kind == ARRAY_I64)
+		free(yf);
+	return rtn;
+}
+
+/**
+ * Combines the lanes of a float sum or dot product, and adds in the elements left over after
+ * the last whole group of lanes, in the same order for every kernel. b is 0 for a sum.
+ */
+double array_finish_f64(const double *lanes, const double *a, const double *b, uint64_t n) {
+	double result;
+	uint64_t i;
+
+	result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (i = 0; i < n; ++i)
+		result += (b != 0) ? a[i] * b[i] : a[i];
+
+	return result;
+}
+
+/**
+ * Combines the lanes of an integer sum and adds in the leftover elements, returning 0 on
+ * overflow
+ */
+int array_finish_i64(const int64_t *lanes, const int64_t *a, uint64_t n, int64_t *sum) {
+	int64_t result;
+	uint64_t i;
+	int k;
+
+	result = 0;
+	for (k = 0; k < ARRAY_LANES; ++k) {
+		if (__builtin_add_overflow(result, lanes[k], &result))
+			return 0;
+	}
+	for (i = 0; i < n; ++i) {
+		if (__builtin_add_overflow(result, a[i], &result))
+			return 0;
+	}
+
+	*sum = result;
+	return 1;
+}
+
+/**
+ * Sums floats in plain C
+ */
+double array_sum_f64_scalar(const double *a, uint64_t n) {
+	double lanes[ARRAY_LANES] = {0, 0, 0, 0};
+	uint64_t i;
+	int k;
+
+	for (i = 0; i + ARRAY_LANES <= n; i += ARRAY_LANES) {
+		for (k = 0; k < ARRAY_LANES; ++k)
+			lanes[k] += a[i + k];
+	}
+
+	return array_finish_f64(lanes, a + i, 0, n - i);
+}
+
+/**
+ * Takes the dot product of float arrays in plain C
+ */
+double array_dot_f64_scalar(const double *a, const double *b, uint64_t n) {
+	double lanes[ARRAY_LANES] = {0, 0, 0, 0};
+	uint64_t i;
+	int k;
+
+	for (i = 0; i + ARRAY_LANES <= n; i += ARRAY_LANES) {
+		for (k = 0; k < ARRAY_LANES; ++k)
+			lanes[k] += a[i + k] * b[i + k];
+	}
+
+	return array_finish_f64(lanes, a + i, b + i, n - i);
+}
+
+/**
+ * Elementwise float arithmetic in plain C
+ */
+void array_map_f64_scalar(int op, double *r, const double *a, const double *b, int bStep, uint64_t n) {
+	uint64_t i;
+
+	for (i = 0; i < n; ++i) {
+		switch (op) {
+			case ARRAY_ADD:
+				r[i] = a[i] + b[i * bStep];
+				break;
+			case ARRAY_SUB:
+				r[i] = a[i] - b[i * bStep];
+				break;
+			case ARRAY_MUL:
+				r[i] = a[i] * b[i * bStep];
+				break;
+			default:
+				r[i] = a[i] / b[i * bStep];
+				break;
+		}
+	}
+}
+
+/**
+ * Sums integers in plain C, returning 0 on overflow
+ */
+int array_sum_i64_scalar(const int64_t *a, uint64_t n, int64_t *sum) {
+	int64_t lanes[ARRAY_LANES] = {0, 0, 0, 0};
+
+	return array_finish_i64(lanes, a, n, sum);
+}
+
+/**
+ * Elementwise integer arithmetic in plain C, returning 0 on overflow
+ */
+int array_map_i64_scalar(int op, int64_t *r, const int64_t *a, const int64_t *b, int bStep, uint64_t n) {
+	uint64_t i;
+	int overflow;
+
+	overflow = 0;
+	for (i = 0; i < n; ++i) {
+		switch (op) {
+			case ARRAY_ADD:
+				overflow |= __builtin_add_overflow(a[i], b[i * bStep], &r[i]);
+				break;
+			case ARRAY_SUB:
+				overflow |= __builtin_sub_overflow(a[i], b[i * bStep], &r[i]);
+				break;
+			default:
+				overflow |= __builtin_mul_overflow(a[i], b[i * bStep], &r[i]);
+				break;
+		}
+	}
+
+	return !overflow;
+}
+
+#if defined(__x86_64__)
+/**
+ * Sums floats two lanes at a time in each of two SSE2 registers
+ */
+double array_sum_f64_sse2(const double *a, uint64_t n) {
+	double lanes[ARRAY_LANES];
+	__m128d lo;
+	__m128d hi;
+	uint64_t i;
+
+	lo = _mm_setzero_pd();
+	hi = _mm_setzero_pd();
+	for (i = 0; i + ARRAY_LANES <= n; i += ARRAY_LANES) {
+		lo = _mm_add_pd(lo, _mm_loadu_pd(a + i));
+		hi = _mm_add_pd(hi, _mm_loadu_pd(a + i + 2));
+	}
+
+	_mm_storeu_pd(lanes, lo);
+	_mm_storeu_pd(lanes + 2, hi);
+	return array_finish_f64(lanes, a + i, 0, n - i);
+}
+
+/**
+ * Takes the dot product of float arrays with SSE2
+ */
+double array_dot_f64_sse2(const double *a, const double *b, uint64_t n) {
+	double lanes[ARRAY_LANES];
+	__m128d lo;
+	__m128d hi;
+	uint64_t i;
+
+	lo = _mm_setzero_pd();
+	hi = _mm_setzero_pd();
+	for (i = 0; i + ARRAY_LANES <= n; i += ARRAY_LANES) {
+		lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+	}
+
+	_mm_storeu_pd(lanes, lo);
+	_mm_storeu_pd(lanes + 2, hi);
+	return array_finish_f64(lanes, a + i, b + i, n - i);
+}
+
+/**
+ * Elementwise float arithmetic with SSE2
+ */
+void array_map_f64_sse2(int op, double *r, const double *a, const double *b, int bStep, uint64_t n) {
+	__m128d x;
+	__m128d y;
+	uint64_t i;
+
+	y = (bStep == 0) ? _mm_set1_pd(*b) : _mm_setzero_pd();
+	for (i = 0; i + 2 <= n; i += 2) {
+		x = _mm_loadu_pd(a + i);
+		if (bStep != 0)
+			y = _mm_loadu_pd(b + i);
+
+		switch (op) {
+			case ARRAY_ADD:
+				x = _mm_add_pd(x, y);
+				break;
+			case ARRAY_SUB:
+				x = _mm_sub_pd(x, y);
+				break;
+			case ARRAY_MUL:
+				x = _mm_mul_pd(x, y);
+				break;
+			default:
+				x = _mm_div_pd(x, y);
+				break;
+		}
+		_mm_storeu_pd(r + i, x);
+	}
+
+	array_map_f64_scalar(op, r + i, a + i, b + i * bStep, bStep, n - i);
+}
+
+/**
+ * Sums integers with SSE2. A lane overflowed if the value added and the old sum had the same
+ * sign, and the new sum has the other one, which the sign bits of the lanes collect.
+ */
+int array_sum_i64_sse2(const int64_t *a, uint64_t n, int64_t *sum) {
+	int64_t lanes[ARRAY_LANES];
+	__m128i lo;
+	__m128i hi;
+	__m128i x;
+	__m128i s;
+	__m128i overflow;
+	uint64_t i;
+
+	lo = _mm_setzero_si128();
+	hi = _mm_setzero_si128();
+	overflow = _mm_setzero_si128();
+	for (i = 0; i + ARRAY_LANES <= n; i += ARRAY_LANES) {
+		x = _mm_loadu_si128((const __m128i *) (a + i));
+		s = _mm_add_epi64(lo, x);
+		overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(lo, s), _mm_xor_si128(x, s)));
+		lo = s;
+
+		x = _mm_loadu_si128((const __m128i *) (a + i + 2));
+		s = _mm_add_epi64(hi, x);
+		overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(hi, s), _mm_xor_si128(x, s)));
+		hi = s;
+	}
+
+	if (_mm_movemask_pd(_mm_castsi128_pd(overflow)) != 0)
+		return 0;
+
+	_mm_storeu_si128((__m128i *) lanes, lo);
+	_mm_storeu_si128((__m128i *) (lanes + 2), hi);
+	return array_finish_i64(lanes, a + i, n - i, sum);
+}
+
+/**
+ * Elementwise integer arithmetic with SSE2, for addition and subtraction
+ */
+int array_map_i64_sse2(int op, int64_t *r, const int64_t *a, const int64_t *b, int bStep, uint64_t n) {
+	__m128i overflow;
+	__m128i x;
+	__m128i y;
+	__m128i s;
+	uint64_t i;
+
+	if (op == ARRAY_MUL)
+		return array_map_i64_scalar(op, r, a, b, bStep, n);
+
+	overflow = _mm_setzero_si128();
+	y = (bStep == 0) ? _mm_set1_epi64x(*b) : _mm_setzero_si128();
+	for (i = 0; i + 2 <= n; i += 2) {
+		x = _mm_loadu_si128((const __m128i *) (a + i));
+		if (bStep != 0)
+			y = _mm_loadu_si128((const __m128i *) (b + i));
+
+		if (op == ARRAY_ADD) {
+			s = _mm_add_epi64(x, y);
+			overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(x, s), _mm_xor_si128(y, s)));
+		}
+		else {
+			s = _mm_sub_epi64(x, y);
+			overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(x, y), _mm_xor_si128(x, s)));
+		}
+		_mm_storeu_si128((__m128i *) (r + i), s);
+	}
+
+	if (_mm_movemask_pd(_mm_castsi128_pd(overflow)) != 0)
+		return 0;
+	return array_map_i64_scalar(op, r + i, a + i, b + i * bStep, bStep, n - i);
+}
+
+/**
+ * Sums floats four lanes at a time with AVX2
+ */
+__attribute__((target("avx2")))
+double array_sum_f64_avx2(const double *a, uint64_t n) {
+	double lanes[ARRAY_LANES];
+	__m256d acc;
+	uint64_t i;
+
+	acc = _mm256_setzero_pd();
+	for (i = 0; i + ARRAY_LANES <= n; i += ARRAY_LANES)
+		acc = _mm256_add_pd(acc, _mm256_loadu_pd(a + i));
+
+	_mm256_storeu_pd(lanes, acc);
+	return array_finish_f64(lanes, a + i, 0, n - i);
+}
+
+/**
+ * Takes the dot product of float arrays with AVX2. The multiply and add are kept separate, as
+ * a fused multiply-add would round differently from the other kernels.
+ */
+__attribute__((target("avx2")))
+double array_dot_f64_avx2(const double *a, const double *b, uint64_t n) {
+	double lanes[ARRAY_LANES];
+	__m256d acc;
+	uint64_t i;
+
+	acc = _mm256_setzero_pd();
+	for (i = 0; i + ARRAY_LANES <= n; i += ARRAY_LANES)
+		acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+
+	_mm256_storeu_pd(lanes, acc);
+	return array_finish_f64(lanes, a + i, b + i, n - i);
+}
+
+/**
+ * Elementwise float arithmetic with AVX2
+ */
+__attribute__((target("avx2")))
+void array_map_f64_avx2(int op, double *r, const double *a, const double *b, int bStep, uint64_t n) {
+	__m256d x;
+	__m256d y;
+	uint64_t i;
+
+	y = (bStep == 0) ? _mm256_set1_pd(*b) : _mm256_setzero_pd();
+	for (i = 0; i + 4 <= n; i += 4) {
+		x = _mm256_loadu_pd(a + i);
+		if (bStep != 0)
+			y = _mm256_loadu_pd(b + i);
+
+		switch (op) {
+			case ARRAY_ADD:
+				x = _mm256_add_pd(x, y);
+				break;
+			case ARRAY_SUB:
+				x = _mm256_sub_pd(x, y);
+				break;
+			case ARRAY_MUL:
+				x = _mm256_mul_pd(x, y);
+				break;
+			default:
+				x = _mm256_div_pd(x, y);
+				break;
+		}
+		_mm256_storeu_pd(r + i, x);
+	}
+
+	array_map_f64_scalar(op, r + i, a + i, b + i * bStep, bStep, n - i);
+}
+
+/**
+ * Sums integers with AVX2, detecting overflow the same way as the SSE2 kernel
+ */
+__attribute__((target("avx2")))
+int array_sum_i64_avx2(const int64_t *a, uint64_t n, int64_t *sum) {
+	int64_t lanes[ARRAY_LANES];
+	__m256i acc;
+	__m256i x;
+	__m256i s;
+	__m256i overflow;
+	uint64_t i;
+
+	acc = _mm256_setzero_si256();
+	overflow = _mm256_setzero_si256();
+	for (i = 0; i + ARRAY_LANES <= n; i += ARRAY_LANES) {
+		x = _mm256_loadu_si256((const __m256i *) (a + i));
+		s = _mm256_add_epi64(acc, x);
+		overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(acc, s), _mm256_xor_si256(x, s)));
+		acc = s;
+	}
+
+	if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)) != 0)
+		return 0;
+
+	_mm256_storeu_si256((__m256i *) lanes, acc);
+	return array_finish_i64(lanes, a + i, n - i, sum);
+}
+
+/**
+ * Elementwise integer arithmetic with AVX2, for addition and subtraction
+ */
+__attribute__((target("avx2")))
+int array_map_i64_avx2(int op, int64_t *r, const int64_t *a, const int64_t *b, int bStep, uint64_t n) {
+	__m256i overflow;
+	__m256i x;
+	__m256i y;
+	__m256i s;
+	uint64_t i;
+
+	if (op == ARRAY_MUL)
+		return array_map_i64_scalar(op, r, a, b, bStep, n);
+
+	overflow = _mm256_setzero_si256();
+	y = (bStep == 0) ? _mm256_set1_epi64x(*b) : _mm256_setzero_si256();
+	for (i = 0; i + 4 <= n; i += 4) {
+		x = _mm256_loadu_si256((const __m256i *) (a + i));
+		if (bStep != 0)
+			y = _mm256_loadu_si256((const __m256i *) (b + i));
+
+		if (op == ARRAY_ADD) {
+			s = _mm256_add_epi64(x, y);
+			overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(x, s), _mm256_xor_si256(y, s)));
+		}
+		else {
+			s = _mm256_sub_epi64(x, y);
+			overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(x, y), _mm256_xor_si256(x, s)));
+		}
+		_mm256_storeu_si256((__m256i *) (r + i), s);
+	}
+
+	if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)) != 0)
+		return 0;
+	return array_map_i64_scalar(op, r + i, a + i, b + i * bStep, bStep, n - i);
+}
+#endif
@@ -0,0 +1,129 @@
+#ifndef _LISP_ARRAY_H_
+#define _LISP_ARRAY_H_
+/**
+ * Homogeneous numeric arrays. An array atom points to a lisp_array, whose elements are either
+ * doubles or 64-bit integers held in one contiguous, aligned buffer, so that numeric code runs
+ * over them in a C loop instead of walking a list and evaluating once per element. Sums, dot
+ * products and elementwise arithmetic are done by kernels that use AVX2 or SSE2 when the
+ * processor has them, picked once at startup, and plain C otherwise. Every kernel adds floats
+ * in the same order, four lanes at a time, so the results don't depend on which one runs.
+ *
+ * Integer arrays hold machine integers. Elementwise integer arithmetic that overflows raises an
+ * overflow error rather than wrapping, while sums and dot products that overflow are finished
+ * exactly, and may give a bignum. Anything else that involves a float, a non-fixnum, or a
+ * division gives a float array. Arrays are mutable, so like boxes they are only equal to
+ * themselves.
+ */
+
+// Standard headers
+#include <inttypes.h>
+
+// Project headers
+#include "lisp.h"
+
+// Kinds of element
+#define ARRAY_F64		0
+#define ARRAY_I64		1
+
+// Elementwise operations
+#define ARRAY_ADD		0
+#define ARRAY_SUB		1
+#define ARRAY_MUL		2
+#define ARRAY_DIV		3
+
+// Buffers are aligned for the widest vectors the kernels use
+#define ARRAY_ALIGN		32
+
+// Sums and dot products are accumulated in this many lanes, whatever the vector width
+#define ARRAY_LANES		4
+
+/**
+ * The storage of an array atom
+ */
+struct lisp_array {
+	int kind;
+	uint64_t length;
+	union {
+		double *f64;
+		int64_t *i64;
+	} data;
+};
+
+/**
+ * One implementation of the numeric kernels. op is one of the ARRAY_ operations, and b is read
+ * as an array when bStep is 1, or as a single value that applies to every element when it is 0.
+ * The integer kernels return 0 if anything overflowed, and never see ARRAY_DIV.
+ */
+struct array_kernels {
+	const char *name;
+	double (*sum_f64)(const double *a, uint64_t n);
+	double (*dot_f64)(const double *a, const double *b, uint64_t n);
+	void (*map_f64)(int op, double *r, const double *a, const double *b, int bStep, uint64_t n);
+	int (*sum_i64)(const int64_t *a, uint64_t n, int64_t *sum);
+	int (*map_i64)(int op, int64_t *r, const int64_t *a, const int64_t *b, int bStep, uint64_t n);
+};
+
+// The kernels in use
+extern struct array_kernels *array_kernels;
+
+// Making, printing and freeing arrays
+struct s_exp *make_array(int kind, uint64_t length);
+void array_print(struct s_exp *a);
+void array_free(struct s_exp *a);
+
+// Setup, called by lisp_init()
+void array_init(struct lisp_env *env);
+
+// Lisp-space array primitives
+struct s_exp *_make_array(struct s_exp **argv, int argc, void *data);
+struct s_exp *_list_to_array(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_to_list(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_p(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_length(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_ref(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_set(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_map(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_sum(struct s_exp **argv, int argc, void *data);
+struct s_exp *_dot(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_add(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_sub(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_mul(struct s_exp **argv, int argc, void *data);
+struct s_exp *_array_div(struct s_exp **argv, int argc, void *data);
+
+// Array helpers, used internally
+struct lisp_array *array_check(struct s_exp *a, const char *name);
+int array_kind(struct s_exp *kind, const char *name);
+uint64_t array_index(struct lisp_array *array, struct s_exp *index, const char *name);
+struct s_exp *array_element(struct lisp_array *array, uint64_t i);
+void array_store(struct lisp_array *array, uint64_t i, struct s_exp *value, const char *name);
+size_t array_copy_size(struct lisp_array *array);
+double *array_as_f64(struct lisp_array *array);
+void array_make_f64(struct lisp_array *array);
+struct s_exp *array_arith(int op, struct s_exp *a, struct s_exp *b, const char *name);
+double array_finish_f64(const double *lanes, const double *a, const double *b, uint64_t n);
+int array_finish_i64(const int64_t *lanes, const int64_t *a, uint64_t n, int64_t *sum);
+
+// Kernels in plain C, which the vector kernels also use for their leftover elements
+double array_sum_f64_scalar(const double *a, uint64_t n);
+double array_dot_f64_scalar(const double *a, const double *b, uint64_t n);
+void array_map_f64_scalar(int op, double *r, const double *a, const double *b, int bStep, uint64_t n);
+int array_sum_i64_scalar(const int64_t *a, uint64_t n, int64_t *sum);
+int array_map_i64_scalar(int op, int64_t *r, const int64_t *a, const int64_t *b, int bStep, uint64_t n);
+
+#if defined(__x86_64__)
+// Kernels using SSE2, which every x86-64 processor has
+double array_sum_f64_sse2(const double *a, uint64_t n);
+double array_dot_f64_sse2(const double *a, const double *b, uint64_t n);
+void array_map_f64_sse2(int op, double *r, const double *a, const double *b, int bStep, uint64_t n);
+int array_sum_i64_sse2(const int64_t *a, uint64_t n, int64_t *sum);
+int array_map_i64_sse2(int op, int64_t *r, const int64_t *a, const int64_t *b, int bStep, uint64_t n);
+
+// Kernels using AVX2, which are only used when the processor supports it
+double array_sum_f64_avx2(const double *a, uint64_t n);
+double array_dot_f64_avx2(const double *a, const double *b, uint64_t n);
+void array_map_f64_avx2(int op, double *r, const double *a, const double *b, int bStep, uint64_t n);
+int array_sum_i64_avx2(const int64_t *a, uint64_t n, int64_t *sum);
+int array_map_i64_avx2(int op, int64_t *r, const int64_t *a, const int64_t *b, int bStep, uint64_t n);
+#endif
+
+#endif
@@ -0,0 +1,660 @@
+/**
+ * Arbitrary precision integers. Magnitudes are arrays of 64-bit limbs, and products and
+ * quotients of limbs are formed with the compiler's 128-bit integers. The mag_ functions work on
+ * bare magnitudes, and the bignum_ functions on signed values built from them.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_bignum.h"
+
+/**
+ * Allocates a bignum with room for length limbs, all zero, and a positive sign
+ */
+struct lisp_bignum *bignum_alloc(size_t length) {
+	struct lisp_bignum *b;
+
+	b = (struct lisp_bignum *) calloc(1, sizeof(struct lisp_bignum) + length * sizeof(uint64_t));
+	b->sign = 1;
+	b->length = length;
+	return b;
+}
+
+/**
+ * Makes a bignum with the value of a fixnum
+ */
+struct lisp_bignum *bignum_from_int(int64_t val) {
+	struct lisp_bignum *b;
+
+	if (val == 0)
+		return bignum_alloc(0);
+
+	b = bignum_alloc(1);
+	if (val < 0) {
+		b->sign = -1;
+		b->limbs[0] = -(uint64_t) val;
+	}
+	else {
+		b->limbs[0] = (uint64_t) val;
+	}
+	return b;
+}
+
+/**
+ * Makes a copy of a bignum
+ */
+struct lisp_bignum *bignum_copy(struct lisp_bignum *b) {
+	struct lisp_bignum *rtn;
+
+	rtn = bignum_alloc(b->length);
+	rtn->sign = b->sign;
+	memcpy(rtn->limbs, b->limbs, b->length * sizeof(uint64_t));
+	return rtn;
+}
+
+/**
+ * Reads a decimal integer with an optional sign, returning 0 if text is anything else. The
+ * digits are taken BIGNUM_DECIMAL_DIGITS at a time, each group multiplied in with one pass.
+ */
+struct lisp_bignum *bignum_parse(const char *text) {
+	struct lisp_bignum *b;
+	unsigned __int128 p;
+	const char *digits;
+	uint64_t chunk;
+	uint64_t scale;
+	uint64_t carry;
+	size_t count;
+	size_t taken;
+	size_t length;
+	size_t i;
+	int sign;
+
+	sign = 1;
+	if (*text == '-' || *text == '+') {
+		sign = (*text == '-') ? -1 : 1;
+		text += 1;
+	}
+
+	count = strlen(text);
+	if (count == 0 || strspn(text, "0123456789") != count)
+		return 0;
+
+	b = bignum_alloc(count / BIGNUM_DECIMAL_DIGITS + 2);
+	length = 0;
+
+	// The first group takes whatever is left over, so that every later group is full
+	for (digits = text; *digits != 0; digits += taken) {
+		taken = (digits == text && count % BIGNUM_DECIMAL_DIGITS != 0) ? count % BIGNUM_DECIMAL_DIGITS : BIGNUM_DECIMAL_DIGITS;
+		chunk = 0;
+		scale = 1;
+		for (i = 0; i < taken; ++i) {
+			chunk = chunk * 10 + (digits[i] - '0');
+			scale *= 10;
+		}
+
+		carry = chunk;
+		for (i = 0; i < length; ++i) {
+			p = (unsigned __int128) b->limbs[i] * scale + carry;
+			b->limbs[i] = (uint64_t) p;
+			carry = (uint64_t) (p >> 64);
+		}
+		if (carry != 0)
+			b->limbs[length++] = carry;
+	}
+
+	b->length = length;
+	b->sign = sign;
+	return bignum_trim(b);
+}
+
+/**
+ * Adds two bignums
+ */
+struct lisp_bignum *bignum_add(struct lisp_bignum *a, struct lisp_bignum *b) {
+	return bignum_add_signed(a, b, 1);
+}
+
+/**
+ * Subtracts b from a
+ */
+struct lisp_bignum *bignum_sub(struct lisp_bignum *a, struct lisp_bignum *b) {
+	return bignum_add_signed(a, b, -1);
+}
+
+/**
+ * Multiplies two bignums
+ */
+struct lisp_bignum *bignum_mul(struct lisp_bignum *a, struct lisp_bignum *b) {
+	struct lisp_bignum *rtn;
+
+	if (a->length == 0 || b->length == 0)
+		return bignum_alloc(0);
+
+	rtn = bignum_alloc(a->length + b->length);
+	mag_mul(rtn->limbs, a->limbs, a->length, b->limbs, b->length);
+	rtn->sign = a->sign * b->sign;
+	return bignum_trim(rtn);
+}
+
+/**
+ * Divides a by b, which must not be zero, rounding the quotient towards zero so that the
+ * remainder has the sign of a. Either result may be left out by passing a null pointer.
+ */
+void bignum_divmod(struct lisp_bignum *a, struct lisp_bignum *b, struct lisp_bignum **quotient, struct lisp_bignum **remainder) {
+	struct lisp_bignum *q;
+	struct lisp_bignum *r;
+
+	if (mag_compare(a->limbs, a->length, b->limbs, b->length) < 0) {
+		q = bignum_alloc(0);
+		r = bignum_copy(a);
+	}
+	else {
+		q = bignum_alloc(a->length - b->length + 1);
+		r = bignum_alloc(b->length);
+		mag_divmod(q->limbs, r->limbs, a->limbs, a->length, b->limbs, b->length);
+		q->sign = a->sign * b->sign;
+		r->sign = a->sign;
+		bignum_trim(q);
+		bignum_trim(r);
+	}
+
+	if (quotient != 0)
+		*quotient = q;
+	else
+		free(q);
+
+	if (remainder != 0)
+		*remainder = r;
+	else
+		free(r);
+}
+
+/**
+ * The greatest common divisor of two bignums, which is never negative, by Euclid's algorithm
+ */
+struct lisp_bignum *bignum_gcd(struct lisp_bignum *a, struct lisp_bignum *b) {
+	struct lisp_bignum *x;
+	struct lisp_bignum *y;
+	struct lisp_bignum *r;
+
+	x = bignum_copy(a);
+	y = bignum_copy(b);
+	x->sign = 1;
+	y->sign = 1;
+
+	while (y->length != 0) {
+		bignum_divmod(x, y, 0, &r);
+		free(x);
+		x = y;
+		y = r;
+	}
+
+	free(y);
+	return x;
+}
+
+/**
+ * Makes a copy of b with the opposite sign
+ */
+struct lisp_bignum *bignum_negate(struct lisp_bignum *b) {
+	struct lisp_bignum *rtn;
+
+	rtn = bignum_copy(b);
+	if (rtn->length != 0)
+		rtn->sign = -rtn->sign;
+	return rtn;
+}
+
+/**
+ * Compares two bignums, returning a negative number, zero, or a positive number as a is less
+ * than, equal to, or greater than b
+ */
+int bignum_compare(struct lisp_bignum *a, struct lisp_bignum *b) {
+	if (a->sign != b->sign)
+		return (a->sign < b->sign) ? -1 : 1;
+
+	return a->sign * mag_compare(a->limbs, a->length, b->limbs, b->length);
+}
+
+/**
+ * Checks if a bignum is zero
+ */
+int bignum_is_zero(struct lisp_bignum *b) {
+	return (b->length == 0) ? 1 : 0;
+}
+
+/**
+ * Stores the value of b in val and returns 1 if it fits in a fixnum, or returns 0 if not
+ */
+int bignum_to_int(struct lisp_bignum *b, int64_t *val) {
+	uint64_t m;
+
+	if (b->length == 0) {
+		*val = 0;
+		return 1;
+	}
+	if (b->length > 1)
+		return 0;
+
+	m = b->limbs[0];
+	if (b->sign > 0) {
+		if (m > (uint64_t) INT64_MAX)
+			return 0;
+		*val = (int64_t) m;
+	}
+	else {
+		if (m > (uint64_t) INT64_MAX + 1)
+			return 0;
+		*val = (int64_t) (0 - m);
+	}
+	return 1;
+}
+
+/**
+ * The nearest double to b, or an infinity if it is too large
+ */
+double bignum_to_double(struct lisp_bignum *b) {
+	double d;
+	size_t i;
+
+	d = 0;
+	for (i = b->length; i > 0; --i) {
+		d = d * 18446744073709551616.0 + (double) b->limbs[i - 1];
+	}
+
+	return b->sign * d;
+}
+
+/**
+ * Writes b in decimal, into a string that the caller must free. The magnitude is divided by
+ * the largest power of ten that fits in a limb over and over, and each remainder gives that
+ * many digits.
+ */
+char *bignum_to_string(struct lisp_bignum *b) {
+	uint64_t *chunks;
+	uint64_t *work;
+	size_t length;
+	size_t count;
+	char *rtn;
+	char *out;
+
+	if (b->length == 0)
+		return strdup("0");
+
+	work = (uint64_t *) malloc(b->length * sizeof(uint64_t));
+	memcpy(work, b->limbs, b->length * sizeof(uint64_t));
+	chunks = (uint64_t *) malloc((2 * b->length + 1) * sizeof(uint64_t));
+	length = b->length;
+	count = 0;
+
+	while (length > 0) {
+		chunks[count++] = mag_div_small(work, work, length, BIGNUM_DECIMAL_BASE);
+		length = mag_trim(work, length);
+	}
+
+	rtn = (char *) malloc(count * BIGNUM_DECIMAL_DIGITS + 2);
+	out = rtn;
+	if (b->sign < 0)
+		*out++ = '-';
+
+	out += sprintf(out, "%" PRIu64, chunks[count - 1]);
+	while (--count > 0) {
+		out += sprintf(out, "%019" PRIu64, chunks[count - 1]);
+	}
+
+	free(work);
+	free(chunks);
+	return rtn;
+}
+
+/**
+ * Hashes the value of a bignum, with FNV-1a over its sign and limbs
+ */
+uint64_t bignum_hash(struct lisp_bignum *b) {
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	hash = (hash ^ (uint64_t) b->sign) * 1099511628211ULL;
+	for (i = 0; i < b->length; ++i) {
+		hash = (hash ^ b->limbs[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Drops the leading zero limbs of b, and makes zero positive. Returns b.
+ */
+struct lisp_bignum *bignum_trim(struct lisp_bignum *b) {
+	b->length = mag_trim(b->limbs, b->length);
+	if (b->length == 0)
+		b->sign = 1;
+	return b;
+}
+
+/**
+ * Adds bSign times b to a, by adding magnitudes when the signs agree and subtracting the
+ * smaller from the larger when they don't
+ */
+struct lisp_bignum *bignum_add_signed(struct lisp_bignum *a, struct lisp_bignum *b, int bSign) {
+	struct lisp_bignum *rtn;
+	struct lisp_bignum *large;
+	struct lisp_bignum *small;
+	int sign;
+	int cmp;
+
+	sign = b->sign * bSign;
+
+	if (a->sign == sign || b->length == 0) {
+		large = (a->length >= b->length) ? a : b;
+		small = (large == a) ? b : a;
+		rtn = bignum_alloc(large->length + 1);
+		memcpy(rtn->limbs, large->limbs, large->length * sizeof(uint64_t));
+		mag_add_into(rtn->limbs, rtn->length, small->limbs, small->length);
+		rtn->sign = a->sign;
+		if (a->length == 0)
+			rtn->sign = sign;
+		return bignum_trim(rtn);
+	}
+
+	cmp = mag_compare(a->limbs, a->length, b->limbs, b->length);
+	if (cmp == 0)
+		return bignum_alloc(0);
+
+	large = (cmp > 0) ? a : b;
+	small = (cmp > 0) ? b : a;
+	rtn = bignum_alloc(large->length);
+	memcpy(rtn->limbs, large->limbs, large->length * sizeof(uint64_t));
+	mag_sub_into(rtn->limbs, rtn->length, small->limbs, small->length);
+	rtn->sign = (cmp > 0) ? a->sign : sign;
+	return bignum_trim(rtn);
+}
+
+/**
+ * The length of a magnitude without its leading zero limbs
+ */
+size_t mag_trim(const uint64_t *a, size_t an) {
+	while (an > 0 && a[an - 1] == 0)
+		an -= 1;
+	return an;
+}
+
+/**
+ * Compares two trimmed magnitudes
+ */
+int mag_compare(const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+	size_t i;
+
+	if (an != bn)
+		return (an < bn) ? -1 : 1;
+
+	for (i = an; i > 0; --i) {
+		if (a[i - 1] != b[i - 1])
+			return (a[i - 1] < b[i - 1]) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Adds the magnitude a into the rn limbs at r, where an is at most rn, and returns the carry
+ * out of the top limb
+ */
+uint64_t mag_add_into(uint64_t *r, size_t rn, const uint64_t *a, size_t an) {
+	unsigned __int128 s;
+	uint64_t carry;
+	size_t i;
+
+	carry = 0;
+	for (i = 0; i < an; ++i) {
+		s = (unsigned __int128) r[i] + a[i] + carry;
+		r[i] = (uint64_t) s;
+		carry = (uint64_t) (s >> 64);
+	}
+	for (; carry != 0 && i < rn; ++i) {
+		r[i] += 1;
+		carry = (r[i] == 0) ? 1 : 0;
+	}
+
+	return carry;
+}
+
+/**
+ * Subtracts the magnitude a from the rn limbs at r, where an is at most rn, and returns the
+ * borrow out of the top limb, which is zero whenever a was no larger
+ */
+uint64_t mag_sub_into(uint64_t *r, size_t rn, const uint64_t *a, size_t an) {
+	unsigned __int128 d;
+	uint64_t borrow;
+	size_t i;
+
+	borrow = 0;
+	for (i = 0; i < an; ++i) {
+		d = (unsigned __int128) r[i] - a[i] - borrow;
+		r[i] = (uint64_t) d;
+		borrow = ((d >> 64) != 0) ? 1 : 0;
+	}
+	for (; borrow != 0 && i < rn; ++i) {
+		borrow = (r[i] == 0) ? 1 : 0;
+		r[i] -= 1;
+	}
+
+	return borrow;
+}
+
+/**
+ * Multiplies two magnitudes, writing all an + bn limbs of the product to r, which must not
+ * overlap either of them. A much longer operand is cut into pieces the size of the shorter one,
+ * so that Karatsuba's method always works on operands of about the same size.
+ */
+void mag_mul(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+	const uint64_t *t;
+	uint64_t *piece;
+	size_t chunk;
+	size_t i;
+
+	if (an < bn) {
+		t = a;
+		a = b;
+		b = t;
+		i = an;
+		an = bn;
+		bn = i;
+	}
+
+	if (bn < BIGNUM_KARATSUBA_LIMBS) {
+		mag_mul_school(r, a, an, b, bn);
+		return;
+	}
+
+	if (an < 2 * bn) {
+		mag_mul_karatsuba(r, a, an, b, bn);
+		return;
+	}
+
+	memset(r, 0, (an + bn) * sizeof(uint64_t));
+	piece = (uint64_t *) malloc(2 * bn * sizeof(uint64_t));
+	for (i = 0; i < an; i += bn) {
+		chunk = (an - i < bn) ? an - i : bn;
+		mag_mul(piece, a + i, chunk, b, bn);
+		mag_add_into(r + i, an + bn - i, piece, chunk + bn);
+	}
+	free(piece);
+}
+
+/**
+ * Multiplies two magnitudes one limb at a time, which is fastest while either is small
+ */
+void mag_mul_school(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+	unsigned __int128 p;
+	uint64_t carry;
+	size_t i;
+	size_t j;
+
+	memset(r, 0, (an + bn) * sizeof(uint64_t));
+	for (i = 0; i < an; ++i) {
+		carry = 0;
+		for (j = 0; j < bn; ++j) {
+			p = (unsigned __int128) a[i] * b[j] + r[i + j] + carry;
+			r[i + j] = (uint64_t) p;
+			carry = (uint64_t) (p >> 64);
+		}
+		r[i + bn] = carry;
+	}
+}
+
+/**
+ * Multiplies two magnitudes by Karatsuba's method, for bn <= an < 2*bn. With a = a1*W + a0 and
+ * b = b1*W + b0, where W is 2^64 to the power m, the product is z2*W^2 + z1*W + z0, where
+ * z0 = a0*b0, z2 = a1*b1, and z1 = (a0 + a1)*(b0 + b1) - z0 - z2. z0 and z2 are formed right
+ * where they belong in r, and z1 is then added in across the middle.
+ */
+void mag_mul_karatsuba(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+	uint64_t *sa;
+	uint64_t *sb;
+	uint64_t *z1;
+	size_t san;
+	size_t sbn;
+	size_t z1n;
+	size_t m;
+
+	m = an / 2;
+
+	mag_mul(r, a, m, b, m);
+	mag_mul(r + 2*m, a + m, an - m, b + m, bn - m);
+
+	// a0 + a1, where a1 is at least as long as a0, and b0 + b1, where either may be longer
+	san = an - m + 1;
+	sa = (uint64_t *) calloc(san, sizeof(uint64_t));
+	memcpy(sa, a + m, (an - m) * sizeof(uint64_t));
+	mag_add_into(sa, san, a, m);
+
+	sbn = ((bn - m > m) ? bn - m : m) + 1;
+	sb = (uint64_t *) calloc(sbn, sizeof(uint64_t));
+	memcpy(sb, b, m * sizeof(uint64_t));
+	mag_add_into(sb, sbn, b + m, bn - m);
+
+	san = mag_trim(sa, san);
+	sbn = mag_trim(sb, sbn);
+	z1n = san + sbn;
+	z1 = (uint64_t *) malloc(z1n * sizeof(uint64_t));
+	mag_mul(z1, sa, san, sb, sbn);
+
+	mag_sub_into(z1, z1n, r, mag_trim(r, 2*m));
+	mag_sub_into(z1, z1n, r + 2*m, mag_trim(r + 2*m, an + bn - 2*m));
+	mag_add_into(r + m, an + bn - m, z1, mag_trim(z1, z1n));
+
+	free(sa);
+	free(sb);
+	free(z1);
+}
+
+/**
+ * Divides the magnitude a by a single limb, writing the quotient to q, which may be a itself,
+ * and returning the remainder
+ */
+uint64_t mag_div_small(uint64_t *q, const uint64_t *a, size_t an, uint64_t d) {
+	unsigned __int128 cur;
+	uint64_t rem;
+	size_t i;
+
+	rem = 0;
+	for (i = an; i > 0; --i) {
+		cur = ((unsigned __int128) rem << 64) | a[i - 1];
+		q[i - 1] = (uint64_t) (cur / d);
+		rem = (uint64_t) (cur % d);
+	}
+
+	return rem;
+}
+
+/**
+ * Divides the trimmed magnitude a by the trimmed magnitude b, where an >= bn >= 1, by Knuth's
+ * algorithm D. q receives an - bn + 1 limbs and r receives bn limbs. Both operands are first
+ * shifted so that the top bit of b is set, which makes the estimate of each quotient limb from
+ * the top two limbs of the running remainder at most two too large.
+ */
+void mag_divmod(uint64_t *q, uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+	unsigned __int128 num;
+	unsigned __int128 qhat;
+	unsigned __int128 rhat;
+	unsigned __int128 p;
+	unsigned __int128 s;
+	__int128 t;
+	__int128 k;
+	uint64_t *u;
+	uint64_t *v;
+	uint64_t carry;
+	size_t i;
+	size_t j;
+	int shift;
+
+	if (bn == 1) {
+		r[0] = mag_div_small(q, a, an, b[0]);
+		return;
+	}
+
+	shift = __builtin_clzll(b[bn - 1]);
+	v = (uint64_t *) malloc(bn * sizeof(uint64_t));
+	u = (uint64_t *) malloc((an + 1) * sizeof(uint64_t));
+
+	for (i = bn - 1; i > 0; --i)
+		v[i] = (b[i] << shift) | (shift ? b[i - 1] >> (64 - shift) : 0);
+	v[0] = b[0] << shift;
+
+	u[an] = shift ? a[an - 1] >> (64 - shift) : 0;
+	for (i = an - 1; i > 0; --i)
+		u[i] = (a[i] << shift) | (shift ? a[i - 1] >> (64 - shift) : 0);
+	u[0] = a[0] << shift;
+
+	for (j = an - bn + 1; j > 0; --j) {
+		// Estimate the quotient limb, and correct the estimate with the next limb of v
+		num = ((unsigned __int128) u[j - 1 + bn] << 64) | u[j - 2 + bn];
+		qhat = num / v[bn - 1];
+		rhat = num % v[bn - 1];
+		while ((qhat >> 64) != 0 || qhat * v[bn - 2] > ((rhat << 64) | u[j - 3 + bn])) {
+			qhat -= 1;
+			rhat += v[bn - 1];
+			if ((rhat >> 64) != 0)
+				break;
+		}
+
+		// Multiply and subtract
+		k = 0;
+		for (i = 0; i < bn; ++i) {
+			p = qhat * v[i];
+			t = (__int128) u[i + j - 1] - k - (__int128) (uint64_t) p;
+			u[i + j - 1] = (uint64_t) t;
+			k = (__int128) (uint64_t) (p >> 64) - (t >> 64);
+		}
+		t = (__int128) u[j - 1 + bn] - k;
+		u[j - 1 + bn] = (uint64_t) t;
+
+		// The estimate was one too large, so add v back
+		q[j - 1] = (uint64_t) qhat;
+		if (t < 0) {
+			q[j - 1] -= 1;
+			carry = 0;
+			for (i = 0; i < bn; ++i) {
+				s = (unsigned __int128) u[i + j - 1] + v[i] + carry;
+				u[i + j - 1] = (uint64_t) s;
+				carry = (uint64_t) (s >> 64);
+			}
+			u[j - 1 + bn] += carry;
+		}
+	}
+
+	// Shift the remainder back down
+	for (i = 0; i < bn - 1; ++i)
+		r[i] = (u[i] >> shift) | (shift ? u[i + 1] << (64 - shift) : 0);
+	r[bn - 1] = u[bn - 1] >> shift;
+
+	free(u);
+	free(v);
+}
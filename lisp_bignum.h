@@ -0,0 +1,70 @@
+#ifndef _LISP_BIGNUM_H_
+#define _LISP_BIGNUM_H_
+/**
+ * Arbitrary precision integers, which fixnum arithmetic is promoted to when it overflows. A
+ * bignum is a sign and a magnitude stored as an array of 64-bit limbs, least significant first,
+ * with no leading zero limbs. Magnitudes are multiplied by schoolbook multiplication when either
+ * is small, and otherwise by Karatsuba's method, which splits each operand in two and gets by
+ * with three half sized products instead of four. Division is Knuth's algorithm D.
+ *
+ * These functions always return newly allocated bignums and never keep their arguments, so the
+ * caller owns both. They know nothing of fixnums; lisp_number.c decides which representation a
+ * value gets.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stddef.h>
+
+// Operands with fewer limbs than this are multiplied by schoolbook multiplication
+#define BIGNUM_KARATSUBA_LIMBS	32
+
+// The largest power of ten that fits in a limb, used to convert to and from decimal
+#define BIGNUM_DECIMAL_BASE		10000000000000000000ULL
+#define BIGNUM_DECIMAL_DIGITS	19
+
+/**
+ * A signed integer of any size. Zero has no limbs and a sign of 1.
+ */
+struct lisp_bignum {
+	int sign;
+	uint32_t length;
+	uint64_t limbs[];
+};
+
+// Making bignums
+struct lisp_bignum *bignum_alloc(size_t length);
+struct lisp_bignum *bignum_from_int(int64_t val);
+struct lisp_bignum *bignum_copy(struct lisp_bignum *b);
+struct lisp_bignum *bignum_parse(const char *text);
+
+// Arithmetic
+struct lisp_bignum *bignum_add(struct lisp_bignum *a, struct lisp_bignum *b);
+struct lisp_bignum *bignum_sub(struct lisp_bignum *a, struct lisp_bignum *b);
+struct lisp_bignum *bignum_mul(struct lisp_bignum *a, struct lisp_bignum *b);
+void bignum_divmod(struct lisp_bignum *a, struct lisp_bignum *b, struct lisp_bignum **quotient, struct lisp_bignum **remainder);
+struct lisp_bignum *bignum_gcd(struct lisp_bignum *a, struct lisp_bignum *b);
+struct lisp_bignum *bignum_negate(struct lisp_bignum *b);
+
+// Queries and conversions
+int bignum_compare(struct lisp_bignum *a, struct lisp_bignum *b);
+int bignum_is_zero(struct lisp_bignum *b);
+int bignum_to_int(struct lisp_bignum *b, int64_t *val);
+double bignum_to_double(struct lisp_bignum *b);
+char *bignum_to_string(struct lisp_bignum *b);
+uint64_t bignum_hash(struct lisp_bignum *b);
+
+// Operations on magnitudes, used internally
+struct lisp_bignum *bignum_trim(struct lisp_bignum *b);
+struct lisp_bignum *bignum_add_signed(struct lisp_bignum *a, struct lisp_bignum *b, int bSign);
+size_t mag_trim(const uint64_t *a, size_t an);
+int mag_compare(const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+uint64_t mag_add_into(uint64_t *r, size_t rn, const uint64_t *a, size_t an);
+uint64_t mag_sub_into(uint64_t *r, size_t rn, const uint64_t *a, size_t an);
+void mag_mul(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+void mag_mul_school(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+void mag_mul_karatsuba(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+uint64_t mag_div_small(uint64_t *q, const uint64_t *a, size_t an, uint64_t d);
+void mag_divmod(uint64_t *q, uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+
+#endif
@@ -0,0 +1,916 @@
+/**
+ * Ahead-of-time compilation. A file of definitions is translated into C, in which each function
+ * defined with a lambda or label form becomes a C function that calls the primitives directly,
+ * and the result is built into a shared object with gcc. Loading the library binds every
+ * compiled function in the environment as a native, so interpreted code calls compiled code
+ * through the usual FLAG_FUNCTION path, and compiled code calls anything it doesn't know about
+ * through call_value(). Calls between functions compiled together are direct C calls, and a
+ * function that calls itself in tail position loops instead.
+ *
+ * The parameters of a compiled function are C variables, so unlike in the interpreter they are
+ * only visible to the function's own body, and not to the functions it calls. Free variables
+ * are looked up in the global environment. Every other top-level form in the file, and any
+ * form in a body that the compiler doesn't handle itself, is kept as data and evaluated by the
+ * interpreter instead.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_api.h"
+#include "lisp_compile.h"
+#include "lisp_parser.h"
+
+/**
+ * The primitives that compiled code calls directly, rather than looking them up at runtime
+ */
+struct aot_primitive_call {
+	const char *name;
+	int arity;
+	const char *call;
+};
+
+struct aot_primitive_call aot_primitives[] = {
+	{"cons", 2, "_cons"},
+	{"car", 1, "_car"},
+	{"cdr", 1, "_cdr"},
+	{"eq?", 2, "_eq"},
+	{"atom?", 1, "_atom"},
+	{"string-length", 1, "_string_length"},
+	{"string=?", 2, "_string_eq"},
+	{"+", 2, "_add"},
+	{"-", 2, "_sub"},
+	{"*", 2, "_mul"},
+	{"/", 2, "_div"},
+	{"<", 2, "_lt"},
+	{">", 2, "_gt"},
+	{"=", 2, "_num_eq"},
+	{0, 0, 0}
+};
+
+/**
+ * Translates the definitions read from in into C, and builds them into the shared object named
+ * by output. The C source is left next to it, in output with .c appended. Returns 0 on success.
+ */
+int aot_compile(FILE *in, const char *output, struct lisp_env *env) {
+	struct aot_unit unit;
+	struct aot_function *fn;
+	struct aot_function **tail;
+	struct s_list *forms;
+	struct s_list *cur;
+	struct s_exp *exp;
+	char *code;
+	char *program;
+	char *source;
+	char *command;
+	size_t codeSize;
+	size_t programSize;
+	FILE *out;
+	int status;
+	int count;
+
+	memset(&unit, 0, sizeof(struct aot_unit));
+	count = 0;
+	unit.env = env;
+	unit.program = open_memstream(&program, &programSize);
+	tail = &unit.functions;
+
+	// First find every function the file defines, so that calls to them can be direct, and record
+	// what the library needs to do with each top-level form when it is loaded
+	forms = lisp_parse_file(in);
+	for (cur = forms; cur != 0; cur = cur->next) {
+		exp = cur->exp;
+		fn = aot_function_form(exp);
+
+		if (fn != 0) {
+			fn->id = count++;
+			*tail = fn;
+			tail = &fn->next;
+			fprintf(unit.program, "\tdefine_label(");
+			aot_emit_cstring(unit.program, fn->name->lisp_car.label, strlen(fn->name->lisp_car.label));
+			fprintf(unit.program, ", aot_natives[%d], env);\n", fn->id);
+			continue;
+		}
+
+		// Macros are defined here too, so that calls to them in compiled bodies are recognized
+		if (!IS_ATOM(exp) && IS_SYMBOL(exp->lisp_car.car) && c_lisp_eq(exp->lisp_car.car, lisp_defmacro) == 1)
+			define_macro(exp->lisp_cdr.cdr, env);
+
+		fprintf(unit.program, "\teval(aot_form[%d], env);\n", aot_table_add(&unit.forms, exp));
+	}
+	fclose(unit.program);
+
+	// Then compile each function
+	unit.code = open_memstream(&code, &codeSize);
+	for (fn = unit.functions; fn != 0; fn = fn->next) {
+		aot_emit_function(&unit, fn);
+	}
+	fclose(unit.code);
+
+	// Write out the whole library
+	source = (char *) malloc(strlen(output) + 3);
+	sprintf(source, "%s.c", output);
+	out = fopen(source, "w");
+	if (out == NULL) {
+		lisp_error("Unable to write compiled source to %s\n", source);
+		free(source);
+		return 1;
+	}
+
+	fprintf(out, "/**\n * Compiled lisp, generated automatically\n */\n\n");
+	fprintf(out, "#include \"lisp.h\"\n#include \"lisp_api.h\"\n#include \"lisp_compile.h\"\n\n");
+	fprintf(out, "static struct lisp_env *aot_env;\n");
+	fprintf(out, "static struct s_exp *aot_natives[%d];\n", count + 1);
+	fprintf(out, "static struct s_exp *aot_const[%d];\n", unit.constants.count + 1);
+	fprintf(out, "static struct s_exp *aot_global[%d];\n", unit.globals.count + 1);
+	fprintf(out, "static struct s_exp *aot_form[%d];\n\n", unit.forms.count + 1);
+
+	// Compiled functions may call each other in any order
+	for (fn = unit.functions; fn != 0; fn = fn->next) {
+		aot_emit_signature(out, fn);
+		fprintf(out, ";\n");
+	}
+	fprintf(out, "\n");
+	fputs(code, out);
+	aot_emit_init(&unit, out, program);
+	fclose(out);
+	free(code);
+	free(program);
+
+	// And build it
+	command = (char *) malloc(2*strlen(output) + strlen(LISP_INCLUDE_DIR) + 64);
+	sprintf(command, "gcc -shared -fPIC -O2 -I'%s' -o '%s' '%s'", LISP_INCLUDE_DIR, output, source);
+	status = system(command);
+	if (status != 0)
+		lisp_error("Compilation of %s failed: %s\n", source, command);
+
+	free(command);
+	free(source);
+	return (status == 0) ? 0 : 1;
+}
+
+/**
+ * Loads a compiled library, binding everything it defines in env. Returns 0 on success.
+ */
+int aot_load(const char *path, struct lisp_env *env) {
+	void *library;
+	void (*init)(struct lisp_env *);
+
+	library = dlopen(path, RTLD_NOW);
+	if (library == 0) {
+		lisp_error("Unable to load compiled library: %s\n", dlerror());
+		return 1;
+	}
+
+	init = (void (*)(struct lisp_env *)) dlsym(library, AOT_INIT_NAME);
+	if (init == 0) {
+		lisp_error("%s is not a compiled lisp library\n", path);
+		dlclose(library);
+		return 1;
+	}
+
+	init(env);
+	return 0;
+}
+
+/**
+ * Creates a fresh symbol cell, which compiled code uses as the call site for global lookups
+ */
+struct s_exp *aot_symbol(const char *label) {
+	struct s_exp *rtn;
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_SYMBOL;
+	rtn->lisp_car.label = strdup(label);
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Creates a string atom holding a copy of buf
+ */
+struct s_exp *aot_string(const char *buf, size_t length) {
+	char *copy;
+
+	copy = (char *) malloc(length + 1);
+	memcpy(copy, buf, length);
+	copy[length] = '\0';
+	return make_string(copy, length);
+}
+
+/**
+ * Creates an exact number atom from its decimal text, for bignums and ratios
+ */
+struct s_exp *aot_number(const char *text) {
+	struct s_exp *rtn;
+
+	rtn = find_free_s_exp();
+	rtn->lisp_cdr.cdr = 0;
+	number_parse(text, rtn);
+	return rtn;
+}
+
+/**
+ * Wraps a compiled function in a native. Functions of up to three arguments are called through
+ * the matching fixed entry point, and larger ones through an array wrapper.
+ */
+struct s_exp *aot_native(const char *name, int arity, void *entry) {
+	struct s_exp *rtn;
+	struct lisp_native *native;
+
+	rtn = make_native(name, arity, 0, 0);
+	native = rtn->lisp_car.native;
+
+	switch (arity) {
+		case 0: native->fn0 = (struct s_exp *(*)(void)) entry; break;
+		case 1: native->fn1 = (struct s_exp *(*)(struct s_exp *)) entry; break;
+		case 2: native->fn2 = (struct s_exp *(*)(struct s_exp *, struct s_exp *)) entry; break;
+		case 3: native->fn3 = (struct s_exp *(*)(struct s_exp *, struct s_exp *, struct s_exp *)) entry; break;
+		default: native->fn = (lisp_native_fn) entry; break;
+	}
+
+	return rtn;
+}
+
+/**
+ * Evaluates a form that compiled code left to the interpreter, with the compiled function's
+ * parameters bound to their current values
+ */
+struct s_exp *aot_eval(struct s_exp *form, struct lisp_env *env, char **names, struct s_exp **values, int count) {
+	struct lisp_env *frame;
+	struct s_exp *rtn;
+	int i;
+
+	frame = frame_acquire(env);
+	for (i = count-1; i >= 0; --i) {
+		define_label(names[i], values[i], frame);
+	}
+
+	rtn = eval(form, frame);
+	frame_release(frame);
+	return rtn;
+}
+
+/**
+ * Adds an expression to a table, returning its index. An expression that is already there
+ * keeps the index it has.
+ */
+int aot_table_add(struct aot_table *table, struct s_exp *exp) {
+	int i;
+
+	for (i = 0; i < table->count; ++i) {
+		if (table->items[i] == exp)
+			return i;
+	}
+
+	if (table->count == table->size) {
+		table->size = (table->size == 0) ? 16 : 2*table->size;
+		table->items = (struct s_exp **) realloc(table->items, table->size * sizeof(struct s_exp *));
+	}
+
+	table->items[table->count] = exp;
+	return table->count++;
+}
+
+/**
+ * Finds the slot for looking up a global by name, sharing one slot among all references to it
+ */
+int aot_global_index(struct aot_unit *unit, struct s_exp *symbol) {
+	int i;
+
+	for (i = 0; i < unit->globals.count; ++i) {
+		if (strcmp(unit->globals.items[i]->lisp_car.label, symbol->lisp_car.label) == 0)
+			return i;
+	}
+
+	return aot_table_add(&unit->globals, symbol);
+}
+
+/**
+ * Returns the position of symbol among the parameters of fn, or -1 if it is not one of them
+ */
+int aot_param_index(struct aot_function *fn, struct s_exp *symbol) {
+	struct s_exp *cur;
+	int i;
+
+	for (cur = fn->params, i = 0; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr, ++i) {
+		if (strcmp(cur->lisp_car.car->lisp_car.label, symbol->lisp_car.label) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * Checks if head names the special form, and isn't a parameter that hides it
+ */
+int aot_is_form(struct aot_function *fn, struct s_exp *head, struct s_exp *form) {
+	if (!IS_SYMBOL(head) || c_lisp_eq(head, form) != 1)
+		return 0;
+
+	return (aot_param_index(fn, head) < 0) ? 1 : 0;
+}
+
+/**
+ * Checks if head names a macro, which can't be compiled because it needs to see its code
+ */
+int aot_is_macro(struct aot_unit *unit, struct aot_function *fn, struct s_exp *head) {
+	struct s_exp *value;
+
+	if (!IS_SYMBOL(head) || aot_param_index(fn, head) >= 0)
+		return 0;
+
+	value = lookup_label(head->lisp_car.label, unit->env);
+
+	return IS_MACRO(value) ? 1 : 0;
+}
+
+/**
+ * Finds the compiled function that a call with head refers to, if any
+ */
+struct aot_function *aot_callee(struct aot_unit *unit, struct aot_function *fn, struct s_exp *head) {
+	struct aot_function *cur;
+
+	if (!IS_SYMBOL(head) || aot_param_index(fn, head) >= 0)
+		return 0;
+
+	if (strcmp(fn->self->lisp_car.label, head->lisp_car.label) == 0)
+		return fn;
+
+	for (cur = unit->functions; cur != 0; cur = cur->next) {
+		if (strcmp(cur->name->lisp_car.label, head->lisp_car.label) == 0)
+			return cur;
+	}
+
+	return 0;
+}
+
+/**
+ * Returns the C function to call for a primitive applied to argc arguments, or 0 if head does
+ * not name a primitive that compiled code can call directly
+ */
+const char *aot_primitive(struct aot_unit *unit, struct aot_function *fn, struct s_exp *head, int argc) {
+	int i;
+
+	if (!IS_SYMBOL(head) || aot_param_index(fn, head) >= 0 || aot_callee(unit, fn, head) != 0)
+		return 0;
+
+	for (i = 0; aot_primitives[i].name != 0; ++i) {
+		if (strcmp(aot_primitives[i].name, head->lisp_car.label) == 0 && aot_primitives[i].arity == argc)
+			return aot_primitives[i].call;
+	}
+
+	return 0;
+}
+
+/**
+ * Recognizes the top-level forms that define compilable functions:
+ *
+ *   (define name (lambda (params) body))
+ *   (define name (label self (lambda (params) body)))
+ *   (label name (lambda (params) body))
+ *
+ * and returns a description of the function, or 0 if exp is anything else
+ */
+struct aot_function *aot_function_form(struct s_exp *exp) {
+	struct aot_function *fn;
+	struct s_exp *name;
+	struct s_exp *self;
+	struct s_exp *lambda;
+	struct s_exp *cur;
+	int arity;
+
+	if (IS_ATOM(exp) || !IS_SYMBOL(exp->lisp_car.car))
+		return 0;
+
+	if (c_lisp_eq(exp->lisp_car.car, lisp_define) != 1 && c_lisp_eq(exp->lisp_car.car, lisp_label) != 1)
+		return 0;
+
+	name = _car(_cdr(exp));
+	lambda = _car(_cdr(_cdr(exp)));
+	self = name;
+	if (!IS_SYMBOL(name) || IS_ATOM(lambda) || !IS_NIL(_cdr(_cdr(_cdr(exp)))))
+		return 0;
+
+	// A label inside a define gives the function a second name for itself
+	if (c_lisp_eq(exp->lisp_car.car, lisp_define) == 1 && IS_SYMBOL(lambda->lisp_car.car) && c_lisp_eq(lambda->lisp_car.car, lisp_label) == 1) {
+		self = _car(_cdr(lambda));
+		lambda = _car(_cdr(_cdr(lambda)));
+		if (!IS_SYMBOL(self) || IS_ATOM(lambda))
+			return 0;
+	}
+
+	if (!IS_SYMBOL(lambda->lisp_car.car) || c_lisp_eq(lambda->lisp_car.car, lisp_lambda) != 1)
+		return 0;
+
+	// The parameters have to be a proper list of symbols, and the body a single expression
+	arity = 0;
+	for (cur = _car(_cdr(lambda)); !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		if (!IS_SYMBOL(cur->lisp_car.car) || IS_NIL(cur->lisp_car.car))
+			return 0;
+		arity += 1;
+	}
+	if (!IS_NIL(cur) || IS_ATOM(_cdr(_cdr(lambda))) || !IS_NIL(_cdr(_cdr(_cdr(lambda)))))
+		return 0;
+
+	// Parameters live in C variables, where a set! run by the interpreter can't change them
+	if (form_assigns(_car(_cdr(_cdr(lambda))), _car(_cdr(lambda))))
+		return 0;
+
+	fn = (struct aot_function *) calloc(1, sizeof(struct aot_function));
+	fn->name = name;
+	fn->self = self;
+	fn->params = _car(_cdr(lambda));
+	fn->body = _car(_cdr(_cdr(lambda)));
+	fn->arity = arity;
+	return fn;
+}
+
+/**
+ * Indents the current line of the function body to the current block depth
+ */
+void aot_indent(struct aot_unit *unit) {
+	int i;
+
+	for (i = 0; i < unit->depth; ++i) {
+		fputc('\t', unit->out);
+	}
+}
+
+/**
+ * Writes a C string literal with the given contents, escaping anything that isn't printable
+ */
+void aot_emit_cstring(FILE *out, const char *buf, size_t length) {
+	size_t i;
+
+	fputc('"', out);
+	for (i = 0; i < length; ++i) {
+		if (buf[i] == '"' || buf[i] == '\\')
+			fprintf(out, "\\%c", buf[i]);
+		else if (buf[i] >= ' ' && buf[i] <= '~' && buf[i] != '?')
+			fputc(buf[i], out);
+		else
+			fprintf(out, "\\%03o", (unsigned char) buf[i]);
+	}
+	fputc('"', out);
+}
+
+/**
+ * Writes a C expression that builds a copy of a datum when the library is loaded. Constant
+ * cells are interned again, so that they are shared with any identical interpreted constants.
+ */
+void aot_emit_datum(FILE *out, struct s_exp *exp) {
+	char *text;
+
+	if (!IS_ATOM(exp)) {
+		fprintf(out, "_cons(");
+		aot_emit_datum(out, exp->lisp_car.car);
+		fprintf(out, ", ");
+		aot_emit_datum(out, exp->lisp_cdr.cdr);
+		fprintf(out, ")");
+	}
+	else if (IS_NIL(exp)) {
+		fprintf(out, "lisp_nil");
+	}
+	else if (IS_SYMBOL(exp)) {
+		fprintf(out, "aot_symbol(");
+		aot_emit_cstring(out, exp->lisp_car.label, strlen(exp->lisp_car.label));
+		fprintf(out, ")");
+	}
+	else if (IS_STRING(exp)) {
+		fprintf(out, "aot_string(");
+		aot_emit_cstring(out, string_flatten(exp), exp->lisp_cdr.length);
+		fprintf(out, ", %" PRIu64 ")", exp->lisp_cdr.length);
+	}
+	else if (IS_INT(exp)) {
+		fprintf(out, "make_int((int64_t) %" PRIu64 "ULL)", exp->lisp_car.uiVal);
+	}
+	else if (IS_FLOAT(exp)) {
+		fprintf(out, "make_float(%a)", exp->lisp_car.dVal);
+	}
+	else if (IS_BIGNUM(exp) || IS_RATIO(exp)) {
+		text = number_to_string(exp);
+		fprintf(out, "aot_number(");
+		aot_emit_cstring(out, text, strlen(text));
+		fprintf(out, ")");
+		free(text);
+	}
+	else if (IS_BOOL(exp)) {
+		fprintf(out, (exp->lisp_car.uiVal != 0) ? "lisp_true" : "lisp_false");
+	}
+	else if (IS_CONSTANT(exp)) {
+		fprintf(out, "intern_constant(");
+		aot_emit_datum(out, exp->lisp_car.car);
+		fprintf(out, ")");
+	}
+	else {
+		if (!IS_UNDEFINED(exp))
+			lisp_error("Unable to compile a reference to a native or macro value\n");
+		fprintf(out, "lisp_undefined");
+	}
+}
+
+/**
+ * Compiles an expression whose value is needed, emitting statements that leave the value in
+ * a new temporary. Returns the number of the temporary.
+ */
+int aot_expr(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp) {
+	struct s_exp *head;
+	int index;
+	int t;
+
+	if (IS_ATOM(exp)) {
+		t = unit->temps++;
+		aot_indent(unit);
+
+		if (!IS_SYMBOL(exp)) {
+			fprintf(unit->out, "struct s_exp *t%d = aot_const[%d];\n", t, aot_table_add(&unit->constants, exp));
+		}
+		else if ((index = aot_param_index(fn, exp)) >= 0) {
+			fprintf(unit->out, "struct s_exp *t%d = a%d;\n", t, index);
+		}
+		else if (strcmp(exp->lisp_car.label, fn->self->lisp_car.label) == 0) {
+			fprintf(unit->out, "struct s_exp *t%d = aot_natives[%d];\n", t, fn->id);
+		}
+		else if (IS_NIL(exp) || strcmp(exp->lisp_car.label, "nil") == 0) {
+			fprintf(unit->out, "struct s_exp *t%d = lisp_nil;\n", t);
+		}
+		else if (strcmp(exp->lisp_car.label, "#t") == 0) {
+			fprintf(unit->out, "struct s_exp *t%d = lisp_true;\n", t);
+		}
+		else if (strcmp(exp->lisp_car.label, "#f") == 0) {
+			fprintf(unit->out, "struct s_exp *t%d = lisp_false;\n", t);
+		}
+		else {
+			fprintf(unit->out, "struct s_exp *t%d = lookup_symbol(aot_global[%d], aot_env);\n", t, aot_global_index(unit, exp));
+		}
+
+		return t;
+	}
+
+	head = exp->lisp_car.car;
+
+	if (aot_is_form(fn, head, lisp_quote)) {
+		t = unit->temps++;
+		aot_indent(unit);
+		fprintf(unit->out, "struct s_exp *t%d = aot_const[%d];\n", t, aot_table_add(&unit->constants, intern_constant(_car(_cdr(exp)))));
+		return t;
+	}
+	else if (aot_is_form(fn, head, lisp_cond)) {
+		return aot_cond(unit, fn, exp, 0);
+	}
+	else if (aot_is_form(fn, head, lisp_lambda) || aot_is_form(fn, head, lisp_label) || aot_is_form(fn, head, lisp_memo)) {
+		// Function forms evaluate to themselves, and are run by the interpreter when called
+		t = unit->temps++;
+		aot_indent(unit);
+		fprintf(unit->out, "struct s_exp *t%d = aot_const[%d]->lisp_car.car;\n", t, aot_table_add(&unit->constants, intern_constant(exp)));
+		return t;
+	}
+	else if (aot_is_form(fn, head, lisp_define) || aot_is_form(fn, head, lisp_define_memo)
+			|| aot_is_form(fn, head, lisp_defmacro) || aot_is_form(fn, head, lisp_delay)
+			|| aot_is_form(fn, head, lisp_stream_cons) || aot_is_form(fn, head, lisp_catch)
+			|| aot_is_form(fn, head, lisp_set)
+			|| aot_is_macro(unit, fn, head)) {
+		return aot_fallback(unit, fn, exp);
+	}
+
+	return aot_call(unit, fn, exp, 0);
+}
+
+/**
+ * Compiles an expression in tail position, whose value is returned from the function
+ */
+void aot_tail(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp) {
+	int t;
+
+	if (!IS_ATOM(exp) && aot_is_form(fn, exp->lisp_car.car, lisp_cond)) {
+		t = aot_cond(unit, fn, exp, 1);
+	}
+	else if (!IS_ATOM(exp) && aot_callee(unit, fn, exp->lisp_car.car) == fn) {
+		t = aot_call(unit, fn, exp, 1);
+	}
+	else {
+		t = aot_expr(unit, fn, exp);
+	}
+
+	if (t >= 0) {
+		aot_indent(unit);
+		fprintf(unit->out, "return t%d;\n", t);
+	}
+}
+
+/**
+ * Compiles a cond form into a chain of if statements. In tail position, each branch returns
+ * its own value and -1 is returned, and otherwise the number of the temporary holding the value
+ * of whichever branch ran is returned.
+ */
+int aot_cond(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp, int tail) {
+	struct s_exp *clause;
+	struct s_exp *test;
+	struct s_exp *cur;
+	int result;
+	int opened;
+	int a;
+	int b;
+	int t;
+
+	// Malformed clauses are left to the interpreter to report
+	for (cur = exp->lisp_cdr.cdr; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		clause = cur->lisp_car.car;
+		if (IS_ATOM(clause) || IS_ATOM(clause->lisp_cdr.cdr)) {
+			t = aot_fallback(unit, fn, exp);
+			if (!tail)
+				return t;
+			aot_indent(unit);
+			fprintf(unit->out, "return t%d;\n", t);
+			return -1;
+		}
+	}
+
+	result = -1;
+	if (!tail) {
+		result = unit->temps++;
+		aot_indent(unit);
+		fprintf(unit->out, "struct s_exp *t%d = lisp_undefined;\n", result);
+	}
+
+	opened = 0;
+	for (cur = exp->lisp_cdr.cdr; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		clause = cur->lisp_car.car;
+		test = clause->lisp_car.car;
+
+		// A literal #t always matches, so its branch needs no test and ends the chain
+		if (IS_SYMBOL(test) && strcmp(test->lisp_car.label, "#t") == 0 && aot_param_index(fn, test) < 0) {
+			if (tail)
+				aot_tail(unit, fn, _car(clause->lisp_cdr.cdr));
+			else {
+				t = aot_expr(unit, fn, _car(clause->lisp_cdr.cdr));
+				aot_indent(unit);
+				fprintf(unit->out, "t%d = t%d;\n", result, t);
+			}
+			break;
+		}
+
+		// Comparisons are tested in C, without going through a boolean value
+		if (!IS_ATOM(test) && aot_primitive(unit, fn, test->lisp_car.car, 2) != 0 && strcmp(test->lisp_car.car->lisp_car.label, "eq?") == 0) {
+			a = aot_expr(unit, fn, _car(_cdr(test)));
+			b = aot_expr(unit, fn, _car(_cdr(_cdr(test))));
+			aot_indent(unit);
+			fprintf(unit->out, "if (c_lisp_eq(t%d, t%d) == 1) {\n", a, b);
+		}
+		else {
+			t = aot_expr(unit, fn, test);
+			aot_indent(unit);
+			fprintf(unit->out, "if (c_lisp_eq(t%d, lisp_true) == 1) {\n", t);
+		}
+
+		unit->depth += 1;
+		if (tail)
+			aot_tail(unit, fn, _car(clause->lisp_cdr.cdr));
+		else {
+			t = aot_expr(unit, fn, _car(clause->lisp_cdr.cdr));
+			aot_indent(unit);
+			fprintf(unit->out, "t%d = t%d;\n", result, t);
+		}
+		unit->depth -= 1;
+
+		aot_indent(unit);
+		fprintf(unit->out, "}\n");
+		aot_indent(unit);
+		fprintf(unit->out, "else {\n");
+		unit->depth += 1;
+		opened += 1;
+
+		// With no clauses left, the cond has no value
+		if (IS_ATOM(cur->lisp_cdr.cdr) && tail) {
+			aot_indent(unit);
+			fprintf(unit->out, "return lisp_undefined;\n");
+		}
+	}
+
+	for (; opened > 0; --opened) {
+		unit->depth -= 1;
+		aot_indent(unit);
+		fprintf(unit->out, "}\n");
+	}
+
+	return result;
+}
+
+/**
+ * Compiles a function call. The arguments are evaluated from left to right, as they are in
+ * the interpreter. A call from fn to itself in tail position reassigns the parameters and
+ * jumps back to the top of the function, returning -1.
+ */
+int aot_call(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp, int tail) {
+	struct aot_function *callee;
+	struct s_exp *head;
+	struct s_exp *cur;
+	const char *primitive;
+	int *args;
+	int argc;
+	int function;
+	int i;
+	int t;
+
+	head = exp->lisp_car.car;
+	argc = 0;
+	for (cur = exp->lisp_cdr.cdr; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		argc += 1;
+	}
+	if (!IS_NIL(cur))
+		return aot_fallback(unit, fn, exp);
+
+	callee = aot_callee(unit, fn, head);
+	if (callee != 0 && callee->arity != argc)
+		callee = 0;
+	primitive = aot_primitive(unit, fn, head, argc);
+
+	// Anything else is looked up before its arguments are evaluated, just like in eval()
+	function = -1;
+	if (callee == 0 && primitive == 0)
+		function = aot_expr(unit, fn, head);
+
+	args = (int *) malloc((argc + 1) * sizeof(int));
+	for (cur = exp->lisp_cdr.cdr, i = 0; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr, ++i) {
+		args[i] = aot_expr(unit, fn, cur->lisp_car.car);
+	}
+
+	if (tail && callee == fn) {
+		for (i = 0; i < argc; ++i) {
+			aot_indent(unit);
+			fprintf(unit->out, "a%d = t%d;\n", i, args[i]);
+		}
+		aot_indent(unit);
+		fprintf(unit->out, "goto aot_top;\n");
+		unit->loops = 1;
+		free(args);
+		return -1;
+	}
+
+	t = unit->temps++;
+	aot_indent(unit);
+	if (primitive != 0)
+		fprintf(unit->out, "struct s_exp *t%d = %s(", t, primitive);
+	else if (callee != 0)
+		fprintf(unit->out, "struct s_exp *t%d = aot_fn_%d(", t, callee->id);
+	else if (argc == 0)
+		fprintf(unit->out, "struct s_exp *t%d = call_value(t%d, 0, 0", t, function);
+	else
+		fprintf(unit->out, "struct s_exp *t%d = call_value(t%d, (struct s_exp *[]) {", t, function);
+
+	for (i = 0; i < argc; ++i) {
+		fprintf(unit->out, (i == 0) ? "t%d" : ", t%d", args[i]);
+	}
+
+	if (function >= 0 && argc > 0)
+		fprintf(unit->out, "}, %d", argc);
+	if (function >= 0)
+		fprintf(unit->out, ", aot_env");
+	fprintf(unit->out, ");\n");
+
+	free(args);
+	return t;
+}
+
+/**
+ * Leaves an expression to the interpreter, which evaluates it with the parameters of fn bound
+ */
+int aot_fallback(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp) {
+	struct s_exp *cur;
+	int t;
+	int i;
+
+	t = unit->temps++;
+	aot_indent(unit);
+	fprintf(unit->out, "struct s_exp *t%d = aot_eval(aot_form[%d], aot_env, ", t, aot_table_add(&unit->forms, exp));
+
+	if (fn->arity == 0) {
+		fprintf(unit->out, "0, 0, 0);\n");
+		return t;
+	}
+
+	fprintf(unit->out, "(char *[]) {");
+	for (cur = fn->params, i = 0; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr, ++i) {
+		if (i > 0)
+			fprintf(unit->out, ", ");
+		aot_emit_cstring(unit->out, cur->lisp_car.car->lisp_car.label, strlen(cur->lisp_car.car->lisp_car.label));
+	}
+
+	fprintf(unit->out, "}, (struct s_exp *[]) {");
+	for (i = 0; i < fn->arity; ++i) {
+		fprintf(unit->out, (i == 0) ? "a%d" : ", a%d", i);
+	}
+	fprintf(unit->out, "}, %d);\n", fn->arity);
+
+	return t;
+}
+
+/**
+ * Writes the C declaration of a compiled function, which takes each parameter as an argument
+ */
+void aot_emit_signature(FILE *out, struct aot_function *fn) {
+	int i;
+
+	fprintf(out, "static struct s_exp *aot_fn_%d(", fn->id);
+	if (fn->arity == 0)
+		fprintf(out, "void");
+	for (i = 0; i < fn->arity; ++i) {
+		fprintf(out, (i == 0) ? "struct s_exp *a%d" : ", struct s_exp *a%d", i);
+	}
+	fprintf(out, ")");
+}
+
+/**
+ * Compiles one function, along with an array entry point if it takes more than three arguments
+ */
+void aot_emit_function(struct aot_unit *unit, struct aot_function *fn) {
+	char *body;
+	size_t bodySize;
+	int i;
+
+	unit->out = open_memstream(&body, &bodySize);
+	unit->temps = 0;
+	unit->depth = 1;
+	unit->loops = 0;
+	aot_tail(unit, fn, fn->body);
+	fclose(unit->out);
+
+	fprintf(unit->code, "// %s\n", fn->name->lisp_car.label);
+	aot_emit_signature(unit->code, fn);
+	fprintf(unit->code, " {\n");
+
+	if (unit->loops)
+		fprintf(unit->code, "aot_top: ;\n");
+	fprintf(unit->code, "\tLISP_STEP();\n");
+	fputs(body, unit->code);
+	fprintf(unit->code, "}\n\n");
+	free(body);
+
+	if (fn->arity <= 3)
+		return;
+
+	fprintf(unit->code, "static struct s_exp *aot_entry_%d(struct s_exp **argv, int argc, void *data) {\n", fn->id);
+	fprintf(unit->code, "\treturn aot_fn_%d(", fn->id);
+	for (i = 0; i < fn->arity; ++i) {
+		fprintf(unit->code, (i == 0) ? "argv[%d]" : ", argv[%d]", i);
+	}
+	fprintf(unit->code, ");\n}\n\n");
+}
+
+/**
+ * Writes the library's entry point, which builds the data the compiled code uses and then
+ * replays the file's top-level forms in order
+ */
+void aot_emit_init(struct aot_unit *unit, FILE *out, const char *program) {
+	struct aot_function *fn;
+	struct s_exp *exp;
+	int i;
+
+	fprintf(out, "void %s(struct lisp_env *env) {\n", AOT_INIT_NAME);
+	fprintf(out, "\taot_env = env;\n");
+
+	// Everything the library keeps in its tables stays alive, and moves along with the heap
+	fprintf(out, "\tgc_add_roots(aot_natives, sizeof(aot_natives) / sizeof(aot_natives[0]));\n");
+	fprintf(out, "\tgc_add_roots(aot_const, sizeof(aot_const) / sizeof(aot_const[0]));\n");
+	fprintf(out, "\tgc_add_roots(aot_global, sizeof(aot_global) / sizeof(aot_global[0]));\n");
+	fprintf(out, "\tgc_add_roots(aot_form, sizeof(aot_form) / sizeof(aot_form[0]));\n\n");
+
+	for (i = 0; i < unit->globals.count; ++i) {
+		fprintf(out, "\taot_global[%d] = aot_symbol(", i);
+		aot_emit_cstring(out, unit->globals.items[i]->lisp_car.label, strlen(unit->globals.items[i]->lisp_car.label));
+		fprintf(out, ");\n");
+	}
+
+	// Quoted data is interned, and the compiled code refers to the datum itself
+	for (i = 0; i < unit->constants.count; ++i) {
+		exp = unit->constants.items[i];
+		fprintf(out, "\taot_const[%d] = ", i);
+		aot_emit_datum(out, exp);
+		fprintf(out, IS_CONSTANT(exp) ? "->lisp_car.car;\n" : ";\n");
+	}
+
+	for (i = 0; i < unit->forms.count; ++i) {
+		fprintf(out, "\taot_form[%d] = ", i);
+		aot_emit_datum(out, unit->forms.items[i]);
+		fprintf(out, ";\n");
+	}
+
+	for (fn = unit->functions; fn != 0; fn = fn->next) {
+		fprintf(out, "\taot_natives[%d] = aot_native(", fn->id);
+		aot_emit_cstring(out, fn->name->lisp_car.label, strlen(fn->name->lisp_car.label));
+		if (fn->arity <= 3)
+			fprintf(out, ", %d, (void *) aot_fn_%d);\n", fn->arity, fn->id);
+		else
+			fprintf(out, ", %d, (void *) aot_entry_%d);\n", fn->arity, fn->id);
+	}
+
+	fputs(program, out);
+	fprintf(out, "}\n");
+}
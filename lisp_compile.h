@@ -0,0 +1,101 @@
+#ifndef _LISP_COMPILE_H_
+#define _LISP_COMPILE_H_
+/**
+ * Ahead-of-time compilation of a file of definitions to a shared object, and the small runtime
+ * that compiled code calls back into. Compiled libraries export a single entry point, which
+ * binds everything the file defined in the environment it is given.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Project headers
+#include "lisp.h"
+
+// Directory holding the headers, which generated code includes
+#ifndef LISP_INCLUDE_DIR
+#define LISP_INCLUDE_DIR	"."
+#endif
+
+// Name of the function every compiled library exports
+#define AOT_INIT_NAME		"lisp_aot_init"
+
+/**
+ * A growable list of expressions, used to collect the constants, global names and interpreted
+ * forms that a compiled library sets up when it is loaded
+ */
+struct aot_table {
+	struct s_exp **items;
+	int count;
+	int size;
+};
+
+/**
+ * A function being compiled. The body can refer to the function by self, which differs from
+ * name when it was written as (define name (label self (lambda ...))).
+ */
+struct aot_function {
+	struct s_exp *name;
+	struct s_exp *self;
+	struct s_exp *params;
+	struct s_exp *body;
+	int id;
+	int arity;
+	struct aot_function *next;
+};
+
+/**
+ * State for compiling one file. Finished functions are written to code, and the body of the
+ * function currently being compiled goes to out, so that its header can be written once the
+ * whole body is known. The statements that replay the file's top-level forms in order when the
+ * library is loaded go to program.
+ */
+struct aot_unit {
+	struct lisp_env *env;
+	struct aot_function *functions;
+	struct aot_table constants;
+	struct aot_table globals;
+	struct aot_table forms;
+	FILE *code;
+	FILE *out;
+	FILE *program;
+	int temps;
+	int depth;
+	int loops;
+};
+
+// Compiling and loading libraries
+int aot_compile(FILE *in, const char *output, struct lisp_env *env);
+int aot_load(const char *path, struct lisp_env *env);
+
+// Runtime support for compiled code
+struct s_exp *aot_symbol(const char *label);
+struct s_exp *aot_string(const char *buf, size_t length);
+struct s_exp *aot_number(const char *text);
+struct s_exp *aot_native(const char *name, int arity, void *entry);
+struct s_exp *aot_eval(struct s_exp *form, struct lisp_env *env, char **names, struct s_exp **values, int count);
+
+// Code generation, used internally
+int aot_table_add(struct aot_table *table, struct s_exp *exp);
+int aot_global_index(struct aot_unit *unit, struct s_exp *symbol);
+int aot_param_index(struct aot_function *fn, struct s_exp *symbol);
+int aot_is_form(struct aot_function *fn, struct s_exp *head, struct s_exp *form);
+int aot_is_macro(struct aot_unit *unit, struct aot_function *fn, struct s_exp *head);
+struct aot_function *aot_callee(struct aot_unit *unit, struct aot_function *fn, struct s_exp *head);
+const char *aot_primitive(struct aot_unit *unit, struct aot_function *fn, struct s_exp *head, int argc);
+struct aot_function *aot_function_form(struct s_exp *exp);
+void aot_indent(struct aot_unit *unit);
+void aot_emit_cstring(FILE *out, const char *buf, size_t length);
+void aot_emit_datum(FILE *out, struct s_exp *exp);
+int aot_expr(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp);
+void aot_tail(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp);
+int aot_cond(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp, int tail);
+int aot_call(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp, int tail);
+int aot_fallback(struct aot_unit *unit, struct aot_function *fn, struct s_exp *exp);
+void aot_emit_signature(FILE *out, struct aot_function *fn);
+void aot_emit_function(struct aot_unit *unit, struct aot_function *fn);
+void aot_emit_init(struct aot_unit *unit, FILE *out, const char *program);
+
+#endif
@@ -0,0 +1,274 @@
+/**
+ * Raising and catching errors, and the error objects that describe them
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_error.h"
+
+// The innermost handler, which a raised error unwinds to
+struct lisp_handler *lisp_handlers = 0;
+
+// The line that the top-level form being evaluated started on, or zero if it has none
+int lisp_source_line = 0;
+
+/**
+ * Makes handler the innermost one, recording the evaluation state to return to
+ */
+void handler_push(struct lisp_handler *handler) {
+	handler->prev = lisp_handlers;
+	handler->frames = frame_active;
+	handler->argvs = argv_active;
+	handler->depth = lisp_depth;
+	handler->pending = lisp_pending_forms;
+	handler->spans = trace_spans;
+	handler->error = lisp_undefined;
+	lisp_handlers = handler;
+}
+
+/**
+ * Removes handler, once the code it protected has returned normally
+ */
+void handler_pop(struct lisp_handler *handler) {
+	lisp_handlers = handler->prev;
+}
+
+/**
+ * Unwinds to the innermost handler with an error object. The handler is popped, and the local
+ * frames, argument arrays, depth and pending forms are put back the way they were when it was pushed, ending
+ * any trace spans that were begun since. With no handler to catch it, the error is reported and
+ * the program exits.
+ */
+void lisp_raise(struct s_exp *error) {
+	struct lisp_handler *handler;
+
+	handler = lisp_handlers;
+	if (handler == 0) {
+		error_report(error);
+		exit(ERROR_EXIT_UNCAUGHT);
+	}
+
+	lisp_handlers = handler->prev;
+	frame_unwind(handler->frames);
+	argv_unwind(handler->argvs);
+	lisp_depth = handler->depth;
+	lisp_pending_forms = handler->pending;
+	TRACE_HOOK(trace_unwind(handler->spans));
+	handler->error = error;
+	longjmp(handler->jump, 1);
+}
+
+/**
+ * Raises a new error of the given kind, with a printf style message
+ */
+void lisp_throw(const char *kind, struct s_exp *value, const char *fmt, ...) {
+	va_list args;
+	va_list copy;
+	char *message;
+	int length;
+
+	va_start(args, fmt);
+	va_copy(copy, args);
+	length = vsnprintf(0, 0, fmt, args);
+	message = (char *) malloc(length + 1);
+	vsnprintf(message, length + 1, fmt, copy);
+	va_end(copy);
+	va_end(args);
+
+	lisp_raise(make_error(kind, message, value));
+}
+
+/**
+ * Creates an error object, which takes ownership of message. The error is allocated outside
+ * of any cell quota, so that running out of cells can be reported like anything else.
+ */
+struct s_exp *make_error(const char *kind, char *message, struct s_exp *value) {
+	struct lisp_condition *condition;
+	struct lisp_location loc;
+	struct s_exp *rtn;
+	size_t cellsLeft;
+
+	source_locate(&loc);
+
+	condition = (struct lisp_condition *) malloc(sizeof(struct lisp_condition));
+	condition->kind = intern_label(kind);
+	condition->message = message;
+	condition->file = loc.file;
+	condition->line = loc.line;
+	condition->column = loc.column;
+	condition->value = value;
+
+	cellsLeft = lisp_cells_left;
+	lisp_cells_left = SIZE_MAX;
+	rtn = find_free_s_exp();
+	lisp_cells_left = cellsLeft;
+
+	rtn->flags = FLAG_ATOM | FLAG_ERROR;
+	rtn->lisp_car.condition = condition;
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Prints an error that nothing caught to stderr, where it stays out of the program's output
+ */
+void error_report(struct s_exp *error) {
+	struct lisp_condition *condition;
+
+	condition = error->lisp_car.condition;
+	if (condition->file != 0)
+		fprintf(stderr, "Error at %s:%d:%d: %s\n", condition->file, condition->line, condition->column, condition->message);
+	else if (condition->column > 0)
+		fprintf(stderr, "Error on line %d, column %d: %s\n", condition->line, condition->column, condition->message);
+	else if (condition->line > 0)
+		fprintf(stderr, "Error on line %d: %s\n", condition->line, condition->message);
+	else
+		fprintf(stderr, "Error: %s\n", condition->message);
+}
+
+/**
+ * Releases the state of an error object that is no longer reachable
+ */
+void error_free(struct lisp_condition *condition) {
+	free(condition->message);
+	free(condition);
+}
+
+/**
+ * Evaluates (catch expr [handler]), whose arguments are given in exp. If evaluating expr raises
+ * an error, the handler is evaluated and applied to the error object, or if there is no
+ * handler, the error object is the value of the form.
+ */
+struct s_exp *eval_catch(struct s_exp *exp, struct lisp_env *env) {
+	struct lisp_handler handler;
+	struct s_exp *value;
+
+	// The handler expression and the error are still needed after either evaluation
+	lisp_pending_forms += 1;
+	handler_push(&handler);
+	if (setjmp(handler.jump) == 0) {
+		value = eval(_car(exp), env);
+		handler_pop(&handler);
+		lisp_pending_forms -= 1;
+		return value;
+	}
+
+	if (IS_NIL(_cdr(exp))) {
+		lisp_pending_forms -= 1;
+		return handler.error;
+	}
+
+	value = eval(_car(_cdr(exp)), env);
+	lisp_pending_forms -= 1;
+	return call_value(value, &handler.error, 1, env);
+}
+
+/**
+ * Adds the error primitives to the global environment
+ */
+void error_init(struct lisp_env *env) {
+	define_label("error", make_native("error", LISP_VARIADIC, _error, 0), env);
+	define_label("error?", make_native("error?", 1, _error_p, 0), env);
+	define_label("error-kind", make_native("error-kind", 1, _error_kind, 0), env);
+	define_label("error-message", make_native("error-message", 1, _error_message, 0), env);
+	define_label("error-line", make_native("error-line", 1, _error_line, 0), env);
+	define_label("error-column", make_native("error-column", 1, _error_column, 0), env);
+	define_label("error-file", make_native("error-file", 1, _error_file, 0), env);
+	define_label("error-value", make_native("error-value", 1, _error_value, 0), env);
+}
+
+/**
+ * Raises an error from lisp, called as (error message [value])
+ */
+struct s_exp *_error(struct s_exp **argv, int argc, void *data) {
+	if (argc < 1 || argc > 2)
+		lisp_throw(ERROR_ARITY, lisp_nil, "error expects 1 or 2 arguments, but was given %d", argc);
+	if (!IS_STRING(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "error expects a string message");
+
+	lisp_raise(make_error(ERROR_USER, strdup(string_flatten(argv[0])), argc == 2 ? argv[1] : lisp_nil));
+}
+
+/**
+ * Checks whether a value is an error object
+ */
+struct s_exp *_error_p(struct s_exp **argv, int argc, void *data) {
+	return IS_ERROR(argv[0]) ? lisp_true : lisp_false;
+}
+
+/**
+ * Returns the kind of an error as a symbol
+ */
+struct s_exp *_error_kind(struct s_exp **argv, int argc, void *data) {
+	struct lisp_condition *condition;
+	struct s_exp *rtn;
+
+	condition = error_check(argv[0], "error-kind");
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_SYMBOL;
+	rtn->lisp_car.label = condition->kind;
+	rtn->lisp_cdr.icache = 0;
+	return rtn;
+}
+
+/**
+ * Returns the message of an error as a string
+ */
+struct s_exp *_error_message(struct s_exp **argv, int argc, void *data) {
+	struct lisp_condition *condition;
+
+	condition = error_check(argv[0], "error-message");
+	return make_string(strdup(condition->message), strlen(condition->message));
+}
+
+/**
+ * Returns the source line an error was raised on, or zero if it is not known
+ */
+struct s_exp *_error_line(struct s_exp **argv, int argc, void *data) {
+	return make_int(error_check(argv[0], "error-line")->line);
+}
+
+/**
+ * Returns the source column an error was raised at, or zero if it is not known
+ */
+struct s_exp *_error_column(struct s_exp **argv, int argc, void *data) {
+	return make_int(error_check(argv[0], "error-column")->column);
+}
+
+/**
+ * Returns the name of the file an error was raised in as a string, or nil if it is not known
+ */
+struct s_exp *_error_file(struct s_exp **argv, int argc, void *data) {
+	struct lisp_condition *condition;
+
+	condition = error_check(argv[0], "error-file");
+	if (condition->file == 0)
+		return lisp_nil;
+	return make_string(strdup(condition->file), strlen(condition->file));
+}
+
+/**
+ * Returns the value attached to an error, which is nil if there is none
+ */
+struct s_exp *_error_value(struct s_exp **argv, int argc, void *data) {
+	return error_check(argv[0], "error-value")->value;
+}
+
+/**
+ * Checks that e is an error object for the primitive name, and returns its condition
+ */
+struct lisp_condition *error_check(struct s_exp *e, const char *name) {
+	if (!IS_ERROR(e))
+		lisp_throw(ERROR_TYPE, e, "%s expects an error", name);
+
+	return e->lisp_car.condition;
+}
@@ -0,0 +1,101 @@
+#ifndef _LISP_ERROR_H_
+#define _LISP_ERROR_H_
+/**
+ * Errors raised during evaluation. Raising an error unwinds straight to the innermost handler,
+ * so nothing between the error and the handler has to check for it, and a primitive that finds
+ * a bad argument gives up on the spot instead of returning a value for its caller to test.
+ * Handlers are set up by the catch form, by the embedding interface, and by the interpreter
+ * around each top-level form, and cost a setjmp() each when they are entered.
+ *
+ * An error is an atom pointing at a lisp_condition, which records what kind of error it was,
+ * a message, where in the source it was raised, and an optional value that
+ * (error message value) attaches for the handler. In lisp, (catch expr handler) evaluates expr,
+ * and if it raises an error, applies handler to the error object instead. Without a handler,
+ * the error object itself is the value of the catch form.
+ */
+
+// Standard headers
+#include <setjmp.h>
+
+// Project headers
+#include "lisp.h"
+
+// Kinds of error raised by the interpreter and its primitives
+#define ERROR_USER				"error"
+#define ERROR_TYPE				"type-error"
+#define ERROR_ARITY				"arity-error"
+#define ERROR_SYNTAX			"syntax-error"
+#define ERROR_UNDEFINED			"undefined-symbol"
+#define ERROR_OVERFLOW			"overflow"
+#define ERROR_RANGE				"range-error"
+#define ERROR_IO				"io-error"
+#define ERROR_LIMIT				"limit"
+
+// Exit status of the interpreter when an error is raised with no handler to catch it
+#define ERROR_EXIT_UNCAUGHT		4
+
+/**
+ * The state of an error object. kind is an interned label, and message is owned by the
+ * condition. The location is that of the code that raised it, or only the line of the top-level
+ * form being evaluated when that code has no location, and line is zero if there is neither.
+ */
+struct lisp_condition {
+	char *kind;
+	char *message;
+	const char *file;
+	int line;
+	int column;
+	struct s_exp *value;
+};
+
+/**
+ * A place to unwind to, which lives on the C stack of whoever set it up. The frames, argument
+ * arrays, depth and trace spans in progress are recorded when it is pushed, and put back when
+ * an error unwinds to it.
+ */
+struct lisp_handler {
+	jmp_buf jump;
+	struct lisp_handler *prev;
+	struct lisp_frame *frames;
+	struct lisp_argv *argvs;
+	int depth;
+	int pending;
+	int spans;
+	struct s_exp *error;
+};
+
+// The innermost handler, and the line of the top-level form being evaluated
+extern struct lisp_handler *lisp_handlers;
+extern int lisp_source_line;
+
+// Handlers. Push, then setjmp() on the jump buffer, and pop when the protected code returns
+void handler_push(struct lisp_handler *handler);
+void handler_pop(struct lisp_handler *handler);
+
+// Raising errors
+void lisp_raise(struct s_exp *error) __attribute__ ((noreturn));
+void lisp_throw(const char *kind, struct s_exp *value, const char *fmt, ...) __attribute__ ((noreturn, format (printf, 3, 4)));
+struct s_exp *make_error(const char *kind, char *message, struct s_exp *value);
+void error_report(struct s_exp *error);
+void error_free(struct lisp_condition *condition);
+
+// The catch form
+struct s_exp *eval_catch(struct s_exp *exp, struct lisp_env *env);
+
+// Setup, called by lisp_init()
+void error_init(struct lisp_env *env);
+
+// Lisp-space error primitives
+struct s_exp *_error(struct s_exp **argv, int argc, void *data);
+struct s_exp *_error_p(struct s_exp **argv, int argc, void *data);
+struct s_exp *_error_kind(struct s_exp **argv, int argc, void *data);
+struct s_exp *_error_message(struct s_exp **argv, int argc, void *data);
+struct s_exp *_error_line(struct s_exp **argv, int argc, void *data);
+struct s_exp *_error_column(struct s_exp **argv, int argc, void *data);
+struct s_exp *_error_file(struct s_exp **argv, int argc, void *data);
+struct s_exp *_error_value(struct s_exp **argv, int argc, void *data);
+
+// Error helpers, used internally
+struct lisp_condition *error_check(struct s_exp *e, const char *name);
+
+#endif
@@ -0,0 +1,736 @@
+/**
+ * The heap and a copying garbage collector. New cells are bump allocated from the current
+ * chunk. A collection treats every chunk allocated so far as from-space, copies the cells that
+ * are reachable from the roots into fresh chunks, and then frees the old ones, so the heap is
+ * always compacted and the cost of a collection depends only on how much is still alive.
+ *
+ * Copied cells are scanned in the order they were copied, in the manner of Cheney, with the
+ * one refinement that copying a pair also copies the rest of its list right behind it. Lists
+ * therefore end up as runs of consecutive cells, in the order that cdr walks them.
+ *
+ * Each chunk is larger than the one before it by a constant factor, so a heap of n cells takes
+ * only a logarithmic number of allocations to build. When a limit is set, chunks are trimmed to
+ * fit under it, and running into it ends the program with an error rather than letting it
+ * swap or crash.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_gc.h"
+#include "lisp_jit.h"
+
+// Collection happens automatically at safe points while this is nonzero. It is off unless asked
+// for, because an embedder may hold on to heap cells between calls
+int gc_enabled = 0;
+
+// Heap sizing, which may be changed before or between allocations
+size_t heap_initial_cells = HEAP_INITIAL_CELLS;
+size_t heap_max_cells = 0;
+double heap_growth = HEAP_GROWTH;
+int heap_huge_pages = 0;
+
+// The chunks of the heap in the order they were allocated, with new cells coming from the last
+struct heap_chunk *heap_chunks = 0;
+struct heap_chunk *heap_current = 0;
+
+// Cells in all chunks of the heap, cells that survived the last collection, and cells handed
+// out since then along with how many may be before the next collection
+size_t heap_total_cells = 0;
+size_t heap_live = 0;
+size_t heap_allocated = 0;
+size_t heap_threshold = GC_MIN_CELLS;
+
+// Everything outside of the heap that refers to heap cells
+struct gc_roots *gc_root_list = 0;
+struct gc_env *gc_env_list = 0;
+
+// Cells outside of the heap that have had heap cells stored into them, which are scanned at
+// every collection whether or not anything else still reaches them
+struct s_exp **gc_remembered = 0;
+size_t gc_remembered_count = 0;
+size_t gc_remembered_size = 0;
+
+// During a collection, the old chunks sorted by address and the new chunks being copied into
+struct heap_chunk **gc_from = 0;
+size_t gc_from_count = 0;
+struct heap_chunk *gc_to_current = 0;
+
+// Cells outside of the heap that have been reached during a collection, and still need scanning
+struct s_exp **gc_stack = 0;
+size_t gc_stack_count = 0;
+size_t gc_stack_size = 0;
+
+// During a collection, how far scanning has got through the copies and through gc_stack
+struct heap_chunk *gc_scan_chunk = 0;
+size_t gc_scanned = 0;
+size_t gc_queued = 0;
+
+/**
+ * Parses a size in bytes, which may be followed by k, m or g, and returns the number of cells
+ * that fit in it, or zero if the size is malformed
+ */
+size_t heap_parse_size(const char *value) {
+	unsigned long long bytes;
+	char *end;
+
+	bytes = strtoull(value, &end, 10);
+	if (end == value)
+		return 0;
+
+	switch (*end) {
+		case 'g': case 'G':
+			bytes *= 1024;
+			// Fall through
+		case 'm': case 'M':
+			bytes *= 1024;
+			// Fall through
+		case 'k': case 'K':
+			bytes *= 1024;
+			++end;
+			break;
+	}
+
+	if (*end != '\0')
+		return 0;
+	return (size_t) (bytes / sizeof(struct s_exp));
+}
+
+/**
+ * Sets one of the heap options by name, which are the command line options without their
+ * leading dashes. Returns zero on success, or -1 if the option or its value is not valid.
+ */
+int heap_configure(const char *option, const char *value) {
+	size_t cells;
+	double growth;
+	char *end;
+
+	if (strcmp(option, "heap-initial") == 0) {
+		cells = heap_parse_size(value);
+		if (cells == 0)
+			return -1;
+		heap_initial_cells = cells;
+		return 0;
+	}
+
+	if (strcmp(option, "heap-max") == 0) {
+		cells = heap_parse_size(value);
+		if (cells == 0)
+			return -1;
+		heap_max_cells = cells;
+		return 0;
+	}
+
+	if (strcmp(option, "heap-growth") == 0) {
+		growth = strtod(value, &end);
+		if (end == value || *end != '\0' || growth < 1.0)
+			return -1;
+		heap_growth = growth;
+		return 0;
+	}
+
+	if (strcmp(option, "huge-pages") == 0) {
+		heap_huge_pages = (strcmp(value, "0") != 0);
+		return 0;
+	}
+
+	return -1;
+}
+
+/**
+ * Reads the heap options from LISP_HEAP_INITIAL, LISP_HEAP_MAX, LISP_HEAP_GROWTH and
+ * LISP_HUGE_PAGES. Invalid values are reported and otherwise ignored.
+ */
+void heap_configure_env(void) {
+	const char *names[] = {"LISP_HEAP_INITIAL", "LISP_HEAP_MAX", "LISP_HEAP_GROWTH", "LISP_HUGE_PAGES"};
+	const char *options[] = {"heap-initial", "heap-max", "heap-growth", "huge-pages"};
+	const char *value;
+	int i;
+
+	for (i = 0; i < 4; ++i) {
+		value = getenv(names[i]);
+		if (value != 0 && heap_configure(options[i], value) != 0)
+			lisp_error("Ignoring invalid value for %s: %s\n", names[i], value);
+	}
+}
+
+/**
+ * Decides how many cells the next chunk should have, given the size of the previous chunk (or
+ * zero for the first) and the number of cells in the chunks so far. Returns zero if the heap
+ * is already as large as it may get.
+ */
+size_t heap_chunk_size(size_t previous, size_t total) {
+	size_t count;
+
+	if (previous == 0)
+		count = heap_initial_cells;
+	else if (previous * heap_growth > HEAP_MAX_CHUNK_CELLS)
+		count = (previous > HEAP_MAX_CHUNK_CELLS) ? previous : HEAP_MAX_CHUNK_CELLS;
+	else
+		count = (size_t) (previous * heap_growth);
+
+	if (heap_max_cells != 0) {
+		if (total >= heap_max_cells)
+			return 0;
+		if (count > heap_max_cells - total)
+			count = heap_max_cells - total;
+	}
+
+	return count;
+}
+
+/**
+ * Allocates a zeroed chunk able to hold count cells, from huge pages if they were asked for.
+ * Explicitly reserved huge pages are tried first, and if there are none the chunk is mapped
+ * normally with a request for transparent huge pages.
+ */
+struct heap_chunk *heap_new_chunk(size_t count) {
+	struct heap_chunk *chunk;
+	size_t mapped;
+	void *mem;
+
+	chunk = (struct heap_chunk *) calloc(1, sizeof(struct heap_chunk));
+	if (chunk == 0)
+		heap_out_of_memory();
+
+	if (heap_huge_pages) {
+		mapped = (count * sizeof(struct s_exp) + HEAP_HUGE_PAGE_SIZE - 1) & ~((size_t) HEAP_HUGE_PAGE_SIZE - 1);
+		mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		mem = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		if (mem == MAP_FAILED) {
+			mem = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+			if (mem != MAP_FAILED)
+				madvise(mem, mapped, MADV_HUGEPAGE);
+#endif
+		}
+
+		if (mem != MAP_FAILED) {
+			chunk->cells = (struct s_exp *) mem;
+			chunk->mapped = mapped;
+		}
+	}
+
+	if (chunk->cells == 0)
+		chunk->cells = (struct s_exp *) calloc(count, sizeof(struct s_exp));
+	if (chunk->cells == 0)
+		heap_out_of_memory();
+
+	chunk->count = count;
+	return chunk;
+}
+
+/**
+ * Returns a chunk's memory to the system
+ */
+void heap_free_chunk(struct heap_chunk *chunk) {
+	if (chunk->mapped != 0)
+		munmap(chunk->cells, chunk->mapped);
+	else
+		free(chunk->cells);
+	free(chunk);
+}
+
+/**
+ * Ends the program when the heap cannot grow. There is no way to back out of an evaluation
+ * halfway through, and collecting is not safe until it finishes, so this is all that can be
+ * done. The message goes straight to stderr, because errors may be muted at the time.
+ */
+void heap_out_of_memory(void) {
+	if (heap_max_cells != 0 && heap_total_cells >= heap_max_cells)
+		fprintf(stderr, "Out of memory: the heap is limited to %zu cells\n", heap_max_cells);
+	else
+		fprintf(stderr, "Out of memory: unable to grow the heap\n");
+	exit(HEAP_EXIT_OOM);
+}
+
+/**
+ * Hands out the next cell of the current heap chunk, starting a new chunk when it is full
+ */
+struct s_exp *find_free_s_exp(void) {
+	struct heap_chunk *chunk;
+	size_t count;
+
+	if (lisp_cells_left-- == 0)
+		limit_exceeded(LIMIT_CELLS);
+
+	if (heap_current == 0 || heap_current->used == heap_current->count) {
+		count = heap_chunk_size(heap_current == 0 ? 0 : heap_current->count, heap_total_cells);
+		if (count == 0)
+			heap_out_of_memory();
+
+		chunk = heap_new_chunk(count);
+		if (heap_current == 0)
+			heap_chunks = chunk;
+		else
+			heap_current->next = chunk;
+		heap_current = chunk;
+		heap_total_cells += count;
+		TRACE_HOOK(trace_emit(TRACE_COUNTER, "heap size", 0, heap_total_cells));
+	}
+
+	heap_allocated += 1;
+	TRACE_HOOK(trace_alloc(heap_allocated));
+	return &heap_current->cells[heap_current->used++];
+}
+
+/**
+ * Registers an array of count slots whose contents are roots. The slots are updated in place
+ * when the cells they refer to move.
+ */
+void gc_add_roots(struct s_exp **slots, int count) {
+	struct gc_roots *roots;
+
+	roots = (struct gc_roots *) malloc(sizeof(struct gc_roots));
+	roots->slots = slots;
+	roots->count = count;
+	roots->next = gc_root_list;
+	gc_root_list = roots;
+}
+
+/**
+ * Forgets an array of slots registered with gc_add_roots()
+ */
+void gc_remove_roots(struct s_exp **slots) {
+	struct gc_roots **link;
+	struct gc_roots *roots;
+
+	for (link = &gc_root_list; *link != 0; link = &roots->next) {
+		roots = *link;
+		if (roots->slots == slots) {
+			*link = roots->next;
+			free(roots);
+			return;
+		}
+	}
+}
+
+/**
+ * Registers an environment, so that its bindings are roots
+ */
+void gc_register_env(struct lisp_env *env) {
+	struct gc_env *node;
+
+	node = (struct gc_env *) malloc(sizeof(struct gc_env));
+	node->env = env;
+	node->next = gc_env_list;
+	gc_env_list = node;
+}
+
+/**
+ * Forgets an environment that is about to be destroyed
+ */
+void gc_unregister_env(struct lisp_env *env) {
+	struct gc_env **link;
+	struct gc_env *node;
+
+	for (link = &gc_env_list; *link != 0; link = &node->next) {
+		node = *link;
+		if (node->env == env) {
+			*link = node->next;
+			free(node);
+			return;
+		}
+	}
+}
+
+/**
+ * Returns how many cells may be allocated before the next collection
+ */
+size_t gc_threshold(void) {
+	// Near the limit, collect sooner, so that each form has as much of the heap as possible
+	if (heap_max_cells != 0 && heap_threshold > (heap_max_cells - heap_live) / 2)
+		return (heap_max_cells - heap_live) / 2;
+	return heap_threshold;
+}
+
+/**
+ * Collects if enough has been allocated since the last collection. This must only be called
+ * at a safe point, where no evaluation is in progress.
+ */
+void gc_maybe_collect(void) {
+	if (gc_enabled && heap_allocated >= gc_threshold())
+		gc_collect();
+}
+
+/**
+ * Collects, if enough has been allocated, from inside a native that is running straight from a
+ * top-level form. Nothing but the native itself can be holding on to heap cells there, so the
+ * cells it still needs are passed in slots, which are updated in place. Anywhere deeper, or
+ * inside a special form like cond that goes on using its form afterwards, the interpreter's own
+ * frames may hold cells, and nothing happens.
+ */
+void gc_safe_point(struct s_exp **slots, int count) {
+	struct gc_roots roots;
+
+	if (!gc_enabled || lisp_depth != GC_SAFE_DEPTH || lisp_pending_forms != 0 || heap_allocated < gc_threshold())
+		return;
+
+	roots.slots = slots;
+	roots.count = count;
+	roots.next = gc_root_list;
+	gc_root_list = &roots;
+
+	gc_collect();
+
+	gc_root_list = roots.next;
+}
+
+/**
+ * The write barrier, called before value is stored into a cell that already exists. Cells
+ * outside of the heap are only scanned when a collection happens to reach them, much like an
+ * old generation, so one that is given a heap cell is remembered, and scanned at every
+ * collection from then on. Stores into heap cells need nothing, since they are always copied
+ * and scanned as a whole.
+ */
+void gc_write_barrier(struct s_exp *cell, struct s_exp *value) {
+	if ((cell->flags & FLAG_REMEMBERED) == FLAG_REMEMBERED || heap_contains(cell) || !heap_contains(value))
+		return;
+
+	if (gc_remembered_count == gc_remembered_size) {
+		gc_remembered_size = (gc_remembered_size == 0) ? 64 : 2*gc_remembered_size;
+		gc_remembered = (struct s_exp **) realloc(gc_remembered, gc_remembered_size * sizeof(struct s_exp *));
+	}
+
+	cell->flags |= FLAG_REMEMBERED;
+	gc_remembered[gc_remembered_count++] = cell;
+}
+
+/**
+ * Checks whether a cell was allocated from the heap, outside of a collection
+ */
+int heap_contains(struct s_exp *p) {
+	struct heap_chunk *chunk;
+
+	for (chunk = heap_chunks; chunk != 0; chunk = chunk->next) {
+		if (p >= chunk->cells && p < chunk->cells + chunk->count)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Checks whether a cell lies in one of the chunks being collected, by binary search over the
+ * chunks sorted by address
+ */
+int gc_in_from_space(struct s_exp *p) {
+	size_t lo;
+	size_t hi;
+	size_t mid;
+
+	lo = 0;
+	hi = gc_from_count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (p < gc_from[mid]->cells)
+			hi = mid;
+		else if (p >= gc_from[mid]->cells + gc_from[mid]->count)
+			lo = mid + 1;
+		else
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Copies a single cell to the end of to-space and leaves a forwarding address behind in the
+ * old cell. The copy is marked, which tells gc_forward() that it needs no further attention.
+ */
+struct s_exp *gc_copy_one(struct s_exp *old) {
+	struct heap_chunk *chunk;
+	struct s_exp *rtn;
+	size_t count;
+
+	// Everything copied was in a heap that fit under the limit, so to-space can't outgrow it
+	if (gc_to_current->used == gc_to_current->count) {
+		count = heap_chunk_size(gc_to_current->count, heap_total_cells);
+		chunk = heap_new_chunk(count == 0 ? 1 : count);
+		heap_total_cells += chunk->count;
+		gc_to_current->next = chunk;
+		gc_to_current = chunk;
+	}
+
+	rtn = &gc_to_current->cells[gc_to_current->used++];
+	*rtn = *old;
+	rtn->flags |= FLAG_GC_MARK;
+
+	old->flags |= FLAG_FORWARDED;
+	old->lisp_car.car = rtn;
+	return rtn;
+}
+
+/**
+ * Copies a cell to to-space, and if it is a pair, copies as much of the rest of its list as
+ * has not been copied already right behind it
+ */
+struct s_exp *gc_copy(struct s_exp *old) {
+	struct s_exp *rtn;
+	struct s_exp *cur;
+	struct s_exp *next;
+
+	rtn = gc_copy_one(old);
+	for (cur = rtn; !IS_ATOM(cur); cur = next) {
+		next = cur->lisp_cdr.cdr;
+		if (next == 0 || (next->flags & FLAG_FORWARDED) == FLAG_FORWARDED || !gc_in_from_space(next))
+			break;
+
+		next = gc_copy_one(next);
+		cur->lisp_cdr.cdr = next;
+	}
+
+	return rtn;
+}
+
+/**
+ * Returns where a cell lives after the collection. Heap cells are copied the first time they
+ * are reached. Cells outside of the heap stay put, but are marked and queued the first time
+ * they are reached, so that the heap cells they refer to are found as well.
+ */
+struct s_exp *gc_forward(struct s_exp *p) {
+	if (p == 0 || (p->flags & FLAG_GC_MARK) == FLAG_GC_MARK)
+		return p;
+
+	if ((p->flags & FLAG_FORWARDED) == FLAG_FORWARDED)
+		return p->lisp_car.car;
+
+	if (gc_in_from_space(p))
+		return gc_copy(p);
+
+	if (gc_stack_count == gc_stack_size) {
+		gc_stack_size = (gc_stack_size == 0) ? 1024 : 2*gc_stack_size;
+		gc_stack = (struct s_exp **) realloc(gc_stack, gc_stack_size * sizeof(struct s_exp *));
+	}
+
+	p->flags |= FLAG_GC_MARK;
+	gc_stack[gc_stack_count++] = p;
+	return p;
+}
+
+/**
+ * Checks, during a collection, whether a cell has been reached so far. A heap cell has been if
+ * it was copied, and a cell outside of the heap if it was marked.
+ */
+int gc_reached(struct s_exp *p) {
+	if (gc_in_from_space(p))
+		return (p->flags & FLAG_FORWARDED) == FLAG_FORWARDED;
+	return (p->flags & FLAG_GC_MARK) == FLAG_GC_MARK;
+}
+
+/**
+ * Scans the copies and the queued cells outside of the heap until neither turns up anything
+ * new, picking up where the last call left off
+ */
+void gc_drain(void) {
+	do {
+		for (;;) {
+			while (gc_scanned < gc_scan_chunk->used)
+				gc_scan(&gc_scan_chunk->cells[gc_scanned++]);
+			if (gc_scan_chunk->next == 0)
+				break;
+			gc_scan_chunk = gc_scan_chunk->next;
+			gc_scanned = 0;
+		}
+
+		while (gc_queued < gc_stack_count)
+			gc_scan(gc_stack[gc_queued++]);
+	} while (gc_scanned < gc_scan_chunk->used || gc_scan_chunk->next != 0);
+}
+
+/**
+ * Forwards every pointer to another cell held by cell. Besides pairs, these are constants,
+ * macros and boxes, which point at their datum, lambda form or value, ropes, which point at
+ * their halves, promises, which point at whatever they need to produce their value, and errors,
+ * which point at the value attached to them.
+ */
+void gc_scan(struct s_exp *cell) {
+	struct lisp_promise *promise;
+	int i;
+
+	if (!IS_ATOM(cell)) {
+		cell->lisp_car.car = gc_forward(cell->lisp_car.car);
+		cell->lisp_cdr.cdr = gc_forward(cell->lisp_cdr.cdr);
+	}
+	else if (IS_CONSTANT(cell) || IS_MACRO(cell) || IS_BOX(cell)) {
+		cell->lisp_car.car = gc_forward(cell->lisp_car.car);
+	}
+	else if (IS_ROPE(cell)) {
+		cell->lisp_car.rope->left = gc_forward(cell->lisp_car.rope->left);
+		cell->lisp_car.rope->right = gc_forward(cell->lisp_car.rope->right);
+	}
+	else if (IS_PROMISE(cell)) {
+		promise = cell->lisp_car.promise;
+		promise->value = gc_forward(promise->value);
+		promise->exp = gc_forward(promise->exp);
+		for (i = 0; i < PROMISE_ARGS; ++i)
+			promise->args[i] = gc_forward(promise->args[i]);
+
+		// A global environment is a root already, but a snapshot of local bindings is not
+		if (promise->env != 0 && promise->env->parent != 0)
+			gc_forward_env(promise->env);
+	}
+	else if (IS_ERROR(cell)) {
+		cell->lisp_car.condition->value = gc_forward(cell->lisp_car.condition->value);
+	}
+}
+
+/**
+ * Forwards the bindings of an environment. The version is bumped as well, because inline
+ * caches hold on to the values they found and those may have moved.
+ */
+void gc_forward_env(struct lisp_env *env) {
+	struct lisp_mapping *mapping;
+
+	for (mapping = env->mapping; mapping != 0; mapping = mapping->next) {
+		mapping->exp = gc_forward(mapping->exp);
+	}
+	env->version += 1;
+}
+
+/**
+ * Releases the memory that dead atoms in a from-space chunk owned, and then the chunk. These
+ * are the buffers of strings and arrays, the limbs of bignums and ratios, the state of promises
+ * and errors, and the caches of symbols.
+ */
+void gc_sweep(struct heap_chunk *chunk) {
+	struct s_exp *cell;
+	size_t i;
+
+	for (i = 0; i < chunk->used; ++i) {
+		cell = &chunk->cells[i];
+		if ((cell->flags & FLAG_FORWARDED) == FLAG_FORWARDED || !IS_ATOM(cell))
+			continue;
+
+		if (IS_STRING(cell)) {
+			if (IS_ROPE(cell))
+				free(cell->lisp_car.rope);
+			else
+				free(cell->lisp_car.strVal);
+		}
+		else if (IS_PROMISE(cell)) {
+			promise_free(cell->lisp_car.promise);
+		}
+		else if (IS_ERROR(cell)) {
+			error_free(cell->lisp_car.condition);
+		}
+		else if (IS_BIGNUM(cell) || IS_RATIO(cell)) {
+			number_free(cell);
+		}
+		else if (IS_ARRAY(cell)) {
+			array_free(cell);
+		}
+		else if (IS_SYMBOL(cell)) {
+			free(cell->lisp_cdr.icache);
+		}
+	}
+
+	heap_free_chunk(chunk);
+}
+
+/**
+ * Orders chunks by address, for qsort()
+ */
+int gc_chunk_compare(const void *a, const void *b) {
+	const struct heap_chunk *x = *(const struct heap_chunk **) a;
+	const struct heap_chunk *y = *(const struct heap_chunk **) b;
+
+	if (x->cells < y->cells)
+		return -1;
+	return (x->cells > y->cells) ? 1 : 0;
+}
+
+/**
+ * Collects the heap. This must only be called at a safe point, where no evaluation is in
+ * progress, because every heap cell that is not reachable from a root is released and every
+ * one that is may move. Compiled lambdas refer to cells directly, so they are all discarded
+ * and will be compiled again once they are hot.
+ */
+void gc_collect(void) {
+	struct heap_chunk *chunk;
+	struct gc_roots *roots;
+	struct gc_env *node;
+	size_t live;
+	size_t i;
+	int j;
+
+	TRACE_HOOK(trace_emit(TRACE_BEGIN, "gc", 0, 0));
+
+	// Everything allocated so far is from-space
+	gc_from_count = 0;
+	for (chunk = heap_chunks; chunk != 0; chunk = chunk->next)
+		gc_from_count += 1;
+
+	gc_from = (struct heap_chunk **) malloc((gc_from_count + 1) * sizeof(struct heap_chunk *));
+	for (i = 0, chunk = heap_chunks; chunk != 0; chunk = chunk->next)
+		gc_from[i++] = chunk;
+	qsort(gc_from, gc_from_count, sizeof(struct heap_chunk *), gc_chunk_compare);
+
+	heap_chunks = heap_new_chunk(heap_chunk_size(0, 0));
+	heap_total_cells = heap_chunks->count;
+	gc_to_current = heap_chunks;
+	gc_stack_count = 0;
+
+	// Copy everything the roots refer to
+	for (node = gc_env_list; node != 0; node = node->next)
+		gc_forward_env(node->env);
+
+	for (roots = gc_root_list; roots != 0; roots = roots->next) {
+		for (j = 0; j < roots->count; ++j)
+			roots->slots[j] = gc_forward(roots->slots[j]);
+	}
+
+	for (i = 0; i < gc_remembered_count; ++i)
+		gc_forward(gc_remembered[i]);
+
+	constant_pool_collect();
+
+	// Then scan the copies and the cells outside of the heap until neither turns up anything new
+	gc_scan_chunk = heap_chunks;
+	gc_scanned = 0;
+	gc_queued = 0;
+	gc_drain();
+
+	// A memo table keeps its entries only while its form is alive, and the entries may lead to
+	// the forms of other tables, so this goes on until no more forms are found
+	while (memo_collect() != 0)
+		gc_drain();
+	memo_sweep();
+
+	// Clear the marks, which are only meaningful during a collection
+	for (i = 0; i < gc_stack_count; ++i)
+		gc_stack[i]->flags &= ~FLAG_GC_MARK;
+
+	live = 0;
+	for (chunk = heap_chunks; chunk != 0; chunk = chunk->next) {
+		for (i = 0; i < chunk->used; ++i)
+			chunk->cells[i].flags &= ~FLAG_GC_MARK;
+		live += chunk->used;
+	}
+
+	// Shared pairs are only held weakly, so the table lets go of the ones that weren't copied
+	hashcons_collect();
+
+	// Nothing refers to from-space any more
+	for (i = 0; i < gc_from_count; ++i)
+		gc_sweep(gc_from[i]);
+	free(gc_from);
+	gc_from = 0;
+	gc_from_count = 0;
+
+	heap_current = gc_to_current;
+	heap_allocated = 0;
+	heap_threshold = (live > GC_MIN_CELLS) ? live : GC_MIN_CELLS;
+	heap_live = live;
+
+	jit_reset();
+	TRACE_HOOK(trace_emit(TRACE_END, "gc", 0, live));
+}
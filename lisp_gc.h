@@ -0,0 +1,127 @@
+#ifndef _LISP_GC_H_
+#define _LISP_GC_H_
+/**
+ * The heap and its garbage collector. Cells are bump allocated out of large contiguous chunks,
+ * and a Cheney-style copying collector moves everything that is still reachable into fresh
+ * chunks, laying each list out in cdr order so that walking it touches consecutive memory.
+ *
+ * Cells that were not taken from the heap (parsed code, pooled constants, natives and the
+ * built-in values) never move, but they are scanned for pointers into the heap. Collection
+ * moves cells, so it may only happen when no evaluation is in progress and nothing outside of
+ * the roots below is holding on to a heap cell, such as between two top-level forms. Natives
+ * that loop for a long time, like stream-fold, can offer a safe point of their own, which only
+ * collects when they were called straight from a top-level form.
+ *
+ * The size of the first chunk, how much larger each chunk is than the one before, and the
+ * most the heap may hold can be set from the command line or the environment. Chunks can also
+ * be placed in huge pages, which saves TLB misses when walking a large heap.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stddef.h>
+
+// Project headers
+#include "lisp.h"
+
+// Default number of cells in the first chunk of the heap
+#define HEAP_INITIAL_CELLS	(64*1024)
+
+// Default factor by which each chunk is larger than the one before it
+#define HEAP_GROWTH			2.0
+
+// Chunks stop growing once they hold this many cells
+#define HEAP_MAX_CHUNK_CELLS	(16*1024*1024)
+
+// Chunks in huge pages are rounded up to a multiple of this many bytes
+#define HEAP_HUGE_PAGE_SIZE	(2*1024*1024)
+
+// Exit status when the heap cannot grow any further
+#define HEAP_EXIT_OOM		3
+
+// Minimum number of cells allocated between two collections
+#define GC_MIN_CELLS		(256*1024)
+
+// The value of lisp_depth inside a native called straight from a top-level form, counting the
+// application and the native call. Special forms don't count towards it, so they are tracked
+// by lisp_pending_forms instead.
+#define GC_SAFE_DEPTH		2
+
+/**
+ * One contiguous chunk of heap cells, of which the first used have been handed out. Chunks in
+ * huge pages record how many bytes were mapped, and mapped is zero for ordinary chunks.
+ */
+struct heap_chunk {
+	struct s_exp *cells;
+	size_t count;
+	size_t used;
+	size_t mapped;
+	struct heap_chunk *next;
+};
+
+/**
+ * An array of slots holding heap cells that something outside of the heap depends on, such as
+ * the tables of a compiled library
+ */
+struct gc_roots {
+	struct s_exp **slots;
+	int count;
+	struct gc_roots *next;
+};
+
+/**
+ * An environment whose bindings are roots, chained into a list of every such environment
+ */
+struct gc_env {
+	struct lisp_env *env;
+	struct gc_env *next;
+};
+
+// Set to nonzero to collect automatically, which the interpreter does and embedders may
+extern int gc_enabled;
+
+// Heap sizing, with a limit of zero meaning that the heap may grow without bound
+extern size_t heap_initial_cells;
+extern size_t heap_max_cells;
+extern double heap_growth;
+extern int heap_huge_pages;
+
+// Configuration
+int heap_configure(const char *option, const char *value);
+void heap_configure_env(void);
+
+// Roots
+void gc_add_roots(struct s_exp **slots, int count);
+void gc_remove_roots(struct s_exp **slots);
+void gc_register_env(struct lisp_env *env);
+void gc_unregister_env(struct lisp_env *env);
+
+// The write barrier, for anything that changes a cell after it is made: the mutation primitives,
+// macro expansion and the optimizer
+void gc_write_barrier(struct s_exp *cell, struct s_exp *value);
+
+// Collection
+void gc_maybe_collect(void);
+void gc_safe_point(struct s_exp **slots, int count);
+void gc_collect(void);
+struct s_exp *gc_forward(struct s_exp *p);
+
+// Heap management and copying, used internally
+size_t heap_parse_size(const char *value);
+size_t gc_threshold(void);
+size_t heap_chunk_size(size_t previous, size_t total);
+struct heap_chunk *heap_new_chunk(size_t count);
+void heap_free_chunk(struct heap_chunk *chunk);
+void heap_out_of_memory(void);
+int heap_contains(struct s_exp *p);
+int gc_in_from_space(struct s_exp *p);
+struct s_exp *gc_copy_one(struct s_exp *old);
+struct s_exp *gc_copy(struct s_exp *old);
+int gc_reached(struct s_exp *p);
+void gc_drain(void);
+void gc_scan(struct s_exp *cell);
+void gc_forward_env(struct lisp_env *env);
+void gc_sweep(struct heap_chunk *chunk);
+int gc_chunk_compare(const void *a, const void *b);
+
+#endif
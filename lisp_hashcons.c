@@ -0,0 +1,153 @@
+/**
+ * Hash-consing of pairs. The shared pairs are kept in an open addressed table with linear
+ * probing, which holds only the cells themselves, because each cell's car and cdr are its key.
+ * Entries are never removed except by the garbage collector, which rebuilds the table, so the
+ * table needs no tombstones.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_hashcons.h"
+
+// Off unless asked for, because shared pairs can't be modified
+int hashcons_enabled = 0;
+
+// The table of shared pairs, with its size always a power of two
+struct s_exp **hashcons_slots = 0;
+size_t hashcons_size = 0;
+size_t hashcons_count = 0;
+
+/**
+ * Checks whether s may be half of a shared pair. Undefined never equals anything, and pairs
+ * that are not shared could later change, so neither can be part of a key.
+ */
+int hashcons_eligible(struct s_exp *s) {
+	if (IS_ATOM(s))
+		return !IS_UNDEFINED(s);
+	return IS_HASHCONS(s);
+}
+
+/**
+ * Hashes one half of a pair. Atoms hash by value, like c_lisp_hash(), and shared pairs by
+ * address, which is enough because equal shared pairs are the same cell.
+ */
+uint64_t hashcons_key(struct s_exp *s) {
+	if (IS_ATOM(s))
+		return c_lisp_hash(s);
+	return ((uint64_t) (uintptr_t) s) * 0x9e3779b97f4a7c15ULL;
+}
+
+/**
+ * Hashes a pair from its two halves
+ */
+uint64_t hashcons_hash(struct s_exp *car, struct s_exp *cdr) {
+	return (hashcons_key(car) * 1099511628211ULL) ^ (hashcons_key(cdr) >> 7) ^ hashcons_key(cdr);
+}
+
+/**
+ * Checks whether two halves make the same key
+ */
+int hashcons_same(struct s_exp *a, struct s_exp *b) {
+	if (a == b)
+		return 1;
+	if (IS_ATOM(a) && IS_ATOM(b))
+		return c_lisp_eq(a, b);
+	return 0;
+}
+
+/**
+ * Puts a cell into the first free slot of its probe sequence
+ */
+void hashcons_insert(struct s_exp **slots, size_t size, struct s_exp *cell) {
+	size_t i;
+
+	i = hashcons_hash(cell->lisp_car.car, cell->lisp_cdr.cdr) & (size - 1);
+	while (slots[i] != 0)
+		i = (i + 1) & (size - 1);
+	slots[i] = cell;
+}
+
+/**
+ * Moves every cell in the table into a new table with the given number of slots, skipping
+ * empty slots
+ */
+void hashcons_rebuild(size_t size) {
+	struct s_exp **slots;
+	size_t i;
+
+	slots = (struct s_exp **) calloc(size, sizeof(struct s_exp *));
+	hashcons_count = 0;
+	for (i = 0; i < hashcons_size; ++i) {
+		if (hashcons_slots[i] != 0) {
+			hashcons_insert(slots, size, hashcons_slots[i]);
+			hashcons_count += 1;
+		}
+	}
+
+	free(hashcons_slots);
+	hashcons_slots = slots;
+	hashcons_size = size;
+}
+
+/**
+ * Finds the shared pair of car and cdr, creating it if there is none. Returns zero if the pair
+ * can't be shared, in which case the caller builds an ordinary pair.
+ */
+struct s_exp *hashcons(struct s_exp *car, struct s_exp *cdr) {
+	struct s_exp *cell;
+	size_t i;
+
+	if (!hashcons_eligible(car) || !hashcons_eligible(cdr))
+		return 0;
+
+	// Keep the table at most half full, so that probe sequences stay short
+	if (2*(hashcons_count + 1) > hashcons_size)
+		hashcons_rebuild(hashcons_size == 0 ? HASHCONS_INITIAL_SLOTS : 2*hashcons_size);
+
+	i = hashcons_hash(car, cdr) & (hashcons_size - 1);
+	for (cell = hashcons_slots[i]; cell != 0; cell = hashcons_slots[i]) {
+		if (hashcons_same(cell->lisp_car.car, car) && hashcons_same(cell->lisp_cdr.cdr, cdr))
+			return cell;
+		i = (i + 1) & (hashcons_size - 1);
+	}
+
+	cell = find_free_s_exp();
+	cell->flags = FLAG_HASHCONS | FLAG_IMMUTABLE;
+	cell->lisp_car.car = car;
+	cell->lisp_cdr.cdr = cdr;
+
+	hashcons_slots[i] = cell;
+	hashcons_count += 1;
+	return cell;
+}
+
+/**
+ * Called by the garbage collector once everything alive has been copied. Pairs that were
+ * copied are replaced by their copies and the rest are dropped. The halves of the survivors
+ * may have moved, so the whole table is rehashed.
+ */
+void hashcons_collect(void) {
+	struct s_exp *cell;
+	size_t i;
+
+	if (hashcons_size == 0)
+		return;
+
+	for (i = 0; i < hashcons_size; ++i) {
+		cell = hashcons_slots[i];
+		if (cell == 0 || !gc_in_from_space(cell))
+			continue;
+
+		if ((cell->flags & FLAG_FORWARDED) == FLAG_FORWARDED)
+			hashcons_slots[i] = cell->lisp_car.car;
+		else
+			hashcons_slots[i] = 0;
+	}
+
+	hashcons_rebuild(hashcons_size);
+}
@@ -0,0 +1,35 @@
+#ifndef _LISP_HASHCONS_H_
+#define _LISP_HASHCONS_H_
+/**
+ * Hash-consing, an opt-in mode in which cons hands back an existing pair instead of building
+ * a new one whenever an identical pair is still alive. A pair is shared when both of its halves
+ * are atoms or shared pairs themselves, so that structurally equal shared pairs are always the
+ * same cell, and equal? on them is a pointer comparison. Shared pairs are immutable.
+ *
+ * The table of shared pairs is weak. It does not keep pairs alive, and the garbage collector
+ * drops the pairs that died and rehashes the rest, since their halves may have moved.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stddef.h>
+
+// Initial number of slots in the table, which must be a power of two
+#define HASHCONS_INITIAL_SLOTS	1024
+
+// Set to nonzero to share identical pairs
+extern int hashcons_enabled;
+
+// Construction and collection
+struct s_exp *hashcons(struct s_exp *car, struct s_exp *cdr);
+void hashcons_collect(void);
+
+// Table management, used internally
+int hashcons_eligible(struct s_exp *s);
+uint64_t hashcons_key(struct s_exp *s);
+uint64_t hashcons_hash(struct s_exp *car, struct s_exp *cdr);
+int hashcons_same(struct s_exp *a, struct s_exp *b);
+void hashcons_insert(struct s_exp **slots, size_t size, struct s_exp *cell);
+void hashcons_rebuild(size_t size);
+
+#endif
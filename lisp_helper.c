@@ -3,6 +3,7 @@
  */
 
 // Standard headers
+#include <stddef.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <stdarg.h>
@@ -12,9 +13,22 @@
 // Project headers
 #include "lisp.h"
 
-// This is our pre-allocated list of free s-expressions. In the event that we need more, find_free_s_exp()
-// will just call the allocator again
-struct s_exp *next_free_exp = 0;
+// The pool of quoted constants, chained into buckets by the structural hash of their data
+struct lisp_constant **constant_pool = 0;
+uint32_t constant_pool_buckets = 0;
+uint32_t constant_pool_count = 0;
+
+// Released local frames, ready to be handed out again, and the innermost frame in use
+struct lisp_frame *frame_free_list = 0;
+struct lisp_frame *frame_active = 0;
+
+// The innermost array of arguments in use that was too long for the C stack
+struct lisp_argv *argv_active = 0;
+
+// Interned labels, chained into buckets by the hash of their text
+struct lisp_label **label_table = 0;
+uint32_t label_buckets = 0;
+uint32_t label_count = 0;
 
 /**
  * This function creates the global environment, adds labels for our default symbols, and creates some
@@ -32,9 +46,62 @@ struct lisp_env *lisp_init(void) {
 	define_label("quote", lisp_quote, env);
 	define_label("define", lisp_define, env);
 	define_label("lambda", lisp_lambda, env);
+	define_label("memo", lisp_memo, env);
+	define_label("define-memo", lisp_define_memo, env);
+	define_label("defmacro", lisp_defmacro, env);
+	define_label("delay", lisp_delay, env);
+	define_label("stream-cons", lisp_stream_cons, env);
+	define_label("catch", lisp_catch, env);
+	define_label("set!", lisp_set, env);
+
+	// Then the primitive functions, which are ordinary bindings to function atoms
+	define_label("cons", lisp_cons, env);
+	define_label("car", lisp_car, env);
+	define_label("cdr", lisp_cdr, env);
+	define_label("eq?", lisp_eq, env);
+	define_label("equal?", lisp_equal, env);
+	define_label("atom?", lisp_atom, env);
+	define_label("string-append", lisp_string_append, env);
+	define_label("substring", lisp_substring, env);
+	define_label("string-length", lisp_string_length, env);
+	define_label("string=?", lisp_string_eq, env);
+	define_label("memo-stats", lisp_memo_stats, env);
+	define_label("+", lisp_add, env);
+	define_label("-", lisp_sub, env);
+	define_label("*", lisp_mul, env);
+	define_label("/", lisp_div, env);
+	define_label("<", lisp_lt, env);
+	define_label(">", lisp_gt, env);
+	define_label("=", lisp_num_eq, env);
+
+	// Integer division and the parts of exact numbers
+	number_init(env);
+
+	// Output for programs that are run quietly
+	define_label("display", make_native("display", 1, _display, 0), env);
+	define_label("write", make_native("write", 1, _write, 0), env);
+	define_label("newline", make_native("newline", 0, _newline, 0), env);
+
+	// Promises and the stream library
+	stream_init(env);
+
+	// Raising errors and taking them apart
+	error_init(env);
+
+	// Controlling the trace
+	trace_init(env);
+
+	// Loading other files
+	module_init(env);
+
+	// Boxes and changing pairs in place
+	mutate_init(env);
 
-	// Allocate the initial batch of free s-expressions
-	next_free_exp = alloc_s_exp_to_free(100);
+	// Numeric arrays
+	array_init(env);
+
+	// The global environment's bindings keep everything they refer to alive
+	gc_register_env(env);
 
 	return env;
 }
@@ -44,6 +111,8 @@ struct lisp_env *lisp_init(void) {
  * adjusted, parenthesis added, etc.
  */
 void pp_atomic(struct s_exp *exp) {
+	char *text;
+
 	if (IS_UNDEFINED(exp)) {
 		printf("#<undefined>");
 	}
@@ -57,6 +126,11 @@ void pp_atomic(struct s_exp *exp) {
 		else if (IS_FLOAT(exp)) {
 			printf("%f", exp->lisp_car.dVal);
 		}
+		else if (IS_BIGNUM(exp) || IS_RATIO(exp)) {
+			text = number_to_string(exp);
+			printf("%s", text);
+			free(text);
+		}
 		else if (IS_BOOL(exp)) {
 			if (exp->lisp_car.uiVal == 0) {
 				printf("#f");
@@ -66,7 +140,38 @@ void pp_atomic(struct s_exp *exp) {
 			}
 		}
 		else if (IS_STRING(exp)) {
-			printf("\"%s\"", exp->lisp_car.strVal);
+			print_string(exp);
+		}
+		else if (IS_CONSTANT(exp)) {
+			// Show pooled constants the way they were written
+			printf("(quote ");
+			if (IS_ATOM(exp->lisp_car.car)) {
+				pp_atomic(exp->lisp_car.car);
+			}
+			else {
+				printf("(");
+				pp_helper(exp->lisp_car.car, 0, 1);
+				printf(")");
+			}
+			printf(")");
+		}
+		else if (IS_MACRO(exp)) {
+			printf("#<macro>");
+		}
+		else if (IS_PROMISE(exp)) {
+			printf("#<promise>");
+		}
+		else if (IS_ERROR(exp)) {
+			printf("#<error %s: %s>", exp->lisp_car.condition->kind, exp->lisp_car.condition->message);
+		}
+		else if (IS_FUNCTION(exp)) {
+			printf("#<native %s>", exp->lisp_car.native->name);
+		}
+		else if (IS_BOX(exp)) {
+			printf("#<box>");
+		}
+		else if (IS_ARRAY(exp)) {
+			array_print(exp);
 		}
 		else {
 			printf("#<atomic>");
@@ -166,31 +271,225 @@ void simple_print_exp(struct s_exp *exp) {
 }
 
 /**
- * This allocates a bunch of s-expression structures and chains them together properly, so that
- * they can be used with find_free_s_exp()
+ * Prints an expression on a single line, the way display and write show it. Strings are printed
+ * as their text when raw is set, and quoted otherwise.
+ */
+void display_exp(struct s_exp *exp, int raw) {
+	if (IS_ATOM(exp)) {
+		if (raw && IS_STRING(exp))
+			fwrite(string_flatten(exp), 1, exp->lisp_cdr.length, stdout);
+		else
+			pp_atomic(exp);
+		return;
+	}
+
+	printf("(");
+	display_exp(exp->lisp_car.car, raw);
+	for (exp = exp->lisp_cdr.cdr; !IS_ATOM(exp); exp = exp->lisp_cdr.cdr) {
+		printf(" ");
+		display_exp(exp->lisp_car.car, raw);
+	}
+	if (!IS_NIL(exp)) {
+		printf(" . ");
+		display_exp(exp, raw);
+	}
+	printf(")");
+}
+
+/**
+ * (display x) prints x for people to read, with strings as their text
+ */
+struct s_exp *_display(struct s_exp **argv, int argc, void *data) {
+	display_exp(argv[0], 1);
+	return lisp_undefined;
+}
+
+/**
+ * (write x) prints x the way it would be written in source
+ */
+struct s_exp *_write(struct s_exp **argv, int argc, void *data) {
+	display_exp(argv[0], 0);
+	return lisp_undefined;
+}
+
+/**
+ * (newline) ends the line of output
+ */
+struct s_exp *_newline(struct s_exp **argv, int argc, void *data) {
+	putchar('\n');
+	return lisp_undefined;
+}
+
+/**
+ * Creates a new integer atom from the free store
+ */
+struct s_exp *make_int(int64_t val) {
+	struct s_exp *rtn;
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_INT;
+	rtn->lisp_car.siVal = val;
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Creates a function atom for a native function called through the array entry point fn, which
+ * may be null if the caller fills in a fixed arity entry point instead. Natives live as long as the program, so the
+ * atom and its description are allocated with malloc() rather than taken from the free store.
+ */
+struct s_exp *make_native(const char *name, int arity, lisp_native_fn fn, void *data) {
+	struct s_exp *rtn;
+	struct lisp_native *native;
+
+	native = (struct lisp_native *) calloc(1, sizeof(struct lisp_native));
+	native->name = strdup(name);
+	native->arity = arity;
+	native->fn = fn;
+	native->data = data;
+
+	rtn = (struct s_exp *) malloc(sizeof(struct s_exp));
+	rtn->flags = FLAG_ATOM | FLAG_FUNCTION;
+	rtn->lisp_car.native = native;
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Flags every pair in a datum as immutable, so that nothing can later modify a pooled constant
+ * out from under the other code that shares it
+ */
+void mark_immutable(struct s_exp *datum) {
+	while (!IS_ATOM(datum) && !IS_IMMUTABLE(datum)) {
+		datum->flags |= FLAG_IMMUTABLE;
+		mark_immutable(datum->lisp_car.car);
+		datum = datum->lisp_cdr.cdr;
+	}
+}
+
+/**
+ * Finds the pooled constant cell for a datum, creating it if no equal datum has been pooled
+ * before. Constants live for the lifetime of the program, so they are allocated with malloc()
+ * rather than taken from the free store.
+ */
+struct s_exp *intern_constant(struct s_exp *datum) {
+	struct lisp_constant *entry;
+	struct lisp_constant *next;
+	struct lisp_constant **buckets;
+	uint64_t hash;
+	uint32_t i;
+
+	hash = c_lisp_hash(datum);
+
+	if (constant_pool != 0) {
+		for (entry = constant_pool[hash & (constant_pool_buckets - 1)]; entry != 0; entry = entry->next) {
+			if (entry->hash == hash && c_lisp_equal(entry->cell->lisp_car.car, datum) == 1)
+				return entry->cell;
+		}
+	}
+
+	// Grow the pool when it is full, rehashing everything that is already in it
+	if (constant_pool_count >= constant_pool_buckets) {
+		buckets = (struct lisp_constant **) calloc(constant_pool_buckets == 0 ? 64 : constant_pool_buckets * 2,
+				sizeof(struct lisp_constant *));
+		for (i = 0; i < constant_pool_buckets; ++i) {
+			for (entry = constant_pool[i]; entry != 0; entry = next) {
+				next = entry->next;
+				entry->next = buckets[entry->hash & (constant_pool_buckets * 2 - 1)];
+				buckets[entry->hash & (constant_pool_buckets * 2 - 1)] = entry;
+			}
+		}
+		free(constant_pool);
+		constant_pool = buckets;
+		constant_pool_buckets = constant_pool_buckets == 0 ? 64 : constant_pool_buckets * 2;
+	}
+
+	mark_immutable(datum);
+
+	entry = (struct lisp_constant *) malloc(sizeof(struct lisp_constant));
+	entry->hash = hash;
+	entry->cell = (struct s_exp *) malloc(sizeof(struct s_exp));
+	entry->cell->flags = FLAG_ATOM | FLAG_CONSTANT;
+	entry->cell->lisp_car.car = datum;
+	entry->cell->lisp_cdr.cdr = 0;
+	entry->next = constant_pool[hash & (constant_pool_buckets - 1)];
+	constant_pool[hash & (constant_pool_buckets - 1)] = entry;
+	constant_pool_count += 1;
+
+	return entry->cell;
+}
+
+/**
+ * Forwards the data held by every pooled constant, for the garbage collector. The constant
+ * cells themselves are not on the heap and never move, so code that refers to them is fine.
+ */
+void constant_pool_collect(void) {
+	struct lisp_constant *entry;
+	uint32_t i;
+
+	for (i = 0; i < constant_pool_buckets; ++i) {
+		for (entry = constant_pool[i]; entry != 0; entry = entry->next)
+			gc_forward(entry->cell);
+	}
+}
+
+/**
+ * Returns the interned copy of label, adding one the first time a label is seen
  */
-struct s_exp *alloc_s_exp_to_free(int count) {
-	struct s_exp *head;
-	int i;
+char *intern_label(const char *label) {
+	struct lisp_label **buckets;
+	struct lisp_label *entry;
+	struct lisp_label *next;
+	const char *c;
+	uint64_t hash;
+	uint32_t i;
+
+	hash = 14695981039346656037ULL;
+	for (c = label; *c != '\0'; ++c)
+		hash = (hash ^ (uint8_t) *c) * 1099511628211ULL;
 
-	head = (struct s_exp *) calloc(count, sizeof(struct s_exp));
-	head[count-1].lisp_cdr.cdr = 0;
-	for (i = 0; i < count-1; ++i) {
-		head[i].lisp_cdr.cdr = &head[i+1];
+	if (label_buckets > 0) {
+		for (entry = label_table[hash & (label_buckets - 1)]; entry != 0; entry = entry->next) {
+			if (entry->hash == hash && strcmp(entry->label, label) == 0)
+				return entry->label;
+		}
 	}
 
-	return head;
+	// Grow the table when it is full, in the same way as the constant pool
+	if (label_count >= label_buckets) {
+		buckets = (struct lisp_label **) calloc(label_buckets == 0 ? 64 : label_buckets * 2, sizeof(struct lisp_label *));
+		for (i = 0; i < label_buckets; ++i) {
+			for (entry = label_table[i]; entry != 0; entry = next) {
+				next = entry->next;
+				entry->next = buckets[entry->hash & (label_buckets * 2 - 1)];
+				buckets[entry->hash & (label_buckets * 2 - 1)] = entry;
+			}
+		}
+		free(label_table);
+		label_table = buckets;
+		label_buckets = label_buckets == 0 ? 64 : label_buckets * 2;
+	}
+
+	entry = (struct lisp_label *) malloc(sizeof(struct lisp_label));
+	entry->hash = hash;
+	entry->label = strdup(label);
+	entry->next = label_table[hash & (label_buckets - 1)];
+	label_table[hash & (label_buckets - 1)] = entry;
+	label_count += 1;
+
+	return entry->label;
 }
 
 /**
- * Print an error message, for some nice abstraction. Eventually this might prepend or something
+ * Print an error message to stderr, for problems such as parse errors that happen outside of
+ * evaluation and so cannot be raised
  */
 void lisp_error(char *fmt, ...) {
 	va_list args;
-	
+
 	// Set up variadic arguments and then call printf with them
 	va_start(args, fmt);
-	vprintf(fmt, args);
+	vfprintf(stderr, fmt, args);
 	va_end(args);
 }
 
@@ -201,9 +500,8 @@ void lisp_error(char *fmt, ...) {
 struct s_exp *lookup_label(char *label, struct lisp_env *env) {
 	struct lisp_mapping *map;
 
-	// First check to make sure we have environment left in which to search
-	if (env == 0 || env->mapping == 0) {
-		lisp_error("Label %s not found!", label);
+	// Running out of environments to search means that the label is unbound
+	if (env == 0) {
 		return lisp_undefined;
 	}
 
@@ -220,37 +518,115 @@ struct s_exp *lookup_label(char *label, struct lisp_env *env) {
 	return lookup_label(label, env->parent);
 }
 
+/**
+ * Looks up the value of a symbol cell. Local frames are searched directly, because they are
+ * small, but once the search reaches the global environment the symbol's inline cache is used,
+ * so that repeated references to global functions skip the long global mapping list.
+ */
+struct s_exp *lookup_symbol(struct s_exp *symbol, struct lisp_env *env) {
+	struct lisp_mapping *map;
+	struct lisp_icache *cache;
+	struct s_exp *value;
+
+	// Walk every frame but the outermost one
+	while (env != 0 && env->parent != 0) {
+		for (map = env->mapping; map != 0; map = map->next) {
+			if (strcmp(symbol->lisp_car.label, map->label) == 0) {
+				return map->exp;
+			}
+		}
+		env = env->parent;
+	}
+
+	// Check the cache before searching the global environment
+	cache = symbol->lisp_cdr.icache;
+	if (cache != 0 && cache->env == env && cache->version == env->version) {
+		return cache->value;
+	}
+
+	value = lookup_label(symbol->lisp_car.label, env);
+	if (IS_UNDEFINED(value)) {
+		return value;
+	}
+
+	// Fill in the cache for next time
+	if (cache == 0) {
+		cache = (struct lisp_icache *) malloc(sizeof(struct lisp_icache));
+		symbol->lisp_cdr.icache = cache;
+	}
+	cache->env = env;
+	cache->version = env->version;
+	cache->value = value;
+	return value;
+}
+
 /**
  * Insert a label into the current environment with an s-expression value.
  * Note that this doesn't bother checking if it already exists, because we prepend it
  * will effectively be overwritten anyway, from the lookup perspective.
  *
- * Also, since s-expressions are immutable, we don't need to make a copy, ever.
- *
- * TODO: Preallocate a bunch of mapping structures to speed up their allocation/deallocation
+ * Also, values are shared rather than copied, just as they are everywhere else. The label is
+ * interned, so the caller's copy can go away and nothing has to free it later.
  */
 void define_label(char *label, struct s_exp *val, struct lisp_env *env) {
 	struct lisp_mapping *mapping;
+	struct lisp_frame *frame;
 	
-	// Allocate our mapping, copy the label to make it easier on the caller, and then insert
-	mapping = (struct lisp_mapping *) calloc(1, sizeof(struct lisp_mapping));
-	mapping->label = strdup(label);
+	// Local frames use their inline slots first, and anything else gets a mapping of its own
+	frame = env->frame;
+	if (frame != 0 && frame->used < FRAME_SLOTS) {
+		mapping = &frame->slots[frame->used++];
+	}
+	else {
+		mapping = (struct lisp_mapping *) malloc(sizeof(struct lisp_mapping));
+		if (frame != 0)
+			frame->overflow = 1;
+	}
+
+	mapping->label = intern_label(label);
 	mapping->exp = val;
 	mapping->next = env->mapping;
 	env->mapping = mapping;
+
+	// Anything cached from this environment may now be shadowed
+	env->version += 1;
 }
 
 /**
- * Walk an environment and deallocate all of the mappings and labels found therein.
+ * Changes the value of the nearest binding of label that is visible from env, and returns 1,
+ * or returns 0 if label isn't bound at all. Inline caches and compiled code hold on to the
+ * values of globals, so changing one bumps the version of the global environment, just as
+ * defining one does.
+ */
+int set_label(char *label, struct s_exp *val, struct lisp_env *env) {
+	struct lisp_mapping *map;
+
+	for (; env != 0; env = env->parent) {
+		for (map = env->mapping; map != 0; map = map->next) {
+			if (strcmp(label, map->label) == 0) {
+				map->exp = val;
+				if (env->parent == 0)
+					env->version += 1;
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Walk an environment and deallocate all of the mappings found therein.
  * If only it were this easy in real life to clean up the environment!
  *
  * Note: this doesn't recurse on the parent. This is just deallocating this particular
- * call frame/locale (for instance, within a let statement, or something).
+ * call frame/locale (for instance, within a let statement, or something). Local frames from
+ * the pool are released with frame_release() instead.
  *
  * Also, the environment struct itself must still be deallocated external to this function
  *
- * TODO: This will attempt to deallocate the statically allocated symbols for true, false and nil
- * TODO: Add in checks to avoid attempting to deallocate them, as that will cause a crash
+ * Labels are interned and the values belong to the heap (or are the static built-ins), so
+ * only the mappings themselves are freed.
  */
 void cleanup_environment(struct lisp_env *env) {
 	struct lisp_mapping *next;
@@ -260,26 +636,104 @@ void cleanup_environment(struct lisp_env *env) {
 	// allocated with malloc()
 	next = env->mapping;
 	while (next != 0) {
-		free(next->label);
 		prev = next;
 		next = next->next;
 		free(prev);
 	}
+	env->mapping = 0;
 }
 
 /**
- * This finds a free s-expression to allocate to cons (that is, one who is pointed to by our free list)
+ * Takes an empty local frame on top of parent from the pool, allocating a new one only when
+ * every frame is in use
  */
-struct s_exp *find_free_s_exp(void) {
-	struct s_exp *rtn;
+struct lisp_env *frame_acquire(struct lisp_env *parent) {
+	struct lisp_frame *frame;
+
+	frame = frame_free_list;
+	if (frame != 0)
+		frame_free_list = frame->next;
+	else
+		frame = (struct lisp_frame *) malloc(sizeof(struct lisp_frame));
+
+	frame->env.mapping = 0;
+	frame->env.parent = parent;
+	frame->env.version = 0;
+	frame->env.frame = frame;
+	frame->used = 0;
+	frame->overflow = 0;
+	frame->below = frame_active;
+	frame_active = frame;
+	return &frame->env;
+}
+
+/**
+ * Returns a local frame to the pool. Frames are released in the reverse of the order they were
+ * acquired in, so this is always the innermost frame in use. Its bindings live in the frame
+ * itself, so unless some overflowed the inline slots there is nothing to free.
+ */
+void frame_release(struct lisp_env *env) {
+	struct lisp_frame *frame;
+	struct lisp_mapping *mapping;
+	struct lisp_mapping *next;
 
-	// Make sure we have space
-	if (next_free_exp == 0) {
-		next_free_exp = alloc_s_exp_to_free(100);
+	frame = env->frame;
+	if (frame->overflow) {
+		for (mapping = env->mapping; mapping != 0; mapping = next) {
+			next = mapping->next;
+			if (mapping < frame->slots || mapping >= frame->slots + FRAME_SLOTS)
+				free(mapping);
+		}
+	}
+
+	frame_active = frame->below;
+	frame->next = frame_free_list;
+	frame_free_list = frame;
+}
+
+/**
+ * Releases every frame acquired since mark was the innermost frame in use, for an evaluation
+ * that was abandoned without releasing its own
+ */
+void frame_unwind(struct lisp_frame *mark) {
+	while (frame_active != 0 && frame_active != mark)
+		frame_release(&frame_active->env);
+}
+
+/**
+ * Allocates an array for argc arguments, for a call with too many to keep them on the C stack
+ */
+struct s_exp **argv_acquire(int argc) {
+	struct lisp_argv *block;
+
+	block = (struct lisp_argv *) malloc(sizeof(struct lisp_argv) + argc * sizeof(struct s_exp *));
+	block->below = argv_active;
+	argv_active = block;
+	return block->argv;
+}
+
+/**
+ * Frees an array from argv_acquire(). Like frames, arrays are released in the reverse of the
+ * order they were acquired in, so this is always the innermost one.
+ */
+void argv_release(struct s_exp **argv) {
+	struct lisp_argv *block;
+
+	block = (struct lisp_argv *) ((char *) argv - offsetof(struct lisp_argv, argv));
+	argv_active = block->below;
+	free(block);
+}
+
+/**
+ * Frees every array acquired since mark was the innermost one in use, for an evaluation that
+ * was abandoned without releasing its own
+ */
+void argv_unwind(struct lisp_argv *mark) {
+	struct lisp_argv *block;
+
+	while (argv_active != 0 && argv_active != mark) {
+		block = argv_active;
+		argv_active = block->below;
+		free(block);
 	}
-	
-	// Update our linked list and return the first free s-expression
-	rtn = next_free_exp;
-	next_free_exp = next_free_exp->lisp_cdr.cdr;
-	return rtn;
 }
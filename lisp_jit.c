@@ -0,0 +1,1042 @@
+/**
+ * Template JIT for lambda bodies on x86-64. Each kind of expression is translated by a fixed
+ * template that leaves its value in rax. Within compiled code rbx points at the array of
+ * arguments, so parameters are a single load, and r12 holds the environment the lambda was
+ * applied in.
+ *
+ * car, cdr and atom? are inlined behind a type check on the cell, and +, -, *, <, > and = are
+ * inlined for fixnums behind a check on both arguments and on overflow. When a check fails the
+ * template falls back to the interpreter's own primitive, which handles the remaining cases and
+ * reports errors exactly as eval() would. cons and eq? are called directly, and so are other
+ * natives and the lambda itself when it recurses, with a self call in tail position becoming a
+ * jump back to the top.
+ *
+ * Scoping is dynamic, so anything else, including calls to other lambdas, is handed to the
+ * interpreter in a frame that binds the parameters to their current values, where every lookup
+ * sees what it would have seen had the whole body been interpreted. The values are copied back
+ * afterwards, in case something it called assigned to a parameter. Free variables are looked up
+ * in the environment the lambda was applied in, as they would be from its frame.
+ *
+ * The decisions about which names are primitives, natives or the lambda itself are made against
+ * the global environment at compile time, and recorded as guards on the compiled code. Like the
+ * rest of the evaluator, compiled code assumes that callers do not shadow those names with
+ * parameters of their own.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_jit.h"
+
+#if defined(__x86_64__)
+int jit_enabled = 1;
+#else
+int jit_enabled = 0;
+#endif
+int jit_threshold = JIT_THRESHOLD;
+
+// The table of lambdas that have been applied while the JIT was enabled
+struct jit_entry **jit_buckets = 0;
+uint32_t jit_bucket_count = 0;
+uint32_t jit_count = 0;
+
+// The block of executable memory currently being filled
+struct jit_region *jit_region = 0;
+
+/**
+ * Forgets every lambda and all compiled code, which the garbage collector needs after moving
+ * the cells that compiled code refers to. The block of executable memory being filled is reused
+ * for new code, and the blocks before it are unmapped. Collections only happen where no
+ * compiled code is running, so none of it can still be on the stack.
+ */
+void jit_reset(void) {
+	struct jit_region *region;
+	struct jit_entry *entry;
+	struct jit_entry *next;
+	uint32_t i;
+
+	for (i = 0; i < jit_bucket_count; ++i) {
+		for (entry = jit_buckets[i]; entry != 0; entry = next) {
+			next = entry->next;
+			if (entry->code != 0) {
+				free(entry->code->guardSymbols);
+				free(entry->code->guardValues);
+				free(entry->code);
+			}
+			free(entry);
+		}
+	}
+
+	free(jit_buckets);
+	jit_buckets = 0;
+	jit_bucket_count = 0;
+	jit_count = 0;
+
+	if (jit_region != 0) {
+		while (jit_region->prev != 0) {
+			region = jit_region->prev;
+			jit_region->prev = region->prev;
+			munmap(region->base, JIT_REGION_SIZE);
+			free(region);
+		}
+		jit_region->used = 0;
+	}
+}
+
+/**
+ * Applies a lambda to unevaluated arguments, counting the application and compiling the lambda
+ * once it is hot. Arguments to compiled code are evaluated straight into an array, without
+ * building a list.
+ */
+struct s_exp *jit_apply(struct s_exp *lambda, struct s_exp *args, struct lisp_env *env) {
+	struct s_exp *local[NATIVE_LOCAL_ARGS];
+	struct jit_entry *entry;
+	struct jit_code *code;
+	struct s_exp *cur;
+	int argc;
+
+	entry = jit_find(lambda);
+	if (entry->code == 0 && entry->state == JIT_COLD && ++entry->calls >= jit_threshold)
+		jit_try_compile(entry, env);
+
+	code = entry->code;
+	if (code == 0)
+		return apply_lambda(lambda, eval_each(args, env), env);
+
+	// Mismatched argument counts are left for the interpreter to deal with
+	argc = 0;
+	for (cur = args; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		argc += 1;
+	}
+	if (argc != entry->arity || !IS_NIL(cur))
+		return apply_lambda(lambda, eval_each(args, env), env);
+
+	for (cur = args, argc = 0; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		local[argc++] = eval(cur->lisp_car.car, env);
+	}
+
+	lisp_depth += 1;
+	cur = code->fn(local, env);
+	lisp_depth -= 1;
+	return cur;
+}
+
+/**
+ * Compiles a lambda, giving up on it if its body is malformed enough to raise an error, which
+ * the interpreter raises again when it reaches that part of the body
+ */
+void jit_try_compile(struct jit_entry *entry, struct lisp_env *env) {
+	struct lisp_handler handler;
+	struct jit_buffer buf;
+
+	memset(&buf, 0, sizeof(struct jit_buffer));
+
+	handler_push(&handler);
+	if (setjmp(handler.jump) != 0) {
+		entry->state = JIT_FAILED;
+		jit_buffer_free(&buf);
+		return;
+	}
+
+	jit_compile(entry, env, &buf);
+	handler_pop(&handler);
+	jit_buffer_free(&buf);
+}
+
+/**
+ * Frees whatever a buffer still owns once compilation is over, including the compiled code if
+ * it was never installed
+ */
+void jit_buffer_free(struct jit_buffer *buf) {
+	if (buf->compiled != 0) {
+		free(buf->compiled->guardSymbols);
+		free(buf->compiled->guardValues);
+		free(buf->compiled);
+	}
+	free(buf->code);
+	free(buf->ends);
+}
+
+/**
+ * Called by compiled code when the global environment has changed since it last checked its
+ * guards. Returns 1 if the code is still good, or retires it and returns 0 if not.
+ */
+int jit_revalidate(struct jit_code *code) {
+	struct jit_entry *entry;
+	struct s_exp *value;
+	int i;
+
+	if (code->valid == 0)
+		return 0;
+
+	for (i = 0; i < code->guardCount; ++i) {
+		value = lookup_label(code->guardSymbols[i]->lisp_car.label, code->root);
+
+		if (value != code->guardValues[i]) {
+			code->valid = 0;
+
+			// Let the lambda warm up again, so it can be compiled against the new bindings
+			entry = code->entry;
+			if (entry->code == code) {
+				entry->code = 0;
+				entry->calls = 0;
+				entry->recompiles += 1;
+				if (entry->recompiles > JIT_MAX_RECOMPILES)
+					entry->state = JIT_FAILED;
+			}
+			return 0;
+		}
+	}
+
+	code->version = code->root->version;
+	return 1;
+}
+
+/**
+ * Evaluates part of a lambda body in the interpreter, in a frame binding the lambda's
+ * parameters to the values in argv, exactly as apply_lambda() would have bound them. Scoping
+ * is dynamic, so anything called from there may assign to a parameter, and the values are
+ * copied back into argv for the compiled code to see.
+ */
+struct s_exp *jit_interpret(struct s_exp *exp, struct s_exp **argv, struct lisp_env *env, struct s_exp *lambda) {
+	struct lisp_env *frame;
+	struct s_exp *formals;
+	struct s_exp *rtn;
+	int i;
+
+	frame = frame_acquire(env);
+
+	for (formals = _car(_cdr(lambda)), i = 0; !IS_ATOM(formals); formals = formals->lisp_cdr.cdr, ++i) {
+		define_label(formals->lisp_car.car->lisp_car.label, argv[i], frame);
+	}
+
+	rtn = eval(exp, frame);
+
+	for (formals = _car(_cdr(lambda)), i = 0; !IS_ATOM(formals); formals = formals->lisp_cdr.cdr, ++i) {
+		argv[i] = lookup_label(formals->lisp_car.car->lisp_car.label, frame);
+	}
+
+	frame_release(frame);
+	return rtn;
+}
+
+/**
+ * Runs the whole body in the interpreter, for compiled code whose guards have failed
+ */
+struct s_exp *jit_fallback(struct jit_code *code, struct s_exp **argv, struct lisp_env *env) {
+	struct s_exp *lambda;
+
+	lambda = code->entry->lambda;
+	return jit_interpret(_car(_cdr(_cdr(lambda))), argv, env, lambda);
+}
+
+/**
+ * Finds the entry for a lambda, creating it the first time the lambda is seen
+ */
+struct jit_entry *jit_find(struct s_exp *lambda) {
+	struct jit_entry *entry;
+	uint32_t bucket;
+
+	if (jit_bucket_count == 0 || jit_count >= jit_bucket_count)
+		jit_grow();
+
+	bucket = (uint32_t) ((((uint64_t) (uintptr_t) lambda) * 0x9e3779b97f4a7c15ULL) >> 32) & (jit_bucket_count - 1);
+	for (entry = jit_buckets[bucket]; entry != 0; entry = entry->next) {
+		if (entry->lambda == lambda)
+			return entry;
+	}
+
+	entry = (struct jit_entry *) calloc(1, sizeof(struct jit_entry));
+	entry->lambda = lambda;
+	entry->state = JIT_COLD;
+	entry->next = jit_buckets[bucket];
+	jit_buckets[bucket] = entry;
+	jit_count += 1;
+	return entry;
+}
+
+/**
+ * Doubles the number of buckets in the lambda table and rehashes every entry
+ */
+void jit_grow(void) {
+	struct jit_entry **buckets;
+	struct jit_entry *entry;
+	struct jit_entry *next;
+	uint32_t count;
+	uint32_t bucket;
+	uint32_t i;
+
+	count = (jit_bucket_count == 0) ? JIT_INITIAL_BUCKETS : 2*jit_bucket_count;
+	buckets = (struct jit_entry **) calloc(count, sizeof(struct jit_entry *));
+
+	for (i = 0; i < jit_bucket_count; ++i) {
+		for (entry = jit_buckets[i]; entry != 0; entry = next) {
+			next = entry->next;
+			bucket = (uint32_t) ((((uint64_t) (uintptr_t) entry->lambda) * 0x9e3779b97f4a7c15ULL) >> 32) & (count - 1);
+			entry->next = buckets[bucket];
+			buckets[bucket] = entry;
+		}
+	}
+
+	free(jit_buckets);
+	jit_buckets = buckets;
+	jit_bucket_count = count;
+}
+
+#if defined(__x86_64__)
+
+/**
+ * Compiles a lambda into buf, which starts out empty. If it can't be compiled, it is marked so
+ * that it is never tried again. The compiled code is installed on success, and anything else
+ * left in buf is the caller's to free.
+ */
+void jit_compile(struct jit_entry *entry, struct lisp_env *env, struct jit_buffer *buf) {
+	struct jit_code *compiled;
+	struct s_exp *lambda;
+	struct s_exp *cur;
+	struct lisp_env *root;
+	size_t ok;
+	size_t current;
+	size_t fallback;
+	size_t bail;
+	void *mem;
+	int arity;
+	int i;
+
+	lambda = entry->lambda;
+
+	// Only lambdas with a proper list of symbols as parameters, and a single body that never
+	// assigns to them, are handled
+	arity = 0;
+	for (cur = _car(_cdr(lambda)); !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		if (!IS_SYMBOL(cur->lisp_car.car))
+			break;
+		arity += 1;
+	}
+	if (!IS_NIL(cur) || arity > NATIVE_LOCAL_ARGS || IS_ATOM(_cdr(_cdr(lambda))) || !IS_NIL(_cdr(_cdr(_cdr(lambda))))
+			|| form_assigns(_car(_cdr(_cdr(lambda))), _car(_cdr(lambda)))) {
+		entry->state = JIT_FAILED;
+		return;
+	}
+
+	for (root = env; root->parent != 0; root = root->parent)
+		;
+
+	compiled = (struct jit_code *) calloc(1, sizeof(struct jit_code));
+	compiled->entry = entry;
+	compiled->root = root;
+	compiled->version = root->version;
+	compiled->valid = 1;
+
+	entry->arity = arity;
+	buf->size = 256;
+	buf->code = (uint8_t *) malloc(buf->size);
+	buf->length = 0;
+	buf->depth = 0;
+	buf->entry = entry;
+	buf->compiled = compiled;
+
+	// Prologue: push rbp; mov rbp, rsp; push rbx; push r12; mov rbx, rdi; mov r12, rsi
+	jit_bytes(buf, "\x55\x48\x89\xe5\x53\x41\x54\x48\x89\xfb\x49\x89\xf4", 13);
+
+	// Count a step, with sub qword [rcx], 1 borrowing when the countdown runs out
+	buf->top = buf->length;
+	jit_load_imm(buf, JIT_RCX, (uint64_t) (uintptr_t) &lisp_steps_left);
+	jit_bytes(buf, "\x48\x83\x29\x01", 4);
+	ok = jit_jump(buf, JIT_CC_AE);
+	jit_call(buf, (void *) limit_tick);
+	jit_patch(buf, ok);
+
+	// Check that the global environment hasn't changed, or that the guards still hold if it has
+	jit_load_imm(buf, JIT_RCX, (uint64_t) (uintptr_t) &root->version);
+	jit_bytes(buf, "\x48\x8b\x09", 3);
+	jit_load_imm(buf, JIT_RDX, (uint64_t) (uintptr_t) &compiled->version);
+	jit_bytes(buf, "\x48\x8b\x12\x48\x39\xd1", 6);
+	ok = jit_jump(buf, JIT_CC_E);
+	jit_load_imm(buf, JIT_RDI, (uint64_t) (uintptr_t) compiled);
+	jit_call(buf, (void *) jit_revalidate);
+	jit_bytes(buf, "\x85\xc0", 2);
+	current = jit_jump(buf, JIT_CC_NE);
+	fallback = buf->length;
+	jit_load_imm(buf, JIT_RDI, (uint64_t) (uintptr_t) compiled);
+	jit_bytes(buf, "\x48\x89\xde\x4c\x89\xe2", 6);
+	jit_call(buf, (void *) jit_fallback);
+	bail = jit_jump(buf, JIT_JMP);
+	jit_patch(buf, ok);
+	jit_patch(buf, current);
+
+	// A parameter bound to the undefined value reads as unbound in the interpreter, and compiled
+	// code doesn't check its reads, so such calls are run by the interpreter instead
+	for (i = 0; i < arity; ++i) {
+		// mov rax, [rbx + 8*i]; test byte [rax], FLAG_UNDEFINED
+		jit_bytes(buf, "\x48\x8b\x83", 3);
+		jit_u32(buf, 8*i);
+		jit_bytes(buf, "\xf6\x00", 2);
+		jit_byte(buf, FLAG_UNDEFINED);
+		jit_jump_to(buf, JIT_CC_NE, fallback);
+	}
+
+	jit_expr(buf, _car(_cdr(_cdr(lambda))), 1);
+
+	// Epilogue: lea rsp, [rbp-16]; pop r12; pop rbx; pop rbp; ret
+	jit_patch(buf, bail);
+	jit_bytes(buf, "\x48\x8d\x65\xf0\x41\x5c\x5b\x5d\xc3", 9);
+
+	mem = jit_alloc_exec(buf->length);
+	if (mem == 0) {
+		entry->state = JIT_FAILED;
+		return;
+	}
+
+	memcpy(mem, buf->code, buf->length);
+	compiled->fn = (jit_fn) mem;
+	entry->code = compiled;
+	buf->compiled = 0;
+}
+
+/**
+ * Hands out executable memory from a block allocated with mmap, getting a new block when the
+ * current one is full. Returns 0 if no executable memory can be had.
+ */
+void *jit_alloc_exec(size_t size) {
+	struct jit_region *region;
+	void *rtn;
+
+	size = (size + 15) & ~((size_t) 15);
+	if (size > JIT_REGION_SIZE)
+		return 0;
+
+	if (jit_region == 0 || jit_region->used + size > JIT_REGION_SIZE) {
+		rtn = mmap(0, JIT_REGION_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (rtn == MAP_FAILED)
+			return 0;
+
+		region = (struct jit_region *) malloc(sizeof(struct jit_region));
+		region->base = (uint8_t *) rtn;
+		region->used = 0;
+		region->prev = jit_region;
+		jit_region = region;
+	}
+
+	rtn = jit_region->base + jit_region->used;
+	jit_region->used += size;
+	return rtn;
+}
+
+/**
+ * Records that the code being compiled depends on a global binding keeping its current value
+ */
+void jit_add_guard(struct jit_buffer *buf, struct s_exp *symbol, struct s_exp *value) {
+	struct jit_code *code;
+	int i;
+
+	code = buf->compiled;
+	for (i = 0; i < code->guardCount; ++i) {
+		if (strcmp(code->guardSymbols[i]->lisp_car.label, symbol->lisp_car.label) == 0)
+			return;
+	}
+
+	if (code->guardCount == code->guardSize) {
+		code->guardSize = (code->guardSize == 0) ? 8 : 2*code->guardSize;
+		code->guardSymbols = (struct s_exp **) realloc(code->guardSymbols, code->guardSize * sizeof(struct s_exp *));
+		code->guardValues = (struct s_exp **) realloc(code->guardValues, code->guardSize * sizeof(struct s_exp *));
+	}
+
+	code->guardSymbols[code->guardCount] = symbol;
+	code->guardValues[code->guardCount] = value;
+	code->guardCount += 1;
+}
+
+/**
+ * Looks up the global value of a name at compile time. Code that relies on the value must add
+ * a guard on it.
+ */
+struct s_exp *jit_global(struct jit_buffer *buf, struct s_exp *symbol) {
+	return lookup_label(symbol->lisp_car.label, buf->compiled->root);
+}
+
+/**
+ * Returns the index of the parameter a symbol names, or -1. Later parameters hide earlier ones
+ * with the same name, as they do in apply_lambda().
+ */
+int jit_param_index(struct jit_buffer *buf, struct s_exp *symbol) {
+	struct s_exp *cur;
+	int index;
+	int i;
+
+	index = -1;
+	for (cur = _car(_cdr(buf->entry->lambda)), i = 0; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr, ++i) {
+		if (strcmp(cur->lisp_car.car->lisp_car.label, symbol->lisp_car.label) == 0)
+			index = i;
+	}
+
+	return index;
+}
+
+/**
+ * Appends one byte of code
+ */
+void jit_byte(struct jit_buffer *buf, uint8_t b) {
+	if (buf->length == buf->size) {
+		buf->size *= 2;
+		buf->code = (uint8_t *) realloc(buf->code, buf->size);
+	}
+
+	buf->code[buf->length++] = b;
+}
+
+/**
+ * Appends a fixed sequence of instruction bytes
+ */
+void jit_bytes(struct jit_buffer *buf, const char *bytes, size_t count) {
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		jit_byte(buf, (uint8_t) bytes[i]);
+	}
+}
+
+/**
+ * Appends a 32 bit little endian immediate
+ */
+void jit_u32(struct jit_buffer *buf, uint32_t v) {
+	int i;
+
+	for (i = 0; i < 4; ++i) {
+		jit_byte(buf, (uint8_t) (v >> (8*i)));
+	}
+}
+
+/**
+ * Appends a 64 bit little endian immediate
+ */
+void jit_u64(struct jit_buffer *buf, uint64_t v) {
+	jit_u32(buf, (uint32_t) v);
+	jit_u32(buf, (uint32_t) (v >> 32));
+}
+
+/**
+ * Emits a forward jump, conditional on cc or unconditional for JIT_JMP, and returns the position
+ * of its displacement so that it can be patched once the target is known
+ */
+size_t jit_jump(struct jit_buffer *buf, uint8_t cc) {
+	if (cc == JIT_JMP) {
+		jit_byte(buf, 0xe9);
+	}
+	else {
+		jit_byte(buf, 0x0f);
+		jit_byte(buf, 0x80 | cc);
+	}
+
+	jit_u32(buf, 0);
+	return buf->length - 4;
+}
+
+/**
+ * Emits a jump back to an earlier position
+ */
+void jit_jump_to(struct jit_buffer *buf, uint8_t cc, size_t target) {
+	int32_t rel;
+	size_t at;
+
+	at = jit_jump(buf, cc);
+	rel = (int32_t) ((int64_t) target - (int64_t) (at + 4));
+	memcpy(buf->code + at, &rel, 4);
+}
+
+/**
+ * Points a forward jump at the current position
+ */
+void jit_patch(struct jit_buffer *buf, size_t at) {
+	int32_t rel;
+
+	rel = (int32_t) (buf->length - (at + 4));
+	memcpy(buf->code + at, &rel, 4);
+}
+
+/**
+ * Emits mov reg, imm64
+ */
+void jit_load_imm(struct jit_buffer *buf, int reg, uint64_t value) {
+	jit_byte(buf, (reg >= 8) ? 0x49 : 0x48);
+	jit_byte(buf, 0xb8 + (reg & 7));
+	jit_u64(buf, value);
+}
+
+/**
+ * Emits a call to a C function through r11, padding the stack to keep it 16 byte aligned
+ */
+void jit_call(struct jit_buffer *buf, void *target) {
+	jit_load_imm(buf, JIT_R11, (uint64_t) (uintptr_t) target);
+	if (buf->depth & 1)
+		jit_bytes(buf, "\x48\x83\xec\x08", 4);
+	jit_bytes(buf, "\x41\xff\xd3", 3);
+	if (buf->depth & 1)
+		jit_bytes(buf, "\x48\x83\xc4\x08", 4);
+}
+
+/**
+ * Emits a store of args to lisp_source_site before a call to a primitive that may raise an
+ * error, so that the error is located at the same form as it would be by eval(). Only r10 and
+ * r11 are used, which leaves the arguments to the call alone.
+ */
+void jit_site(struct jit_buffer *buf, struct s_exp *args) {
+	jit_load_imm(buf, JIT_R10, (uint64_t) (uintptr_t) args);
+	jit_load_imm(buf, JIT_R11, (uint64_t) (uintptr_t) &lisp_source_site);
+
+	// mov [r11], r10
+	jit_bytes(buf, "\x4d\x89\x13", 3);
+}
+
+/**
+ * Emits push rax
+ */
+void jit_push(struct jit_buffer *buf) {
+	jit_byte(buf, 0x50);
+	buf->depth += 1;
+}
+
+/**
+ * Emits a pop into one of the first eight registers
+ */
+void jit_pop(struct jit_buffer *buf, int reg) {
+	jit_byte(buf, 0x58 + reg);
+	buf->depth -= 1;
+}
+
+/**
+ * Compiles an expression, leaving its value in rax. In tail position, a call of the lambda to
+ * itself reuses the argument array and jumps back to the top instead.
+ */
+void jit_expr(struct jit_buffer *buf, struct s_exp *exp, int tail) {
+	struct s_exp *head;
+	struct s_exp *value;
+	struct s_exp *cur;
+	int index;
+	int argc;
+	int i;
+
+	if (IS_ATOM(exp)) {
+		if (!IS_SYMBOL(exp)) {
+			jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) (IS_CONSTANT(exp) ? exp->lisp_car.car : exp));
+		}
+		else if ((index = jit_param_index(buf, exp)) >= 0) {
+			// mov rax, [rbx + 8*index]
+			jit_bytes(buf, "\x48\x8b\x83", 3);
+			jit_u32(buf, 8*index);
+		}
+		else if (IS_NIL(exp) || strcmp(exp->lisp_car.label, "nil") == 0) {
+			jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) lisp_nil);
+		}
+		else if (strcmp(exp->lisp_car.label, "#t") == 0) {
+			jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) lisp_true);
+		}
+		else if (strcmp(exp->lisp_car.label, "#f") == 0) {
+			jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) lisp_false);
+		}
+		else {
+			// Free variables are looked up just as eval() would, through the symbol's cache
+			jit_load_imm(buf, JIT_RDI, (uint64_t) (uintptr_t) exp);
+			jit_bytes(buf, "\x4c\x89\xe6", 3);
+			jit_call(buf, (void *) eval);
+		}
+		return;
+	}
+
+	head = exp->lisp_car.car;
+	if (!IS_SYMBOL(head) || jit_param_index(buf, head) >= 0) {
+		jit_interpret_call(buf, exp);
+		return;
+	}
+
+	if (c_lisp_eq(head, lisp_quote) == 1) {
+		jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) _car(_cdr(exp)));
+		return;
+	}
+	else if (c_lisp_eq(head, lisp_cond) == 1) {
+		jit_cond(buf, exp, tail);
+		return;
+	}
+	else if (c_lisp_eq(head, lisp_lambda) == 1 || c_lisp_eq(head, lisp_label) == 1 || c_lisp_eq(head, lisp_memo) == 1) {
+		jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) exp);
+		return;
+	}
+	else if (c_lisp_eq(head, lisp_define) == 1 || c_lisp_eq(head, lisp_define_memo) == 1 || c_lisp_eq(head, lisp_defmacro) == 1
+			|| c_lisp_eq(head, lisp_set) == 1) {
+		jit_interpret_call(buf, exp);
+		return;
+	}
+
+	if (jit_inline(buf, exp))
+		return;
+
+	// Direct calls need a proper argument list
+	argc = 0;
+	for (cur = exp->lisp_cdr.cdr; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		argc += 1;
+	}
+	value = jit_global(buf, head);
+	if (!IS_NIL(cur) || argc > NATIVE_LOCAL_ARGS) {
+		jit_interpret_call(buf, exp);
+		return;
+	}
+
+	if (value == buf->entry->lambda && argc == buf->entry->arity) {
+		jit_add_guard(buf, head, value);
+		jit_args(buf, exp->lisp_cdr.cdr);
+
+		if (tail) {
+			// Overwrite the arguments in place and start over
+			for (i = 0; i < argc; ++i) {
+				jit_bytes(buf, "\x48\x8b\x84\x24", 4);
+				jit_u32(buf, 8*i);
+				jit_bytes(buf, "\x48\x89\x83", 3);
+				jit_u32(buf, 8*i);
+			}
+			jit_release(buf, argc);
+			jit_jump_to(buf, JIT_JMP, buf->top);
+			return;
+		}
+
+		// mov rdi, rsp; mov rsi, r12; call to the start of this function
+		jit_bytes(buf, "\x48\x89\xe7\x4c\x89\xe6", 6);
+		if (buf->depth & 1)
+			jit_bytes(buf, "\x48\x83\xec\x08", 4);
+		jit_byte(buf, 0xe8);
+		jit_u32(buf, (uint32_t) (int32_t) (0 - (int64_t) (buf->length + 4)));
+		if (buf->depth & 1)
+			jit_bytes(buf, "\x48\x83\xc4\x08", 4);
+		jit_release(buf, argc);
+		return;
+	}
+
+	if (IS_FUNCTION(value)) {
+		// Natives can't see the environment, so they are called straight from here
+		jit_add_guard(buf, head, value);
+		jit_args(buf, exp->lisp_cdr.cdr);
+		jit_bytes(buf, "\x48\x89\xe6", 3);
+		jit_load_imm(buf, JIT_RDI, (uint64_t) (uintptr_t) value->lisp_car.native);
+		jit_byte(buf, 0xba);
+		jit_u32(buf, argc);
+		jit_site(buf, exp->lisp_cdr.cdr);
+		jit_call(buf, (void *) native_dispatch);
+		jit_release(buf, argc);
+		return;
+	}
+
+	jit_interpret_call(buf, exp);
+}
+
+/**
+ * Compiles a cond form into a chain of tests and jumps
+ */
+void jit_cond(struct jit_buffer *buf, struct s_exp *exp, int tail) {
+	struct s_exp *clause;
+	struct s_exp *test;
+	struct s_exp *cur;
+	size_t skip;
+	int base;
+	int i;
+
+	// Malformed clauses are left to the interpreter to report
+	for (cur = exp->lisp_cdr.cdr; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		clause = cur->lisp_car.car;
+		if (IS_ATOM(clause) || IS_ATOM(clause->lisp_cdr.cdr)) {
+			jit_interpret_call(buf, exp);
+			return;
+		}
+	}
+
+	// Each clause's jump to the end is stacked in the buffer until the end is known
+	base = buf->endCount;
+	for (cur = exp->lisp_cdr.cdr; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		clause = cur->lisp_car.car;
+		test = clause->lisp_car.car;
+
+		// A literal #t always matches, and nothing after it can run
+		if (IS_SYMBOL(test) && strcmp(test->lisp_car.label, "#t") == 0 && jit_param_index(buf, test) < 0) {
+			jit_expr(buf, _car(clause->lisp_cdr.cdr), tail);
+			break;
+		}
+
+		jit_test(buf, test, &skip);
+		jit_expr(buf, _car(clause->lisp_cdr.cdr), tail);
+		if (buf->endCount == buf->endSize) {
+			buf->endSize = (buf->endSize == 0) ? 16 : 2*buf->endSize;
+			buf->ends = (size_t *) realloc(buf->ends, buf->endSize * sizeof(size_t));
+		}
+		buf->ends[buf->endCount++] = jit_jump(buf, JIT_JMP);
+		jit_patch(buf, skip);
+	}
+
+	// Falling off the end of the clauses gives undefined
+	if (IS_ATOM(cur))
+		jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) lisp_undefined);
+
+	for (i = base; i < buf->endCount; ++i) {
+		jit_patch(buf, buf->ends[i]);
+	}
+	buf->endCount = base;
+}
+
+/**
+ * Compiles a cond test, with skip set to a jump that is taken when the test fails. Tests with
+ * eq? branch on c_lisp_eq() directly, and anything else is compared against #t, with #t and #f
+ * themselves recognized without a call.
+ */
+void jit_test(struct jit_buffer *buf, struct s_exp *test, size_t *skip) {
+	size_t isTrue;
+	size_t isFalse;
+	size_t wasTrue;
+
+	if (!IS_ATOM(test) && IS_SYMBOL(test->lisp_car.car) && jit_param_index(buf, test->lisp_car.car) < 0
+			&& strcmp(test->lisp_car.car->lisp_car.label, "eq?") == 0 && !IS_ATOM(_cdr(test))
+			&& !IS_ATOM(_cdr(_cdr(test))) && IS_NIL(_cdr(_cdr(_cdr(test)))) && jit_global(buf, test->lisp_car.car) == lisp_eq) {
+		jit_add_guard(buf, test->lisp_car.car, lisp_eq);
+		jit_expr(buf, _car(_cdr(test)), 0);
+		jit_push(buf);
+		jit_expr(buf, _car(_cdr(_cdr(test))), 0);
+		jit_bytes(buf, "\x48\x89\xc6", 3);
+		jit_pop(buf, JIT_RDI);
+		jit_call(buf, (void *) c_lisp_eq);
+		jit_bytes(buf, "\x85\xc0", 2);
+		*skip = jit_jump(buf, JIT_CC_E);
+		return;
+	}
+
+	jit_expr(buf, test, 0);
+	jit_load_imm(buf, JIT_RCX, (uint64_t) (uintptr_t) lisp_true);
+	jit_bytes(buf, "\x48\x39\xc8", 3);
+	isTrue = jit_jump(buf, JIT_CC_E);
+	jit_load_imm(buf, JIT_RCX, (uint64_t) (uintptr_t) lisp_false);
+	jit_bytes(buf, "\x48\x39\xc8", 3);
+	isFalse = jit_jump(buf, JIT_CC_E);
+	jit_bytes(buf, "\x48\x89\xc7", 3);
+	jit_load_imm(buf, JIT_RSI, (uint64_t) (uintptr_t) lisp_true);
+	jit_call(buf, (void *) c_lisp_eq);
+	jit_bytes(buf, "\x85\xc0", 2);
+	wasTrue = jit_jump(buf, JIT_CC_NE);
+	jit_patch(buf, isFalse);
+	*skip = jit_jump(buf, JIT_JMP);
+	jit_patch(buf, isTrue);
+	jit_patch(buf, wasTrue);
+}
+
+/**
+ * Reserves a slot on the stack for each argument and evaluates the arguments into them, from
+ * left to right, so that rsp points at them as an array. Returns the number of arguments.
+ */
+int jit_args(struct jit_buffer *buf, struct s_exp *args) {
+	struct s_exp *cur;
+	int argc;
+	int i;
+
+	argc = 0;
+	for (cur = args; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		argc += 1;
+	}
+
+	if (argc > 0) {
+		jit_bytes(buf, "\x48\x81\xec", 3);
+		jit_u32(buf, 8*argc);
+		buf->depth += argc;
+	}
+
+	for (cur = args, i = 0; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr, ++i) {
+		jit_expr(buf, cur->lisp_car.car, 0);
+		jit_bytes(buf, "\x48\x89\x84\x24", 4);
+		jit_u32(buf, 8*i);
+	}
+
+	return argc;
+}
+
+/**
+ * Frees the stack slots reserved by jit_args()
+ */
+void jit_release(struct jit_buffer *buf, int count) {
+	if (count == 0)
+		return;
+
+	jit_bytes(buf, "\x48\x81\xc4", 3);
+	jit_u32(buf, 8*count);
+	buf->depth -= count;
+}
+
+/**
+ * Compiles an application of one of the inlined primitives, returning 0 without emitting
+ * anything if exp is not one
+ */
+int jit_inline(struct jit_buffer *buf, struct s_exp *exp) {
+	struct s_exp *head;
+	struct s_exp *value;
+	struct s_exp *args;
+	size_t slow;
+	size_t slow2;
+	size_t slow3;
+	size_t done;
+	size_t done2;
+	size_t isTrue;
+	void *primitive;
+	int argc;
+
+	head = exp->lisp_car.car;
+	args = exp->lisp_cdr.cdr;
+	argc = 0;
+	for (; !IS_ATOM(args); args = args->lisp_cdr.cdr) {
+		argc += 1;
+	}
+	if (!IS_NIL(args))
+		return 0;
+
+	args = exp->lisp_cdr.cdr;
+	value = jit_global(buf, head);
+
+	if ((value == lisp_car || value == lisp_cdr) && argc == 1) {
+		jit_add_guard(buf, head, value);
+		jit_expr(buf, _car(args), 0);
+		jit_bytes(buf, "\xf6\x00\x01", 3);
+		slow = jit_jump(buf, JIT_CC_NE);
+		jit_bytes(buf, (value == lisp_car) ? "\x48\x8b\x40\x08" : "\x48\x8b\x40\x10", 4);
+		done = jit_jump(buf, JIT_JMP);
+		jit_patch(buf, slow);
+		jit_bytes(buf, "\x48\x89\xc7", 3);
+		jit_site(buf, args);
+		jit_call(buf, (value == lisp_car) ? (void *) _car : (void *) _cdr);
+		jit_patch(buf, done);
+		return 1;
+	}
+
+	if (value == lisp_atom && argc == 1) {
+		// Atoms other than undefined are atoms
+		jit_add_guard(buf, head, value);
+		jit_expr(buf, _car(args), 0);
+		jit_bytes(buf, "\xf6\x00\x01", 3);
+		slow = jit_jump(buf, JIT_CC_E);
+		jit_bytes(buf, "\xf6\x00", 2);
+		jit_byte(buf, FLAG_UNDEFINED);
+		slow2 = jit_jump(buf, JIT_CC_NE);
+		jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) lisp_true);
+		done = jit_jump(buf, JIT_JMP);
+		jit_patch(buf, slow);
+		jit_patch(buf, slow2);
+		jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) lisp_false);
+		jit_patch(buf, done);
+		return 1;
+	}
+
+	if (argc != 2)
+		return 0;
+
+	if (value == lisp_cons)
+		primitive = (void *) _cons;
+	else if (value == lisp_eq)
+		primitive = (void *) _eq;
+	else if (value == lisp_add)
+		primitive = (void *) _add;
+	else if (value == lisp_sub)
+		primitive = (void *) _sub;
+	else if (value == lisp_mul)
+		primitive = (void *) _mul;
+	else if (value == lisp_lt)
+		primitive = (void *) _lt;
+	else if (value == lisp_gt)
+		primitive = (void *) _gt;
+	else if (value == lisp_num_eq)
+		primitive = (void *) _num_eq;
+	else
+		return 0;
+
+	// Both arguments end up in rdi and rsi, ready for a call
+	jit_add_guard(buf, head, value);
+	jit_expr(buf, _car(args), 0);
+	jit_push(buf);
+	jit_expr(buf, _car(_cdr(args)), 0);
+	jit_bytes(buf, "\x48\x89\xc6", 3);
+	jit_pop(buf, JIT_RDI);
+
+	if (value == lisp_cons || value == lisp_eq) {
+		jit_call(buf, primitive);
+		return 1;
+	}
+
+	// Fixnums only: cmp dword [rdi], FLAG_ATOM | FLAG_INT; cmp dword [rsi], FLAG_ATOM | FLAG_INT
+	jit_bytes(buf, "\x81\x3f", 2);
+	jit_u32(buf, FLAG_ATOM | FLAG_INT);
+	slow = jit_jump(buf, JIT_CC_NE);
+	jit_bytes(buf, "\x81\x3e", 2);
+	jit_u32(buf, FLAG_ATOM | FLAG_INT);
+	slow2 = jit_jump(buf, JIT_CC_NE);
+
+	// mov rax, [rdi+8]; mov rcx, [rsi+8]
+	jit_bytes(buf, "\x48\x8b\x47\x08\x48\x8b\x4e\x08", 8);
+
+	if (value == lisp_add || value == lisp_sub || value == lisp_mul) {
+		if (value == lisp_add)
+			jit_bytes(buf, "\x48\x01\xc8", 3);
+		else if (value == lisp_sub)
+			jit_bytes(buf, "\x48\x29\xc8", 3);
+		else
+			jit_bytes(buf, "\x48\x0f\xaf\xc1", 4);
+
+		// Overflow is reported by the primitive
+		slow3 = jit_jump(buf, JIT_CC_O);
+		jit_bytes(buf, "\x48\x89\xc7", 3);
+		jit_call(buf, (void *) make_int);
+		done = jit_jump(buf, JIT_JMP);
+		jit_patch(buf, slow);
+		jit_patch(buf, slow2);
+		jit_patch(buf, slow3);
+		jit_site(buf, args);
+		jit_call(buf, primitive);
+		jit_patch(buf, done);
+		return 1;
+	}
+
+	jit_bytes(buf, "\x48\x39\xc8", 3);
+	if (value == lisp_lt)
+		isTrue = jit_jump(buf, JIT_CC_L);
+	else if (value == lisp_gt)
+		isTrue = jit_jump(buf, JIT_CC_G);
+	else
+		isTrue = jit_jump(buf, JIT_CC_E);
+	jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) lisp_false);
+	done = jit_jump(buf, JIT_JMP);
+	jit_patch(buf, isTrue);
+	jit_load_imm(buf, JIT_RAX, (uint64_t) (uintptr_t) lisp_true);
+	done2 = jit_jump(buf, JIT_JMP);
+	jit_patch(buf, slow);
+	jit_patch(buf, slow2);
+	jit_site(buf, args);
+	jit_call(buf, primitive);
+	jit_patch(buf, done);
+	jit_patch(buf, done2);
+	return 1;
+}
+
+/**
+ * Compiles a call to jit_interpret(), evaluating exp in the interpreter
+ */
+void jit_interpret_call(struct jit_buffer *buf, struct s_exp *exp) {
+	jit_load_imm(buf, JIT_RDI, (uint64_t) (uintptr_t) exp);
+	jit_bytes(buf, "\x48\x89\xde\x4c\x89\xe2", 6);
+	jit_load_imm(buf, JIT_RCX, (uint64_t) (uintptr_t) buf->entry->lambda);
+	jit_call(buf, (void *) jit_interpret);
+}
+
+#else
+
+/**
+ * There is no code generator for this architecture, so nothing is ever compiled
+ */
+void jit_compile(struct jit_entry *entry, struct lisp_env *env, struct jit_buffer *buf) {
+	entry->state = JIT_FAILED;
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef _LISP_JIT_H_
+#define _LISP_JIT_H_
+/**
+ * A template JIT for x86-64. Every lambda application is counted, and once a lambda has been
+ * applied jit_threshold times its body is translated into machine code, one fixed template per
+ * kind of expression. On other architectures, or with jit_enabled cleared, every lambda is
+ * interpreted as usual.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stddef.h>
+
+// Project headers
+#include "lisp.h"
+
+// Number of applications after which a lambda is compiled, unless jit_threshold is changed
+#define JIT_THRESHOLD		64
+
+// Number of times a lambda may be recompiled after its assumptions were broken
+#define JIT_MAX_RECOMPILES	4
+
+// Size of each block of executable memory
+#define JIT_REGION_SIZE		(1024*1024)
+
+// Initial number of buckets in the table of lambdas, which must be a power of two
+#define JIT_INITIAL_BUCKETS	64
+
+// Registers, by their number in instruction encodings
+#define JIT_RAX			0
+#define JIT_RCX			1
+#define JIT_RDX			2
+#define JIT_RSI			6
+#define JIT_RDI			7
+#define JIT_R10			10
+#define JIT_R11			11
+
+// Condition codes for jumps, with JIT_JMP standing in for an unconditional jump
+#define JIT_CC_O		0x0
+#define JIT_CC_AE		0x3
+#define JIT_CC_E		0x4
+#define JIT_CC_NE		0x5
+#define JIT_CC_L		0xc
+#define JIT_CC_G		0xf
+#define JIT_JMP			0xff
+
+// Compilation states for a lambda
+#define JIT_COLD		0
+#define JIT_FAILED		1
+
+/**
+ * Machine code for a lambda. It is called with the evaluated arguments in argv and the
+ * environment the lambda was applied in.
+ */
+typedef struct s_exp *(*jit_fn)(struct s_exp **argv, struct lisp_env *env);
+
+/**
+ * One compilation of a lambda. The code depends on the global bindings listed in guards still
+ * having the values it was compiled against, which is checked cheaply on entry by comparing the
+ * global environment's version with the one recorded here. When the version has moved on the
+ * guards are checked one by one, and if any has changed the code is retired for good.
+ */
+struct jit_code {
+	jit_fn fn;
+	struct jit_entry *entry;
+	struct lisp_env *root;
+	uint64_t version;
+	int valid;
+	struct s_exp **guardSymbols;
+	struct s_exp **guardValues;
+	int guardCount;
+	int guardSize;
+};
+
+/**
+ * Everything the JIT knows about a lambda, found through a hash table keyed on the form
+ */
+struct jit_entry {
+	struct s_exp *lambda;
+	uint32_t calls;
+	int state;
+	int arity;
+	int recompiles;
+	struct jit_code *code;
+	struct jit_entry *next;
+};
+
+/**
+ * A function being compiled. depth counts the eight byte words pushed on the machine stack
+ * since the prologue, so that calls can keep the stack aligned. The jumps out of the clauses of
+ * the cond forms being compiled are stacked in ends. The buffer owns the code, that stack, and
+ * the compiled code until it is installed, so that a compilation abandoned by an error frees
+ * them all in one place.
+ */
+struct jit_buffer {
+	uint8_t *code;
+	size_t length;
+	size_t size;
+	int depth;
+	size_t top;
+	struct jit_entry *entry;
+	struct jit_code *compiled;
+	size_t *ends;
+	int endCount;
+	int endSize;
+};
+
+/**
+ * A block of executable memory, chained to the blocks that were filled before it
+ */
+struct jit_region {
+	uint8_t *base;
+	size_t used;
+	struct jit_region *prev;
+};
+
+// Set to zero to interpret every lambda
+extern int jit_enabled;
+
+// Number of applications after which a lambda is compiled, one to compile them all at once
+extern int jit_threshold;
+
+// Evaluator interface
+struct s_exp *jit_apply(struct s_exp *lambda, struct s_exp *args, struct lisp_env *env);
+void jit_reset(void);
+
+// Runtime support for compiled code
+int jit_revalidate(struct jit_code *code);
+struct s_exp *jit_interpret(struct s_exp *exp, struct s_exp **argv, struct lisp_env *env, struct s_exp *lambda);
+struct s_exp *jit_fallback(struct jit_code *code, struct s_exp **argv, struct lisp_env *env);
+
+// Lambda table and compilation, used internally
+struct jit_entry *jit_find(struct s_exp *lambda);
+void jit_grow(void);
+void jit_compile(struct jit_entry *entry, struct lisp_env *env, struct jit_buffer *buf);
+void jit_buffer_free(struct jit_buffer *buf);
+void jit_try_compile(struct jit_entry *entry, struct lisp_env *env);
+void *jit_alloc_exec(size_t size);
+void jit_add_guard(struct jit_buffer *buf, struct s_exp *symbol, struct s_exp *value);
+struct s_exp *jit_global(struct jit_buffer *buf, struct s_exp *symbol);
+int jit_param_index(struct jit_buffer *buf, struct s_exp *symbol);
+
+// Code generation, used internally
+void jit_byte(struct jit_buffer *buf, uint8_t b);
+void jit_bytes(struct jit_buffer *buf, const char *bytes, size_t count);
+void jit_u32(struct jit_buffer *buf, uint32_t v);
+void jit_u64(struct jit_buffer *buf, uint64_t v);
+size_t jit_jump(struct jit_buffer *buf, uint8_t cc);
+void jit_jump_to(struct jit_buffer *buf, uint8_t cc, size_t target);
+void jit_patch(struct jit_buffer *buf, size_t at);
+void jit_load_imm(struct jit_buffer *buf, int reg, uint64_t value);
+void jit_call(struct jit_buffer *buf, void *target);
+void jit_site(struct jit_buffer *buf, struct s_exp *args);
+void jit_push(struct jit_buffer *buf);
+void jit_pop(struct jit_buffer *buf, int reg);
+void jit_expr(struct jit_buffer *buf, struct s_exp *exp, int tail);
+void jit_cond(struct jit_buffer *buf, struct s_exp *exp, int tail);
+void jit_test(struct jit_buffer *buf, struct s_exp *test, size_t *skip);
+int jit_args(struct jit_buffer *buf, struct s_exp *args);
+void jit_release(struct jit_buffer *buf, int count);
+int jit_inline(struct jit_buffer *buf, struct s_exp *exp);
+void jit_interpret_call(struct jit_buffer *buf, struct s_exp *exp);
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * Resource limits on evaluation. The budget of the evaluation in progress is kept partly in the
+ * countdowns that the hot paths test, and partly here, for the slow paths to consult.
+ */
+
+// Standard headers
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_limit.h"
+
+/**
+ * The limited evaluation in progress. steps is how many steps of the budget are left besides
+ * those in the countdown, deadline is zero when there is no time limit, and the stack is
+ * measured down from stackBase. status records the limit the evaluation ran into, if any.
+ */
+struct limit_state {
+	int active;
+	uint64_t steps;
+	double deadline;
+	char *stackBase;
+	size_t stackSize;
+	int status;
+};
+
+// Countdowns tested by the hot paths
+uint64_t lisp_steps_left = UINT64_MAX;
+size_t lisp_cells_left = SIZE_MAX;
+int lisp_depth_limit = INT_MAX;
+
+// The budget being enforced
+struct limit_state limit_current = {0};
+
+/**
+ * Evaluates exp within a budget, storing the value in result. Returns LIMIT_OK if the
+ * evaluation finished, LIMIT_ERROR if it raised an error that it didn't catch, or which limit
+ * it ran into, and in either of the last two cases result is the error object. Running into a
+ * limit fails the evaluation even if the error was caught along the way. A limited evaluation
+ * that is nested inside another replaces its budget until it is done.
+ */
+int lisp_eval_limited(struct s_exp *exp, struct lisp_env *env, struct lisp_budget *budget, struct s_exp **result) {
+	struct lisp_handler handler;
+	struct limit_state saved;
+	uint64_t stepsLeft;
+	size_t cellsLeft;
+	int depthLimit;
+	int status;
+	char base;
+
+	saved = limit_current;
+	stepsLeft = lisp_steps_left;
+	cellsLeft = lisp_cells_left;
+	depthLimit = lisp_depth_limit;
+
+	limit_current.active = 1;
+	limit_current.steps = budget->steps == 0 ? UINT64_MAX : budget->steps;
+	limit_current.deadline = budget->seconds > 0 ? limit_now() + budget->seconds : 0;
+	if (!saved.active) {
+		limit_current.stackBase = &base;
+		limit_current.stackSize = limit_stack_size();
+	}
+	limit_current.status = LIMIT_OK;
+
+	// The first step takes the slow path, which fills in the countdown
+	lisp_steps_left = 0;
+	lisp_cells_left = budget->cells == 0 ? SIZE_MAX : budget->cells;
+	lisp_depth_limit = budget->depth == 0 ? INT_MAX : lisp_depth + budget->depth;
+
+	handler_push(&handler);
+	if (setjmp(handler.jump) == 0) {
+		*result = eval(exp, env);
+		handler_pop(&handler);
+		status = LIMIT_OK;
+	}
+	else {
+		*result = handler.error;
+		status = LIMIT_ERROR;
+	}
+
+	if (limit_current.status != LIMIT_OK) {
+		if (status == LIMIT_OK)
+			*result = make_error(ERROR_LIMIT, strdup(limit_describe(limit_current.status)), lisp_nil);
+		status = limit_current.status;
+	}
+
+	limit_current = saved;
+	lisp_steps_left = stepsLeft;
+	lisp_cells_left = cellsLeft;
+	lisp_depth_limit = depthLimit;
+	return status;
+}
+
+/**
+ * Describes the limit that a limited evaluation ran into
+ */
+const char *limit_describe(int status) {
+	switch (status) {
+		case LIMIT_OK:
+			return "no limit exceeded";
+		case LIMIT_STEPS:
+			return "step budget exhausted";
+		case LIMIT_CELLS:
+			return "cell quota exhausted";
+		case LIMIT_DEPTH:
+			return "recursion too deep";
+		case LIMIT_TIME:
+			return "deadline passed";
+		case LIMIT_ERROR:
+			return "uncaught error";
+	}
+	return "unknown limit";
+}
+
+/**
+ * Called when the step countdown runs out, for the step it was taking. Checks the clock and the
+ * stack, then refills the countdown from the budget, or abandons the evaluation if the budget
+ * is spent. Outside of a limited evaluation the countdown is simply refilled.
+ */
+void limit_tick(void) {
+	uint64_t chunk;
+	char here;
+
+	if (!limit_current.active) {
+		lisp_steps_left = UINT64_MAX;
+		return;
+	}
+
+	if (limit_current.steps == 0)
+		limit_exceeded(LIMIT_STEPS);
+	if (limit_current.deadline != 0 && limit_now() >= limit_current.deadline)
+		limit_exceeded(LIMIT_TIME);
+	if ((size_t) (limit_current.stackBase - &here) > limit_current.stackSize)
+		limit_exceeded(LIMIT_DEPTH);
+
+	// Unlimited budgets keep steps at UINT64_MAX, which is never spent in practice
+	chunk = LIMIT_CHECK_STEPS;
+	if (chunk > limit_current.steps)
+		chunk = limit_current.steps;
+	if (limit_current.steps != UINT64_MAX)
+		limit_current.steps -= chunk;
+	lisp_steps_left = chunk - 1;
+}
+
+/**
+ * Raises an error for the limit that the evaluation in progress ran into. The countdowns are
+ * left spent, so that code which catches the error runs into the limit again as soon as it
+ * takes another step or allocates another cell.
+ */
+void limit_exceeded(int status) {
+	if (!limit_current.active)
+		return;
+
+	lisp_steps_left = 0;
+	if (status == LIMIT_CELLS)
+		lisp_cells_left = 0;
+
+	limit_current.status = status;
+	lisp_throw(ERROR_LIMIT, lisp_nil, "%s", limit_describe(status));
+}
+
+/**
+ * Charges bytes of storage outside of the heap against the cell budget, as the number of cells
+ * that would take up as much memory, raising a limit error if the budget can't cover it. This
+ * is called before the memory is allocated, so that nothing is left to free.
+ */
+void limit_charge(size_t bytes) {
+	size_t cells;
+
+	cells = limit_cells(bytes);
+	if (cells > lisp_cells_left)
+		limit_exceeded(LIMIT_CELLS);
+	else
+		lisp_cells_left -= cells;
+}
+
+/**
+ * Checks whether bytes of storage outside of the heap, along with the cell that will own it,
+ * fit in what is left of the cell budget. Storage that is already allocated by the time it is
+ * charged is checked first, so that it can be freed before the limit error is raised.
+ */
+int limit_fits(size_t bytes) {
+	return limit_cells(bytes) < lisp_cells_left;
+}
+
+/**
+ * The number of cells that take up at least as much memory as bytes
+ */
+size_t limit_cells(size_t bytes) {
+	return bytes / sizeof(struct s_exp) + (bytes % sizeof(struct s_exp) != 0);
+}
+
+/**
+ * Reads the monotonic clock, in seconds
+ */
+double limit_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Returns how many bytes of C stack a limited evaluation may use, which is whatever the process
+ * is allowed less a reserve for reporting the error
+ */
+size_t limit_stack_size(void) {
+	struct rlimit rl;
+	size_t size;
+
+	if (getrlimit(RLIMIT_STACK, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY)
+		size = LIMIT_STACK_DEFAULT;
+	else
+		size = rl.rlim_cur;
+
+	if (size < 2 * LIMIT_STACK_RESERVE)
+		return size / 2;
+	return size - LIMIT_STACK_RESERVE;
+}
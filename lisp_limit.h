@@ -0,0 +1,81 @@
+#ifndef _LISP_LIMIT_H_
+#define _LISP_LIMIT_H_
+/**
+ * Resource limits for evaluating scripts that can't be trusted to finish. A budget caps the
+ * number of evaluation steps, the number of heap cells allocated, how deeply applications may
+ * nest, and the wall-clock time, and an evaluation that runs past any of them raises a limit
+ * error, which fails the call to lisp_eval_limited() and leaves the interpreter usable.
+ *
+ * The hot paths only decrement a counter and test it: eval() and every entry to compiled code
+ * count steps, find_free_s_exp() counts cells, and apply() compares lisp_depth to its limit.
+ * Storage that atoms own outside of the heap, like array elements, is charged to the cell
+ * budget by limit_charge() as the number of cells it would fill.
+ * Every LIMIT_CHECK_STEPS steps the slow path also reads the clock and checks how much of the
+ * C stack is in use, which catches recursion in compiled code that never goes through apply()
+ * before it can overflow the stack.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stddef.h>
+
+// Project headers
+#include "lisp.h"
+
+// Number of steps between two checks of the clock and the stack
+#define LIMIT_CHECK_STEPS		1024
+
+// Bytes of C stack left unused below the stack limit, for the code that reports the error
+#define LIMIT_STACK_RESERVE		(1024*1024)
+
+// Stack size assumed when the process has no stack limit
+#define LIMIT_STACK_DEFAULT		(8*1024*1024)
+
+// Results of a limited evaluation
+#define LIMIT_OK				0
+#define LIMIT_STEPS				1
+#define LIMIT_CELLS				2
+#define LIMIT_DEPTH				3
+#define LIMIT_TIME				4
+#define LIMIT_ERROR				5
+
+// Exit status of the interpreter when a top-level form runs out of its budget
+#define LIMIT_EXIT_EXCEEDED		5
+
+/**
+ * The resources one evaluation may use, with zero meaning no limit. depth counts applications
+ * in progress, and seconds is measured from the start of the evaluation.
+ */
+struct lisp_budget {
+	uint64_t steps;
+	size_t cells;
+	int depth;
+	double seconds;
+};
+
+// Countdowns tested on the hot paths, which never run out outside of a limited evaluation
+extern uint64_t lisp_steps_left;
+extern size_t lisp_cells_left;
+extern int lisp_depth_limit;
+
+// Counts one evaluation step
+#define LISP_STEP() do { if (lisp_steps_left-- == 0) limit_tick(); } while (0)
+
+// Limited evaluation
+int lisp_eval_limited(struct s_exp *exp, struct lisp_env *env, struct lisp_budget *budget, struct s_exp **result);
+const char *limit_describe(int status);
+
+// Slow paths of the checks, called from evaluation and compiled code
+void limit_tick(void);
+void limit_exceeded(int status);
+
+// Charges memory allocated outside of the heap against the cell budget
+void limit_charge(size_t bytes);
+int limit_fits(size_t bytes);
+size_t limit_cells(size_t bytes);
+
+// Clock and stack measurements, used internally
+double limit_now(void);
+size_t limit_stack_size(void);
+
+#endif
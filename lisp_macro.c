@@ -0,0 +1,151 @@
+/**
+ * Non-hygienic macros. A macro is defined with
+ *
+ *   (defmacro name (args) body)
+ *
+ * and when a call to it is evaluated, body is run with args bound to the unevaluated argument
+ * forms. Whatever it returns is the code that runs in place of the call. The expansion is
+ * written over the cell that held the call, so each source form is expanded exactly once and
+ * later evaluations never see the macro at all. Parsed code lives outside of the heap, so the
+ * call cell goes through the write barrier, which keeps the expansion's heap cells alive for as
+ * long as the code is.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Project headers
+#include "lisp.h"
+
+/**
+ * Handles (defmacro name (args) body) by binding name to a macro atom, whose car is the
+ * equivalent (lambda (args) body) form used to compute expansions
+ */
+void define_macro(struct s_exp *exp, struct lisp_env *env) {
+	struct s_exp *name;
+	struct s_exp *macro;
+
+	name = _car(exp);
+	if (!IS_SYMBOL(name)) {
+		lisp_source_site = exp;
+		lisp_throw(ERROR_SYNTAX, name, "expected a symbol as the name in defmacro");
+	}
+
+	macro = find_free_s_exp();
+	macro->flags = FLAG_ATOM | FLAG_MACRO;
+	macro->lisp_car.car = _cons(lisp_lambda, _cdr(exp));
+	macro->lisp_cdr.cdr = 0;
+
+	define_label(name->lisp_car.label, macro, env);
+}
+
+/**
+ * The parser pools quoted data in code, but macros expect to see code the way it was written.
+ * This returns form with every pooled constant turned back into a (quote x) list, copying only
+ * the pairs that lead to a constant and sharing everything else.
+ */
+struct s_exp *unpool_constants(struct s_exp *form) {
+	struct s_exp *car;
+	struct s_exp *cdr;
+
+	if (IS_ATOM(form)) {
+		if (IS_CONSTANT(form))
+			return _cons(lisp_quote, _cons(form->lisp_car.car, lisp_nil));
+		return form;
+	}
+
+	// Quoted data can't contain pooled constants, so there is nothing to find inside of it
+	if (IS_IMMUTABLE(form))
+		return form;
+
+	car = unpool_constants(form->lisp_car.car);
+	cdr = unpool_constants(form->lisp_cdr.cdr);
+	if (car == form->lisp_car.car && cdr == form->lisp_cdr.cdr)
+		return form;
+
+	return _cons(car, cdr);
+}
+
+/**
+ * The reverse of unpool_constants(), used on expansions before they are installed, so that
+ * quoted data in expanded code is pooled just like quoted data the parser read. Quote forms
+ * are replaced in place, which is safe because expansions are freshly built code. Immutable
+ * pairs belong to pooled data and are left alone.
+ */
+struct s_exp *pool_constants(struct s_exp *code) {
+	struct s_exp *cur;
+	struct s_exp *arg;
+
+	if (IS_ATOM(code) || IS_IMMUTABLE(code))
+		return code;
+
+	// (quote x) becomes the pooled constant for x
+	if (IS_SYMBOL(code->lisp_car.car) && strcmp(code->lisp_car.car->lisp_car.label, "quote") == 0) {
+		arg = code->lisp_cdr.cdr;
+		if (!IS_ATOM(arg) && IS_NIL(arg->lisp_cdr.cdr))
+			return intern_constant(arg->lisp_car.car);
+		return code;
+	}
+
+	// Anything else is a list of code, so pool each of its elements
+	for (cur = code; !IS_ATOM(cur) && !IS_IMMUTABLE(cur); cur = cur->lisp_cdr.cdr) {
+		arg = pool_constants(cur->lisp_car.car);
+		gc_write_barrier(cur, arg);
+		cur->lisp_car.car = arg;
+	}
+
+	return code;
+}
+
+/**
+ * Expands the macro call exp, whose head has already been looked up and found to be macro.
+ * The call cell is overwritten with the expansion unless it is part of immutable data, which
+ * must not change, in which case the expansion is only returned. An atom that owns its state
+ * or has an identity of its own is not copied, but installed behind a constant.
+ */
+struct s_exp *macro_expand(struct s_exp *macro, struct s_exp *exp, struct lisp_env *env) {
+	struct s_exp *expansion;
+	uint32_t remembered;
+
+	expansion = apply_lambda(macro->lisp_car.car, unpool_constants(_cdr(exp)), env);
+	expansion = pool_constants(expansion);
+
+	if (IS_IMMUTABLE(exp))
+		return expansion;
+
+	// The call cell itself is code, even if the expansion handed back a piece of pooled data,
+	// and it stays in the remembered set if it was already there
+	remembered = exp->flags & FLAG_REMEMBERED;
+
+	// A string's buffer, a promise's state, an error's condition, a bignum's or ratio's limbs and
+	// an array's elements are freed along with their cell, and a box is only equal to itself, so
+	// the call evaluates to the atom through a constant instead
+	if (IS_STRING(expansion) || IS_PROMISE(expansion) || IS_ERROR(expansion) || IS_BIGNUM(expansion) ||
+			IS_RATIO(expansion) || IS_ARRAY(expansion) || IS_BOX(expansion)) {
+		exp->flags = FLAG_ATOM | FLAG_CONSTANT | remembered;
+		exp->lisp_car.car = expansion;
+		exp->lisp_cdr.cdr = 0;
+		gc_write_barrier(exp, expansion);
+		return exp;
+	}
+
+	*exp = *expansion;
+	exp->flags &= ~(FLAG_IMMUTABLE | FLAG_HASHCONS | FLAG_REMEMBERED);
+	exp->flags |= remembered;
+
+	if (!IS_ATOM(exp)) {
+		gc_write_barrier(exp, exp->lisp_car.car);
+		gc_write_barrier(exp, exp->lisp_cdr.cdr);
+	}
+	else if (IS_CONSTANT(exp) || IS_MACRO(exp)) {
+		gc_write_barrier(exp, exp->lisp_car.car);
+	}
+
+	// A symbol's cache belongs to its atom, so the call cell starts one of its own
+	if (IS_SYMBOL(expansion))
+		exp->lisp_cdr.icache = 0;
+	return exp;
+}
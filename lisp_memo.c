@@ -0,0 +1,367 @@
+/**
+ * Memoized functions. A memo form looks exactly like a label form,
+ *
+ *   (memo name (lambda (args) body) [limit])
+ *
+ * except that every application first looks the evaluated argument list up in a hash table
+ * attached to the form, and only evaluates the body on a miss. Recursive calls through name
+ * go back through the cache, so exponential recursions collapse into linear ones.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_memo.h"
+
+// The memo tables of every live memo form, chained into buckets by the address of the form
+struct memo_table **memo_buckets = 0;
+uint32_t memo_bucket_count = 0;
+uint32_t memo_count = 0;
+
+/**
+ * Finds the memo table for the given form, creating it the first time the form is applied.
+ * The optional size limit is read out of the form when the table is created.
+ */
+struct memo_table *find_memo_table(struct s_exp *form) {
+	struct memo_table *table;
+	struct s_exp *limit;
+	uint32_t bucket;
+
+	if (memo_bucket_count == 0 || memo_count >= memo_bucket_count)
+		memo_rehash((memo_bucket_count == 0) ? MEMO_INITIAL_TABLES : 2*memo_bucket_count);
+
+	bucket = memo_bucket(form, memo_bucket_count);
+	for (table = memo_buckets[bucket]; table != 0; table = table->next) {
+		if (table->form == form)
+			return table;
+	}
+
+	table = (struct memo_table *) calloc(1, sizeof(struct memo_table));
+	table->form = form;
+	table->bucketCount = MEMO_INITIAL_BUCKETS;
+	table->buckets = (struct memo_entry **) calloc(table->bucketCount, sizeof(struct memo_entry *));
+
+	// (memo name lambda limit) -- the limit is the fourth element, if it is present
+	limit = _cdr(_cdr(_cdr(form)));
+	if (!IS_NIL(limit)) {
+		limit = _car(limit);
+		if (IS_INT(limit) && limit->lisp_car.siVal > 0) {
+			table->limit = (uint32_t) limit->lisp_car.siVal;
+		}
+		else {
+			lisp_error("Ignoring invalid size limit for memo form, expected a positive integer\n");
+		}
+	}
+
+	table->next = memo_buckets[bucket];
+	memo_buckets[bucket] = table;
+	memo_count += 1;
+	return table;
+}
+
+/**
+ * Returns the bucket that a form's table belongs in, out of count
+ */
+uint32_t memo_bucket(struct s_exp *form, uint32_t count) {
+	return (uint32_t) ((((uint64_t) (uintptr_t) form) * 0x9e3779b97f4a7c15ULL) >> 32) & (count - 1);
+}
+
+/**
+ * Redistributes the tables over count buckets, which is also how they are put back in order
+ * after the collector has moved their forms
+ */
+void memo_rehash(uint32_t count) {
+	struct memo_table **buckets;
+	struct memo_table *table;
+	struct memo_table *next;
+	uint32_t bucket;
+	uint32_t i;
+
+	buckets = (struct memo_table **) calloc(count, sizeof(struct memo_table *));
+
+	for (i = 0; i < memo_bucket_count; ++i) {
+		for (table = memo_buckets[i]; table != 0; table = next) {
+			next = table->next;
+			bucket = memo_bucket(table->form, count);
+			table->next = buckets[bucket];
+			buckets[bucket] = table;
+		}
+	}
+
+	free(memo_buckets);
+	memo_buckets = buckets;
+	memo_bucket_count = count;
+}
+
+/**
+ * Frees a table along with every entry in it
+ */
+void memo_table_free(struct memo_table *table) {
+	struct memo_entry *entry;
+	struct memo_entry *older;
+
+	for (entry = table->newest; entry != 0; entry = older) {
+		older = entry->older;
+		free(entry);
+	}
+
+	free(table->buckets);
+	free(table);
+}
+
+/**
+ * Unlinks an entry from the use-ordered list, leaving its bucket chain untouched
+ */
+void memo_unlink(struct memo_table *table, struct memo_entry *entry) {
+	if (entry->newer != 0)
+		entry->newer->older = entry->older;
+	else
+		table->newest = entry->older;
+
+	if (entry->older != 0)
+		entry->older->newer = entry->newer;
+	else
+		table->oldest = entry->newer;
+
+	entry->newer = 0;
+	entry->older = 0;
+}
+
+/**
+ * Pushes an entry onto the most recently used end of the use-ordered list
+ */
+void memo_push(struct memo_table *table, struct memo_entry *entry) {
+	entry->older = table->newest;
+	entry->newer = 0;
+	if (table->newest != 0)
+		table->newest->newer = entry;
+	table->newest = entry;
+	if (table->oldest == 0)
+		table->oldest = entry;
+}
+
+/**
+ * Removes the least recently used entry from the table entirely
+ */
+void memo_evict(struct memo_table *table) {
+	struct memo_entry *victim;
+	struct memo_entry **link;
+
+	victim = table->oldest;
+	if (victim == 0)
+		return;
+
+	// Find the pointer that references the victim in its bucket chain and splice it out
+	link = &table->buckets[victim->hash & (table->bucketCount - 1)];
+	while (*link != victim) {
+		link = &(*link)->chain;
+	}
+	*link = victim->chain;
+
+	memo_unlink(table, victim);
+	table->size -= 1;
+	free(victim);
+}
+
+/**
+ * Doubles the number of buckets and redistributes the existing entries. The use-ordered list
+ * does not care about buckets, so it is left alone.
+ */
+void memo_grow(struct memo_table *table) {
+	struct memo_entry **buckets;
+	struct memo_entry *entry;
+	struct memo_entry *next;
+	uint32_t count;
+	uint32_t i;
+
+	count = table->bucketCount * 2;
+	buckets = (struct memo_entry **) calloc(count, sizeof(struct memo_entry *));
+
+	for (i = 0; i < table->bucketCount; ++i) {
+		entry = table->buckets[i];
+		while (entry != 0) {
+			next = entry->chain;
+			entry->chain = buckets[entry->hash & (count - 1)];
+			buckets[entry->hash & (count - 1)] = entry;
+			entry = next;
+		}
+	}
+
+	free(table->buckets);
+	table->buckets = buckets;
+	table->bucketCount = count;
+}
+
+/**
+ * Searches a table for a structurally equal argument list, returning 0 if there isn't one
+ */
+struct memo_entry *memo_lookup(struct memo_table *table, struct s_exp *args, uint64_t hash) {
+	struct memo_entry *entry;
+
+	entry = table->buckets[hash & (table->bucketCount - 1)];
+	while (entry != 0) {
+		if (entry->hash == hash && c_lisp_equal(entry->args, args) == 1)
+			return entry;
+		entry = entry->chain;
+	}
+
+	return 0;
+}
+
+/**
+ * Adds a new result to the table, evicting the least recently used one first if the table is full
+ */
+void memo_insert(struct memo_table *table, struct s_exp *args, uint64_t hash, struct s_exp *value) {
+	struct memo_entry *entry;
+	uint32_t bucket;
+
+	if (table->limit != 0 && table->size >= table->limit)
+		memo_evict(table);
+
+	if (table->size >= (table->bucketCount / 4) * 3)
+		memo_grow(table);
+
+	entry = (struct memo_entry *) calloc(1, sizeof(struct memo_entry));
+	entry->hash = hash;
+	entry->args = args;
+	entry->value = value;
+
+	bucket = hash & (table->bucketCount - 1);
+	entry->chain = table->buckets[bucket];
+	table->buckets[bucket] = entry;
+	memo_push(table, entry);
+	table->size += 1;
+}
+
+/**
+ * Applies a memo form to an unevaluated argument list. On a hit the cached value is returned
+ * directly; on a miss, the name is bound to the form (exactly like label does) and the lambda
+ * is applied, with the result recorded for next time.
+ */
+struct s_exp *eval_memo(struct s_exp *form, struct s_exp *args, struct lisp_env *env) {
+	struct memo_table *table;
+	struct memo_entry *entry;
+	struct lisp_env *memo_env;
+	struct s_exp *name;
+	struct s_exp *value;
+	uint64_t hash;
+
+	table = find_memo_table(form);
+	args = eval_each(args, env);
+	hash = c_lisp_hash(args);
+
+	entry = memo_lookup(table, args, hash);
+	if (entry != 0) {
+		table->hits += 1;
+		memo_unlink(table, entry);
+		memo_push(table, entry);
+		return entry->value;
+	}
+	table->misses += 1;
+
+	// Create a new environment that will store the name for recursion, which goes through the cache
+	name = _car(_cdr(form));
+	memo_env = frame_acquire(env);
+	define_label(name->lisp_car.label, form, memo_env);
+
+	// A call that raises an error unwinds past the insert, so that the next call raises it again
+	value = apply_lambda(_car(_cdr(_cdr(form))), args, memo_env);
+	frame_release(memo_env);
+	memo_insert(table, args, hash, value);
+
+	return value;
+}
+
+/**
+ * Handles (define-memo name (lambda (args) body) [limit]) by building the equivalent memo form
+ * once and binding it to name, so that every later call shares the same cache.
+ */
+void define_memo(struct s_exp *exp, struct lisp_env *env) {
+	struct s_exp *name;
+
+	name = _car(exp);
+	if (!IS_SYMBOL(name)) {
+		lisp_source_site = exp;
+		lisp_throw(ERROR_SYNTAX, name, "expected a symbol as the name in define-memo");
+	}
+
+	define_label(name->lisp_car.label, _cons(lisp_memo, exp), env);
+}
+
+/**
+ * Forwards what the memo tables hold on to, for the garbage collector, but only for the tables
+ * whose forms the collection has reached, since nothing else can ever look a table up. Entries
+ * are keyed on the structure of their arguments, so moving them leaves the hashes unchanged.
+ * Returns how many tables were newly reached, which may have reached the forms of others.
+ */
+int memo_collect(void) {
+	struct memo_table *table;
+	struct memo_entry *entry;
+	uint32_t i;
+	int reached;
+
+	reached = 0;
+	for (i = 0; i < memo_bucket_count; ++i) {
+		for (table = memo_buckets[i]; table != 0; table = table->next) {
+			if (table->reached || !gc_reached(table->form))
+				continue;
+
+			table->reached = 1;
+			table->form = gc_forward(table->form);
+			for (entry = table->newest; entry != 0; entry = entry->older) {
+				entry->args = gc_forward(entry->args);
+				entry->value = gc_forward(entry->value);
+			}
+			reached += 1;
+		}
+	}
+
+	return reached;
+}
+
+/**
+ * Frees the tables whose forms died in the collection, and rehashes the rest, whose forms may
+ * have moved
+ */
+void memo_sweep(void) {
+	struct memo_table **link;
+	struct memo_table *table;
+	uint32_t i;
+
+	for (i = 0; i < memo_bucket_count; ++i) {
+		for (link = &memo_buckets[i]; *link != 0; ) {
+			table = *link;
+			if (table->reached) {
+				table->reached = 0;
+				link = &table->next;
+			}
+			else {
+				*link = table->next;
+				memo_table_free(table);
+				memo_count -= 1;
+			}
+		}
+	}
+
+	if (memo_bucket_count != 0)
+		memo_rehash(memo_bucket_count);
+}
+
+/**
+ * Reports the statistics for a memo form as the list (hits misses size)
+ */
+struct s_exp *memo_stats(struct s_exp *form) {
+	struct memo_table *table;
+
+	if (IS_ATOM(form) || c_lisp_eq(_car(form), lisp_memo) == 0)
+		lisp_throw(ERROR_TYPE, form, "memo-stats expects a memoized function");
+
+	table = find_memo_table(form);
+	return _cons(make_int(table->hits),
+			_cons(make_int(table->misses),
+				_cons(make_int(table->size), lisp_nil)));
+}
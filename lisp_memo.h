@@ -0,0 +1,72 @@
+#ifndef _LISP_MEMO_H_
+#define _LISP_MEMO_H_
+/**
+ * Result caches for memoized functions, which are keyed on the structure of the evaluated
+ * argument list rather than on pointer identity.
+ */
+
+// Standard headers
+#include <inttypes.h>
+
+// Initial number of buckets for a fresh memo table, which must be a power of two
+#define MEMO_INITIAL_BUCKETS	16
+
+// Initial number of buckets in the table of memo tables, which must be a power of two
+#define MEMO_INITIAL_TABLES		16
+
+/**
+ * A single cached result. Entries are chained within their hash bucket, and also threaded
+ * onto a doubly linked list in order of use, so that the least recently used entry can be
+ * found in constant time when the table is full.
+ */
+struct memo_entry {
+	uint64_t hash;
+	struct s_exp *args;
+	struct s_exp *value;
+	struct memo_entry *chain;
+	struct memo_entry *newer;
+	struct memo_entry *older;
+};
+
+/**
+ * The cache attached to one memo form. A limit of zero means the table may grow without bound.
+ * Tables are chained into buckets by the address of their form, and reached is set while the
+ * garbage collector has found the form alive.
+ */
+struct memo_table {
+	struct s_exp *form;
+	int reached;
+	struct memo_entry **buckets;
+	uint32_t bucketCount;
+	uint32_t size;
+	uint32_t limit;
+	uint64_t hits;
+	uint64_t misses;
+	struct memo_entry *newest;
+	struct memo_entry *oldest;
+	struct memo_table *next;
+};
+
+// Evaluator interface, used by eval() to dispatch the memo special forms
+struct s_exp *eval_memo(struct s_exp *form, struct s_exp *args, struct lisp_env *env);
+void define_memo(struct s_exp *exp, struct lisp_env *env);
+struct s_exp *memo_stats(struct s_exp *form);
+
+// Garbage collector interface. The arguments and values in a table are forwarded once its form
+// has been reached, and the tables whose forms weren't are freed afterwards.
+int memo_collect(void);
+void memo_sweep(void);
+
+// Table management, used internally
+struct memo_table *find_memo_table(struct s_exp *form);
+uint32_t memo_bucket(struct s_exp *form, uint32_t count);
+void memo_rehash(uint32_t count);
+void memo_table_free(struct memo_table *table);
+struct memo_entry *memo_lookup(struct memo_table *table, struct s_exp *args, uint64_t hash);
+void memo_insert(struct memo_table *table, struct s_exp *args, uint64_t hash, struct s_exp *value);
+void memo_unlink(struct memo_table *table, struct memo_entry *entry);
+void memo_push(struct memo_table *table, struct memo_entry *entry);
+void memo_evict(struct memo_table *table);
+void memo_grow(struct memo_table *table);
+
+#endif
@@ -0,0 +1,641 @@
+/**
+ * Loading files with require and load, and the cache of the forms they parse to. A cache file
+ * holds a header and then each top-level form, with the line it starts on, written out node by
+ * node. Lists and atoms of code carry their source location, quoted data is written as the
+ * datum to pool, and nil and the quote symbol refer to the interpreter's own.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_module.h"
+#include "lisp_parser.h"
+
+// Whether parsed forms are cached on disk
+int module_cache_enabled = 1;
+
+// Every file that has been required
+struct lisp_module *module_list = 0;
+
+/**
+ * Evaluates the top-level forms of the file at path in env. With once set, a file that was
+ * already loaded is not evaluated again, and the value is true, and otherwise the value is that
+ * of the last form. Raises an error if the file can't be read or parsed, or if it is required
+ * again while it is still loading. A file whose evaluation raises an error is not counted as
+ * loaded.
+ */
+struct s_exp *module_load(const char *path, struct lisp_env *env, int once) {
+	struct lisp_handler handler;
+	struct lisp_module *module;
+	struct s_list *forms;
+	struct s_exp *value;
+	char *resolved;
+	char *real;
+	char *source;
+	size_t length;
+	int line;
+
+	// The file is known by its real path, but its code is located by the path it was found at
+	resolved = module_resolve(path);
+	real = realpath(resolved, 0);
+	if (real == 0) {
+		free(resolved);
+		lisp_throw(ERROR_IO, lisp_nil, "unable to open %s", path);
+	}
+
+	module = module_find(real);
+	if (module != 0 && (module->state == MODULE_LOADING || (module->state == MODULE_LOADED && once))) {
+		free(resolved);
+		free(real);
+		if (module->state == MODULE_LOADING)
+			lisp_throw(ERROR_USER, lisp_nil, "%s was required again while it was still loading", path);
+		return lisp_true;
+	}
+
+	source = module_read_file(real, &length);
+	if (source == 0) {
+		free(resolved);
+		free(real);
+		lisp_throw(ERROR_IO, lisp_nil, "unable to read %s", path);
+	}
+
+	forms = module_parse(resolved, source, length);
+	free(resolved);
+	free(source);
+	if (lisp_parse_failed) {
+		free(real);
+		lisp_throw(ERROR_SYNTAX, lisp_nil, "unable to parse %s", path);
+	}
+
+	if (module == 0) {
+		module = (struct lisp_module *) malloc(sizeof(struct lisp_module));
+		module->path = real;
+		module->next = module_list;
+		module_list = module;
+	}
+	else {
+		free(real);
+	}
+
+	module->state = MODULE_LOADING;
+	line = lisp_source_line;
+	value = lisp_undefined;
+
+	handler_push(&handler);
+	if (setjmp(handler.jump) != 0) {
+		module->state = 0;
+		lisp_source_line = line;
+		lisp_raise(handler.error);
+	}
+
+	for (; forms != 0; forms = forms->next) {
+		forms->exp = optimize(forms->exp, env);
+		lisp_source_line = forms->line;
+		lisp_source_site = forms->exp;
+		value = eval(forms->exp, env);
+	}
+
+	handler_pop(&handler);
+	lisp_source_line = line;
+	module->state = MODULE_LOADED;
+	return once ? lisp_true : value;
+}
+
+/**
+ * Parses the contents of the file at path into its top-level forms, from the cache if they
+ * are there, or else with the parser, storing them in the cache for next time. Sets
+ * lisp_parse_failed just like the parser does.
+ */
+struct s_list *module_parse(const char *path, char *source, size_t length) {
+	struct s_list *forms;
+	char *cachePath;
+	uint64_t hash;
+
+	hash = module_hash(source, length);
+	source_set_file(path);
+
+	cachePath = module_cache_enabled ? module_cache_path(hash) : 0;
+	if (cachePath != 0) {
+		forms = module_cache_read(cachePath, hash, length);
+		if (forms != 0) {
+			free(cachePath);
+			lisp_parse_failed = 0;
+			return forms;
+		}
+	}
+
+	forms = lisp_parse_string(source);
+	if (cachePath != 0 && !lisp_parse_failed && forms != 0)
+		module_cache_write(cachePath, forms, hash, length);
+
+	free(cachePath);
+	return forms;
+}
+
+/**
+ * Adds the loading primitives to the global environment
+ */
+void module_init(struct lisp_env *env) {
+	define_label("require", make_native("require", 1, _require, env), env);
+	define_label("load", make_native("load", 1, _load, env), env);
+}
+
+/**
+ * (require path) loads the file at path unless it has been loaded already
+ */
+struct s_exp *_require(struct s_exp **argv, int argc, void *data) {
+	if (!IS_STRING(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "require expects a string path");
+
+	return module_load(string_flatten(argv[0]), (struct lisp_env *) data, 1);
+}
+
+/**
+ * (load path) evaluates the file at path, and returns the value of its last form
+ */
+struct s_exp *_load(struct s_exp **argv, int argc, void *data) {
+	if (!IS_STRING(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "load expects a string path");
+
+	return module_load(string_flatten(argv[0]), (struct lisp_env *) data, 0);
+}
+
+/**
+ * Hashes the contents of a file, with the same FNV-1a hash that interns labels
+ */
+uint64_t module_hash(const char *data, size_t length) {
+	uint64_t hash;
+	size_t i;
+
+	hash = 14695981039346656037ULL;
+	for (i = 0; i < length; ++i)
+		hash = (hash ^ (uint8_t) data[i]) * 1099511628211ULL;
+	return hash;
+}
+
+/**
+ * Returns the path of the cache file for contents with the given hash, creating the cache
+ * directory if it isn't there yet, or 0 if there is nowhere to put the cache
+ */
+char *module_cache_path(uint64_t hash) {
+	const char *dir;
+	const char *home;
+	char *path;
+	size_t size;
+
+	dir = getenv("LISP_CACHE_DIR");
+	if (dir != 0 && dir[0] != 0) {
+		size = strlen(dir) + 32;
+		path = (char *) malloc(size);
+		mkdir(dir, 0755);
+		snprintf(path, size, "%s/%016" PRIx64 ".lc", dir, hash);
+		return path;
+	}
+
+	home = getenv("HOME");
+	if (home == 0 || home[0] == 0)
+		return 0;
+
+	size = strlen(home) + 64;
+	path = (char *) malloc(size);
+	snprintf(path, size, "%s/.cache", home);
+	mkdir(path, 0755);
+	snprintf(path, size, "%s/.cache/cs-lisp", home);
+	mkdir(path, 0755);
+	snprintf(path, size, "%s/.cache/cs-lisp/%016" PRIx64 ".lc", home, hash);
+	return path;
+}
+
+/**
+ * Rebuilds the forms stored in the cache file at path, if it is there and was written for
+ * contents with the given hash and length. Returns 0 if it can't be used.
+ */
+struct s_list *module_cache_read(const char *path, uint64_t hash, size_t length) {
+	struct module_header header;
+	struct module_input in;
+	struct s_list *first;
+	struct s_list **tail;
+	struct s_exp *exp;
+	uint32_t line;
+	uint32_t i;
+
+	in.data = module_read_file(path, &in.length);
+	in.at = 0;
+	if (in.data == 0)
+		return 0;
+
+	first = 0;
+	if (module_read_bytes(&in, &header, sizeof(struct module_header)) != 0 || header.magic != MODULE_CACHE_MAGIC ||
+			header.version != MODULE_CACHE_VERSION || header.hash != hash || header.length != length) {
+		free(in.data);
+		return 0;
+	}
+
+	tail = &first;
+	for (i = 0; i < header.forms; ++i) {
+		if (module_read_bytes(&in, &line, sizeof(uint32_t)) != 0 || (exp = module_read_exp(&in, 0)) == 0) {
+			module_free_forms(first);
+			first = 0;
+			break;
+		}
+
+		*tail = (struct s_list *) malloc(sizeof(struct s_list));
+		(*tail)->exp = exp;
+		(*tail)->line = line;
+		(*tail)->next = 0;
+		tail = &(*tail)->next;
+	}
+
+	free(in.data);
+	return first;
+}
+
+/**
+ * Frees the forms read out of a cache file that turned out to be unusable further on
+ */
+void module_free_forms(struct s_list *forms) {
+	struct s_list *next;
+
+	for (; forms != 0; forms = next) {
+		next = forms->next;
+		module_free_exp(forms->exp);
+		free(forms);
+	}
+}
+
+/**
+ * Writes forms to the cache file at path, through a temporary file that replaces it only once
+ * it is complete. Forms that can't be written leave the cache as it was.
+ */
+void module_cache_write(const char *path, struct s_list *forms, uint64_t hash, size_t length) {
+	struct module_header header;
+	struct s_list *cur;
+	char *temp;
+	FILE *fp;
+	uint32_t line;
+	size_t size;
+	int failed;
+
+	size = strlen(path) + 32;
+	temp = (char *) malloc(size);
+	snprintf(temp, size, "%s.%d.tmp", path, (int) getpid());
+
+	fp = fopen(temp, "wb");
+	if (fp == NULL) {
+		free(temp);
+		return;
+	}
+
+	memset(&header, 0, sizeof(struct module_header));
+	header.magic = MODULE_CACHE_MAGIC;
+	header.version = MODULE_CACHE_VERSION;
+	header.hash = hash;
+	header.length = length;
+	for (cur = forms; cur != 0; cur = cur->next)
+		header.forms += 1;
+
+	failed = fwrite(&header, sizeof(struct module_header), 1, fp) != 1;
+	for (cur = forms; cur != 0 && !failed; cur = cur->next) {
+		line = cur->line;
+		failed = fwrite(&line, sizeof(uint32_t), 1, fp) != 1 || module_write_exp(fp, cur->exp, 0) != 0;
+	}
+
+	if (fclose(fp) != 0 || failed || rename(temp, path) != 0)
+		unlink(temp);
+	free(temp);
+}
+
+/**
+ * Writes one node of a form and everything below it. Code has its source locations written
+ * along with it, and data is written with none. Returns 0, or -1 if the node is something the
+ * parser would never have built.
+ */
+int module_write_exp(FILE *fp, struct s_exp *exp, int data) {
+	struct lisp_location loc;
+	struct s_exp *cur;
+	uint32_t pos[2];
+	uint32_t count;
+	uint8_t tag;
+	char *text;
+	int rtn;
+
+	if (exp == lisp_nil || exp == lisp_quote) {
+		tag = (exp == lisp_nil) ? MODULE_TAG_NIL : MODULE_TAG_QUOTE;
+		return fwrite(&tag, 1, 1, fp) == 1 ? 0 : -1;
+	}
+
+	if (IS_ATOM(exp) && IS_CONSTANT(exp)) {
+		tag = MODULE_TAG_CONSTANT;
+		if (fwrite(&tag, 1, 1, fp) != 1)
+			return -1;
+		return module_write_exp(fp, exp->lisp_car.car, 1);
+	}
+
+	pos[0] = 0;
+	pos[1] = 0;
+	if (!data && source_lookup(exp, &loc)) {
+		pos[0] = loc.line;
+		pos[1] = loc.column;
+	}
+
+	if (!IS_ATOM(exp)) {
+		count = 0;
+		for (cur = exp; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr)
+			count++;
+		if (cur != lisp_nil)
+			return -1;
+
+		tag = MODULE_TAG_LIST;
+		if (fwrite(&tag, 1, 1, fp) != 1 || fwrite(pos, sizeof(pos), 1, fp) != 1 || fwrite(&count, sizeof(uint32_t), 1, fp) != 1)
+			return -1;
+		for (cur = exp; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+			if (module_write_exp(fp, cur->lisp_car.car, data) != 0)
+				return -1;
+		}
+		return 0;
+	}
+
+	if (IS_SYMBOL(exp)) {
+		tag = MODULE_TAG_SYMBOL;
+		text = exp->lisp_car.label;
+		count = strlen(text);
+	}
+	else if (IS_STRING(exp)) {
+		tag = MODULE_TAG_STRING;
+		text = string_flatten(exp);
+		count = exp->lisp_cdr.length;
+	}
+	else if (IS_INT(exp)) {
+		tag = MODULE_TAG_INT;
+		text = (char *) &exp->lisp_car.siVal;
+		count = sizeof(int64_t);
+	}
+	else if (IS_FLOAT(exp)) {
+		tag = MODULE_TAG_FLOAT;
+		text = (char *) &exp->lisp_car.dVal;
+		count = sizeof(double);
+	}
+	else if (IS_BIGNUM(exp) || IS_RATIO(exp)) {
+		// Exact numbers are kept in decimal, the way they would be written
+		tag = MODULE_TAG_NUMBER;
+		text = number_to_string(exp);
+		count = strlen(text);
+	}
+	else {
+		return -1;
+	}
+
+	rtn = 0;
+	if (fwrite(&tag, 1, 1, fp) != 1 || fwrite(pos, sizeof(pos), 1, fp) != 1)
+		rtn = -1;
+	else if (tag != MODULE_TAG_INT && tag != MODULE_TAG_FLOAT && fwrite(&count, sizeof(uint32_t), 1, fp) != 1)
+		rtn = -1;
+	else if (count > 0 && fwrite(text, count, 1, fp) != 1)
+		rtn = -1;
+
+	if (tag == MODULE_TAG_NUMBER)
+		free(text);
+	return rtn;
+}
+
+/**
+ * Reads one node written by module_write_exp(), building it the way the parser would have,
+ * and recording the locations of code. Returns 0 if the file ends early or holds something
+ * it shouldn't, in which case whatever was built of the node so far has been freed.
+ */
+struct s_exp *module_read_exp(struct module_input *in, int data) {
+	struct s_exp *exp;
+	struct s_exp *cur;
+	struct s_exp *item;
+	uint32_t pos[2];
+	uint32_t count;
+	uint32_t i;
+	uint8_t tag;
+	char *text;
+
+	if (module_read_bytes(in, &tag, 1) != 0)
+		return 0;
+
+	switch (tag) {
+		case MODULE_TAG_NIL:
+			return lisp_nil;
+		case MODULE_TAG_QUOTE:
+			return lisp_quote;
+		case MODULE_TAG_CONSTANT:
+			exp = module_read_exp(in, 1);
+			if (exp == 0)
+				return 0;
+
+			// A datum equal to one that is already pooled isn't kept by the pool
+			item = intern_constant(exp);
+			if (item->lisp_car.car != exp)
+				module_free_exp(exp);
+			return item;
+	}
+
+	if (module_read_bytes(in, pos, sizeof(pos)) != 0)
+		return 0;
+
+	exp = (struct s_exp *) malloc(sizeof(struct s_exp));
+	exp->lisp_cdr.cdr = 0;
+
+	switch (tag) {
+		case MODULE_TAG_SYMBOL:
+		case MODULE_TAG_STRING:
+			if (module_read_bytes(in, &count, sizeof(uint32_t)) != 0 || count > in->length - in->at) {
+				free(exp);
+				return 0;
+			}
+
+			exp->lisp_car.strVal = (char *) malloc(count + 1);
+			module_read_bytes(in, exp->lisp_car.strVal, count);
+			exp->lisp_car.strVal[count] = 0;
+			if (tag == MODULE_TAG_SYMBOL) {
+				exp->flags = FLAG_ATOM | FLAG_SYMBOL;
+			}
+			else {
+				exp->flags = FLAG_ATOM | FLAG_STRING;
+				exp->lisp_cdr.length = count;
+			}
+			break;
+		case MODULE_TAG_INT:
+			exp->flags = FLAG_ATOM | FLAG_INT;
+			if (module_read_bytes(in, &exp->lisp_car.siVal, sizeof(int64_t)) != 0) {
+				free(exp);
+				return 0;
+			}
+			break;
+		case MODULE_TAG_FLOAT:
+			exp->flags = FLAG_ATOM | FLAG_FLOAT;
+			if (module_read_bytes(in, &exp->lisp_car.dVal, sizeof(double)) != 0) {
+				free(exp);
+				return 0;
+			}
+			break;
+		case MODULE_TAG_NUMBER:
+			if (module_read_bytes(in, &count, sizeof(uint32_t)) != 0 || count > in->length - in->at) {
+				free(exp);
+				return 0;
+			}
+
+			text = (char *) malloc(count + 1);
+			module_read_bytes(in, text, count);
+			text[count] = 0;
+			i = number_parse(text, exp);
+			free(text);
+			if (i == 0) {
+				free(exp);
+				return 0;
+			}
+			break;
+		case MODULE_TAG_LIST:
+			if (module_read_bytes(in, &count, sizeof(uint32_t)) != 0 || count == 0) {
+				free(exp);
+				return 0;
+			}
+
+			// Build the spine as it is read, the way the parser does, with nil in each car until
+			// its element has been read, so that a partial list can be freed
+			cur = exp;
+			for (i = 0; i < count; ++i) {
+				if (i > 0) {
+					cur->lisp_cdr.cdr = (struct s_exp *) malloc(sizeof(struct s_exp));
+					cur = cur->lisp_cdr.cdr;
+				}
+				cur->flags = 0;
+				cur->lisp_car.car = lisp_nil;
+				cur->lisp_cdr.cdr = lisp_nil;
+				item = module_read_exp(in, data);
+				if (item == 0) {
+					module_free_exp(exp);
+					return 0;
+				}
+				cur->lisp_car.car = item;
+			}
+
+			if (!data && pos[0] > 0)
+				source_record_list(exp, pos[0], pos[1]);
+			return exp;
+		default:
+			free(exp);
+			return 0;
+	}
+
+	if (!data && pos[0] > 0)
+		source_record(exp, pos[0], pos[1]);
+	return exp;
+}
+
+/**
+ * Frees a node built by module_read_exp() and everything below it, for a cache file that turns
+ * out to be unusable part of the way through. Nil, quote and pooled constants are shared, so
+ * they are left alone.
+ */
+void module_free_exp(struct s_exp *exp) {
+	struct s_exp *next;
+
+	while (exp != lisp_nil && exp != lisp_quote && !IS_CONSTANT(exp)) {
+		source_forget(exp);
+
+		if (IS_ATOM(exp)) {
+			if (IS_SYMBOL(exp) || IS_STRING(exp))
+				free(exp->lisp_car.strVal);
+			else
+				number_free(exp);
+			free(exp);
+			return;
+		}
+
+		module_free_exp(exp->lisp_car.car);
+		next = exp->lisp_cdr.cdr;
+		free(exp);
+		exp = next;
+	}
+}
+
+/**
+ * Copies the next size bytes of the input to buf. Returns 0, or -1 if there aren't that many.
+ */
+int module_read_bytes(struct module_input *in, void *buf, size_t size) {
+	if (size > in->length - in->at)
+		return -1;
+
+	memcpy(buf, in->data + in->at, size);
+	in->at += size;
+	return 0;
+}
+
+/**
+ * Finds a path given to require or load. Relative paths are taken from the directory of the
+ * file that the call is in, when it was parsed from one.
+ */
+char *module_resolve(const char *path) {
+	struct lisp_location loc;
+	const char *slash;
+	char *resolved;
+	size_t dirLength;
+
+	source_locate(&loc);
+	if (path[0] == '/' || loc.file == 0 || (slash = strrchr(loc.file, '/')) == 0)
+		return strdup(path);
+
+	dirLength = slash - loc.file + 1;
+	resolved = (char *) malloc(dirLength + strlen(path) + 1);
+	memcpy(resolved, loc.file, dirLength);
+	strcpy(resolved + dirLength, path);
+	return resolved;
+}
+
+/**
+ * Reads a whole file into a buffer with a terminating null, storing its length. Returns 0 if
+ * the file can't be read.
+ */
+char *module_read_file(const char *path, size_t *length) {
+	char *data;
+	FILE *fp;
+	long size;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+		return 0;
+
+	if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+		fclose(fp);
+		return 0;
+	}
+
+	data = (char *) malloc(size + 1);
+	if (fread(data, 1, size, fp) != (size_t) size) {
+		free(data);
+		fclose(fp);
+		return 0;
+	}
+
+	fclose(fp);
+	data[size] = 0;
+	*length = size;
+	return data;
+}
+
+/**
+ * Finds a module by its real path, or returns 0 if it has never been required
+ */
+struct lisp_module *module_find(const char *path) {
+	struct lisp_module *module;
+
+	for (module = module_list; module != 0; module = module->next) {
+		if (strcmp(module->path, path) == 0)
+			return module;
+	}
+
+	return 0;
+}
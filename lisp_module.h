@@ -0,0 +1,103 @@
+#ifndef _LISP_MODULE_H_
+#define _LISP_MODULE_H_
+/**
+ * Loading source files from lisp. (require "file") evaluates a file's top-level forms in the
+ * global environment the first time it is required, and does nothing after that, while
+ * (load "file") evaluates them every time. Relative paths are found from the directory of the
+ * file that the require or load is written in.
+ *
+ * Parsing a file only depends on its contents, so the forms it parses to are kept in a cache
+ * directory, in a file named by the hash of those contents. A file that hasn't changed since
+ * it was last loaded is rebuilt straight from the cache, with its pooled constants and source
+ * locations, instead of being tokenized and parsed again. The cache is in $LISP_CACHE_DIR, or
+ * else ~/.cache/cs-lisp, and a cache file that can't be read or doesn't match is ignored and
+ * written over.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stdio.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_parser.h"
+
+// Identifies cache files, and the version of their format
+#define MODULE_CACHE_MAGIC		0x434c5343
+#define MODULE_CACHE_VERSION	2
+
+// Kinds of node in a cache file
+#define MODULE_TAG_NIL			0
+#define MODULE_TAG_QUOTE		1
+#define MODULE_TAG_SYMBOL		2
+#define MODULE_TAG_INT			3
+#define MODULE_TAG_FLOAT		4
+#define MODULE_TAG_STRING		5
+#define MODULE_TAG_LIST			6
+#define MODULE_TAG_CONSTANT		7
+#define MODULE_TAG_NUMBER		8
+
+// States of a module
+#define MODULE_LOADING			1
+#define MODULE_LOADED			2
+
+/**
+ * A file that has been required, by its real path
+ */
+struct lisp_module {
+	char *path;
+	int state;
+	struct lisp_module *next;
+};
+
+/**
+ * The header of a cache file, which must match the source it is used for
+ */
+struct module_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t hash;
+	uint64_t length;
+	uint32_t forms;
+};
+
+/**
+ * A cache file read into memory, and how far it has been read
+ */
+struct module_input {
+	char *data;
+	size_t length;
+	size_t at;
+};
+
+// Whether parsed forms are cached on disk
+extern int module_cache_enabled;
+
+// Loading files
+struct s_exp *module_load(const char *path, struct lisp_env *env, int once);
+struct s_list *module_parse(const char *path, char *source, size_t length);
+
+// Setup, called by lisp_init()
+void module_init(struct lisp_env *env);
+
+// Lisp-space loading primitives
+struct s_exp *_require(struct s_exp **argv, int argc, void *data);
+struct s_exp *_load(struct s_exp **argv, int argc, void *data);
+
+// The compile cache, used internally
+uint64_t module_hash(const char *data, size_t length);
+char *module_cache_path(uint64_t hash);
+struct s_list *module_cache_read(const char *path, uint64_t hash, size_t length);
+void module_cache_write(const char *path, struct s_list *forms, uint64_t hash, size_t length);
+int module_write_exp(FILE *fp, struct s_exp *exp, int data);
+struct s_exp *module_read_exp(struct module_input *in, int data);
+void module_free_exp(struct s_exp *exp);
+void module_free_forms(struct s_list *forms);
+int module_read_bytes(struct module_input *in, void *buf, size_t size);
+
+// Module helpers, used internally
+char *module_resolve(const char *path);
+char *module_read_file(const char *path, size_t *length);
+struct lisp_module *module_find(const char *path);
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * The set! form, boxes, and the primitives that change pairs in place
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <stdio.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_mutate.h"
+
+/**
+ * Evaluates (set! name expr), whose arguments are given in exp, by changing the value of the
+ * nearest binding of name that is visible from env. Unlike define, it never makes a binding.
+ */
+struct s_exp *eval_set(struct s_exp *exp, struct lisp_env *env) {
+	struct s_exp *name;
+	struct s_exp *value;
+
+	name = _car(exp);
+	if (!IS_SYMBOL(name) || IS_NIL(name) || IS_ATOM(_cdr(exp))) {
+		lisp_source_site = exp;
+		lisp_throw(ERROR_SYNTAX, name, "set! expects a symbol and a value");
+	}
+
+	value = eval(_car(_cdr(exp)), env);
+	if (set_label(name->lisp_car.label, value, env) == 0) {
+		lisp_source_site = exp;
+		lisp_throw(ERROR_UNDEFINED, name, "set! of undefined symbol %s", name->lisp_car.label);
+	}
+
+	return lisp_undefined;
+}
+
+/**
+ * Makes a new box holding value. A box is an atom whose car is its value, and it is only ever
+ * equal to itself.
+ */
+struct s_exp *make_box(struct s_exp *value) {
+	struct s_exp *rtn;
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_BOX;
+	rtn->lisp_car.car = value;
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Adds the mutation primitives to the global environment
+ */
+void mutate_init(struct lisp_env *env) {
+	define_label("box", make_native("box", 1, _box, 0), env);
+	define_label("box?", make_native("box?", 1, _box_p, 0), env);
+	define_label("unbox", make_native("unbox", 1, _unbox, 0), env);
+	define_label("set-box!", make_native("set-box!", 2, _set_box, 0), env);
+	define_label("set-car!", make_native("set-car!", 2, _set_car, 0), env);
+	define_label("set-cdr!", make_native("set-cdr!", 2, _set_cdr, 0), env);
+}
+
+/**
+ * (box x) makes a new box holding x
+ */
+struct s_exp *_box(struct s_exp **argv, int argc, void *data) {
+	return make_box(argv[0]);
+}
+
+/**
+ * (box? x) is true if x is a box
+ */
+struct s_exp *_box_p(struct s_exp **argv, int argc, void *data) {
+	return IS_BOX(argv[0]) ? lisp_true : lisp_false;
+}
+
+/**
+ * (unbox b) is the value held by the box b
+ */
+struct s_exp *_unbox(struct s_exp **argv, int argc, void *data) {
+	if (!IS_BOX(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "unbox expects a box");
+
+	return argv[0]->lisp_car.car;
+}
+
+/**
+ * (set-box! b x) makes the box b hold x instead
+ */
+struct s_exp *_set_box(struct s_exp **argv, int argc, void *data) {
+	if (!IS_BOX(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "set-box! expects a box");
+
+	gc_write_barrier(argv[0], argv[1]);
+	argv[0]->lisp_car.car = argv[1];
+	return lisp_undefined;
+}
+
+/**
+ * (set-car! p x) replaces the car of the pair p with x
+ */
+struct s_exp *_set_car(struct s_exp **argv, int argc, void *data) {
+	mutate_check_pair(argv[0], "set-car!");
+
+	gc_write_barrier(argv[0], argv[1]);
+	argv[0]->lisp_car.car = argv[1];
+	return lisp_undefined;
+}
+
+/**
+ * (set-cdr! p x) replaces the cdr of the pair p with x
+ */
+struct s_exp *_set_cdr(struct s_exp **argv, int argc, void *data) {
+	mutate_check_pair(argv[0], "set-cdr!");
+
+	gc_write_barrier(argv[0], argv[1]);
+	argv[0]->lisp_cdr.cdr = argv[1];
+	return lisp_undefined;
+}
+
+/**
+ * Raises an error unless cell is a pair that may be changed, which quoted data and shared pairs
+ * may not be
+ */
+void mutate_check_pair(struct s_exp *cell, const char *name) {
+	if (IS_ATOM(cell))
+		lisp_throw(ERROR_TYPE, cell, "%s expects a pair", name);
+	if (IS_HASHCONS(cell))
+		lisp_throw(ERROR_TYPE, cell, "%s cannot change a shared pair", name);
+	if (IS_IMMUTABLE(cell))
+		lisp_throw(ERROR_TYPE, cell, "%s cannot change quoted data", name);
+}
+
+/**
+ * Checks if exp contains a set! of any of the symbols in names. Compiled code keeps a lambda's
+ * parameters outside of any frame, where set! can't reach them, so lambdas that assign their
+ * own parameters are left to the interpreter. Shadowing isn't taken into account, which only
+ * errs on the side of interpreting.
+ */
+int form_assigns(struct s_exp *exp, struct s_exp *names) {
+	struct s_exp *cur;
+
+	if (IS_ATOM(exp) || IS_IMMUTABLE(exp))
+		return 0;
+
+	if (c_lisp_eq(exp->lisp_car.car, lisp_set) == 1 && !IS_ATOM(exp->lisp_cdr.cdr)) {
+		for (cur = names; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+			if (c_lisp_eq(cur->lisp_car.car, exp->lisp_cdr.cdr->lisp_car.car) == 1)
+				return 1;
+		}
+	}
+
+	for (cur = exp; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		if (form_assigns(cur->lisp_car.car, names))
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef _LISP_MUTATE_H_
+#define _LISP_MUTATE_H_
+/**
+ * Mutable state, for programs that build their results up a piece at a time. (set! name value)
+ * changes the nearest binding of a variable that is already bound, a box is a cell holding one
+ * value that (set-box! b value) replaces, and set-car! and set-cdr! change a pair in place, so
+ * that a list can be grown at its tail in constant time instead of being rebuilt.
+ *
+ * Quoted data is pooled and shared by every occurrence of an equal datum, and shared pairs made
+ * while hash-consing stand for every equal pair, so neither can be changed. Every change to a
+ * cell goes through gc_write_barrier() first, which keeps the collector aware of pointers into
+ * the heap from cells that it doesn't own.
+ */
+
+// Standard headers
+#include <inttypes.h>
+
+// Project headers
+#include "lisp.h"
+
+// The set! form
+struct s_exp *eval_set(struct s_exp *exp, struct lisp_env *env);
+
+// Boxes
+struct s_exp *make_box(struct s_exp *value);
+
+// Setup, called by lisp_init()
+void mutate_init(struct lisp_env *env);
+
+// Lisp-space mutation primitives
+struct s_exp *_box(struct s_exp **argv, int argc, void *data);
+struct s_exp *_box_p(struct s_exp **argv, int argc, void *data);
+struct s_exp *_unbox(struct s_exp **argv, int argc, void *data);
+struct s_exp *_set_box(struct s_exp **argv, int argc, void *data);
+struct s_exp *_set_car(struct s_exp **argv, int argc, void *data);
+struct s_exp *_set_cdr(struct s_exp **argv, int argc, void *data);
+
+// Mutation helpers, used internally
+void mutate_check_pair(struct s_exp *cell, const char *name);
+int form_assigns(struct s_exp *exp, struct s_exp *names);
+
+#endif
@@ -0,0 +1,566 @@
+/**
+ * Numeric primitives. Each one takes exactly two arguments, and the fixnum case is checked
+ * first, because it is by far the most common.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_number.h"
+
+/**
+ * Creates a float atom
+ */
+struct s_exp *make_float(double val) {
+	struct s_exp *rtn;
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_FLOAT;
+	rtn->lisp_car.dVal = val;
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Creates an integer atom with the value of b, which is a fixnum if it fits
+ */
+struct s_exp *make_integer(struct lisp_bignum *b) {
+	struct s_exp *rtn;
+
+	number_charge(b, 0);
+	rtn = find_free_s_exp();
+	rtn->lisp_cdr.cdr = 0;
+	number_set_integer(rtn, b);
+	return rtn;
+}
+
+/**
+ * Creates the exact number num/den, where den is not zero
+ */
+struct s_exp *make_ratio(struct lisp_bignum *num, struct lisp_bignum *den) {
+	struct s_exp *rtn;
+
+	number_charge(num, den);
+	rtn = find_free_s_exp();
+	rtn->lisp_cdr.cdr = 0;
+	number_set_ratio(rtn, num, den);
+	return rtn;
+}
+
+/**
+ * Charges the limbs of b, and of den if there is one, against the cell budget before a cell is
+ * made to own them. They have already been allocated, so if they don't fit they are freed
+ * before the limit error is raised, and otherwise the cell is sure to fit as well.
+ */
+void number_charge(struct lisp_bignum *b, struct lisp_bignum *den) {
+	size_t bytes;
+
+	bytes = sizeof(struct lisp_bignum) + b->length * sizeof(uint64_t);
+	if (den != 0)
+		bytes += sizeof(struct lisp_bignum) + den->length * sizeof(uint64_t);
+
+	if (!limit_fits(bytes)) {
+		free(b);
+		free(den);
+		limit_exceeded(LIMIT_CELLS);
+	}
+	limit_charge(bytes);
+}
+
+/**
+ * Makes exp an integer atom with the value of b, demoting it to a fixnum if it fits
+ */
+void number_set_integer(struct s_exp *exp, struct lisp_bignum *b) {
+	int64_t val;
+
+	if (bignum_to_int(b, &val)) {
+		free(b);
+		exp->flags = FLAG_ATOM | FLAG_INT;
+		exp->lisp_car.siVal = val;
+	}
+	else {
+		exp->flags = FLAG_ATOM | FLAG_BIGNUM;
+		exp->lisp_car.bignum = b;
+	}
+}
+
+/**
+ * Makes exp the exact number num/den, where den is not zero, reducing it to lowest terms and
+ * making it an integer if the denominator comes out as one
+ */
+void number_set_ratio(struct s_exp *exp, struct lisp_bignum *num, struct lisp_bignum *den) {
+	struct lisp_ratio *ratio;
+	struct lisp_bignum *g;
+	struct lisp_bignum *t;
+
+	if (den->sign < 0) {
+		den->sign = 1;
+		if (num->length != 0)
+			num->sign = -num->sign;
+	}
+
+	g = bignum_gcd(num, den);
+	if (g->length != 1 || g->limbs[0] != 1) {
+		bignum_divmod(num, g, &t, 0);
+		free(num);
+		num = t;
+		bignum_divmod(den, g, &t, 0);
+		free(den);
+		den = t;
+	}
+	free(g);
+
+	if (den->length == 1 && den->limbs[0] == 1) {
+		free(den);
+		number_set_integer(exp, num);
+		return;
+	}
+
+	ratio = (struct lisp_ratio *) malloc(sizeof(struct lisp_ratio));
+	ratio->num = num;
+	ratio->den = den;
+	exp->flags = FLAG_ATOM | FLAG_RATIO;
+	exp->lisp_car.ratio = ratio;
+}
+
+/**
+ * Reads the exact numbers that don't fit in a fixnum, which are integers too large for one and
+ * fractions written n/d, into exp. Returns 1 on success and 0 if text is neither.
+ */
+int number_parse(const char *text, struct s_exp *exp) {
+	struct lisp_bignum *num;
+	struct lisp_bignum *den;
+	const char *slash;
+	char *head;
+
+	slash = strchr(text, '/');
+	if (slash == 0) {
+		num = bignum_parse(text);
+		if (num == 0)
+			return 0;
+		number_set_integer(exp, num);
+		return 1;
+	}
+
+	// The denominator is written without a sign, and must not be zero
+	if (slash[1] < '0' || slash[1] > '9')
+		return 0;
+
+	head = strndup(text, slash - text);
+	num = bignum_parse(head);
+	free(head);
+	den = bignum_parse(slash + 1);
+
+	if (num == 0 || den == 0 || bignum_is_zero(den)) {
+		free(num);
+		free(den);
+		return 0;
+	}
+
+	number_set_ratio(exp, num, den);
+	return 1;
+}
+
+/**
+ * Writes an exact number in decimal, into a string that the caller must free
+ */
+char *number_to_string(struct s_exp *n) {
+	char *num;
+	char *den;
+	char *rtn;
+
+	if (IS_BIGNUM(n))
+		return bignum_to_string(n->lisp_car.bignum);
+
+	if (IS_RATIO(n)) {
+		num = bignum_to_string(n->lisp_car.ratio->num);
+		den = bignum_to_string(n->lisp_car.ratio->den);
+		rtn = (char *) malloc(strlen(num) + strlen(den) + 2);
+		sprintf(rtn, "%s/%s", num, den);
+		free(num);
+		free(den);
+		return rtn;
+	}
+
+	rtn = (char *) malloc(24);
+	sprintf(rtn, "%" PRId64, n->lisp_car.siVal);
+	return rtn;
+}
+
+/**
+ * Frees the storage owned by a bignum or ratio atom, when the collector finds it dead
+ */
+void number_free(struct s_exp *n) {
+	if (IS_BIGNUM(n)) {
+		free(n->lisp_car.bignum);
+	}
+	else if (IS_RATIO(n)) {
+		free(n->lisp_car.ratio->num);
+		free(n->lisp_car.ratio->den);
+		free(n->lisp_car.ratio);
+	}
+}
+
+/**
+ * Adds the numeric primitives that aren't defined statically to the global environment
+ */
+void number_init(struct lisp_env *env) {
+	define_label("quotient", make_native("quotient", 2, _quotient, 0), env);
+	define_label("remainder", make_native("remainder", 2, _remainder, 0), env);
+	define_label("numerator", make_native("numerator", 1, _numerator, 0), env);
+	define_label("denominator", make_native("denominator", 1, _denominator, 0), env);
+	define_label("exact->inexact", make_native("exact->inexact", 1, _exact_to_inexact, 0), env);
+}
+
+/**
+ * Checks that both arguments to a numeric primitive are numbers, raising an error if not
+ */
+void number_check(struct s_exp *a, struct s_exp *b, const char *name) {
+	if (!IS_INT(a) && !IS_FLOAT(a) && !IS_BIGNUM(a) && !IS_RATIO(a))
+		lisp_throw(ERROR_TYPE, a, "non-numeric argument supplied to %s", name);
+	if (!IS_INT(b) && !IS_FLOAT(b) && !IS_BIGNUM(b) && !IS_RATIO(b))
+		lisp_throw(ERROR_TYPE, b, "non-numeric argument supplied to %s", name);
+}
+
+/**
+ * Converts any number to a double, for mixed arithmetic
+ */
+double number_to_double(struct s_exp *n) {
+	if (IS_FLOAT(n))
+		return n->lisp_car.dVal;
+	if (IS_BIGNUM(n))
+		return bignum_to_double(n->lisp_car.bignum);
+	if (IS_RATIO(n))
+		return bignum_to_double(n->lisp_car.ratio->num) / bignum_to_double(n->lisp_car.ratio->den);
+
+	return (double) n->lisp_car.siVal;
+}
+
+/**
+ * Lisp-space addition
+ */
+struct s_exp *_add(struct s_exp *a, struct s_exp *b) {
+	int64_t result;
+
+	if (IS_INT(a) && IS_INT(b) && !__builtin_add_overflow(a->lisp_car.siVal, b->lisp_car.siVal, &result))
+		return make_int(result);
+
+	return number_arith(NUMBER_ADD, a, b, "+");
+}
+
+/**
+ * Lisp-space subtraction
+ */
+struct s_exp *_sub(struct s_exp *a, struct s_exp *b) {
+	int64_t result;
+
+	if (IS_INT(a) && IS_INT(b) && !__builtin_sub_overflow(a->lisp_car.siVal, b->lisp_car.siVal, &result))
+		return make_int(result);
+
+	return number_arith(NUMBER_SUB, a, b, "-");
+}
+
+/**
+ * Lisp-space multiplication
+ */
+struct s_exp *_mul(struct s_exp *a, struct s_exp *b) {
+	int64_t result;
+
+	if (IS_INT(a) && IS_INT(b) && !__builtin_mul_overflow(a->lisp_car.siVal, b->lisp_car.siVal, &result))
+		return make_int(result);
+
+	return number_arith(NUMBER_MUL, a, b, "*");
+}
+
+/**
+ * Lisp-space division, which is exact unless either argument is a float. Fixnums that divide
+ * evenly stay fixnums, and anything else makes a ratio.
+ */
+struct s_exp *_div(struct s_exp *a, struct s_exp *b) {
+	if (IS_INT(a) && IS_INT(b) && b->lisp_car.siVal > 0 && a->lisp_car.siVal % b->lisp_car.siVal == 0)
+		return make_int(a->lisp_car.siVal / b->lisp_car.siVal);
+
+	return number_arith(NUMBER_DIV, a, b, "/");
+}
+
+/**
+ * Lisp-space less than
+ */
+struct s_exp *_lt(struct s_exp *a, struct s_exp *b) {
+	if (IS_INT(a) && IS_INT(b))
+		return (a->lisp_car.siVal < b->lisp_car.siVal) ? lisp_true : lisp_false;
+
+	number_check(a, b, "<");
+	if (IS_FLOAT(a) || IS_FLOAT(b))
+		return (number_to_double(a) < number_to_double(b)) ? lisp_true : lisp_false;
+
+	return (number_compare(a, b) < 0) ? lisp_true : lisp_false;
+}
+
+/**
+ * Lisp-space greater than
+ */
+struct s_exp *_gt(struct s_exp *a, struct s_exp *b) {
+	if (IS_INT(a) && IS_INT(b))
+		return (a->lisp_car.siVal > b->lisp_car.siVal) ? lisp_true : lisp_false;
+
+	number_check(a, b, ">");
+	if (IS_FLOAT(a) || IS_FLOAT(b))
+		return (number_to_double(a) > number_to_double(b)) ? lisp_true : lisp_false;
+
+	return (number_compare(a, b) > 0) ? lisp_true : lisp_false;
+}
+
+/**
+ * Lisp-space numeric equality, under which an integer equals the float with the same value
+ */
+struct s_exp *_num_eq(struct s_exp *a, struct s_exp *b) {
+	if (IS_INT(a) && IS_INT(b))
+		return (a->lisp_car.siVal == b->lisp_car.siVal) ? lisp_true : lisp_false;
+
+	number_check(a, b, "=");
+	if (IS_FLOAT(a) || IS_FLOAT(b))
+		return (number_to_double(a) == number_to_double(b)) ? lisp_true : lisp_false;
+
+	return (number_compare(a, b) == 0) ? lisp_true : lisp_false;
+}
+
+/**
+ * (quotient a b) divides the integer a by the integer b, rounding towards zero
+ */
+struct s_exp *_quotient(struct s_exp **argv, int argc, void *data) {
+	return number_divide(argv[0], argv[1], 0, "quotient");
+}
+
+/**
+ * (remainder a b) is what is left over from (quotient a b), with the sign of a
+ */
+struct s_exp *_remainder(struct s_exp **argv, int argc, void *data) {
+	return number_divide(argv[0], argv[1], 1, "remainder");
+}
+
+/**
+ * (numerator x) is the numerator of the exact number x in lowest terms
+ */
+struct s_exp *_numerator(struct s_exp **argv, int argc, void *data) {
+	if (IS_INT(argv[0]) || IS_BIGNUM(argv[0]))
+		return argv[0];
+	if (!IS_RATIO(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "numerator expects an exact number");
+
+	return make_integer(bignum_copy(argv[0]->lisp_car.ratio->num));
+}
+
+/**
+ * (denominator x) is the denominator of the exact number x in lowest terms, which is 1 for an
+ * integer
+ */
+struct s_exp *_denominator(struct s_exp **argv, int argc, void *data) {
+	if (IS_INT(argv[0]) || IS_BIGNUM(argv[0]))
+		return make_int(1);
+	if (!IS_RATIO(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "denominator expects an exact number");
+
+	return make_integer(bignum_copy(argv[0]->lisp_car.ratio->den));
+}
+
+/**
+ * (exact->inexact x) is the float nearest to the number x
+ */
+struct s_exp *_exact_to_inexact(struct s_exp **argv, int argc, void *data) {
+	number_check(argv[0], argv[0], "exact->inexact");
+	if (IS_FLOAT(argv[0]))
+		return argv[0];
+
+	return make_float(number_to_double(argv[0]));
+}
+
+/**
+ * Carries out op on any two numbers, for everything that the fixnum fast paths don't handle.
+ * Integers are added, subtracted and multiplied as bignums, and the result goes back to being
+ * a fixnum if it fits. Anything involving a ratio, or a division, is done on fractions and then
+ * reduced.
+ */
+struct s_exp *number_arith(int op, struct s_exp *a, struct s_exp *b, const char *name) {
+	struct lisp_bignum *aNum;
+	struct lisp_bignum *aDen;
+	struct lisp_bignum *bNum;
+	struct lisp_bignum *bDen;
+	struct lisp_bignum *num;
+	struct lisp_bignum *den;
+	struct lisp_bignum *x;
+	struct lisp_bignum *y;
+	double fa;
+	double fb;
+
+	number_check(a, b, name);
+
+	if (IS_FLOAT(a) || IS_FLOAT(b)) {
+		fa = number_to_double(a);
+		fb = number_to_double(b);
+		switch (op) {
+			case NUMBER_ADD:
+				return make_float(fa + fb);
+			case NUMBER_SUB:
+				return make_float(fa - fb);
+			case NUMBER_MUL:
+				return make_float(fa * fb);
+			default:
+				return make_float(fa / fb);
+		}
+	}
+
+	// Zero is always a fixnum
+	if (op == NUMBER_DIV && IS_INT(b) && b->lisp_car.siVal == 0)
+		lisp_throw(ERROR_RANGE, a, "division by zero in %s", name);
+
+	if (op != NUMBER_DIV && !IS_RATIO(a) && !IS_RATIO(b)) {
+		x = number_to_bignum(a);
+		y = number_to_bignum(b);
+		if (op == NUMBER_ADD)
+			num = bignum_add(x, y);
+		else if (op == NUMBER_SUB)
+			num = bignum_sub(x, y);
+		else
+			num = bignum_mul(x, y);
+		free(x);
+		free(y);
+		return make_integer(num);
+	}
+
+	aNum = number_numerator(a);
+	aDen = number_denominator(a);
+	bNum = number_numerator(b);
+	bDen = number_denominator(b);
+
+	switch (op) {
+		case NUMBER_ADD:
+		case NUMBER_SUB:
+			x = bignum_mul(aNum, bDen);
+			y = bignum_mul(bNum, aDen);
+			num = (op == NUMBER_ADD) ? bignum_add(x, y) : bignum_sub(x, y);
+			den = bignum_mul(aDen, bDen);
+			free(x);
+			free(y);
+			break;
+		case NUMBER_MUL:
+			num = bignum_mul(aNum, bNum);
+			den = bignum_mul(aDen, bDen);
+			break;
+		default:
+			num = bignum_mul(aNum, bDen);
+			den = bignum_mul(aDen, bNum);
+			break;
+	}
+
+	free(aNum);
+	free(aDen);
+	free(bNum);
+	free(bDen);
+	return make_ratio(num, den);
+}
+
+/**
+ * Compares two exact numbers, returning a negative number, zero, or a positive number as a is
+ * less than, equal to, or greater than b. Denominators are positive, so fractions are compared
+ * by cross multiplying.
+ */
+int number_compare(struct s_exp *a, struct s_exp *b) {
+	struct lisp_bignum *num;
+	struct lisp_bignum *den;
+	struct lisp_bignum *x;
+	struct lisp_bignum *y;
+	int cmp;
+
+	if (IS_RATIO(a) || IS_RATIO(b)) {
+		num = number_numerator(a);
+		den = number_denominator(b);
+		x = bignum_mul(num, den);
+		free(num);
+		free(den);
+
+		num = number_numerator(b);
+		den = number_denominator(a);
+		y = bignum_mul(num, den);
+		free(num);
+		free(den);
+	}
+	else {
+		x = number_to_bignum(a);
+		y = number_to_bignum(b);
+	}
+
+	cmp = bignum_compare(x, y);
+	free(x);
+	free(y);
+	return cmp;
+}
+
+/**
+ * Divides the integer a by the integer b, rounding towards zero, and returns the quotient, or
+ * the remainder if remainder is set
+ */
+struct s_exp *number_divide(struct s_exp *a, struct s_exp *b, int remainder, const char *name) {
+	struct lisp_bignum *x;
+	struct lisp_bignum *y;
+	struct lisp_bignum *result;
+
+	if (!IS_INT(a) && !IS_BIGNUM(a))
+		lisp_throw(ERROR_TYPE, a, "%s expects integers", name);
+	if (!IS_INT(b) && !IS_BIGNUM(b))
+		lisp_throw(ERROR_TYPE, b, "%s expects integers", name);
+	if (IS_INT(b) && b->lisp_car.siVal == 0)
+		lisp_throw(ERROR_RANGE, a, "division by zero in %s", name);
+
+	// The one fixnum quotient that overflows is INT64_MIN / -1
+	if (IS_INT(a) && IS_INT(b) && (a->lisp_car.siVal != INT64_MIN || b->lisp_car.siVal != -1)) {
+		if (remainder)
+			return make_int(a->lisp_car.siVal % b->lisp_car.siVal);
+		return make_int(a->lisp_car.siVal / b->lisp_car.siVal);
+	}
+
+	x = number_to_bignum(a);
+	y = number_to_bignum(b);
+	if (remainder)
+		bignum_divmod(x, y, 0, &result);
+	else
+		bignum_divmod(x, y, &result, 0);
+	free(x);
+	free(y);
+	return make_integer(result);
+}
+
+/**
+ * A new bignum with the value of an integer, either a fixnum or a bignum
+ */
+struct lisp_bignum *number_to_bignum(struct s_exp *n) {
+	if (IS_BIGNUM(n))
+		return bignum_copy(n->lisp_car.bignum);
+
+	return bignum_from_int(n->lisp_car.siVal);
+}
+
+/**
+ * A new bignum with the numerator of an exact number
+ */
+struct lisp_bignum *number_numerator(struct s_exp *n) {
+	if (IS_RATIO(n))
+		return bignum_copy(n->lisp_car.ratio->num);
+
+	return number_to_bignum(n);
+}
+
+/**
+ * A new bignum with the denominator of an exact number
+ */
+struct lisp_bignum *number_denominator(struct s_exp *n) {
+	if (IS_RATIO(n))
+		return bignum_copy(n->lisp_car.ratio->den);
+
+	return bignum_from_int(1);
+}
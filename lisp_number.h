@@ -0,0 +1,76 @@
+#ifndef _LISP_NUMBER_H_
+#define _LISP_NUMBER_H_
+/**
+ * Arithmetic and comparison on numbers. Integers are fixnums held directly in the atom for as
+ * long as they fit, and are promoted to bignums when an operation overflows, so integer
+ * arithmetic is always exact. Dividing integers that don't divide evenly gives an exact ratio.
+ * Results are always put in the smallest representation that holds them, so that a value has
+ * exactly one representation and a bignum is never small enough to be a fixnum, nor a ratio an
+ * integer. Any operation involving a float is carried out in floating point.
+ *
+ * Each primitive checks the fixnum case first and handles it without leaving the function, and
+ * only the rare cases (overflow, bignums, ratios, floats) go through number_arith().
+ */
+
+// Standard headers
+#include <inttypes.h>
+
+// Project headers
+#include "lisp_bignum.h"
+
+// The operations carried out by number_arith()
+#define NUMBER_ADD		0
+#define NUMBER_SUB		1
+#define NUMBER_MUL		2
+#define NUMBER_DIV		3
+
+/**
+ * An exact fraction in lowest terms, pointed to by a FLAG_RATIO atom. The denominator is always
+ * greater than one.
+ */
+struct lisp_ratio {
+	struct lisp_bignum *num;
+	struct lisp_bignum *den;
+};
+
+// Making exact numbers, which take ownership of the bignums they are given
+struct s_exp *make_integer(struct lisp_bignum *b);
+struct s_exp *make_ratio(struct lisp_bignum *num, struct lisp_bignum *den);
+void number_charge(struct lisp_bignum *b, struct lisp_bignum *den);
+void number_set_integer(struct s_exp *exp, struct lisp_bignum *b);
+void number_set_ratio(struct s_exp *exp, struct lisp_bignum *num, struct lisp_bignum *den);
+
+// Reading, printing, and freeing exact numbers
+int number_parse(const char *text, struct s_exp *exp);
+char *number_to_string(struct s_exp *n);
+void number_free(struct s_exp *n);
+
+// Setup, called by lisp_init()
+void number_init(struct lisp_env *env);
+
+// Lisp-space numeric primitives
+struct s_exp *_add(struct s_exp *a, struct s_exp *b);
+struct s_exp *_sub(struct s_exp *a, struct s_exp *b);
+struct s_exp *_mul(struct s_exp *a, struct s_exp *b);
+struct s_exp *_div(struct s_exp *a, struct s_exp *b);
+struct s_exp *_lt(struct s_exp *a, struct s_exp *b);
+struct s_exp *_gt(struct s_exp *a, struct s_exp *b);
+struct s_exp *_num_eq(struct s_exp *a, struct s_exp *b);
+struct s_exp *_quotient(struct s_exp **argv, int argc, void *data);
+struct s_exp *_remainder(struct s_exp **argv, int argc, void *data);
+struct s_exp *_numerator(struct s_exp **argv, int argc, void *data);
+struct s_exp *_denominator(struct s_exp **argv, int argc, void *data);
+struct s_exp *_exact_to_inexact(struct s_exp **argv, int argc, void *data);
+
+// Helpers, used internally
+struct s_exp *make_float(double val);
+void number_check(struct s_exp *a, struct s_exp *b, const char *name);
+double number_to_double(struct s_exp *n);
+struct s_exp *number_arith(int op, struct s_exp *a, struct s_exp *b, const char *name);
+int number_compare(struct s_exp *a, struct s_exp *b);
+struct s_exp *number_divide(struct s_exp *a, struct s_exp *b, int remainder, const char *name);
+struct lisp_bignum *number_to_bignum(struct s_exp *n);
+struct lisp_bignum *number_numerator(struct s_exp *n);
+struct lisp_bignum *number_denominator(struct s_exp *n);
+
+#endif
@@ -0,0 +1,374 @@
+/**
+ * A simple optimization pass over parsed forms, run on each top-level form just before it is
+ * evaluated. It rewrites the form in place:
+ *
+ *  - #t, #f and nil are replaced by the values they name
+ *  - applications of pure primitives to constant arguments are replaced by their results
+ *  - cond clauses whose test is a constant false are dropped, as is everything after a clause
+ *    whose test is a constant true, and a cond that starts with a true clause becomes its body
+ *  - ((lambda (x ...) body) v ...) is inlined when every v is a constant or a variable and the
+ *    body only uses constants, variables, cond and pure primitives
+ *
+ * Like most compilers, the pass assumes that the names of the primitives, #t, #f and nil are not
+ * rebound at runtime. Names bound by an enclosing lambda, label or memo form are respected.
+ * Parsed code lives outside of the heap, so every store into it goes through the write barrier,
+ * since inlined bodies and folded results may be heap cells.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Project headers
+#include "lisp.h"
+
+/**
+ * Checks if a symbol is bound by one of the enclosing function forms, whose names are kept in
+ * the list bound
+ */
+int opt_is_bound(struct s_exp *symbol, struct s_exp *bound) {
+	for (; !IS_ATOM(bound); bound = bound->lisp_cdr.cdr) {
+		if (strcmp(bound->lisp_car.car->lisp_car.label, symbol->lisp_car.label) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Replaces the car of a cell of code
+ */
+void opt_set_car(struct s_exp *cell, struct s_exp *value) {
+	gc_write_barrier(cell, value);
+	cell->lisp_car.car = value;
+}
+
+/**
+ * Replaces the cdr of a cell of code
+ */
+void opt_set_cdr(struct s_exp *cell, struct s_exp *value) {
+	gc_write_barrier(cell, value);
+	cell->lisp_cdr.cdr = value;
+}
+
+/**
+ * Checks if an expression is a constant, meaning that evaluating it always produces the same
+ * value with no side effects and no environment access
+ */
+int opt_is_constant(struct s_exp *exp) {
+	if (!IS_ATOM(exp))
+		return 0;
+
+	if (IS_CONSTANT(exp))
+		return 1;
+
+	return (!IS_SYMBOL(exp) && !IS_UNDEFINED(exp)) ? 1 : 0;
+}
+
+/**
+ * Turns a value computed at optimization time back into an expression that evaluates to it
+ */
+struct s_exp *opt_quote(struct s_exp *value) {
+	if (IS_ATOM(value) && !IS_SYMBOL(value) && !IS_UNDEFINED(value))
+		return value;
+
+	return intern_constant(value);
+}
+
+/**
+ * Looks up the current global value of a symbol, which is undefined if it has none yet
+ */
+struct s_exp *opt_lookup(struct s_exp *symbol, struct lisp_env *env) {
+	return lookup_label(symbol->lisp_car.label, env);
+}
+
+/**
+ * Finds the pure primitive that a symbol in function position refers to, or returns 0
+ */
+struct lisp_native *opt_pure_native(struct s_exp *head, struct lisp_env *env, struct s_exp *bound) {
+	struct s_exp *value;
+
+	if (!IS_SYMBOL(head) || opt_is_bound(head, bound))
+		return 0;
+
+	value = opt_lookup(head, env);
+	if (!IS_FUNCTION(value) || value->lisp_car.native->pure == 0)
+		return 0;
+
+	return value->lisp_car.native;
+}
+
+/**
+ * Calls a pure primitive on constant arguments, returning the folded expression, or 0 if the
+ * call should be left for runtime (including when it would report an error)
+ */
+struct s_exp *opt_fold(struct lisp_native *native, struct s_exp *args) {
+	struct s_exp *argv[NATIVE_LOCAL_ARGS];
+	struct lisp_handler handler;
+	struct s_exp *cur;
+	struct s_exp *value;
+	int argc;
+
+	argc = 0;
+	for (cur = args; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+		if (!opt_is_constant(cur->lisp_car.car) || argc == NATIVE_LOCAL_ARGS)
+			return 0;
+
+		argv[argc++] = IS_CONSTANT(cur->lisp_car.car) ? cur->lisp_car.car->lisp_car.car : cur->lisp_car.car;
+	}
+
+	// Errors raised while folding are left to be raised when the code actually runs instead
+	handler_push(&handler);
+	if (setjmp(handler.jump) != 0)
+		return 0;
+
+	value = native_dispatch(native, argv, argc);
+	handler_pop(&handler);
+	return opt_quote(value);
+}
+
+/**
+ * Checks if a lambda body is simple enough to inline: it may only contain constants, variables,
+ * cond, and applications of pure primitives. Anything that could call user code is excluded,
+ * because user code may look up the lambda's variables dynamically.
+ */
+int opt_is_trivial(struct s_exp *exp, struct lisp_env *env, struct s_exp *bound) {
+	struct s_exp *clause;
+
+	if (IS_ATOM(exp))
+		return 1;
+
+	if (IS_SYMBOL(exp->lisp_car.car) && c_lisp_eq(exp->lisp_car.car, lisp_cond) == 1 && !opt_is_bound(exp->lisp_car.car, bound)) {
+		for (clause = exp->lisp_cdr.cdr; !IS_ATOM(clause); clause = clause->lisp_cdr.cdr) {
+			if (IS_ATOM(clause->lisp_car.car) || !opt_is_trivial(clause->lisp_car.car->lisp_car.car, env, bound)
+					|| !opt_is_trivial(_car(_cdr(clause->lisp_car.car)), env, bound))
+				return 0;
+		}
+		return 1;
+	}
+
+	if (opt_pure_native(exp->lisp_car.car, env, bound) == 0)
+		return 0;
+
+	for (exp = exp->lisp_cdr.cdr; !IS_ATOM(exp); exp = exp->lisp_cdr.cdr) {
+		if (!opt_is_trivial(exp->lisp_car.car, env, bound))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Copies a trivial body, replacing each formal with the matching actual argument. Trivial
+ * bodies contain no binding forms, so there is no shadowing to worry about.
+ */
+struct s_exp *opt_substitute(struct s_exp *exp, struct s_exp *formals, struct s_exp *actuals) {
+	if (IS_ATOM(exp)) {
+		if (!IS_SYMBOL(exp))
+			return exp;
+
+		for (; !IS_ATOM(formals); formals = formals->lisp_cdr.cdr, actuals = actuals->lisp_cdr.cdr) {
+			if (strcmp(formals->lisp_car.car->lisp_car.label, exp->lisp_car.label) == 0)
+				return actuals->lisp_car.car;
+		}
+		return exp;
+	}
+
+	return _cons(opt_substitute(exp->lisp_car.car, formals, actuals), opt_substitute(exp->lisp_cdr.cdr, formals, actuals));
+}
+
+/**
+ * Tries to inline ((lambda (formals) body) actuals), whose parts have already been optimized.
+ * Returns the replacement expression, or 0 if the application must stay as it is.
+ */
+struct s_exp *opt_inline(struct s_exp *lambda, struct s_exp *actuals, struct lisp_env *env, struct s_exp *bound) {
+	struct s_exp *formals;
+	struct s_exp *actual;
+	struct s_exp *cur;
+
+	formals = _car(_cdr(lambda));
+
+	// Arguments must match up one to one, and each must be cheap and safe to evaluate any number of times
+	for (cur = formals, actual = actuals; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr, actual = actual->lisp_cdr.cdr) {
+		if (IS_ATOM(actual) || !IS_SYMBOL(cur->lisp_car.car))
+			return 0;
+		if (!opt_is_constant(actual->lisp_car.car) && !IS_SYMBOL(actual->lisp_car.car))
+			return 0;
+	}
+	if (!IS_ATOM(actual) || !IS_NIL(_cdr(_cdr(_cdr(lambda)))))
+		return 0;
+
+	if (!opt_is_trivial(_car(_cdr(_cdr(lambda))), env, bound))
+		return 0;
+
+	return optimize_exp(opt_substitute(_car(_cdr(_cdr(lambda))), formals, actuals), env, bound);
+}
+
+/**
+ * Optimizes the clauses of a cond form, returning the replacement for the whole form
+ */
+struct s_exp *opt_cond(struct s_exp *exp, struct lisp_env *env, struct s_exp *bound) {
+	struct s_exp *clause;
+	struct s_exp *test;
+	struct s_exp *cur;
+	struct s_exp *prev;
+
+	// Walk the clauses along with the cell that references each one, so clauses can be spliced out
+	prev = exp;
+	for (cur = prev->lisp_cdr.cdr; !IS_ATOM(cur); cur = prev->lisp_cdr.cdr) {
+		clause = cur->lisp_car.car;
+		if (IS_ATOM(clause) || IS_ATOM(clause->lisp_cdr.cdr)) {
+			// Malformed clauses are left for eval() to complain about
+			prev = cur;
+			continue;
+		}
+
+		opt_set_car(clause, optimize_exp(clause->lisp_car.car, env, bound));
+		opt_set_car(clause->lisp_cdr.cdr, optimize_exp(clause->lisp_cdr.cdr->lisp_car.car, env, bound));
+		test = clause->lisp_car.car;
+
+		if (test == lisp_false) {
+			// This clause can never be chosen
+			opt_set_cdr(prev, cur->lisp_cdr.cdr);
+			continue;
+		}
+
+		if (test == lisp_true) {
+			// No clause after this one can be reached
+			opt_set_cdr(cur, lisp_nil);
+			break;
+		}
+
+		prev = cur;
+	}
+
+	// With every clause gone, the cond never matches
+	if (IS_ATOM(exp->lisp_cdr.cdr))
+		return lisp_undefined;
+
+	// If the first clause always matches, the cond is just its body
+	clause = exp->lisp_cdr.cdr->lisp_car.car;
+	if (!IS_ATOM(clause) && clause->lisp_car.car == lisp_true && !IS_ATOM(clause->lisp_cdr.cdr))
+		return clause->lisp_cdr.cdr->lisp_car.car;
+
+	return exp;
+}
+
+/**
+ * Optimizes an expression, with bound holding the names bound by enclosing function forms.
+ * Returns the expression to use in its place, which may be the same cell, modified in place.
+ */
+struct s_exp *optimize_exp(struct s_exp *exp, struct lisp_env *env, struct s_exp *bound) {
+	struct s_exp *head;
+	struct s_exp *value;
+	struct s_exp *cur;
+	struct s_exp *formals;
+	struct lisp_native *native;
+
+	if (IS_ATOM(exp)) {
+		// The literal names are replaced by their values, unless a function has rebound them
+		if (IS_SYMBOL(exp) && !IS_NIL(exp) && !opt_is_bound(exp, bound)) {
+			if (strcmp(exp->lisp_car.label, "#t") == 0)
+				return lisp_true;
+			if (strcmp(exp->lisp_car.label, "#f") == 0)
+				return lisp_false;
+			if (strcmp(exp->lisp_car.label, "nil") == 0)
+				return intern_constant(lisp_nil);
+		}
+		return exp;
+	}
+
+	// Code inside pooled data is data, and never changes
+	if (IS_IMMUTABLE(exp))
+		return exp;
+
+	head = exp->lisp_car.car;
+
+	if (IS_SYMBOL(head) && !opt_is_bound(head, bound)) {
+		if (c_lisp_eq(head, lisp_quote) == 1 || c_lisp_eq(head, lisp_defmacro) == 1) {
+			return exp;
+		}
+		else if (c_lisp_eq(head, lisp_cond) == 1) {
+			return opt_cond(exp, env, bound);
+		}
+		else if (c_lisp_eq(head, lisp_define) == 1 || c_lisp_eq(head, lisp_set) == 1) {
+			// Only the value is an expression, and the name is left as it is
+			cur = _cdr(exp);
+			if (!IS_ATOM(cur) && !IS_ATOM(cur->lisp_cdr.cdr))
+				opt_set_car(cur->lisp_cdr.cdr, optimize_exp(cur->lisp_cdr.cdr->lisp_car.car, env, bound));
+			return exp;
+		}
+		else if (c_lisp_eq(head, lisp_lambda) == 1) {
+			// The formals are visible throughout the body
+			formals = _car(_cdr(exp));
+			for (cur = formals; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr) {
+				if (IS_SYMBOL(cur->lisp_car.car))
+					bound = _cons(cur->lisp_car.car, bound);
+			}
+
+			cur = _cdr(_cdr(exp));
+			if (!IS_ATOM(cur))
+				opt_set_car(cur, optimize_exp(cur->lisp_car.car, env, bound));
+			return exp;
+		}
+		else if (c_lisp_eq(head, lisp_label) == 1 || c_lisp_eq(head, lisp_memo) == 1 || c_lisp_eq(head, lisp_define_memo) == 1) {
+			// (label name fn) binds name within fn
+			cur = _cdr(exp);
+			if (IS_ATOM(cur) || !IS_SYMBOL(cur->lisp_car.car) || IS_ATOM(cur->lisp_cdr.cdr))
+				return exp;
+
+			bound = _cons(cur->lisp_car.car, bound);
+			opt_set_car(cur->lisp_cdr.cdr, optimize_exp(cur->lisp_cdr.cdr->lisp_car.car, env, bound));
+			return exp;
+		}
+
+		// A macro has to see its arguments exactly as they were written
+		value = opt_lookup(head, env);
+		if (IS_MACRO(value))
+			return exp;
+	}
+	else if (!IS_ATOM(head)) {
+		opt_set_car(exp, optimize_exp(head, env, bound));
+	}
+
+	// An ordinary application, so optimize each of the arguments
+	for (cur = exp->lisp_cdr.cdr; !IS_ATOM(cur) && !IS_IMMUTABLE(cur); cur = cur->lisp_cdr.cdr) {
+		opt_set_car(cur, optimize_exp(cur->lisp_car.car, env, bound));
+	}
+
+	// Then see if the application itself can be folded or inlined
+	head = exp->lisp_car.car;
+	native = opt_pure_native(head, env, bound);
+	if (native != 0) {
+		value = opt_fold(native, exp->lisp_cdr.cdr);
+		if (value != 0)
+			return value;
+	}
+	else if (!IS_ATOM(head) && IS_SYMBOL(head->lisp_car.car) && c_lisp_eq(head->lisp_car.car, lisp_lambda) == 1
+			&& !opt_is_bound(head->lisp_car.car, bound)) {
+		value = opt_inline(head, exp->lisp_cdr.cdr, env, bound);
+		if (value != 0)
+			return value;
+	}
+
+	return exp;
+}
+
+/**
+ * Optimizes a top-level form against the environment it is about to be evaluated in. A form
+ * too malformed to optimize is left as it is, for evaluation to raise the error.
+ */
+struct s_exp *optimize(struct s_exp *exp, struct lisp_env *env) {
+	struct lisp_handler handler;
+	struct s_exp *rtn;
+
+	handler_push(&handler);
+	if (setjmp(handler.jump) != 0)
+		return exp;
+
+	rtn = optimize_exp(exp, env, lisp_nil);
+	handler_pop(&handler);
+	return rtn;
+}
@@ -1,10 +1,8 @@
 /**
  * Routines for parsing strings and files into s-expressions
  *
- * TODO: In order to properly handle strings we need to add a token for the stripped whitespace
- * TODO: Whitespace will be mostly ignored, but it'll allow us to convert whitespace between two
- * TODO: double quotes into a part of the string. Technically, it would also enable us to write
- * TODO: syntax rules involving whitespace, which someone somewhere might care about. But I hate them.
+ * String literals are read by the tokenizer as a single token, which preserves whitespace between
+ * the double quotes without needing a whitespace token. They may not span multiple lines.
  */
 
 // Standard headers
@@ -13,6 +11,7 @@
 #include <inttypes.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 
 // Project definitions
 #include "lisp.h"
@@ -21,21 +20,24 @@
 // Maximum line buffer size
 #define LINE_BUFFER_SIZE	1024
 
+// How many quote forms enclose the expression currently being parsed. Quote forms are only turned
+// into pooled constants in code, never inside data that is itself quoted.
+int quoteDepth = 0;
+
+// Whether the last source parsed had an error in it, since a source with no forms at all also
+// parses to an empty list
+int lisp_parse_failed = 0;
+
 /**
  * Parses a file into a series of top-level S-expressions, emitting each one to the given
  * callback as it is completed. This should operate one line at a time.
  */
 struct s_list *lisp_parse_file(FILE *fp) {
 	int lineNumber;
-	int result;
 	char lineBuf[LINE_BUFFER_SIZE];
 	char *res;
 	struct lp_token *startToken;
 	struct lp_token *prevToken;
-	struct lp_token *nextToken;
-	struct s_exp *exp;
-	struct s_list *firstExp;
-	struct s_list *expList;
 
 	// Check file for validity, although this really should be checked in the calling scope too
 	if (fp == NULL) {
@@ -44,12 +46,8 @@ struct s_list *lisp_parse_file(FILE *fp) {
 	}
 
 	// Allocate our first token as a start token, just to regularize later code
-	prevToken = (struct lp_token *) malloc(sizeof(struct lp_token));
-	prevToken->type = LPT_START;
-	prevToken->text = 0;
-	prevToken->lineNumber = 0;
-	prevToken->next = 0;
-	startToken = prevToken;
+	startToken = new_start_token();
+	prevToken = startToken;
 
 	// Loop over all lines and parse into tokens individually
 	lineNumber = 1;
@@ -63,17 +61,275 @@ struct s_list *lisp_parse_file(FILE *fp) {
 		res = fgets(lineBuf, LINE_BUFFER_SIZE, fp);
 		lineNumber++;
 	}
-	
+
+	return parse_tokens(startToken);
+}
+
+/**
+ * Parses a string holding any number of lines of source into a series of top-level S-expressions,
+ * exactly as lisp_parse_file() would if the string were the contents of a file
+ */
+struct s_list *lisp_parse_string(const char *source) {
+	int lineNumber;
+	char *copy;
+	char *line;
+	char *end;
+	struct lp_token *startToken;
+	struct lp_token *prevToken;
+
+	startToken = new_start_token();
+	prevToken = startToken;
+
+	// Work on a copy, so that each line can be terminated in place before it is tokenized
+	copy = strdup(source);
+	line = copy;
+	lineNumber = 1;
+	while (line != 0) {
+		end = strchr(line, '\n');
+		if (end != 0) {
+			*end = '\0';
+		}
+
+		prevToken = tokenize_line(line, lineNumber, prevToken);
+
+		line = (end != 0) ? end+1 : 0;
+		lineNumber++;
+	}
+
+	// Tokens keep their own copies of any text they need
+	free(copy);
+	return parse_tokens(startToken);
+}
+
+/**
+ * Starts reading forms from a file, which is closed along with the reader
+ */
+struct lisp_reader *lisp_reader_open(FILE *fp) {
+	struct lisp_reader *reader;
+
+	reader = (struct lisp_reader *) malloc(sizeof(struct lisp_reader));
+	reader->fp = fp;
+	reader->start = new_start_token();
+	reader->last = reader->start;
+	reader->lineNumber = 1;
+	return reader;
+}
+
+/**
+ * Closes the file and releases any tokens that were never parsed
+ */
+void lisp_reader_close(struct lisp_reader *reader) {
+	free_tokens(reader->start, 0);
+	fclose(reader->fp);
+	free(reader);
+}
+
+/**
+ * Reads the next top-level form, tokenizing only as many lines as it takes to complete it.
+ * The form is read as data, so quoted forms inside of it are left as (quote x) lists, and it
+ * is built from heap cells so that it can be collected once it is no longer needed. Returns
+ * 0 at the end of the file or on a parse error.
+ */
+struct s_exp *lisp_read_form(struct lisp_reader *reader) {
+	char lineBuf[LINE_BUFFER_SIZE];
+	struct lp_token *next;
+	struct s_exp *exp;
+	int result;
+
+	while (reader_form_ready(reader->start->next) == 0) {
+		if (fgets(lineBuf, LINE_BUFFER_SIZE, reader->fp) == NULL) {
+			if (reader->start->next != 0)
+				lisp_error("Incomplete form at the end of the file.\n");
+			return 0;
+		}
+
+		reader->last = tokenize_line(lineBuf, reader->lineNumber, reader->last);
+		reader->lineNumber++;
+	}
+
+	// Parse as though the form were already quoted, so that nothing inside of it is pooled
+	next = 0;
+	quoteDepth = 1;
+	result = parse_s_expression(reader->start->next, &exp, &next);
+	quoteDepth = 0;
+
+	if (result == SEP_ERROR)
+		next = 0;
+
+	free_tokens(reader->start->next, next);
+	reader->start->next = next;
+	if (next == 0)
+		reader->last = reader->start;
+
+	if (result == SEP_ERROR)
+		return 0;
+	return reader_to_heap(exp);
+}
+
+/**
+ * Checks whether the tokens starting at token hold at least one complete form
+ */
+int reader_form_ready(struct lp_token *token) {
+	int depth;
+
+	depth = 0;
+	for (; token != 0; token = token->next) {
+		switch (token->type) {
+			case LPT_OPEN_PAREN:
+			case LPT_OPEN_BRACKET:
+				depth++;
+				break;
+			case LPT_CLOSE_PAREN:
+			case LPT_CLOSE_BRACKET:
+				// A stray close is complete too, so that the parser gets to report it
+				if (--depth <= 0)
+					return 1;
+				break;
+			case LPT_QUOTE:
+			case LPT_START:
+			case LPT_NULL:
+				break;
+			default:
+				if (depth == 0)
+					return 1;
+				break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Moves an expression built by the parser onto the heap, freeing the parser's cells as it
+ * goes. Symbols get interned labels, and string and exact number atoms take over the parser's
+ * buffers. Lists are rebuilt from their last element back, so long lists don't recurse.
+ */
+struct s_exp *reader_to_heap(struct s_exp *exp) {
+	struct s_exp **items;
+	struct s_exp *rtn;
+	struct s_exp *cur;
+	struct s_exp *next;
+	int count;
+	int i;
+
+	if (IS_ATOM(exp)) {
+		// The built-in values, nil and the quote symbol, are shared rather than allocated
+		if (IS_NIL(exp) || exp == lisp_quote)
+			return exp;
+
+		if (IS_SYMBOL(exp)) {
+			rtn = find_free_s_exp();
+			rtn->flags = FLAG_ATOM | FLAG_SYMBOL;
+			rtn->lisp_car.label = intern_label(exp->lisp_car.label);
+			rtn->lisp_cdr.cdr = 0;
+			free(exp->lisp_car.label);
+		}
+		else if (IS_INT(exp)) {
+			rtn = make_int(exp->lisp_car.siVal);
+		}
+		else if (IS_FLOAT(exp)) {
+			rtn = make_float(exp->lisp_car.dVal);
+		}
+		else if (IS_STRING(exp)) {
+			rtn = make_string(exp->lisp_car.strVal, exp->lisp_cdr.length);
+		}
+		else if (IS_BIGNUM(exp) || IS_RATIO(exp)) {
+			rtn = find_free_s_exp();
+			*rtn = *exp;
+		}
+		else {
+			return exp;
+		}
+
+		free(exp);
+		return rtn;
+	}
+
+	count = 0;
+	for (cur = exp; !IS_ATOM(cur); cur = cur->lisp_cdr.cdr)
+		count++;
+
+	items = (struct s_exp **) malloc(count * sizeof(struct s_exp *));
+	for (i = 0, cur = exp; i < count; ++i, cur = next) {
+		next = cur->lisp_cdr.cdr;
+		items[i] = reader_to_heap(cur->lisp_car.car);
+		free(cur);
+	}
+
+	rtn = reader_to_heap(cur);
+	for (i = count-1; i >= 0; --i)
+		rtn = _cons(items[i], rtn);
+
+	free(items);
+	return rtn;
+}
+
+/**
+ * Frees a chain of tokens up to, but not including, stop. String tokens have already handed
+ * their text over to a string atom, so only the token itself is freed for those.
+ */
+void free_tokens(struct lp_token *token, struct lp_token *stop) {
+	struct lp_token *next;
+
+	for (; token != 0 && token != stop; token = next) {
+		next = token->next;
+		if (token->type != LPT_STRING)
+			free(token->text);
+		free(token);
+	}
+}
+
+/**
+ * Allocates the start token that begins every token list
+ */
+struct lp_token *new_start_token(void) {
+	struct lp_token *token;
+
+	token = (struct lp_token *) malloc(sizeof(struct lp_token));
+	token->type = LPT_START;
+	token->text = 0;
+	token->length = 0;
+	token->lineNumber = 0;
+	token->column = 0;
+	token->next = 0;
+	return token;
+}
+
+/**
+ * Parses a complete list of tokens, beginning with a start token, into the list of top-level
+ * S-expressions it contains
+ */
+struct s_list *parse_tokens(struct lp_token *startToken) {
+	int result;
+	struct lp_token *prevToken;
+	struct lp_token *nextToken;
+	struct s_exp *exp;
+	struct s_list *firstExp;
+	struct s_list *expList;
+	struct lp_token *lineToken;
+	int line;
+
+	// A previous parse may have bailed out part way through a quote form
+	quoteDepth = 0;
+	lisp_parse_failed = 0;
+
 	// Now that we have all the tokens, parse them into a series of S-expressions
 	firstExp = 0;
 	expList = 0;
-	prevToken = startToken;
+	prevToken = (startToken->next != 0) ? startToken : 0;
 	while (prevToken != 0) {
+		// The form starts at the first token past any start or null tokens
+		lineToken = prevToken;
+		while (lineToken->next != 0 && (lineToken->type == LPT_START || lineToken->type == LPT_NULL))
+			lineToken = lineToken->next;
+		line = lineToken->lineNumber;
+
 		result = parse_s_expression(prevToken, &exp, &nextToken);
 		if (result == SEP_SUCCESS) {
 			if (firstExp == 0) {
 				firstExp = (struct s_list *) malloc(sizeof(struct s_list));
 				firstExp->exp = exp;
+				firstExp->line = line;
 				firstExp->next = 0;
 				expList = firstExp;
 			}
@@ -81,11 +337,13 @@ struct s_list *lisp_parse_file(FILE *fp) {
 				expList->next = (struct s_list *) malloc(sizeof(struct s_list));
 				expList = expList->next;
 				expList->exp = exp;
+				expList->line = line;
 				expList->next = 0;
 			}
 		}
 		else {
 			lisp_error("File parsing terminated with an error -- see earlier messages for details.\n");
+			lisp_parse_failed = 1;
 			return 0;
 		}
 
@@ -116,6 +374,7 @@ void describe_token(struct lp_token *token) {
 		case LPT_DOUBLE_QUOTE: typeStr = "LPT_DOUBLE_QUOTE"; break;
 		case LPT_SYMBOL: typeStr = "LPT_SYMBOL"; break;
 		case LPT_START: typeStr = "LPT_START"; break;
+		case LPT_STRING: typeStr = "LPT_STRING"; break;
 		default: typeStr = "UNIDENTIFIED TOKEN"; break;
 	}
 
@@ -137,17 +396,25 @@ struct lp_token *tokenize_line(char *line, int lineNumber, struct lp_token *prev
 	nextToken = prevToken;
 	res = line;
 
-	// Loop over the line searching for tokens
+	// Loop over the line searching for tokens, skipping whitespace here so that the column of
+	// each token is known
+	while (isspace(*res)) {
+		res++;
+	}
 	while (find_next_token(res, &nextToken, &nextBuf) == FOUND_TOKEN) {
 //		describe_token(nextToken);
 
 		// Append the newly found token to our list of tokens
 		prevToken->next = nextToken;
 		nextToken->lineNumber = lineNumber;
+		nextToken->column = res - line + 1;
 		prevToken = nextToken;
 		
 		// Set res to the next buffer for our next loop iteration
 		res = nextBuf;
+		while (isspace(*res)) {
+			res++;
+		}
 	}
 	
 	return nextToken;
@@ -209,9 +476,13 @@ int find_next_token(char *buf, struct lp_token **token, char **nextBuf) {
 		*nextBuf = buf+1;
 	}
 	else if (buf[0] == '"') {
-		(*token)->type = LPT_DOUBLE_QUOTE;
-		(*token)->text = strndup("\"", 1);
-		*nextBuf = buf+1;
+		// Read the whole string literal as one token, or leave a lone double quote for the parser
+		// to complain about if it is never closed
+		if (read_string_token(buf+1, *token, nextBuf) == NO_TOKEN) {
+			(*token)->type = LPT_DOUBLE_QUOTE;
+			(*token)->text = strndup("\"", 1);
+			*nextBuf = buf + strlen(buf);
+		}
 	}
 	else {
 		// Doesn't match any single character rules, read out the whole symbol
@@ -232,6 +503,92 @@ int find_next_token(char *buf, struct lp_token **token, char **nextBuf) {
 	return FOUND_TOKEN;
 }
 
+/**
+ * Reads the body of a string literal, starting just after the opening double quote, and
+ * stores the unescaped contents in the token along with their length. The buffer is allocated
+ * once at its final size, so the parser can hand it straight to the string atom without
+ * copying it again. Returns NO_TOKEN if the closing quote is not found on this line.
+ */
+int read_string_token(char *buf, struct lp_token *token, char **nextBuf) {
+	char *end;
+	char *out;
+
+	// Find the closing quote first, skipping over escaped characters, so we know how much to allocate
+	end = buf;
+	while (*end != '"') {
+		if (*end == '\0' || (*end == '\\' && end[1] == '\0'))
+			return NO_TOKEN;
+		if (*end == '\\')
+			end++;
+		end++;
+	}
+
+	// The unescaped text can only be shorter than the raw text
+	token->type = LPT_STRING;
+	token->text = (char *) malloc(end - buf + 1);
+	out = token->text;
+
+	while (buf < end) {
+		if (*buf == '\\') {
+			buf++;
+			switch (*buf) {
+				case 'n': *out = '\n'; break;
+				case 't': *out = '\t'; break;
+				case 'r': *out = '\r'; break;
+				case '0': *out = '\0'; break;
+				default: *out = *buf; break;
+			}
+		}
+		else {
+			*out = *buf;
+		}
+		out++;
+		buf++;
+	}
+
+	*out = '\0';
+	token->length = out - token->text;
+	*nextBuf = end+1;
+	return FOUND_TOKEN;
+}
+
+/**
+ * Attempts to read a token's text as a number, filling in exp as an integer, bignum, ratio or
+ * float atom if the entire text is consumed. Returns 1 on success and 0 if the token is not numeric,
+ * in which case exp is left untouched.
+ */
+int parse_number(char *text, struct s_exp *exp) {
+	char *end;
+	int64_t siVal;
+	double dVal;
+
+	// Numbers must start with a digit, or a sign or decimal point followed by a digit, so that
+	// symbols like + and - are not mistaken for malformed numbers
+	if (!isdigit(text[0]) && !((text[0] == '-' || text[0] == '+' || text[0] == '.') && isdigit(text[1])))
+		return 0;
+
+	errno = 0;
+	siVal = strtoll(text, &end, 10);
+	if (*end == '\0' && errno == 0) {
+		exp->flags = FLAG_ATOM | FLAG_INT;
+		exp->lisp_car.siVal = siVal;
+		return 1;
+	}
+
+	// Integers too large for a fixnum, and fractions, are read exactly
+	if (number_parse(text, exp))
+		return 1;
+
+	dVal = strtod(text, &end);
+	if (*end == '\0') {
+		exp->flags = FLAG_ATOM | FLAG_FLOAT;
+		exp->lisp_car.dVal = dVal;
+		return 1;
+	}
+
+	return 0;
+}
+
 /**
  * Given a starting token, this extracts a complete S-expression or returns an error, and
  * it sets a pointer to the next token from the chain after the complete S-expression found here
@@ -243,6 +600,7 @@ int parse_s_expression(struct lp_token *startToken, struct s_exp **newExp, struc
 	struct lp_token *nextToken;
 	struct lp_token *nextExpToken;
 	int result;
+	int isQuote;
 
 	// If this is a null or a start, just pass through the next token
 	if (startToken->type == LPT_NULL || startToken->type == LPT_START) {
@@ -251,17 +609,36 @@ int parse_s_expression(struct lp_token *startToken, struct s_exp **newExp, struc
 
 	// If we're looking at a symbol, that is the expression, return it
 	if (startToken->type == LPT_SYMBOL) {
-		// TODO: Add the ability to parse bools, numbers, and floats directly
+		// TODO: Add the ability to parse bools directly
 		exp = (struct s_exp *) malloc(sizeof(struct s_exp));
-		exp->flags = FLAG_ATOM | FLAG_SYMBOL;
-		exp->lisp_car.label = strdup(startToken->text);
-		
+		exp->lisp_cdr.cdr = 0;
+		if (parse_number(startToken->text, exp) == 0) {
+			exp->flags = FLAG_ATOM | FLAG_SYMBOL;
+			exp->lisp_car.label = strdup(startToken->text);
+		}
+		if (quoteDepth == 0)
+			source_record(exp, startToken->lineNumber, startToken->column);
+
 		// Export the results
 		*nextStartToken = startToken->next;
 		*newExp = exp;
 		return SEP_SUCCESS;
 	}
 
+	// String literals were already unescaped by the tokenizer, so the atom can take the text as is
+	if (startToken->type == LPT_STRING) {
+		exp = (struct s_exp *) malloc(sizeof(struct s_exp));
+		exp->flags = FLAG_ATOM | FLAG_STRING;
+		exp->lisp_car.strVal = startToken->text;
+		exp->lisp_cdr.length = startToken->length;
+		if (quoteDepth == 0)
+			source_record(exp, startToken->lineNumber, startToken->column);
+
+		*nextStartToken = startToken->next;
+		*newExp = exp;
+		return SEP_SUCCESS;
+	}
+
 	// This is not a symbol, so we need to apply our rules for other token types
 	switch (startToken->type) {
 		case LPT_OPEN_PAREN:
@@ -273,6 +650,7 @@ int parse_s_expression(struct lp_token *startToken, struct s_exp **newExp, struc
 			prevExp->lisp_cdr.cdr = lisp_nil;
 			startExp = prevExp;
 			exp = prevExp;
+			isQuote = 0;
 
 			// Move along the token list and add elements to the S-expression in list form
 			nextToken = startToken->next;
@@ -288,6 +666,12 @@ int parse_s_expression(struct lp_token *startToken, struct s_exp **newExp, struc
 					return SEP_ERROR;
 				}
 
+				// A list that starts with quote holds data, so nothing inside of it is pooled on its own
+				if (prevExp == startExp && IS_SYMBOL(exp) && strcmp(exp->lisp_car.label, "quote") == 0) {
+					isQuote = 1;
+					quoteDepth++;
+				}
+
 				// Save the sub expression and create the next list element
 				prevExp->lisp_car.car = exp;
 				exp = (struct s_exp *) malloc(sizeof(struct s_exp));
@@ -313,6 +697,30 @@ int parse_s_expression(struct lp_token *startToken, struct s_exp **newExp, struc
 			prevExp->lisp_cdr.cdr = lisp_nil;
 			free(exp);
 
+			// A complete (quote x) in code is replaced by the pooled constant for x, which eval()
+			// returns directly without dispatching on quote
+			if (isQuote == 1) {
+				quoteDepth--;
+				exp = _cdr(startExp);
+				if (quoteDepth == 0 && !IS_NIL(exp) && IS_NIL(_cdr(exp))) {
+					prevExp = startExp;
+					startExp = intern_constant(_car(exp));
+					source_forget(prevExp->lisp_car.car);
+					free(prevExp->lisp_car.car->lisp_car.label);
+					free(prevExp->lisp_car.car);
+					free(prevExp);
+					free(exp);
+				}
+			}
+
+			// An empty list never had anything stored in it, and the only cell was just freed, so it is nil
+			if (exp == startExp) {
+				startExp = lisp_nil;
+			}
+			else if (quoteDepth == 0) {
+				source_record_list(startExp, startToken->lineNumber, startToken->column);
+			}
+
 			// With this subexpression complete, advance token chain and return a pointer to the exp
 			*nextStartToken = nextToken->next;
 			*newExp = startExp;
@@ -324,12 +732,40 @@ int parse_s_expression(struct lp_token *startToken, struct s_exp **newExp, struc
 			lisp_error("Unexpected ) or ] on line %d.\n", startToken->lineNumber);
 			return SEP_ERROR;
 		case LPT_QUOTE:
-			// TODO: Determine how to properly insert quotes into the S-expression tree as sugar
-			lisp_error("Unexpected ' on line %d. Quotes are not yet supported!\n", startToken->lineNumber);
-			return SEP_ERROR;
+			if (startToken->next == 0) {
+				lisp_error("Nothing to quote after ' on line %d.\n", startToken->lineNumber);
+				return SEP_ERROR;
+			}
+
+			// Read the quoted datum, which is data rather than code
+			quoteDepth++;
+			result = parse_s_expression(startToken->next, &exp, &nextExpToken);
+			quoteDepth--;
+			if (result == SEP_ERROR) {
+				return SEP_ERROR;
+			}
+
+			// In code, 'x is pooled right away. Inside other quoted data it has to stay an ordinary
+			// (quote x) list, because that is what the data actually contains
+			if (quoteDepth == 0) {
+				startExp = intern_constant(exp);
+			}
+			else {
+				startExp = (struct s_exp *) malloc(sizeof(struct s_exp));
+				startExp->flags = 0;
+				startExp->lisp_car.car = lisp_quote;
+				startExp->lisp_cdr.cdr = (struct s_exp *) malloc(sizeof(struct s_exp));
+				startExp->lisp_cdr.cdr->flags = 0;
+				startExp->lisp_cdr.cdr->lisp_car.car = exp;
+				startExp->lisp_cdr.cdr->lisp_cdr.cdr = lisp_nil;
+			}
+
+			*nextStartToken = nextExpToken;
+			*newExp = startExp;
+			return SEP_SUCCESS;
 		case LPT_DOUBLE_QUOTE:
-			// TODO: Look for a matching double quote and take everything in between as a string
-			lisp_error("Unexpected \" on line %d. Double quotes are not yet supported!\n", startToken->lineNumber);
+			// Complete strings arrive as LPT_STRING, so a lone double quote was never closed
+			lisp_error("Unterminated string on line %d. Strings must be closed on the line they start on.\n", startToken->lineNumber);
 			return SEP_ERROR;
 		default:
 			// This should never happen as we've handled the other three token types previously!
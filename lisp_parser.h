@@ -34,10 +34,12 @@
 #define LPT_DOUBLE_QUOTE		6
 #define LPT_SYMBOL				7
 #define LPT_START				8
+#define LPT_STRING				9
 
-// Linked list for storing all of the top-level s-expressions
+// Linked list for storing all of the top-level s-expressions, with the line each one starts on
 struct s_list {
 	struct s_exp *exp;
+	int line;
 	struct s_list *next;
 };
 
@@ -45,17 +47,43 @@ struct s_list {
 struct lp_token {
 	uint32_t type;
 	char *text;
+	uint32_t length;
 	uint32_t lineNumber;
+	uint32_t column;
 	struct lp_token *next;
 };
 
+// Reads the top-level forms of a file one at a time, keeping only the tokens of unread forms
+struct lisp_reader {
+	FILE *fp;
+	struct lp_token *start;
+	struct lp_token *last;
+	int lineNumber;
+};
+
+// Set when the last source parsed had an error in it
+extern int lisp_parse_failed;
+
 // Parsing interface--parses lines and files
 struct s_list *lisp_parse_file(FILE *fp);
+struct s_list *lisp_parse_string(const char *source);
+
+// Reading data one form at a time
+struct lisp_reader *lisp_reader_open(FILE *fp);
+struct s_exp *lisp_read_form(struct lisp_reader *reader);
+void lisp_reader_close(struct lisp_reader *reader);
 
 // Helper functions, used internally
+struct lp_token *new_start_token(void);
+struct s_list *parse_tokens(struct lp_token *startToken);
 struct lp_token *tokenize_line(char *line, int lineNumber, struct lp_token *prevToken);
 int find_next_token(char *buf, struct lp_token **token, char **nextBuf);
+int read_string_token(char *buf, struct lp_token *token, char **nextBuf);
 int parse_s_expression(struct lp_token *startToken, struct s_exp **newExp, struct lp_token **nextStartToken);
+int parse_number(char *text, struct s_exp *exp);
+int reader_form_ready(struct lp_token *token);
+struct s_exp *reader_to_heap(struct s_exp *exp);
+void free_tokens(struct lp_token *token, struct lp_token *stop);
 
 // Debugging functions
 void describe_token(struct lp_token *token);
@@ -28,12 +28,27 @@ int c_lisp_eq(struct s_exp *a, struct s_exp *b) {
 	if (IS_UNDEFINED(a) || IS_UNDEFINED(b))
 		return 0;
 
+	// Strings compare by content, and a rope may equal a flat string, so check before the flags
+	if (IS_STRING(a) && IS_STRING(b))
+		return string_equal(a, b);
+
 	// If they have different flags, they can't be equal
 	if (a->flags != b->flags)
 		return 0;
 
-	// If we're dealing with a string or symbol, use strcmp
-	if (IS_STRING(a) || IS_SYMBOL(a)) {
+	// Boxes and arrays are only ever equal to themselves, whatever they hold
+	if (IS_BOX(a) || IS_ARRAY(a))
+		return (a == b) ? 1 : 0;
+
+	// Exact numbers too large for a fixnum compare by value
+	if (IS_BIGNUM(a))
+		return (bignum_compare(a->lisp_car.bignum, b->lisp_car.bignum) == 0) ? 1 : 0;
+	if (IS_RATIO(a))
+		return (bignum_compare(a->lisp_car.ratio->num, b->lisp_car.ratio->num) == 0 &&
+				bignum_compare(a->lisp_car.ratio->den, b->lisp_car.ratio->den) == 0) ? 1 : 0;
+
+	// If we're dealing with a symbol, use strcmp
+	if (IS_SYMBOL(a)) {
 		if (strcmp(a->lisp_car.label, b->lisp_car.label) == 0) {
 			return 1;
 		}
@@ -47,21 +62,98 @@ int c_lisp_eq(struct s_exp *a, struct s_exp *b) {
 }
 
 /**
- * S-expression wrapper for the C-environment version gives us our lisp version
+ * Structural equality, which recursively compares lists element by element and falls back
+ * to c_lisp_eq() for atoms.
  */
-struct s_exp *_eq(struct s_exp *a, struct s_exp *b) {
-	// If either pointer is invalid, this is a problem
-	if (a == 0 || b == 0) {
-		lisp_error("Error: Not enough arguments supplied to eq?\n");
-		return lisp_undefined;
+int c_lisp_equal(struct s_exp *a, struct s_exp *b) {
+	while (!IS_ATOM(a) && !IS_ATOM(b)) {
+		if (a == b)
+			return 1;
+
+		// Equal shared pairs are always the same pair
+		if (IS_HASHCONS(a) && IS_HASHCONS(b))
+			return 0;
+
+		if (c_lisp_equal(a->lisp_car.car, b->lisp_car.car) == 0)
+			return 0;
+
+		// Iterate on the cdr rather than recursing, so that long lists don't eat the stack
+		a = a->lisp_cdr.cdr;
+		b = b->lisp_cdr.cdr;
 	}
 
+	return c_lisp_eq(a, b);
+}
+
+/**
+ * Computes a structural hash of an S-expression, such that any two expressions that are
+ * c_lisp_equal() will hash to the same value. This is FNV-1a over the atoms in list order,
+ * with the list structure mixed in so that (a (b)) and ((a b)) do not collide trivially.
+ */
+uint64_t c_lisp_hash(struct s_exp *s) {
+	uint64_t hash = 14695981039346656037ULL;
+	uint64_t i;
+	char *c;
+
+	while (!IS_ATOM(s)) {
+		hash = (hash ^ c_lisp_hash(s->lisp_car.car)) * 1099511628211ULL;
+		s = s->lisp_cdr.cdr;
+	}
+
+	if (IS_STRING(s)) {
+		// Ropes and flat strings with the same contents must hash the same, so leave out the flags
+		hash = (hash ^ FLAG_STRING) * 1099511628211ULL;
+		c = string_flatten(s);
+		for (i = 0; i < s->lisp_cdr.length; ++i) {
+			hash = (hash ^ (uint8_t) c[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	hash = (hash ^ s->flags) * 1099511628211ULL;
+	if (IS_BOX(s) || IS_ARRAY(s)) {
+		// A box's value changes, and so does its address when it is moved, so use neither
+		return hash;
+	}
+	else if (IS_BIGNUM(s)) {
+		hash = (hash ^ bignum_hash(s->lisp_car.bignum)) * 1099511628211ULL;
+	}
+	else if (IS_RATIO(s)) {
+		hash = (hash ^ bignum_hash(s->lisp_car.ratio->num)) * 1099511628211ULL;
+		hash = (hash ^ bignum_hash(s->lisp_car.ratio->den)) * 1099511628211ULL;
+	}
+	else if (IS_SYMBOL(s)) {
+		for (c = s->lisp_car.label; *c != 0; ++c) {
+			hash = (hash ^ (uint8_t) *c) * 1099511628211ULL;
+		}
+	}
+	else {
+		hash = (hash ^ s->lisp_car.uiVal) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * S-expression wrapper for the C-environment version gives us our lisp version
+ */
+struct s_exp *_eq(struct s_exp *a, struct s_exp *b) {
 	if (c_lisp_eq(a, b) == 1)
 		return lisp_true;
 
 	return lisp_false;
 }
 
+/**
+ * Structural equality, exposed to lisp as equal?
+ */
+struct s_exp *_equal(struct s_exp *a, struct s_exp *b) {
+	if (c_lisp_equal(a, b) == 1)
+		return lisp_true;
+
+	return lisp_false;
+}
+
 /**
  * S-expression wrapper for our IS_ATOM() macro
  */
@@ -77,11 +169,12 @@ struct s_exp *_atom(struct s_exp *s) {
  */
 struct s_exp *_cons(struct s_exp *a, struct s_exp *b) {
 	struct s_exp *rtn;
-	
-	// Validate pointers before going any farther
-	if (a == 0 || b == 0) {
-		lisp_error("Error: Invalid arguments supplied to cons\n");
-		return lisp_undefined;
+
+	// In hash-consing mode, an identical pair may already exist
+	if (hashcons_enabled) {
+		rtn = hashcons(a, b);
+		if (rtn != 0)
+			return rtn;
 	}
 
 	rtn = find_free_s_exp();
@@ -98,10 +191,8 @@ struct s_exp *_cons(struct s_exp *a, struct s_exp *b) {
  * Access the car pointer, throws an error if this is not a pair
  */
 struct s_exp *_car(struct s_exp *s) {
-	if (s == 0 || IS_ATOM(s)) {
-		lisp_error("Error: Invalid argument (non-pair) to car\n");
-		return lisp_undefined;
-	}
+	if (IS_ATOM(s))
+		lisp_throw(ERROR_TYPE, s, "car expects a pair");
 
 	return s->lisp_car.car;
 }
@@ -110,10 +201,8 @@ struct s_exp *_car(struct s_exp *s) {
  * Same thing, but for the cdr pointer
  */
 struct s_exp *_cdr(struct s_exp *s) {
-	if (s == 0 || IS_ATOM(s)) {
-		lisp_error("Error: Invalid argument (non-pair) to cdr\n");
-		return lisp_undefined;
-	}
+	if (IS_ATOM(s))
+		lisp_throw(ERROR_TYPE, s, "cdr expects a pair");
 
 	return s->lisp_cdr.cdr;
 }
@@ -8,11 +8,14 @@
 // Lisp-space functions, operate on S-expressions
 struct s_exp *_atom(struct s_exp *s);
 struct s_exp *_eq(struct s_exp *a, struct s_exp *b);
+struct s_exp *_equal(struct s_exp *a, struct s_exp *b);
 struct s_exp *_car(struct s_exp *s);
 struct s_exp *_cdr(struct s_exp *s);
 struct s_exp *_cons(struct s_exp *a, struct s_exp *b);
 
 // C-space functions where appropriate, which are more useful inside the evaluator
 int c_lisp_eq(struct s_exp *a, struct s_exp *b);
+int c_lisp_equal(struct s_exp *a, struct s_exp *b);
+uint64_t c_lisp_hash(struct s_exp *s);
 
 #endif
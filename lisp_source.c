@@ -0,0 +1,174 @@
+/**
+ * The side table of source locations. Slots are probed linearly from the hash of the cell's
+ * address, and file names are kept once each in a table of their own, so a slot is only a
+ * pointer and two small numbers.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_source.h"
+
+// The code that is running, for locating errors
+struct s_exp *lisp_source_site = 0;
+
+// The table of locations, which has source_size slots, a power of two
+struct source_entry *source_slots = 0;
+size_t source_size = 0;
+size_t source_count = 0;
+
+// Names of the files that code was parsed from, where index 0 stands for no file
+char **source_files = 0;
+int source_file_count = 0;
+
+// The file that code being parsed now comes from
+int source_file_current = 0;
+
+/**
+ * Sets the file that code parsed from now on comes from, or no file if name is 0. A file that
+ * was parsed before keeps the same name.
+ */
+void source_set_file(const char *name) {
+	int i;
+
+	if (name == 0) {
+		source_file_current = 0;
+		return;
+	}
+
+	for (i = 1; i < source_file_count; ++i) {
+		if (strcmp(source_files[i], name) == 0) {
+			source_file_current = i;
+			return;
+		}
+	}
+
+	// Indices have to fit in a slot, and past that new files share the last name given
+	if (source_file_count == UINT16_MAX) {
+		source_file_current = source_file_count - 1;
+		return;
+	}
+
+	if (source_file_count == 0)
+		source_file_count = 1;
+	source_files = (char **) realloc(source_files, (source_file_count + 1) * sizeof(char *));
+	source_files[source_file_count] = strdup(name);
+	source_file_current = source_file_count;
+	source_file_count += 1;
+}
+
+/**
+ * Records that cell was parsed from the given line and column of the current file
+ */
+void source_record(struct s_exp *cell, int line, int column) {
+	struct source_entry *slot;
+
+	if (line <= 0)
+		return;
+
+	// Keep the table at most half full, so that probe sequences stay short
+	if (2*(source_count + 1) > source_size)
+		source_grow();
+
+	slot = source_slot(cell);
+	if (slot->cell == 0)
+		source_count += 1;
+
+	slot->cell = cell;
+	slot->line = line;
+	slot->column = column > SOURCE_MAX_COLUMN ? SOURCE_MAX_COLUMN : column;
+	slot->file = source_file_current;
+}
+
+/**
+ * Records every cell along the spine of list at the same location
+ */
+void source_record_list(struct s_exp *list, int line, int column) {
+	for (; !IS_ATOM(list); list = list->lisp_cdr.cdr)
+		source_record(list, line, column);
+}
+
+/**
+ * Drops the location of a cell that is about to be freed, so that another cell allocated at
+ * the same address doesn't inherit it
+ */
+void source_forget(struct s_exp *cell) {
+	struct source_entry *slot;
+
+	if (source_size == 0)
+		return;
+
+	slot = source_slot(cell);
+	if (slot->cell == cell)
+		slot->line = 0;
+}
+
+/**
+ * Looks up where cell was parsed from. Returns 1 and fills in loc if it has a location, or
+ * returns 0 if it doesn't.
+ */
+int source_lookup(struct s_exp *cell, struct lisp_location *loc) {
+	struct source_entry *slot;
+
+	if (source_size == 0 || cell == 0)
+		return 0;
+
+	slot = source_slot(cell);
+	if (slot->cell != cell || slot->line == 0)
+		return 0;
+
+	loc->file = slot->file == 0 ? 0 : source_files[slot->file];
+	loc->line = slot->line;
+	loc->column = slot->column;
+	return 1;
+}
+
+/**
+ * Finds the location of the code that is running. Without one for the site, this falls back
+ * on the line of the top-level form being evaluated, which is zero if there is none.
+ */
+void source_locate(struct lisp_location *loc) {
+	if (source_lookup(lisp_source_site, loc))
+		return;
+
+	loc->file = 0;
+	loc->line = lisp_source_line;
+	loc->column = 0;
+}
+
+/**
+ * Finds the slot that holds cell, or the empty slot where it belongs if it isn't there
+ */
+struct source_entry *source_slot(struct s_exp *cell) {
+	size_t i;
+
+	i = (((uint64_t) (uintptr_t) cell) * 0x9e3779b97f4a7c15ULL >> 16) & (source_size - 1);
+	while (source_slots[i].cell != 0 && source_slots[i].cell != cell)
+		i = (i + 1) & (source_size - 1);
+	return &source_slots[i];
+}
+
+/**
+ * Doubles the number of slots in the table, moving every location over
+ */
+void source_grow(void) {
+	struct source_entry *slots;
+	size_t size;
+	size_t i;
+
+	slots = source_slots;
+	size = source_size;
+
+	source_size = size == 0 ? SOURCE_INITIAL_SLOTS : 2*size;
+	source_slots = (struct source_entry *) calloc(source_size, sizeof(struct source_entry));
+	for (i = 0; i < size; ++i) {
+		if (slots[i].cell != 0)
+			*source_slot(slots[i].cell) = slots[i];
+	}
+
+	free(slots);
+}
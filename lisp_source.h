@@ -0,0 +1,71 @@
+#ifndef _LISP_SOURCE_H_
+#define _LISP_SOURCE_H_
+/**
+ * Where parsed code came from. The parser records the file, line, and column of every cell it
+ * builds for code in a side table keyed by the address of the cell, so struct s_exp stays the
+ * size it is, and nothing on the evaluation paths looks at the table. It is only consulted when
+ * something asks, such as an error being raised, or a tool that reports on running code.
+ *
+ * An atom is recorded at the token it was read from, and every cell along the spine of a list
+ * is recorded at the list's open paren, so that the rest of an application's arguments leads
+ * back to the whole form as well. Quoted data and forms read by the reader are values rather
+ * than code, and have no locations. Parsed code is never moved or freed by the collector, so
+ * its addresses stay valid for as long as the program runs.
+ *
+ * Errors are located at the site of the code that raised them. call_native() sets the site to
+ * the arguments of each primitive just before calling it, and the evaluator sets it to the
+ * offending form before raising errors of its own.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stddef.h>
+
+// Project headers
+#include "lisp.h"
+
+// Initial number of slots in the table, which doubles whenever it gets half full
+#define SOURCE_INITIAL_SLOTS	1024
+
+// Columns past this are recorded as this
+#define SOURCE_MAX_COLUMN		UINT16_MAX
+
+/**
+ * A location in source code. file is 0 if the code was not parsed from a file, and line and
+ * column count from 1, or are 0 when they are not known.
+ */
+struct lisp_location {
+	const char *file;
+	int line;
+	int column;
+};
+
+/**
+ * One slot of the table. file is an index into the table of file names, where 0 means none,
+ * and a slot with line 0 holds no location.
+ */
+struct source_entry {
+	struct s_exp *cell;
+	uint32_t line;
+	uint16_t column;
+	uint16_t file;
+};
+
+// The code that is running, which errors are located at
+extern struct s_exp *lisp_source_site;
+
+// Recording locations, done by the parser
+void source_set_file(const char *name);
+void source_record(struct s_exp *cell, int line, int column);
+void source_record_list(struct s_exp *list, int line, int column);
+void source_forget(struct s_exp *cell);
+
+// Queries
+int source_lookup(struct s_exp *cell, struct lisp_location *loc);
+void source_locate(struct lisp_location *loc);
+
+// Table maintenance, used internally
+struct source_entry *source_slot(struct s_exp *cell);
+void source_grow(void);
+
+#endif
@@ -0,0 +1,428 @@
+/**
+ * Promises and the stream library. A promise is an atom pointing at a lisp_promise, which is
+ * freed by the garbage collector along with the atom. Streams are built from ordinary pairs,
+ * with a promise in the cdr, so car and the list primitives work on a forced stream as usual.
+ *
+ * The stream primitives build their results lazily out of native promises, which hold the
+ * function and the rest of the source stream in their args, and produce one more element when
+ * they are forced. Only stream->list and stream-fold walk a whole stream, and stream-fold lets
+ * the collector run between elements, so folding over a stream that is read from a file or
+ * computed on the fly takes memory for one element at a time rather than for the whole stream.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_api.h"
+#include "lisp_parser.h"
+#include "lisp_stream.h"
+
+/**
+ * Creates a promise to evaluate exp in env. Local frames are gone by the time the promise is
+ * forced, so the bindings visible in them are copied now.
+ */
+struct s_exp *make_promise(struct s_exp *exp, struct lisp_env *env) {
+	struct lisp_promise *promise;
+	struct s_exp *rtn;
+
+	promise = (struct lisp_promise *) calloc(1, sizeof(struct lisp_promise));
+	promise->exp = exp;
+	promise->env = promise_snapshot(env);
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_PROMISE;
+	rtn->lisp_car.promise = promise;
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Creates a promise whose value is computed by a native producer from a and b, which it finds
+ * in args. env is the global environment, which functions are applied in.
+ */
+struct s_exp *make_producer(lisp_producer producer, struct lisp_env *env, struct s_exp *a, struct s_exp *b) {
+	struct lisp_promise *promise;
+	struct s_exp *rtn;
+
+	promise = (struct lisp_promise *) calloc(1, sizeof(struct lisp_promise));
+	promise->producer = producer;
+	promise->env = env;
+	promise->args[0] = a;
+	promise->args[1] = b;
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_PROMISE;
+	rtn->lisp_car.promise = promise;
+	rtn->lisp_cdr.cdr = 0;
+	return rtn;
+}
+
+/**
+ * Copies the bindings visible in the local frames of env into a single new frame on top of the
+ * global environment. Shadowed bindings are left out, which keeps a snapshot taken while
+ * forcing another promise from growing with every level. Labels are interned, because the
+ * frames they came from free theirs, and that also lets shadowing be found by pointer. A
+ * global environment is used as it is.
+ */
+struct lisp_env *promise_snapshot(struct lisp_env *env) {
+	struct lisp_env *snapshot;
+	struct lisp_mapping *mapping;
+	struct lisp_mapping **tail;
+	struct lisp_mapping *map;
+	char *label;
+
+	if (env->parent == 0)
+		return env;
+
+	snapshot = (struct lisp_env *) calloc(1, sizeof(struct lisp_env));
+	tail = &snapshot->mapping;
+	for (; env->parent != 0; env = env->parent) {
+		for (map = env->mapping; map != 0; map = map->next) {
+			label = intern_label(map->label);
+			for (mapping = snapshot->mapping; mapping != 0 && mapping->label != label; mapping = mapping->next)
+				;
+			if (mapping != 0)
+				continue;
+
+			mapping = (struct lisp_mapping *) malloc(sizeof(struct lisp_mapping));
+			mapping->label = label;
+			mapping->exp = map->exp;
+			mapping->next = 0;
+			*tail = mapping;
+			tail = &mapping->next;
+		}
+	}
+
+	snapshot->parent = env;
+	return snapshot;
+}
+
+/**
+ * Forces a promise, evaluating it the first time and returning the remembered value after
+ * that. Anything that is not a promise is its own value.
+ */
+struct s_exp *force(struct s_exp *s) {
+	struct lisp_promise *promise;
+	struct s_exp *value;
+
+	if (!IS_ATOM(s) || !IS_PROMISE(s))
+		return s;
+
+	promise = s->lisp_car.promise;
+	if (promise->value != 0)
+		return promise->value;
+
+	promise->forcing += 1;
+	if (promise->producer != 0)
+		value = promise->producer(promise);
+	else
+		value = eval(promise->exp, promise->env);
+	promise->forcing -= 1;
+
+	// A promise that forced itself along the way keeps the value of the first force to finish
+	if (promise->value == 0)
+		promise->value = value;
+	if (promise->forcing == 0)
+		promise_clear(promise);
+
+	return promise->value;
+}
+
+/**
+ * Lets go of everything a promise needed to produce its value, releasing its C data if it
+ * still has any, and freeing its snapshot of local bindings
+ */
+void promise_clear(struct lisp_promise *promise) {
+	struct lisp_mapping *mapping;
+	struct lisp_mapping *next;
+	int i;
+
+	// Snapshot labels are interned, so only the mappings are freed
+	if (promise->producer == 0 && promise->env != 0 && promise->env->parent != 0) {
+		for (mapping = promise->env->mapping; mapping != 0; mapping = next) {
+			next = mapping->next;
+			free(mapping);
+		}
+		free(promise->env);
+	}
+
+	if (promise->release != 0 && promise->data != 0)
+		promise->release(promise->data);
+
+	promise->exp = 0;
+	promise->env = 0;
+	promise->producer = 0;
+	promise->data = 0;
+	promise->release = 0;
+	for (i = 0; i < PROMISE_ARGS; ++i)
+		promise->args[i] = 0;
+}
+
+/**
+ * Frees a promise, called by the garbage collector when its atom dies
+ */
+void promise_free(struct lisp_promise *promise) {
+	promise_clear(promise);
+	free(promise);
+}
+
+/**
+ * Checks that s is a stream, which is nil or a pair, raising an error for name if not
+ */
+void stream_check(struct s_exp *s, const char *name) {
+	if (!IS_NIL(s) && IS_ATOM(s))
+		lisp_throw(ERROR_TYPE, s, "%s expects a stream", name);
+}
+
+/**
+ * Builds the first element of (stream-map f s), where s is already forced
+ */
+struct s_exp *stream_map(struct lisp_env *env, struct s_exp *f, struct s_exp *s) {
+	struct s_exp *argv[1];
+	struct s_exp *value;
+
+	stream_check(s, "stream-map");
+	if (IS_NIL(s))
+		return lisp_nil;
+
+	argv[0] = s->lisp_car.car;
+	value = call_value(f, argv, 1, env);
+	return _cons(value, make_producer(stream_map_next, env, f, s->lisp_cdr.cdr));
+}
+
+/**
+ * Produces the rest of a mapped stream
+ */
+struct s_exp *stream_map_next(struct lisp_promise *promise) {
+	return stream_map(promise->env, promise->args[0], force(promise->args[1]));
+}
+
+/**
+ * Builds the first element of (stream-filter pred s), where s is already forced, by skipping
+ * ahead to the first element that satisfies pred
+ */
+struct s_exp *stream_filter(struct lisp_env *env, struct s_exp *pred, struct s_exp *s) {
+	struct s_exp *argv[1];
+
+	while (!IS_NIL(s)) {
+		stream_check(s, "stream-filter");
+
+		argv[0] = s->lisp_car.car;
+		if (call_value(pred, argv, 1, env) == lisp_true)
+			return _cons(argv[0], make_producer(stream_filter_next, env, pred, s->lisp_cdr.cdr));
+
+		s = force(s->lisp_cdr.cdr);
+	}
+
+	return lisp_nil;
+}
+
+/**
+ * Produces the rest of a filtered stream
+ */
+struct s_exp *stream_filter_next(struct lisp_promise *promise) {
+	return stream_filter(promise->env, promise->args[0], force(promise->args[1]));
+}
+
+/**
+ * Builds the first element of (stream-take n s), where s is already forced. The source is
+ * never forced past its nth element.
+ */
+struct s_exp *stream_take(struct lisp_env *env, int64_t n, struct s_exp *s) {
+	stream_check(s, "stream-take");
+	if (n <= 0 || IS_NIL(s))
+		return lisp_nil;
+
+	return _cons(s->lisp_car.car, make_producer(stream_take_next, env, make_int(n - 1), s->lisp_cdr.cdr));
+}
+
+/**
+ * Produces the rest of a taken stream, which is empty once the count runs out
+ */
+struct s_exp *stream_take_next(struct lisp_promise *promise) {
+	if (promise->args[0]->lisp_car.siVal <= 0)
+		return lisp_nil;
+	return stream_take(promise->env, promise->args[0]->lisp_car.siVal, force(promise->args[1]));
+}
+
+/**
+ * Reads the next form from a file stream's reader, which is handed on to the promise of the
+ * rest of the stream. At the end of the file the reader stays with this promise, and is closed
+ * when the promise is cleared.
+ */
+struct s_exp *file_stream_next(struct lisp_promise *promise) {
+	struct lisp_promise *next;
+	struct s_exp *form;
+	struct s_exp *rest;
+
+	form = lisp_read_form((struct lisp_reader *) promise->data);
+	if (form == 0)
+		return lisp_nil;
+
+	rest = make_producer(file_stream_next, promise->env, 0, 0);
+	next = rest->lisp_car.promise;
+	next->data = promise->data;
+	next->release = file_stream_release;
+	promise->data = 0;
+
+	return _cons(form, rest);
+}
+
+/**
+ * Closes the reader of a file stream
+ */
+void file_stream_release(void *data) {
+	lisp_reader_close((struct lisp_reader *) data);
+}
+
+/**
+ * (force p) returns the value of the promise p
+ */
+struct s_exp *_force(struct s_exp **argv, int argc, void *data) {
+	return force(argv[0]);
+}
+
+/**
+ * (stream-car s) returns the first element of the stream s
+ */
+struct s_exp *_stream_car(struct s_exp **argv, int argc, void *data) {
+	struct s_exp *s;
+
+	s = force(argv[0]);
+	if (IS_ATOM(s))
+		lisp_throw(ERROR_TYPE, s, "stream-car expects a non-empty stream");
+
+	return s->lisp_car.car;
+}
+
+/**
+ * (stream-cdr s) forces and returns the rest of the stream s
+ */
+struct s_exp *_stream_cdr(struct s_exp **argv, int argc, void *data) {
+	struct s_exp *s;
+
+	s = force(argv[0]);
+	if (IS_ATOM(s))
+		lisp_throw(ERROR_TYPE, s, "stream-cdr expects a non-empty stream");
+
+	return force(s->lisp_cdr.cdr);
+}
+
+/**
+ * (stream-map f s) returns the stream of f applied to each element of s
+ */
+struct s_exp *_stream_map(struct s_exp **argv, int argc, void *data) {
+	return stream_map((struct lisp_env *) data, argv[0], force(argv[1]));
+}
+
+/**
+ * (stream-filter pred s) returns the stream of the elements of s that satisfy pred
+ */
+struct s_exp *_stream_filter(struct s_exp **argv, int argc, void *data) {
+	return stream_filter((struct lisp_env *) data, argv[0], force(argv[1]));
+}
+
+/**
+ * (stream-take n s) returns the stream of the first n elements of s
+ */
+struct s_exp *_stream_take(struct s_exp **argv, int argc, void *data) {
+	if (!IS_INT(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "stream-take expects an integer count");
+
+	return stream_take((struct lisp_env *) data, argv[0]->lisp_car.siVal, force(argv[1]));
+}
+
+/**
+ * (stream-fold f acc s) calls (f acc x) for each element x of s in turn, with each result
+ * becoming the next acc, and returns the last one. Elements that have been folded in are no
+ * longer referenced from here, so the collector may reclaim them as the fold goes on.
+ */
+struct s_exp *_stream_fold(struct s_exp **argv, int argc, void *data) {
+	struct s_exp *roots[3];
+	struct s_exp *args[2];
+
+	roots[0] = argv[0];
+	roots[1] = argv[1];
+	roots[2] = force(argv[2]);
+
+	while (!IS_NIL(roots[2])) {
+		stream_check(roots[2], "stream-fold");
+
+		args[0] = roots[1];
+		args[1] = roots[2]->lisp_car.car;
+		roots[1] = call_value(roots[0], args, 2, (struct lisp_env *) data);
+		roots[2] = force(roots[2]->lisp_cdr.cdr);
+
+		// Only the function, the result so far and the rest of the stream are still needed
+		gc_safe_point(roots, 3);
+	}
+
+	return roots[1];
+}
+
+/**
+ * (stream->list s) forces every element of the finite stream s and returns them as a list.
+ * The elements are gathered in reverse on the heap rather than in a buffer, which would leak if
+ * forcing raised an error.
+ */
+struct s_exp *_stream_to_list(struct s_exp **argv, int argc, void *data) {
+	struct s_exp *reversed;
+	struct s_exp *rtn;
+	struct s_exp *s;
+
+	reversed = lisp_nil;
+	for (s = force(argv[0]); !IS_NIL(s); s = force(s->lisp_cdr.cdr)) {
+		stream_check(s, "stream->list");
+		reversed = _cons(s->lisp_car.car, reversed);
+	}
+
+	rtn = lisp_nil;
+	for (; !IS_NIL(reversed); reversed = reversed->lisp_cdr.cdr)
+		rtn = _cons(reversed->lisp_car.car, rtn);
+
+	return rtn;
+}
+
+/**
+ * (file-stream path) returns the stream of the top-level forms in the file at path, read as
+ * data. Forms are read as the stream is forced, and the file is closed at its end, or when
+ * the stream is collected before reaching it.
+ */
+struct s_exp *_file_stream(struct s_exp **argv, int argc, void *data) {
+	struct lisp_promise *promise;
+	struct s_exp *first;
+	FILE *fp;
+
+	if (!IS_STRING(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "file-stream expects a string path");
+
+	fp = fopen(string_flatten(argv[0]), "r");
+	if (fp == NULL)
+		lisp_throw(ERROR_IO, argv[0], "file-stream unable to open %s", string_flatten(argv[0]));
+
+	first = make_producer(file_stream_next, (struct lisp_env *) data, 0, 0);
+	promise = first->lisp_car.promise;
+	promise->data = lisp_reader_open(fp);
+	promise->release = file_stream_release;
+	return force(first);
+}
+
+/**
+ * Defines the stream primitives in env, which they use to apply their function arguments
+ */
+void stream_init(struct lisp_env *env) {
+	define_label("force", make_native("force", 1, _force, env), env);
+	define_label("stream-car", make_native("stream-car", 1, _stream_car, env), env);
+	define_label("stream-cdr", make_native("stream-cdr", 1, _stream_cdr, env), env);
+	define_label("stream-map", make_native("stream-map", 2, _stream_map, env), env);
+	define_label("stream-filter", make_native("stream-filter", 2, _stream_filter, env), env);
+	define_label("stream-take", make_native("stream-take", 2, _stream_take, env), env);
+	define_label("stream-fold", make_native("stream-fold", 3, _stream_fold, env), env);
+	define_label("stream->list", make_native("stream->list", 1, _stream_to_list, env), env);
+	define_label("file-stream", make_native("file-stream", 1, _file_stream, env), env);
+}
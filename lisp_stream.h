@@ -0,0 +1,83 @@
+#ifndef _LISP_STREAM_H_
+#define _LISP_STREAM_H_
+/**
+ * Promises and lazy streams. (delay x) makes a promise to evaluate x, and force runs it the
+ * first time and remembers the value. A stream is either nil or a pair whose cdr is a promise
+ * of the rest of the stream, as built by (stream-cons a b).
+ *
+ * Evaluation in this lisp is dynamically scoped, and the frame a promise was made in is gone
+ * by the time it is forced, so delay copies the local bindings it can see into a private
+ * environment on top of the global one. The stream primitives apply their function arguments
+ * in the global environment.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stdio.h>
+
+// Project headers
+#include "lisp.h"
+
+// Number of values a native promise can hold on to
+#define PROMISE_ARGS		3
+
+struct lisp_promise;
+
+/**
+ * Computes the value of a native promise, from the values it holds in args
+ */
+typedef struct s_exp *(*lisp_producer)(struct lisp_promise *promise);
+
+/**
+ * The state of a promise, pointed to by a FLAG_PROMISE atom. Before it is forced, a promise
+ * made by delay holds an expression and the environment to evaluate it in, and one made by a
+ * stream primitive holds a producer and its arguments. Either may also own some C data, which
+ * release frees if the promise dies before it is forced. Once forced, only value is kept.
+ * forcing counts the forces of this promise in progress, so that a promise that forces itself
+ * keeps its state until the outermost force is done with it.
+ */
+struct lisp_promise {
+	struct s_exp *value;
+	struct s_exp *exp;
+	struct lisp_env *env;
+	lisp_producer producer;
+	struct s_exp *args[PROMISE_ARGS];
+	void *data;
+	void (*release)(void *data);
+	int forcing;
+};
+
+// Creating and forcing promises
+struct s_exp *make_promise(struct s_exp *exp, struct lisp_env *env);
+struct s_exp *make_producer(lisp_producer producer, struct lisp_env *env, struct s_exp *a, struct s_exp *b);
+struct s_exp *force(struct s_exp *promise);
+void promise_clear(struct lisp_promise *promise);
+void promise_free(struct lisp_promise *promise);
+
+// Setup, called by lisp_init()
+void stream_init(struct lisp_env *env);
+
+// Lisp-space stream primitives, which receive the global environment as their data
+struct s_exp *_force(struct s_exp **argv, int argc, void *data);
+struct s_exp *_stream_car(struct s_exp **argv, int argc, void *data);
+struct s_exp *_stream_cdr(struct s_exp **argv, int argc, void *data);
+struct s_exp *_stream_map(struct s_exp **argv, int argc, void *data);
+struct s_exp *_stream_filter(struct s_exp **argv, int argc, void *data);
+struct s_exp *_stream_take(struct s_exp **argv, int argc, void *data);
+struct s_exp *_stream_fold(struct s_exp **argv, int argc, void *data);
+struct s_exp *_stream_to_list(struct s_exp **argv, int argc, void *data);
+struct s_exp *_file_stream(struct s_exp **argv, int argc, void *data);
+
+// Stream helpers, used internally
+struct lisp_env *promise_snapshot(struct lisp_env *env);
+void stream_check(struct s_exp *s, const char *name);
+struct s_exp *stream_map(struct lisp_env *env, struct s_exp *f, struct s_exp *s);
+struct s_exp *stream_map_next(struct lisp_promise *promise);
+struct s_exp *stream_filter(struct lisp_env *env, struct s_exp *pred, struct s_exp *s);
+struct s_exp *stream_filter_next(struct lisp_promise *promise);
+struct s_exp *stream_take(struct lisp_env *env, int64_t n, struct s_exp *s);
+struct s_exp *stream_take_next(struct lisp_promise *promise);
+struct s_exp *file_stream_next(struct lisp_promise *promise);
+void file_stream_release(void *data);
+
+#endif
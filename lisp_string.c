@@ -0,0 +1,240 @@
+/**
+ * String atoms and the primitives that operate on them. Strings carry their length in the cdr,
+ * so no primitive ever needs to strlen() its arguments, and string-append builds ropes once
+ * the result gets large, so that accumulating a big output piece by piece stays linear.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_string.h"
+
+/**
+ * Wraps an existing buffer in a string atom. The atom takes ownership of buf, which must have
+ * room for a nul terminator after the last character.
+ */
+struct s_exp *make_string(char *buf, size_t length) {
+	struct s_exp *rtn;
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_STRING;
+	rtn->lisp_car.strVal = buf;
+	rtn->lisp_cdr.length = length;
+	return rtn;
+}
+
+/**
+ * Creates a rope node representing the concatenation of two strings, without copying either
+ */
+struct s_exp *make_rope(struct s_exp *left, struct s_exp *right) {
+	struct s_exp *rtn;
+	struct lisp_rope *rope;
+
+	rope = (struct lisp_rope *) malloc(sizeof(struct lisp_rope));
+	rope->left = left;
+	rope->right = right;
+
+	rtn = find_free_s_exp();
+	rtn->flags = FLAG_ATOM | FLAG_STRING | FLAG_ROPE;
+	rtn->lisp_car.rope = rope;
+	rtn->lisp_cdr.length = left->lisp_cdr.length + right->lisp_cdr.length;
+	return rtn;
+}
+
+/**
+ * Returns the contents of a string as a flat buffer. If the string is a rope, the leaves are
+ * copied into a single buffer and the atom is converted to a flat string in place, which is
+ * safe because strings are immutable and the contents do not change.
+ *
+ * The leaves are copied from right to left with an explicit stack, so that neither left-deep
+ * nor right-deep ropes can overflow the C stack.
+ */
+char *string_flatten(struct s_exp *s) {
+	struct s_exp **stack;
+	struct s_exp *node;
+	struct lisp_rope *rope;
+	char *buf;
+	size_t pos;
+	size_t depth;
+	size_t stackSize;
+
+	if (!IS_ROPE(s))
+		return s->lisp_car.strVal;
+
+	buf = (char *) malloc(s->lisp_cdr.length + 1);
+	buf[s->lisp_cdr.length] = '\0';
+	pos = s->lisp_cdr.length;
+
+	stackSize = 16;
+	stack = (struct s_exp **) malloc(stackSize * sizeof(struct s_exp *));
+	stack[0] = s;
+	depth = 1;
+
+	while (depth > 0) {
+		node = stack[--depth];
+
+		if (!IS_ROPE(node)) {
+			pos -= node->lisp_cdr.length;
+			memcpy(buf + pos, node->lisp_car.strVal, node->lisp_cdr.length);
+			continue;
+		}
+
+		if (depth + 2 > stackSize) {
+			stackSize *= 2;
+			stack = (struct s_exp **) realloc(stack, stackSize * sizeof(struct s_exp *));
+		}
+
+		// Push the left half first so that the right half is copied first
+		rope = node->lisp_car.rope;
+		stack[depth++] = rope->left;
+		stack[depth++] = rope->right;
+	}
+
+	free(stack);
+	free(s->lisp_car.rope);
+	s->flags &= ~FLAG_ROPE;
+	s->lisp_car.strVal = buf;
+	return buf;
+}
+
+/**
+ * Compares two strings by content, in C-space
+ */
+int string_equal(struct s_exp *a, struct s_exp *b) {
+	if (a->lisp_cdr.length != b->lisp_cdr.length)
+		return 0;
+
+	if (memcmp(string_flatten(a), string_flatten(b), a->lisp_cdr.length) == 0)
+		return 1;
+
+	return 0;
+}
+
+/**
+ * Prints a string with quotes around it, escaping the characters that the reader would need
+ * escaped in order to read it back in again
+ */
+void print_string(struct s_exp *s) {
+	char *c;
+	char *end;
+
+	c = string_flatten(s);
+	end = c + s->lisp_cdr.length;
+
+	putchar('"');
+	for (; c < end; ++c) {
+		switch (*c) {
+			case '"': printf("\\\""); break;
+			case '\\': printf("\\\\"); break;
+			case '\n': printf("\\n"); break;
+			case '\t': printf("\\t"); break;
+			case '\r': printf("\\r"); break;
+			case '\0': printf("\\0"); break;
+			default: putchar(*c); break;
+		}
+	}
+	putchar('"');
+}
+
+/**
+ * Concatenates any number of strings. Small results are copied into a fresh flat buffer, while
+ * larger ones become rope nodes so that repeated appends to a growing string do not copy it.
+ */
+struct s_exp *_string_append(struct s_exp **argv, int argc, void *data) {
+	struct s_exp *result;
+	struct s_exp *cur;
+	char *buf;
+	int i;
+
+	result = 0;
+	for (i = 0; i < argc; ++i) {
+		cur = argv[i];
+		if (!IS_STRING(cur))
+			lisp_throw(ERROR_TYPE, cur, "non-string argument supplied to string-append");
+
+		if (result == 0) {
+			result = cur;
+		}
+		else if (cur->lisp_cdr.length == 0) {
+			// Nothing to add
+		}
+		else if (result->lisp_cdr.length + cur->lisp_cdr.length < ROPE_MIN_LENGTH) {
+			buf = (char *) malloc(result->lisp_cdr.length + cur->lisp_cdr.length + 1);
+			memcpy(buf, string_flatten(result), result->lisp_cdr.length);
+			memcpy(buf + result->lisp_cdr.length, string_flatten(cur), cur->lisp_cdr.length);
+			buf[result->lisp_cdr.length + cur->lisp_cdr.length] = '\0';
+			result = make_string(buf, result->lisp_cdr.length + cur->lisp_cdr.length);
+		}
+		else {
+			result = make_rope(result, cur);
+		}
+	}
+
+	// (string-append) with no arguments is the empty string
+	if (result == 0) {
+		buf = (char *) calloc(1, 1);
+		result = make_string(buf, 0);
+	}
+
+	return result;
+}
+
+/**
+ * Extracts the characters of s from index start up to, but not including, index end, called
+ * as (substring s start [end]). If end is left out, the substring runs to the end of s.
+ */
+struct s_exp *_substring(struct s_exp **argv, int argc, void *data) {
+	struct s_exp *s;
+	struct s_exp *start;
+	struct s_exp *end;
+	int64_t first;
+	int64_t last;
+	char *buf;
+
+	if (argc != 2 && argc != 3)
+		lisp_throw(ERROR_ARITY, lisp_nil, "substring expects 2 or 3 arguments, but was given %d", argc);
+
+	s = argv[0];
+	start = argv[1];
+	end = (argc == 3) ? argv[2] : lisp_nil;
+	if (!IS_STRING(s) || !IS_INT(start) || !(IS_NIL(end) || IS_INT(end)))
+		lisp_throw(ERROR_TYPE, lisp_nil, "substring expects a string and integer indices");
+
+	first = start->lisp_car.siVal;
+	last = IS_NIL(end) ? (int64_t) s->lisp_cdr.length : end->lisp_car.siVal;
+	if (first < 0 || last < first || last > (int64_t) s->lisp_cdr.length)
+		lisp_throw(ERROR_RANGE, lisp_nil, "substring indices %ld and %ld out of range", first, last);
+
+	buf = (char *) malloc(last - first + 1);
+	memcpy(buf, string_flatten(s) + first, last - first);
+	buf[last - first] = '\0';
+	return make_string(buf, last - first);
+}
+
+/**
+ * Returns the length of a string, which is stored on the atom and never needs to be counted
+ */
+struct s_exp *_string_length(struct s_exp *s) {
+	if (!IS_STRING(s))
+		lisp_throw(ERROR_TYPE, s, "non-string argument supplied to string-length");
+
+	return make_int(s->lisp_cdr.length);
+}
+
+/**
+ * Lisp-space string comparison
+ */
+struct s_exp *_string_eq(struct s_exp *a, struct s_exp *b) {
+	if (!IS_STRING(a) || !IS_STRING(b))
+		lisp_throw(ERROR_TYPE, lisp_nil, "non-string argument supplied to string=?");
+
+	if (string_equal(a, b) == 1)
+		return lisp_true;
+
+	return lisp_false;
+}
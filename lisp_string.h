@@ -0,0 +1,38 @@
+#ifndef _LISP_STRING_H_
+#define _LISP_STRING_H_
+/**
+ * Native strings. A string atom is either flat, with strVal pointing to a buffer of exactly
+ * length bytes (plus a trailing nul for the benefit of C callers), or a rope, which is the
+ * lazy concatenation of two other strings. Ropes are flattened in place the first time their
+ * contents are actually needed.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stddef.h>
+
+// Concatenations shorter than this are copied immediately, because a rope node wouldn't save anything
+#define ROPE_MIN_LENGTH		64
+
+/**
+ * The two halves of a rope, which may themselves be ropes
+ */
+struct lisp_rope {
+	struct s_exp *left;
+	struct s_exp *right;
+};
+
+// Construction and access from C
+struct s_exp *make_string(char *buf, size_t length);
+struct s_exp *make_rope(struct s_exp *left, struct s_exp *right);
+char *string_flatten(struct s_exp *s);
+int string_equal(struct s_exp *a, struct s_exp *b);
+void print_string(struct s_exp *s);
+
+// Lisp-space string primitives
+struct s_exp *_string_append(struct s_exp **argv, int argc, void *data);
+struct s_exp *_substring(struct s_exp **argv, int argc, void *data);
+struct s_exp *_string_length(struct s_exp *s);
+struct s_exp *_string_eq(struct s_exp *a, struct s_exp *b);
+
+#endif
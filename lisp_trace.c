@@ -0,0 +1,312 @@
+/**
+ * The trace ring buffer and its hooks. Slots are claimed by position with an atomic increment
+ * of the head, and an event is only published once its sequence number is stored, so a dump
+ * that runs while events are being written skips the ones it would see half done.
+ */
+
+// Standard headers
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_trace.h"
+
+// Whether tracing is on, tested by every hook
+int lisp_tracing = 0;
+
+// Spans that have begun and not yet ended, so that an error can end the ones it unwinds past
+int trace_spans = 0;
+
+// The ring, which holds trace_size events, a power of two, and the position of the next event
+struct trace_event *trace_ring = 0;
+size_t trace_size = 0;
+uint64_t trace_head = 0;
+
+// When tracing started, which event times are measured from
+uint64_t trace_epoch = 0;
+
+/**
+ * Starts tracing into a new ring that holds the most recent events, rounded up to a power of
+ * two, dropping any trace that was recorded before
+ */
+void trace_start(size_t events) {
+	size_t size;
+
+	lisp_tracing = 0;
+	for (size = 1; size < events; size *= 2)
+		;
+
+	free(trace_ring);
+	trace_ring = (struct trace_event *) calloc(size, sizeof(struct trace_event));
+	trace_size = size;
+	trace_head = 0;
+	trace_spans = 0;
+	trace_epoch = trace_now();
+	lisp_tracing = 1;
+}
+
+/**
+ * Stops recording events, keeping those already recorded so that they can be dumped
+ */
+void trace_stop(void) {
+	lisp_tracing = 0;
+}
+
+/**
+ * Writes the events in the ring to fp in the Chrome trace event format, oldest first. Returns
+ * the number of events written.
+ */
+int trace_dump(FILE *fp) {
+	struct trace_event event;
+	struct trace_event *slot;
+	struct lisp_location loc;
+	uint64_t head;
+	uint64_t i;
+	int count;
+
+	fprintf(fp, "{\"traceEvents\":[");
+	count = 0;
+
+	head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+	for (i = (head > trace_size) ? head - trace_size : 0; i < head; ++i) {
+		// Copy the event out, and skip it if a writer had it or got to it in the meantime
+		slot = &trace_ring[i & (trace_size - 1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != i + 1)
+			continue;
+		event = *slot;
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != i + 1)
+			continue;
+
+		fprintf(fp, "%s\n{\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03" PRIu64 ",\"pid\":1,\"tid\":1",
+				count == 0 ? "" : ",", event.phase, event.time / 1000, event.time % 1000);
+		if (event.name != 0) {
+			fprintf(fp, ",\"name\":\"");
+			trace_write_string(fp, event.name);
+			fprintf(fp, "\"");
+		}
+		if (event.phase == TRACE_INSTANT)
+			fprintf(fp, ",\"s\":\"t\"");
+
+		if (event.phase == TRACE_COUNTER || (event.phase == TRACE_END && event.name != 0)) {
+			fprintf(fp, ",\"args\":{\"cells\":%" PRIu64 "}", event.value);
+		}
+		else if (source_lookup(event.site, &loc)) {
+			fprintf(fp, ",\"args\":{\"at\":\"");
+			if (loc.file != 0) {
+				trace_write_string(fp, loc.file);
+				fprintf(fp, ":");
+			}
+			fprintf(fp, "%d:%d\"}", loc.line, loc.column);
+		}
+
+		fprintf(fp, "}");
+		count += 1;
+	}
+
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+	return count;
+}
+
+/**
+ * Records an event in the next slot of the ring, overwriting the oldest event once it is full
+ */
+void trace_emit(char phase, const char *name, struct s_exp *site, uint64_t value) {
+	struct trace_event *slot;
+	uint64_t seq;
+
+	seq = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+	slot = &trace_ring[seq & (trace_size - 1)];
+
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->time = trace_now() - trace_epoch;
+	slot->name = name;
+	slot->site = site;
+	slot->value = value;
+	slot->phase = phase;
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Begins the span of an application of function
+ */
+void trace_enter(struct s_exp *function) {
+	trace_spans += 1;
+	trace_emit(TRACE_BEGIN, trace_function_name(function), function, 0);
+}
+
+/**
+ * Ends the innermost span
+ */
+void trace_exit(void) {
+	if (trace_spans == 0)
+		return;
+
+	trace_spans -= 1;
+	trace_emit(TRACE_END, 0, 0, 0);
+}
+
+/**
+ * Records the dispatch of a special form, given the head of the form being evaluated. Heads
+ * that aren't special forms are applications, which trace themselves.
+ */
+void trace_form(struct s_exp *head, struct s_exp *exp) {
+	struct s_exp *forms[] = {lisp_quote, lisp_cond, lisp_define, lisp_define_memo, lisp_defmacro, lisp_lambda,
+		lisp_label, lisp_memo, lisp_delay, lisp_stream_cons, lisp_catch, lisp_set};
+	int i;
+
+	for (i = 0; i < sizeof(forms) / sizeof(struct s_exp *); ++i) {
+		if (c_lisp_eq(head, forms[i]) == 1) {
+			trace_emit(TRACE_INSTANT, forms[i]->lisp_car.label, exp, 0);
+			return;
+		}
+	}
+}
+
+/**
+ * Counts a cell allocated by the heap, given how many have been allocated since the last
+ * collection, and records the count every TRACE_ALLOC_SAMPLE cells
+ */
+void trace_alloc(size_t allocated) {
+	if ((allocated & (TRACE_ALLOC_SAMPLE - 1)) == 0)
+		trace_emit(TRACE_COUNTER, "allocated", 0, allocated);
+}
+
+/**
+ * Ends the spans that an error unwinds past, down to the number open when its handler was set
+ */
+void trace_unwind(int spans) {
+	while (trace_spans > spans)
+		trace_exit();
+}
+
+/**
+ * Adds the tracing primitives to the global environment
+ */
+void trace_init(struct lisp_env *env) {
+	define_label("trace-start", make_native("trace-start", LISP_VARIADIC, _trace_start, 0), env);
+	define_label("trace-stop", make_native("trace-stop", 0, _trace_stop, 0), env);
+	define_label("trace-dump", make_native("trace-dump", 1, _trace_dump, 0), env);
+	define_label("trace-begin", make_native("trace-begin", 1, _trace_begin, 0), env);
+	define_label("trace-end", make_native("trace-end", 0, _trace_end, 0), env);
+}
+
+/**
+ * (trace-start [events]) starts tracing, keeping the given number of the most recent events
+ */
+struct s_exp *_trace_start(struct s_exp **argv, int argc, void *data) {
+	if (argc > 1)
+		lisp_throw(ERROR_ARITY, lisp_nil, "trace-start expects at most 1 argument, but was given %d", argc);
+	if (argc == 1 && (!IS_INT(argv[0]) || argv[0]->lisp_car.siVal <= 0))
+		lisp_throw(ERROR_TYPE, argv[0], "trace-start expects a positive number of events");
+
+	trace_start(argc == 1 ? argv[0]->lisp_car.siVal : TRACE_DEFAULT_EVENTS);
+	return lisp_undefined;
+}
+
+/**
+ * (trace-stop) stops tracing
+ */
+struct s_exp *_trace_stop(struct s_exp **argv, int argc, void *data) {
+	trace_stop();
+	return lisp_undefined;
+}
+
+/**
+ * (trace-dump path) writes the trace to the file at path, and returns how many events it held
+ */
+struct s_exp *_trace_dump(struct s_exp **argv, int argc, void *data) {
+	FILE *fp;
+	int count;
+
+	if (!IS_STRING(argv[0]))
+		lisp_throw(ERROR_TYPE, argv[0], "trace-dump expects a string path");
+
+	fp = fopen(string_flatten(argv[0]), "w");
+	if (fp == NULL)
+		lisp_throw(ERROR_IO, argv[0], "trace-dump unable to open %s", string_flatten(argv[0]));
+
+	count = trace_dump(fp);
+	fclose(fp);
+	return make_int(count);
+}
+
+/**
+ * (trace-begin name) begins a span with the given name, which may be a string or a symbol
+ */
+struct s_exp *_trace_begin(struct s_exp **argv, int argc, void *data) {
+	const char *name;
+
+	if (IS_STRING(argv[0]))
+		name = string_flatten(argv[0]);
+	else if (IS_SYMBOL(argv[0]))
+		name = argv[0]->lisp_car.label;
+	else
+		lisp_throw(ERROR_TYPE, argv[0], "trace-begin expects a string or a symbol");
+
+	if (lisp_tracing) {
+		trace_spans += 1;
+		trace_emit(TRACE_BEGIN, intern_label(name), 0, 0);
+	}
+	return lisp_undefined;
+}
+
+/**
+ * (trace-end) ends the innermost span
+ */
+struct s_exp *_trace_end(struct s_exp **argv, int argc, void *data) {
+	TRACE_HOOK(trace_exit());
+	return lisp_undefined;
+}
+
+/**
+ * Names an application of function for the trace. Lambdas are all called lambda, and are told
+ * apart by where they were written.
+ */
+const char *trace_function_name(struct s_exp *function) {
+	struct s_exp *name;
+
+	if (IS_ATOM(function)) {
+		if (IS_FUNCTION(function))
+			return function->lisp_car.native->name;
+		if (IS_SYMBOL(function))
+			return function->lisp_car.label;
+		return "apply";
+	}
+
+	if (c_lisp_eq(_car(function), lisp_label) == 1 || c_lisp_eq(_car(function), lisp_memo) == 1) {
+		name = _car(_cdr(function));
+		if (IS_SYMBOL(name))
+			return name->lisp_car.label;
+	}
+
+	return "lambda";
+}
+
+/**
+ * Reads the monotonic clock, in nanoseconds
+ */
+uint64_t trace_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Writes s to fp escaped for use inside of a JSON string
+ */
+void trace_write_string(FILE *fp, const char *s) {
+	for (; *s != 0; ++s) {
+		if (*s == '"' || *s == '\\')
+			fprintf(fp, "\\%c", *s);
+		else if ((unsigned char) *s < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned char) *s);
+		else
+			fputc(*s, fp);
+	}
+}
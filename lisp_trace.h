@@ -0,0 +1,85 @@
+#ifndef _LISP_TRACE_H_
+#define _LISP_TRACE_H_
+/**
+ * Tracing of what the interpreter is doing, for seeing where the time goes in a running
+ * program. While tracing is on, applications record when they begin and end, special forms
+ * record when they are dispatched, and the heap records how much it has allocated and when it
+ * collects. Lisp code can add spans of its own around units of work, such as requests.
+ *
+ * Every hook sits behind a test of lisp_tracing that is marked unlikely, so with tracing off
+ * each one costs a load and a branch that is never taken. Events go into a ring buffer that
+ * keeps the most recent ones, and which writers claim slots in with an atomic increment, so
+ * nothing ever waits on a lock. trace_dump() writes the buffer in the Chrome trace event
+ * format, which chrome://tracing and Perfetto display as a timeline.
+ */
+
+// Standard headers
+#include <inttypes.h>
+#include <stdio.h>
+
+// Project headers
+#include "lisp.h"
+
+// Number of events kept by default
+#define TRACE_DEFAULT_EVENTS	(1 << 20)
+
+// Allocation is recorded once every this many cells, a power of two
+#define TRACE_ALLOC_SAMPLE		4096
+
+// Kinds of event, which are the phases of the trace event format
+#define TRACE_BEGIN				'B'
+#define TRACE_END				'E'
+#define TRACE_INSTANT			'i'
+#define TRACE_COUNTER			'C'
+
+/**
+ * One event in the ring. seq is one more than the event's position in the trace once it is
+ * complete, and zero while it is being written. name is never freed, and site is code that the
+ * event is about, whose source location is looked up when the trace is dumped. Counters and
+ * ends that are named, which only collections are, carry a count of cells in value.
+ */
+struct trace_event {
+	uint64_t seq;
+	uint64_t time;
+	const char *name;
+	struct s_exp *site;
+	uint64_t value;
+	char phase;
+};
+
+// Whether tracing is on, and how many spans are open
+extern int lisp_tracing;
+extern int trace_spans;
+
+// Calls a tracing hook, only when tracing is on
+#define TRACE_HOOK(call) do { if (__builtin_expect(lisp_tracing, 0)) call; } while (0)
+
+// Control
+void trace_start(size_t events);
+void trace_stop(void);
+int trace_dump(FILE *fp);
+
+// Recording events
+void trace_emit(char phase, const char *name, struct s_exp *site, uint64_t value);
+void trace_enter(struct s_exp *function);
+void trace_exit(void);
+void trace_form(struct s_exp *head, struct s_exp *exp);
+void trace_alloc(size_t allocated);
+void trace_unwind(int spans);
+
+// Setup, called by lisp_init()
+void trace_init(struct lisp_env *env);
+
+// Lisp-space tracing primitives
+struct s_exp *_trace_start(struct s_exp **argv, int argc, void *data);
+struct s_exp *_trace_stop(struct s_exp **argv, int argc, void *data);
+struct s_exp *_trace_dump(struct s_exp **argv, int argc, void *data);
+struct s_exp *_trace_begin(struct s_exp **argv, int argc, void *data);
+struct s_exp *_trace_end(struct s_exp **argv, int argc, void *data);
+
+// Tracing helpers, used internally
+const char *trace_function_name(struct s_exp *function);
+uint64_t trace_now(void);
+void trace_write_string(FILE *fp, const char *s);
+
+#endif
@@ -87,37 +87,289 @@ struct s_exp _lisp_label = {
 	.lisp_cdr = {.cdr = 0}
 };
 
+// Memo form, a label whose results are cached by argument list
+struct s_exp _lisp_memo = {
+	.flags = FLAG_ATOM | FLAG_SYMBOL,
+	.lisp_car = {.label = "memo"},
+	.lisp_cdr = {.cdr = 0}
+};
+
+// Define-memo form, binds a memo form to a name in the environment
+struct s_exp _lisp_define_memo = {
+	.flags = FLAG_ATOM | FLAG_SYMBOL,
+	.lisp_car = {.label = "define-memo"},
+	.lisp_cdr = {.cdr = 0}
+};
+
+// Defmacro form, binds a macro whose expansion replaces each call
+struct s_exp _lisp_defmacro = {
+	.flags = FLAG_ATOM | FLAG_SYMBOL,
+	.lisp_car = {.label = "defmacro"},
+	.lisp_cdr = {.cdr = 0}
+};
+
+// Delay form, makes a promise to evaluate its argument later
+struct s_exp _lisp_delay = {
+	.flags = FLAG_ATOM | FLAG_SYMBOL,
+	.lisp_car = {.label = "delay"},
+	.lisp_cdr = {.cdr = 0}
+};
+
+// Stream-cons form, pairs a value with a promise of the rest of the stream
+struct s_exp _lisp_stream_cons = {
+	.flags = FLAG_ATOM | FLAG_SYMBOL,
+	.lisp_car = {.label = "stream-cons"},
+	.lisp_cdr = {.cdr = 0}
+};
+
+// Catch form, evaluates an expression and hands any error it raises to a handler
+struct s_exp _lisp_catch = {
+	.flags = FLAG_ATOM | FLAG_SYMBOL,
+	.lisp_car = {.label = "catch"},
+	.lisp_cdr = {.cdr = 0}
+};
+
+// Set form, changes the value of a variable that is already bound
+struct s_exp _lisp_set = {
+	.flags = FLAG_ATOM | FLAG_SYMBOL,
+	.lisp_car = {.label = "set!"},
+	.lisp_cdr = {.cdr = 0}
+};
+
 /**
- * The primitive symbols
+ * The primitive functions. Each one is a function atom pointing at a native description, which
+ * gives the entry point matching its arity so that eval() can call it with arguments directly.
  */
 
+struct lisp_native _lisp_cons_native = {
+	.name = "cons",
+	.arity = 2,
+	.fn2 = _cons
+};
+
 struct s_exp _lisp_cons = {
-	.flags = FLAG_ATOM | FLAG_SYMBOL,
-	.lisp_car = {.label = "cons"},
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_cons_native},
 	.lisp_cdr = {.cdr = 0}
 };
 
+struct lisp_native _lisp_car_native = {
+	.name = "car",
+	.arity = 1,
+	.pure = 1,
+	.fn1 = _car
+};
+
 struct s_exp _lisp_car = {
-	.flags = FLAG_ATOM | FLAG_SYMBOL,
-	.lisp_car = {.label = "car"},
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_car_native},
 	.lisp_cdr = {.cdr = 0}
 };
 
+struct lisp_native _lisp_cdr_native = {
+	.name = "cdr",
+	.arity = 1,
+	.pure = 1,
+	.fn1 = _cdr
+};
+
 struct s_exp _lisp_cdr = {
-	.flags = FLAG_ATOM | FLAG_SYMBOL,
-	.lisp_car = {.label = "cdr"},
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_cdr_native},
 	.lisp_cdr = {.cdr = 0}
 };
 
+struct lisp_native _lisp_eq_native = {
+	.name = "eq?",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _eq
+};
+
 struct s_exp _lisp_eq = {
-	.flags = FLAG_ATOM | FLAG_SYMBOL,
-	.lisp_car = {.label = "eq?"},
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_eq_native},
 	.lisp_cdr = {.cdr = 0}
 };
 
+struct lisp_native _lisp_equal_native = {
+	.name = "equal?",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _equal
+};
+
+struct s_exp _lisp_equal = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_equal_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_atom_native = {
+	.name = "atom?",
+	.arity = 1,
+	.pure = 1,
+	.fn1 = _atom
+};
+
 struct s_exp _lisp_atom = {
-	.flags = FLAG_ATOM | FLAG_SYMBOL,
-	.lisp_car = {.label = "atom?"},
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_atom_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_string_append_native = {
+	.name = "string-append",
+	.arity = LISP_VARIADIC,
+	.pure = 1,
+	.fn = _string_append
+};
+
+struct s_exp _lisp_string_append = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_string_append_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_substring_native = {
+	.name = "substring",
+	.arity = LISP_VARIADIC,
+	.pure = 1,
+	.fn = _substring
+};
+
+struct s_exp _lisp_substring = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_substring_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_string_length_native = {
+	.name = "string-length",
+	.arity = 1,
+	.pure = 1,
+	.fn1 = _string_length
+};
+
+struct s_exp _lisp_string_length = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_string_length_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_string_eq_native = {
+	.name = "string=?",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _string_eq
+};
+
+struct s_exp _lisp_string_eq = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_string_eq_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_memo_stats_native = {
+	.name = "memo-stats",
+	.arity = 1,
+	.fn1 = memo_stats
+};
+
+struct s_exp _lisp_memo_stats = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_memo_stats_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_add_native = {
+	.name = "+",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _add
+};
+
+struct s_exp _lisp_add = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_add_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_sub_native = {
+	.name = "-",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _sub
+};
+
+struct s_exp _lisp_sub = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_sub_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_mul_native = {
+	.name = "*",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _mul
+};
+
+struct s_exp _lisp_mul = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_mul_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_div_native = {
+	.name = "/",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _div
+};
+
+struct s_exp _lisp_div = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_div_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_lt_native = {
+	.name = "<",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _lt
+};
+
+struct s_exp _lisp_lt = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_lt_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_gt_native = {
+	.name = ">",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _gt
+};
+
+struct s_exp _lisp_gt = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_gt_native},
+	.lisp_cdr = {.cdr = 0}
+};
+
+struct lisp_native _lisp_num_eq_native = {
+	.name = "=",
+	.arity = 2,
+	.pure = 1,
+	.fn2 = _num_eq
+};
+
+struct s_exp _lisp_num_eq = {
+	.flags = FLAG_ATOM | FLAG_FUNCTION,
+	.lisp_car = {.native = &_lisp_num_eq_native},
 	.lisp_cdr = {.cdr = 0}
 };
 
@@ -132,9 +384,29 @@ struct s_exp *lisp_cond = &_lisp_cond;
 struct s_exp *lisp_define = &_lisp_define;
 struct s_exp *lisp_lambda = &_lisp_lambda;
 struct s_exp *lisp_label = &_lisp_label;
+struct s_exp *lisp_memo = &_lisp_memo;
+struct s_exp *lisp_define_memo = &_lisp_define_memo;
+struct s_exp *lisp_defmacro = &_lisp_defmacro;
+struct s_exp *lisp_delay = &_lisp_delay;
+struct s_exp *lisp_stream_cons = &_lisp_stream_cons;
+struct s_exp *lisp_catch = &_lisp_catch;
+struct s_exp *lisp_set = &_lisp_set;
 
 struct s_exp *lisp_cons = &_lisp_cons;
 struct s_exp *lisp_car = &_lisp_car;
 struct s_exp *lisp_cdr = &_lisp_cdr;
 struct s_exp *lisp_eq = &_lisp_eq;
+struct s_exp *lisp_equal = &_lisp_equal;
 struct s_exp *lisp_atom = &_lisp_atom;
+struct s_exp *lisp_string_append = &_lisp_string_append;
+struct s_exp *lisp_substring = &_lisp_substring;
+struct s_exp *lisp_string_length = &_lisp_string_length;
+struct s_exp *lisp_string_eq = &_lisp_string_eq;
+struct s_exp *lisp_memo_stats = &_lisp_memo_stats;
+struct s_exp *lisp_add = &_lisp_add;
+struct s_exp *lisp_sub = &_lisp_sub;
+struct s_exp *lisp_mul = &_lisp_mul;
+struct s_exp *lisp_div = &_lisp_div;
+struct s_exp *lisp_lt = &_lisp_lt;
+struct s_exp *lisp_gt = &_lisp_gt;
+struct s_exp *lisp_num_eq = &_lisp_num_eq;
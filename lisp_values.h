@@ -24,12 +24,32 @@ extern struct s_exp *lisp_cond;
 extern struct s_exp *lisp_define;
 extern struct s_exp *lisp_lambda;
 extern struct s_exp *lisp_label;
+extern struct s_exp *lisp_memo;
+extern struct s_exp *lisp_define_memo;
+extern struct s_exp *lisp_defmacro;
+extern struct s_exp *lisp_delay;
+extern struct s_exp *lisp_stream_cons;
+extern struct s_exp *lisp_catch;
+extern struct s_exp *lisp_set;
 
-// Symbols for built-ins/primitive functions
+// Function atoms for built-ins/primitive functions
 extern struct s_exp *lisp_cons;
 extern struct s_exp *lisp_car;
 extern struct s_exp *lisp_cdr;
 extern struct s_exp *lisp_eq;
+extern struct s_exp *lisp_equal;
 extern struct s_exp *lisp_atom;
+extern struct s_exp *lisp_string_append;
+extern struct s_exp *lisp_substring;
+extern struct s_exp *lisp_string_length;
+extern struct s_exp *lisp_string_eq;
+extern struct s_exp *lisp_memo_stats;
+extern struct s_exp *lisp_add;
+extern struct s_exp *lisp_sub;
+extern struct s_exp *lisp_mul;
+extern struct s_exp *lisp_div;
+extern struct s_exp *lisp_lt;
+extern struct s_exp *lisp_gt;
+extern struct s_exp *lisp_num_eq;
 
 #endif
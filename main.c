@@ -5,46 +5,341 @@
 // Standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Project headers
 #include "lisp.h"
+#include "lisp_compile.h"
+#include "lisp_jit.h"
 #include "lisp_parser.h"
 
+// Exit status when the command line is wrong or an input can't be read or parsed
+#define MAIN_EXIT_FAILURE		1
+
+/**
+ * How main() runs each top-level form. Unless quiet, every form is echoed along with its
+ * result. Each form is evaluated repeat times within the budget, and with time set, how long
+ * that took is reported on stderr. An error stops the run unless keepGoing is set.
+ */
+struct main_options {
+	int quiet;
+	int keepGoing;
+	int time;
+	long repeat;
+	struct lisp_budget budget;
+};
+
+// Running the inputs
+int main_run_file(const char *path, struct lisp_env *env, struct main_options *options);
+int main_run_string(const char *source, struct lisp_env *env, struct main_options *options);
+int main_run_forms(struct s_list *forms, struct lisp_env *env, struct main_options *options);
+
 /**
- * Loads in the program, calls the parser, evaluates the code, and then prints the output
+ * Loads in the program, calls the parser, evaluates the code, and then prints the output. The
+ * inputs are the files named on the command line and expressions given with -e, run in the
+ * order they are given, where - reads from stdin, and test.lisp is run if there are none.
+ * --quiet only shows what the program prints itself, --keep-going goes on to the next form
+ * after one fails, --time reports how long each form takes, and --repeat n evaluates each form
+ * n times, for benchmarks. --no-cache parses every file that is required instead of using the
+ * compile cache.
+ *
+ * With --aot source output, compiles source into the shared object output instead, and each
+ * --load library loads a compiled library before the program runs. --no-jit interprets every
+ * lambda, for comparison with compiled code, --jit-threshold n compiles a lambda once it has
+ * been applied n times, and --no-gc never collects garbage. The heap is sized with
+ * --heap-initial, --heap-max, --heap-growth and --huge-pages, or the matching LISP_ environment
+ * variables, which the command line overrides. --hash-cons shares identical pairs built by
+ * cons. Each top-level form is evaluated within the budget given by --max-steps,
+ * --max-cells, --max-depth and --timeout, and one that runs out, or raises an error that it
+ * doesn't catch, is reported on stderr. --trace file traces the whole run, and writes the
+ * trace to file at the end.
+ *
+ * Exits with 0 if every form was evaluated, ERROR_EXIT_UNCAUGHT if one raised an error that it
+ * didn't catch, LIMIT_EXIT_EXCEEDED if one ran out of its budget, or MAIN_EXIT_FAILURE if the
+ * command line was wrong or an input couldn't be read. With --keep-going, the first failure
+ * decides the status.
  */
 int main(int argc, char **argv) {
 	FILE *fp;
-	struct s_list *expList;
-	struct s_exp *result;
 	struct lisp_env *env;
+	struct main_options options = {0};
+	char **inputs;
+	char *traceFile;
+	char *end;
+	int inputCount;
+	int status;
+	int result;
+	int i;
 
 	// Initialize the lisp environment, then dump the defined symbols and call it a day
+	heap_configure_env();
 	env = lisp_init();
+	gc_enabled = 1;
+	traceFile = 0;
+	options.repeat = 1;
 
-	// Open our test source file
-	fp = fopen("test.lisp", "r");
-	if (fp == NULL) {
-		perror("Unable to open test file: test.lisp");
-		return 1;
+	// Inputs are kept as they were given, with expressions still preceded by -e
+	inputs = (char **) malloc(argc * sizeof(char *));
+	inputCount = 0;
+
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--aot") == 0 && i + 2 < argc) {
+			fp = fopen(argv[i+1], "r");
+			if (fp == NULL) {
+				perror(argv[i+1]);
+				return MAIN_EXIT_FAILURE;
+			}
+			source_set_file(argv[i+1]);
+			return aot_compile(fp, argv[i+2], env);
+		}
+		else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+			inputs[inputCount++] = argv[i++];
+			inputs[inputCount++] = argv[i];
+		}
+		else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--quiet") == 0) {
+			options.quiet = 1;
+		}
+		else if (strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--keep-going") == 0) {
+			options.keepGoing = 1;
+		}
+		else if (strcmp(argv[i], "--no-cache") == 0) {
+			module_cache_enabled = 0;
+		}
+		else if (strcmp(argv[i], "--time") == 0) {
+			options.time = 1;
+		}
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			options.repeat = strtol(argv[++i], &end, 10);
+			if (*end != 0 || options.repeat < 1)
+				break;
+		}
+		else if (strcmp(argv[i], "--no-jit") == 0) {
+			jit_enabled = 0;
+		}
+		else if (strcmp(argv[i], "--jit-threshold") == 0 && i + 1 < argc) {
+			jit_threshold = strtol(argv[++i], &end, 10);
+			if (*end != 0 || jit_threshold < 1)
+				break;
+		}
+		else if (strcmp(argv[i], "--no-gc") == 0) {
+			gc_enabled = 0;
+		}
+		else if (strcmp(argv[i], "--hash-cons") == 0) {
+			hashcons_enabled = 1;
+		}
+		else if (strncmp(argv[i], "--heap-", 7) == 0 && i + 1 < argc) {
+			if (heap_configure(argv[i] + 2, argv[i+1]) != 0) {
+				fprintf(stderr, "Invalid value for %s: %s\n", argv[i], argv[i+1]);
+				return MAIN_EXIT_FAILURE;
+			}
+			++i;
+		}
+		else if (strcmp(argv[i], "--huge-pages") == 0) {
+			heap_huge_pages = 1;
+		}
+		else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+			options.budget.steps = strtoull(argv[++i], &end, 10);
+			if (*end != 0)
+				break;
+		}
+		else if (strcmp(argv[i], "--max-cells") == 0 && i + 1 < argc) {
+			options.budget.cells = strtoull(argv[++i], &end, 10);
+			if (*end != 0)
+				break;
+		}
+		else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+			options.budget.depth = strtol(argv[++i], &end, 10);
+			if (*end != 0 || options.budget.depth < 0)
+				break;
+		}
+		else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+			options.budget.seconds = strtod(argv[++i], &end);
+			if (*end != 0 || options.budget.seconds < 0)
+				break;
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			traceFile = argv[++i];
+			trace_start(TRACE_DEFAULT_EVENTS);
+		}
+		else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+			if (aot_load(argv[++i], env) != 0)
+				return MAIN_EXIT_FAILURE;
+		}
+		else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+			inputs[inputCount++] = argv[i];
+		}
+		else {
+			break;
+		}
+	}
+
+	if (i < argc) {
+		fprintf(stderr, "Usage: %s [options] [file | - | -e expression]...\n"
+				"Options: [-q | --quiet] [-k | --keep-going] [--no-cache] [--time] [--repeat n] [--no-jit] "
+				"[--jit-threshold n] [--no-gc] [--hash-cons] [--heap-initial size] [--heap-max size] [--heap-growth factor] "
+				"[--huge-pages] [--max-steps n] [--max-cells n] [--max-depth n] [--timeout seconds] [--trace file.json] "
+				"[--load library.so]...\n"
+				"   or: %s --aot source.lisp library.so\n", argv[0], argv[0]);
+		return MAIN_EXIT_FAILURE;
 	}
 
-	// Parse it into a list of s-expressions
-	expList = lisp_parse_file(fp);
-
-	// Pretty print the expressions back to the console to show that we parsed them properly
-	while (expList != 0) {
-		pretty_print_exp(expList->exp);
-		printf("\n");
-		
-		result = eval(expList->exp, env);
-		printf("eval() result: ");
-		pretty_print_exp(result);
-		printf("\n\n");
-		expList = expList->next;
+	// Without any inputs, run the test program, as this always has
+	if (inputCount == 0)
+		inputs[inputCount++] = "test.lisp";
+
+	status = 0;
+	for (i = 0; i < inputCount; ++i) {
+		if (strcmp(inputs[i], "-e") == 0)
+			result = main_run_string(inputs[++i], env, &options);
+		else
+			result = main_run_file(inputs[i], env, &options);
+
+		if (status == 0)
+			status = result;
+		if (status != 0 && !options.keepGoing)
+			break;
+	}
+
+	if (traceFile != 0) {
+		trace_stop();
+		fp = fopen(traceFile, "w");
+		if (fp == NULL) {
+			perror("Unable to write trace");
+			return MAIN_EXIT_FAILURE;
+		}
+		trace_dump(fp);
+		fclose(fp);
 	}
 
 	// TODO: Clean up environment
 
-	return 0;
+	free(inputs);
+	return status;
+}
+
+/**
+ * Runs the program in the file at path, or on stdin if path is -, and returns its exit status
+ */
+int main_run_file(const char *path, struct lisp_env *env, struct main_options *options) {
+	struct s_list *forms;
+	FILE *fp;
+
+	if (strcmp(path, "-") == 0) {
+		source_set_file("<stdin>");
+		forms = lisp_parse_file(stdin);
+	}
+	else {
+		fp = fopen(path, "r");
+		if (fp == NULL) {
+			perror(path);
+			return MAIN_EXIT_FAILURE;
+		}
+
+		source_set_file(path);
+		forms = lisp_parse_file(fp);
+		fclose(fp);
+	}
+
+	if (lisp_parse_failed)
+		return MAIN_EXIT_FAILURE;
+	return main_run_forms(forms, env, options);
+}
+
+/**
+ * Runs the program given on the command line with -e, and returns its exit status
+ */
+int main_run_string(const char *source, struct lisp_env *env, struct main_options *options) {
+	struct s_list *forms;
+
+	source_set_file("-e");
+	forms = lisp_parse_string(source);
+	if (lisp_parse_failed)
+		return MAIN_EXIT_FAILURE;
+	return main_run_forms(forms, env, options);
+}
+
+/**
+ * Evaluates each form in turn, and returns the exit status for the first one that fails, or 0
+ * if none of them do
+ */
+int main_run_forms(struct s_list *forms, struct lisp_env *env, struct main_options *options) {
+	struct lisp_location loc;
+	struct s_exp *result;
+	struct s_exp *code;
+	double start;
+	double elapsed;
+	double total;
+	double fastest;
+	long run;
+	int failed;
+	int status;
+
+	// Expanding a macro call or optimizing the form can leave heap cells in it, which have to
+	// survive the collections between runs
+	code = 0;
+	gc_add_roots(&code, 1);
+
+	failed = 0;
+	status = LIMIT_OK;
+	for (; forms != 0; forms = forms->next) {
+		// Pretty print the expressions back to the console to show that we parsed them properly
+		if (!options->quiet) {
+			pretty_print_exp(forms->exp);
+			printf("\n");
+		}
+
+		code = optimize(forms->exp, env);
+		lisp_source_line = forms->line;
+		lisp_source_site = code;
+		source_locate(&loc);
+
+		total = 0;
+		fastest = 0;
+		for (run = 0; run < options->repeat; ++run) {
+			// Between runs nothing is being evaluated, so it is safe to collect
+			if (run > 0) {
+				gc_maybe_collect();
+				lisp_source_site = code;
+			}
+
+			start = limit_now();
+			status = lisp_eval_limited(code, env, &options->budget, &result);
+			elapsed = limit_now() - start;
+
+			total += elapsed;
+			if (run == 0 || elapsed < fastest)
+				fastest = elapsed;
+			if (status != LIMIT_OK)
+				break;
+		}
+
+		if (options->time) {
+			if (run <= 1)
+				fprintf(stderr, "%s:%d: %.6f s\n", loc.file != 0 ? loc.file : "-", loc.line, total);
+			else
+				fprintf(stderr, "%s:%d: %ld runs, mean %.6f s, min %.6f s\n", loc.file != 0 ? loc.file : "-",
+						loc.line, run, total / run, fastest);
+		}
+
+		if (status != LIMIT_OK)
+			error_report(result);
+
+		if (!options->quiet) {
+			printf("eval() result: ");
+			pretty_print_exp(result);
+			printf("\n\n");
+		}
+
+		// Between forms nothing is being evaluated, so it is safe to collect
+		gc_maybe_collect();
+
+		if (status != LIMIT_OK && failed == 0) {
+			failed = (status == LIMIT_ERROR) ? ERROR_EXIT_UNCAUGHT : LIMIT_EXIT_EXCEEDED;
+			if (!options->keepGoing)
+				break;
+		}
+	}
+
+	gc_remove_roots(&code);
+	return failed;
 }
@@ -0,0 +1,45 @@
+; Integer, bignum, ratio and float arithmetic
+(+ 1 2)
+(- 3 10)
+(* 6 7)
+(/ 12 4)
+(/ 1 3)
+(/ 6 -4)
+(+ 1/3 1/6)
+(* 2/3 3/2)
+(- 1/2 1/2)
+(+ 1 2.5)
+(* 1/2 0.5)
+(< 1 2.5)
+(> 1/3 0.3)
+(= 2/4 1/2)
+(= 1 1.0)
+(+ 9223372036854775807 1)
+(- -9223372036854775808 1)
+(* 4611686018427387904 2)
+(* 99999999999999999999 99999999999999999999)
+(- (+ 9223372036854775807 1) 1)
+(/ 100000000000000000000000 10)
+(/ 100000000000000000000001 100000000000000000000000)
+(quotient 17 5)
+(remainder 17 5)
+(quotient -17 5)
+(remainder -17 5)
+(quotient 100000000000000000000000007 1000)
+(remainder 100000000000000000000000007 1000)
+(numerator 6/4)
+(denominator 6/4)
+(numerator 5)
+(denominator 5)
+(exact->inexact 1/4)
+(exact->inexact 100000000000000000000)
+(define fact (lambda (n) (cond ((= n 0) 1) (#t (* n (fact (- n 1)))))))
+(fact 20)
+(fact 30)
+(/ (fact 30) (fact 28))
+(define harmonic (lambda (n) (cond ((= n 0) 0) (#t (+ (/ 1 n) (harmonic (- n 1)))))))
+(harmonic 10)
+(/ 1 0)
+(quotient 1 0)
+(+ 1 'a)
+(< "a" 1)
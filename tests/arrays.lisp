@@ -0,0 +1,47 @@
+; Numeric arrays
+(define a (list->array (quote f64) (quote (1 2 3 4 5 6 7))))
+(define b (list->array (quote i64) (quote (1 2 3 4 5 6 7))))
+a
+b
+(array-sum a)
+(array-sum b)
+(dot a a)
+(dot b b)
+(dot a b)
+(array-add b b)
+(array-sub b 1)
+(array-mul b 3)
+(array-mul b 0.5)
+(array-div b 2)
+(array-add a b)
+(array-map (lambda (x) (* x x)) b)
+(array-map (lambda (x) (/ x 2)) b)
+(array-map (lambda (x) (+ x 1)) a)
+(array->list b)
+(array-length a)
+(array-ref b 6)
+(array-set! b 0 100)
+b
+(make-array (quote i64) 3 7)
+(make-array (quote f64) 0)
+(array-sum (make-array (quote f64) 0))
+(array? a)
+(array? 1)
+(eq? a a)
+(equal? a (array-add a 0))
+(define iota (lambda (n l) (cond ((= n 0) l) (#t (iota (- n 1) (cons n l))))))
+(define big (list->array (quote f64) (iota 1001 nil)))
+(array-sum big)
+(dot big big)
+(array-sum (array-mul (list->array (quote i64) (iota 1001 nil)) 2))
+(array-sum (list->array (quote i64) (quote (9223372036854775807 9223372036854775807 9223372036854775807 9223372036854775807 5))))
+(dot (list->array (quote i64) (quote (4294967296 4294967296))) (list->array (quote i64) (quote (4294967296 4294967296))))
+(array-add (list->array (quote i64) (quote (9223372036854775807))) 1)
+(array-ref a 7)
+(array-ref a -1)
+(dot a (make-array (quote f64) 3))
+(make-array (quote u8) 3)
+(array-set! b 0 1.5)
+(array-sum 5)
+(defmacro if (c a b) (cons 'cond (cons (cons c (cons a nil)) (cons (cons #t (cons b nil)) nil))))
+(if (array-map (lambda (x) (+ x 1)) (make-array 'i64 400000)) 'yes 'no)
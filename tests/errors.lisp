@@ -0,0 +1,26 @@
+; Raising and catching errors
+(catch (car 'a))
+(catch (car 'a) error-message)
+(catch (car 'a) error-kind)
+(catch (error "custom" '(1 2)) error-value)
+(catch (error "custom" '(1 2)) error-message)
+(catch (error "custom") error-kind)
+(error? (catch (car 'a)))
+(error? 'a)
+(catch 'fine error-message)
+(define safe-div (lambda (a b) (catch (/ a b) (lambda (e) 'undefined))))
+(safe-div 1 2)
+(safe-div 1 0)
+(define deep (lambda (n) (cond ((= n 0) (error "bottom" n)) (#t (+ 1 (deep (- n 1)))))))
+(catch (deep 50) error-value)
+(define retry (lambda (n acc) (cond ((= n 0) acc) (#t (retry (- n 1) (+ acc (catch (deep 3) error-value)))))))
+(retry 100 0)
+(catch (catch (car 'a) (lambda (e) (error "again" (error-kind e)))) error-value)
+(error-line (catch (car 'a)))
+(error "uncaught" 42)
+(undefined-function 1)
+(20)
+(define 5 1)
+((lambda (1) 1) 2)
+((lambda (x y) x) 1)
+'still-running
@@ -0,0 +1,191 @@
+/**
+ * Fuzzing harnesses for the parser and the evaluator, for libFuzzer or AFL. Built with
+ * FUZZ_PARSE, each input is parsed with lisp_parse_file() and thrown away. Built with FUZZ_EVAL,
+ * each input is parsed as a program, and every top-level form is evaluated in a fresh
+ * environment within a small budget, so that loops and runaway recursion end in a limit error
+ * instead of a hang. The natives that read or write files are replaced with ones that raise an
+ * io-error, and stdout goes to /dev/null, so nothing a fuzzed program does leaves the process.
+ *
+ * libFuzzer supplies main() itself. Built with FUZZ_STANDALONE as well, main() runs each file
+ * named on the command line through the harness once instead, which replays a corpus without
+ * any fuzzing engine, and is also how AFL runs it, with @@ in place of the file name.
+ */
+
+// Standard headers
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Project headers
+#include "lisp.h"
+#include "lisp_api.h"
+#include "lisp_parser.h"
+
+#if !defined(FUZZ_PARSE) && !defined(FUZZ_EVAL)
+#error "Build the harness with -DFUZZ_PARSE or -DFUZZ_EVAL"
+#endif
+
+// Budget for each top-level form of a fuzzed program
+#define FUZZ_MAX_STEPS		(1024*1024)
+#define FUZZ_MAX_CELLS		(1024*1024)
+#define FUZZ_MAX_DEPTH		256
+
+// Harness
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+void fuzz_init(void);
+void fuzz_parse(const uint8_t *data, size_t size);
+void fuzz_eval(const uint8_t *data, size_t size);
+struct s_exp *fuzz_disabled(struct s_exp **argv, int argc, void *data);
+
+// The global environment, set up on the first input
+struct lisp_env *fuzz_env = 0;
+
+/**
+ * Runs one input through the harness. Inputs that don't parse, raise errors, or run out of
+ * their budget are all fine, and only a crash or a sanitizer report counts as a failure.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	if (fuzz_env == 0)
+		fuzz_init();
+
+#if defined(FUZZ_PARSE)
+	fuzz_parse(data, size);
+#else
+	fuzz_eval(data, size);
+#endif
+	return 0;
+}
+
+/**
+ * Sets up the interpreter once for every input that follows, with the natives that touch files
+ * taken away
+ */
+void fuzz_init(void) {
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		perror("/dev/null");
+
+	fuzz_env = lisp_init();
+	gc_enabled = 1;
+	module_cache_enabled = 0;
+	source_set_file("<fuzz>");
+
+	lisp_register_native(fuzz_env, "require", 1, fuzz_disabled, "require");
+	lisp_register_native(fuzz_env, "load", 1, fuzz_disabled, "load");
+	lisp_register_native(fuzz_env, "file-stream", 1, fuzz_disabled, "file-stream");
+	lisp_register_native(fuzz_env, "trace-dump", 1, fuzz_disabled, "trace-dump");
+}
+
+/**
+ * Parses an input as though it were a file
+ */
+void fuzz_parse(const uint8_t *data, size_t size) {
+	struct s_list *forms;
+	struct s_list *next;
+	FILE *fp;
+
+	if (size == 0)
+		return;
+
+	fp = fmemopen((void *) data, size, "r");
+	if (fp == NULL)
+		return;
+
+	forms = lisp_parse_file(fp);
+	fclose(fp);
+
+	for (; forms != 0; forms = next) {
+		next = forms->next;
+		free(forms);
+	}
+}
+
+/**
+ * Parses an input as a program, and evaluates each of its forms in an environment of its own,
+ * which is thrown away afterwards so that one input can't change how the next one runs
+ */
+void fuzz_eval(const uint8_t *data, size_t size) {
+	struct lisp_budget budget = {0};
+	struct lisp_env *env;
+	struct s_list *forms;
+	struct s_list *next;
+	struct s_exp *result;
+	char *source;
+
+	source = (char *) malloc(size + 1);
+	memcpy(source, data, size);
+	source[size] = 0;
+
+	forms = lisp_parse_string(source);
+	free(source);
+
+	budget.steps = FUZZ_MAX_STEPS;
+	budget.cells = FUZZ_MAX_CELLS;
+	budget.depth = FUZZ_MAX_DEPTH;
+
+	env = lisp_env_create(fuzz_env);
+	for (; forms != 0; forms = next) {
+		if (!lisp_parse_failed) {
+			forms->exp = optimize(forms->exp, env);
+			lisp_source_line = forms->line;
+			lisp_source_site = forms->exp;
+			lisp_eval_limited(forms->exp, env, &budget, &result);
+
+			// Between forms nothing is being evaluated, so it is safe to collect
+			gc_maybe_collect();
+		}
+
+		next = forms->next;
+		free(forms);
+	}
+
+	lisp_env_destroy(env);
+	gc_maybe_collect();
+}
+
+/**
+ * Stands in for a native that would touch the file system
+ */
+struct s_exp *fuzz_disabled(struct s_exp **argv, int argc, void *data) {
+	lisp_throw(ERROR_IO, lisp_nil, "%s is disabled while fuzzing", (const char *) data);
+}
+
+#if defined(FUZZ_STANDALONE)
+/**
+ * Runs each file named on the command line through the harness, and exits with 0 if none of
+ * them crashed
+ */
+int main(int argc, char **argv) {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+	size_t n;
+	FILE *fp;
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		fp = fopen(argv[i], "rb");
+		if (fp == NULL) {
+			perror(argv[i]);
+			return 1;
+		}
+
+		size = 0;
+		capacity = 4096;
+		data = (uint8_t *) malloc(capacity);
+		while ((n = fread(data + size, 1, capacity - size, fp)) > 0) {
+			size += n;
+			if (size == capacity) {
+				capacity *= 2;
+				data = (uint8_t *) realloc(data, capacity);
+			}
+		}
+		fclose(fp);
+
+		LLVMFuzzerTestOneInput(data, size);
+		free(data);
+	}
+
+	return 0;
+}
+#endif
@@ -0,0 +1,26 @@
+; Enough allocation that the heap is collected many times, with live data kept across collections
+(define build (lambda (n l) (cond ((= n 0) l) (#t (build (- n 1) (cons n l))))))
+(define keep (build 1000 nil))
+(define garbage (lambda (n) (array->list (make-array (quote i64) n 1))))
+(define churn (lambda (n acc) (cond ((= n 0) acc) (#t (churn (- n 1) (+ acc (array-sum (list->array (quote i64) (garbage 5000)))))))))
+(churn 100 0)
+(churn 100 0)
+(churn 100 0)
+(array-sum (list->array (quote i64) keep))
+(car keep)
+(car (cdr keep))
+(define strings (lambda (n acc) (cond ((= n 0) acc) (#t (strings (- n 1) (string-append "x" acc))))))
+(string-length (strings 500 ""))
+(define bigs (lambda (n acc) (cond ((= n 0) acc) (#t (bigs (- n 1) (* acc 1000000007))))))
+(bigs 20 1)
+(define ratios (lambda (n acc) (cond ((= n 0) acc) (#t (ratios (- n 1) (+ acc (/ 1 (* n n))))))))
+(denominator (ratios 40 0))
+(define arrays (lambda (n acc) (cond ((= n 0) acc) (#t (arrays (- n 1) (+ acc (array-sum (make-array (quote i64) 1000 n))))))))
+(arrays 100 0)
+(define kept-box (box (build 100 nil)))
+(churn 100 0)
+(array-sum (list->array (quote i64) (unbox kept-box)))
+(equal? keep (build 1000 nil))
+(define ints (lambda (n) (stream-cons n (ints (+ n 1)))))
+(defmacro if (c a b) (cons 'cond (cons (cons c (cons a nil)) (cons (cons #t (cons b nil)) nil))))
+(if (stream-fold (lambda (acc x) (atom? x)) #t (stream-take 400000 (ints 0))) 'yes 'no)
@@ -0,0 +1,35 @@
+; Hot lambdas, which the JIT compiles, and redefinitions that throw compiled code away
+(define fib (lambda (n) (cond ((< n 2) n) (#t (+ (fib (- n 1)) (fib (- n 2)))))))
+(fib 20)
+(define count (lambda (n acc) (cond ((= n 0) acc) (#t (count (- n 1) (+ acc 1))))))
+(count 3000 0)
+(define len (lambda (l) (cond ((atom? l) 0) (#t (+ 1 (len (cdr l)))))))
+(define build (lambda (n l) (cond ((= n 0) l) (#t (build (- n 1) (cons n l))))))
+(len (build 1000 nil))
+(car (build 5 nil))
+(define mix (lambda (x) (+ x 1.5)))
+(define loop (lambda (n) (cond ((= n 0) (mix 1)) (#t (loop (- n 1))))))
+(loop 200)
+(define dyn (lambda (y) (peek)))
+(define peek (lambda () y))
+(define dl (lambda (n) (cond ((= n 0) (dyn 'seen)) (#t (dl (- n 1))))))
+(dl 100)
+(define bad (lambda (n) (cond ((= n 0) (car 'a)) (#t (bad (- n 1))))))
+(bad 100)
+(define big (lambda (n) (cond ((= n 0) 0) (#t (* 4611686018427387904 2)))))
+(big 1)
+(define grow (lambda (n acc) (cond ((= n 0) acc) (#t (grow (- n 1) (* acc 3))))))
+(grow 100 1)
+(define f (lambda (n) (cond ((= n 0) 'done) (#t (f (- n 1))))))
+(f 100)
+(define g f)
+(define f (lambda (n) 'replaced))
+(g 100)
+(define strs (lambda (n s) (cond ((= n 0) s) (#t (strs (- n 1) (string-append s "a"))))))
+(string-length (strs 100 ""))
+(define unset (lambda (n y) (cond ((= n 0) y) (#t (unset (- n 1) (write n))))))
+(unset 100 'y)
+(define assign (lambda () (set! x 5)))
+(define assigned (lambda (x) (cond ((assign) x) (#t x))))
+(assigned 1)
+(assigned 2)
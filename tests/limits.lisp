@@ -0,0 +1,11 @@
+; Forms run under a cell budget, which also covers the storage that atoms own outside of the heap
+; options: --max-cells 10000
+(make-array (quote i64) 300000000)
+(array-sum (make-array (quote i64) 10000 1))
+(array-sum (array-add (make-array (quote i64) 10000 1) 1))
+(array-sum (array-add (make-array (quote i64) 10000 1) 0.5))
+(array-sum (array-add (make-array (quote f64) 2000 1) 0.5))
+(define grow (lambda (n k) (cond ((= k 0) n) (#t (grow (* n n) (- k 1))))))
+(= (grow 3 19) 0)
+(= (grow 3 20) 0)
+(= (/ 1 (grow 3 19)) 0)
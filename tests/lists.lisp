@@ -0,0 +1,48 @@
+; Pairs, quoting, equality and recursion over lists
+'a
+'(a b 'c)
+(quote (x 'y))
+''a
+(cons 'a '(b c))
+(cons 1 2)
+(car '((a b) c))
+(cdr '(a b c))
+(cdr '(a))
+(eq? 'a (car '(a b)))
+(eq? 'a 'b)
+(eq? nil '())
+(equal? '(a (b c) 1/2) (cons 'a (cons '(b c) (cons 1/2 nil))))
+(equal? '(a b) '(a c))
+(atom? 'a)
+(atom? '(a))
+(atom? nil)
+[cond [(eq? 'b 'c) 'x] [#t 'y]]
+(cond (#f 'a))
+(define _ (cons (quote a) (cons (quote b) (cons (quote c) nil))))
+((label subst (lambda (x y z)
+	(cond
+		[(atom? z) (cond
+			[(eq? y z) x]
+			[#t z])]
+		[#t (cons (subst x y (car z)) (subst x y (cdr z)))]))) (quote a) (quote b) _)
+(define append (lambda (a b) (cond ((eq? a nil) b) (#t (cons (car a) (append (cdr a) b))))))
+(define reverse (lambda (l acc) (cond ((eq? l nil) acc) (#t (reverse (cdr l) (cons (car l) acc))))))
+(append '(1 2 3) '(4 5))
+(reverse '(1 2 3 4 5) nil)
+(define map (lambda (f l) (cond ((eq? l nil) nil) (#t (cons (f (car l)) (map f (cdr l)))))))
+(map (lambda (x) (* x x)) '(1 2 3 4))
+(define y 'outer)
+(define peek (lambda () y))
+(define shadow (lambda (y) (peek)))
+(shadow 'dynamic)
+(peek)
+((lambda (x y) (cond ((eq? x y) 'same) (#t 'diff))) 'a 'a)
+(define q quote)
+(q hello)
+(define kar car)
+(kar '(z))
+car
+(nosuch 'a)
+(car 'a)
+(car '(a) '(b))
+('a 1)
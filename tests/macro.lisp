@@ -0,0 +1,28 @@
+; Macros, which are expanded before evaluation
+(defmacro if (c a b) (cons 'cond (cons (cons c (cons a nil)) (cons (cons #t (cons b nil)) nil))))
+(define pick (lambda (x) (if (atom? x) 'atom 'list)))
+(pick 'a)
+(pick '(a))
+pick
+(defmacro quoted (x) x)
+(quoted '(a b))
+(defmacro const () '(car '(z y)))
+(const)
+(define abs (lambda (n) (if (< n 0) (- 0 n) n)))
+(define sum-abs (lambda (n acc) (if (= n 0) acc (sum-abs (- n 1) (+ acc (abs (- 50 n)))))))
+(sum-abs 100 0)
+(defmacro 1 (x) x)
+if
+(defmacro failed () (catch (car 1)))
+(define fail (lambda () (failed)))
+(error-kind (fail))
+(define churn (lambda (n) (car (array->list (make-array (quote i64) 300000 n)))))
+(churn 1)
+(error-kind (fail))
+(churn 2)
+(error-kind (fail))
+(define the-box (box 1))
+(defmacro boxed () the-box)
+(define get-box (lambda () (boxed)))
+(eq? (get-box) the-box)
+(eq? (get-box) the-box)
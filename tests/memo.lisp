@@ -0,0 +1,19 @@
+; Memoized functions
+(define _ (cons (quote a) (cons (quote b) (cons (quote c) nil))))
+(define-memo subst (lambda (x y z)
+	(cond
+		[(atom? z) (cond [(eq? y z) x] [#t z])]
+		[#t (cons (subst x y (car z)) (subst x y (cdr z)))])) 2)
+(subst (quote a) (quote b) _)
+(subst (quote a) (quote b) _)
+(memo-stats subst)
+((memo s2 (lambda (z) (cond [(atom? z) z] [#t (s2 (cdr z))]))) _)
+(define-memo mfib (lambda (n) (cond ((< n 2) n) (#t (+ (mfib (- n 1)) (mfib (- n 2)))))))
+(mfib 90)
+(mfib 200)
+(define churn (lambda (n) (array->list (make-array (quote i64) 300000 n))))
+((memo s3 (lambda (x) (car x))) (churn 1))
+(define-memo first (lambda (x) (car x)))
+(first (churn 2))
+(first (churn 2))
+(memo-stats first)
@@ -0,0 +1,37 @@
+; set!, boxes, and mutable pairs
+(define n 0)
+(define bump (lambda (k) (set! n (+ n k))))
+(define loop (lambda (i) (cond ((= i 0) n) (#t ((lambda (ignored) (loop (- i 1))) (bump i))))))
+(loop 300)
+(define inc (lambda (x) ((lambda (ignored) x) (set! x (+ x 1)))))
+(define many (lambda (i acc) (cond ((= i 0) acc) (#t (many (- i 1) (+ acc (inc i)))))))
+(many 200 0)
+(define b (box 1))
+(box? b)
+(box? 1)
+(unbox b)
+(set-box! b (cons 1 2))
+(unbox b)
+(eq? b b)
+(equal? (box 1) (box 1))
+(define head (cons 0 nil))
+(define tail head)
+(define push (lambda (x) ((lambda (cell) ((lambda (ignored) (set! tail cell)) (set-cdr! tail cell))) (cons x nil))))
+(define fill (lambda (i) (cond ((= i 0) (cdr head)) (#t ((lambda (ignored) (fill (- i 1))) (push i))))))
+(define result (fill 500))
+(car result)
+(car (cdr result))
+(define len (lambda (l acc) (cond ((eq? l nil) acc) (#t (len (cdr l) (+ acc 1))))))
+(len result 0)
+(define p (cons 1 2))
+(set-car! p 10)
+(set-cdr! p 20)
+p
+(define cyc (cons 1 nil))
+(set-cdr! cyc cyc)
+(car (cdr (cdr cyc)))
+(catch (set-car! '(1 2) 3) error-message)
+(set-car! 5 3)
+(set! nope 1)
+(unbox 3)
+n
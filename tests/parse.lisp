@@ -0,0 +1,16 @@
+; Reader corner cases: brackets, comments, quoting, numbers and strings
+; a comment on its own line
+'(1 -2 +3 4.5 -0.25 1e3 1/2 -3/9 6/3)
+'(123456789012345678901234567890 -98765432109876543210)
+'(9223372036854775807 9223372036854775808 -9223372036854775808 -9223372036854775809)
+[quote [nested [brackets]]]
+'(a ; trailing comment
+  b)
+'("" "with spaces" "quote \" inside" "tab\tnewline\n")
+'#t
+'#f
+(quote ())
+'nil
+'(((((deep)))))
+'sym-with-dashes?
+'(a 'b ''c)
@@ -0,0 +1,8 @@
+; Benchmark runs with --repeat, which collect between runs of forms rewritten in place
+; options: --repeat 4
+(define churn (lambda (n) (array->list (make-array (quote i64) 300000 n))))
+(defmacro m () (cons 'car (cons (cons 'churn (cons 1 nil)) nil)))
+(m)
+(defmacro twice (x) (cons 'cons (cons x (cons x nil))))
+(twice (car (churn 2)))
+((lambda (x) (+ x 1)) (car (churn 3)))
@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# Runs the golden tests, and runs each program again under other evaluation strategies to check
+# that they all agree.
+#
+# Usage: tests/run.sh [lisp] [program.lisp...]
+#
+# Each program is run with -k --no-cache, so every form is echoed along with its result, and what
+# it prints on stdout, then on stderr, then its exit status, is compared with program.out if
+# there is one. The program is then run once more for each strategy in STRATEGIES, and the
+# output of each run is compared with the first, so that the interpreter, code compiled by the
+# JIT, and the collector all have to give the same results. A program without a .out file is
+# only compared across strategies, which is how to run the differential checks on other
+# programs. A line "; options: ..." in a program gives it options of its own, which are used
+# for every run. With no programs, every tests/*.lisp is run. Set UPDATE=1 to write the .out
+# files from the first run instead of checking them.
+
+LISP=${1:-./lisp}
+[ $# -gt 0 ] && shift
+
+TESTS=$(dirname "$0")
+if [ $# -eq 0 ]; then
+	set -- "$TESTS"/*.lisp
+fi
+
+# Strategies to compare with the default run, separated by commas
+STRATEGIES=${STRATEGIES:-"--no-jit,--jit-threshold 1,--no-gc"}
+
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+# Runs a program with the given options, and writes what it printed and its status to a file
+run() {
+	output=$1
+	program=$2
+	shift 2
+	"$LISP" -k --no-cache "$@" "$program" > "$output" 2> "$output.err"
+	status=$?
+	echo "--- stderr" >> "$output"
+	cat "$output.err" >> "$output"
+	echo "--- exit $status" >> "$output"
+}
+
+passed=0
+failed=0
+for program in "$@"; do
+	name=$(basename "$program" .lisp)
+	golden="${program%.lisp}.out"
+	options=$(sed -n 's/^; options: //p' "$program")
+	result=ok
+
+	run "$OUT/$name" "$program" $options
+	if [ -n "$UPDATE" ]; then
+		cp "$OUT/$name" "$golden"
+	elif [ -f "$golden" ] && ! diff -u "$golden" "$OUT/$name"; then
+		echo "FAIL $program: output differs from $golden"
+		result=fail
+	fi
+
+	old=$IFS
+	IFS=,
+	for strategy in $STRATEGIES; do
+		IFS=$old
+		run "$OUT/$name.alt" "$program" $options $strategy
+		if ! diff -u "$OUT/$name" "$OUT/$name.alt"; then
+			echo "FAIL $program: output with $strategy differs"
+			result=fail
+		fi
+	done
+	IFS=$old
+
+	if [ $result = ok ]; then
+		passed=$((passed + 1))
+	else
+		failed=$((failed + 1))
+	fi
+done
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
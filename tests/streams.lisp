@@ -0,0 +1,16 @@
+; Promises and lazy streams
+(define ints (lambda (n) (stream-cons n (ints (+ n 1)))))
+(define s (ints 1))
+(stream->list (stream-take 5 s))
+(stream->list (stream-take 4 (stream-filter (lambda (x) (= (remainder x 2) 0)) (stream-map (lambda (x) (* x x)) (ints 1)))))
+(define p (delay (+ 1 2)))
+(force p)
+(force p)
+(force 7)
+(define mk (lambda (x) (delay (* x 10))))
+(force (mk 4))
+(stream-fold (lambda (a x) (+ a x)) 0 (stream-take 100000 (ints 1)))
+(stream-fold (lambda (a x) (cons x a)) nil (stream-take 5 (ints 1)))
+(stream-car (stream-cdr (ints 5)))
+(stream-car nil)
+(stream-take 'a s)
@@ -0,0 +1,21 @@
+; Strings and ropes
+"hello world"
+(string-append "ab" "c\"d" "\n")
+(string-length (string-append "ab" "cd"))
+(substring "hello world" 6)
+(substring "hello world" 0 5)
+(string=? "abc" (string-append "a" "bc"))
+(string=? "abc" "abd")
+(define big (string-append "0123456789012345678901234567890123456789" "0123456789012345678901234567890123456789" "xyz"))
+(string-length big)
+(string=? big (string-append big ""))
+(substring big 78)
+(define twice (lambda (s n) (cond ((= n 0) s) (#t (twice (string-append s s) (- n 1))))))
+(string-length (twice "ab" 16))
+(substring (twice "abc" 10) 3000 3010)
+(display "display")
+(write "write")
+(newline)
+(substring big)
+(substring "abc" 5)
+(string-append "a" 'b)